@@ -15,6 +15,10 @@ struct ASTNode {
 using ASTNodePtr = std::shared_ptr<ASTNode>;
 using LiteralValue = std::variant<int, double, char, bool, std::string>;
 
+class VectorKernel;
+class SwitchTable;
+struct ParallelLoop;
+
 // ===== EXPRESSIONS =====
 struct ASTLiteral : public ASTNode {
     LiteralValue value;
@@ -66,6 +70,9 @@ struct ASTFunctionCall : public ASTNode {
 struct ASTArrayAccess : public ASTNode {
     ASTNodePtr array;
     ASTNodePtr index;
+    // Set by eliminateBoundsChecks() when the index is an int proven to be
+    // in range whenever the array is an array
+    bool inBounds = false;
     ASTArrayAccess(ASTNodePtr arr, ASTNodePtr idx)
         : array(std::move(arr)), index(std::move(idx)) {}
     void print(int indent = 0) const override;
@@ -100,6 +107,9 @@ struct ASTReturn : public ASTNode {
 
 struct ASTIf : public ASTNode {
     ASTNodePtr condition, thenBlock, elseBlock;
+    // Set by buildSwitchTables() on the first if of a long chain of
+    // equality tests; the chain's arms are reachable from it directly
+    std::shared_ptr<const SwitchTable> switchTable;
     ASTIf(ASTNodePtr cond, ASTNodePtr thenBlk, ASTNodePtr elseBlk = nullptr)
         : condition(std::move(cond)), thenBlock(std::move(thenBlk)), elseBlock(std::move(elseBlk)) {}
     void print(int indent = 0) const override;
@@ -107,6 +117,13 @@ struct ASTIf : public ASTNode {
 
 struct ASTFor : public ASTNode {
     ASTNodePtr init, condition, increment, body;
+    // Set by vectorizeLoops() when the loop can run as a native kernel
+    // right after init
+    std::shared_ptr<const VectorKernel> kernel;
+    // Written as "parallel for"; checkParallelLoops() then sets parallelLoop to
+    // what its iterations may share
+    bool parallel = false;
+    std::shared_ptr<const ParallelLoop> parallelLoop;
     ASTFor(ASTNodePtr i, ASTNodePtr cond, ASTNodePtr inc, ASTNodePtr b)
         : init(std::move(i)), condition(std::move(cond)), increment(std::move(inc)), body(std::move(b)) {}
     void print(int indent = 0) const override;
@@ -134,4 +151,21 @@ struct ASTProgram : public ASTNode {
     void print(int indent = 0) const override;
 };
 
+// Parameters followed by every other name the function assigns, in order of
+// first appearance. Engines that resolve variables to frame slots use this.
+std::vector<std::string> collectLocalNames(const ASTFunction& function);
+
+// Every name a statement assigns, including in nested blocks and loops
+std::vector<std::string> collectAssignedNames(const ASTNodePtr& statement);
+
+// Every variable a statement or expression reads, likewise; callees of
+// function calls are not variables
+std::vector<std::string> collectReadNames(const ASTNodePtr& node);
+
+// The expression inside any parentheses around node
+ASTNode* unwrap(const ASTNodePtr& node);
+
+// Whether node is the variable name, parenthesized or not
+bool isIdentifier(const ASTNodePtr& node, const std::string& name);
+
 #endif // AST_H
@@ -4,10 +4,46 @@
 
 #include "ast.h"
 #include "tokenizer.h"
+#include <iostream>
 #include <memory>
 #include <vector>
 #include <string>
 
+// Builds the AST of a token stream that Parser has accepted. Like Parser,
+// each builder keeps its own position, so files can be built concurrently.
+class ASTBuilder {
+private:
+    const std::vector<GenericToken>& tokens;
+    std::ostream& errors;
+    size_t current;
+
+    const GenericToken& peek() const;
+    const GenericToken& next();
+    bool matchSeparator(char symbol);
+    bool matchOperator(const std::string& symbol);
+
+    ASTNodePtr parseExpression();
+    ASTNodePtr parseStatement();
+    ASTNodePtr parseBlock();
+    ASTNodePtr parseLogicalOr();
+    ASTNodePtr parseLogicalAnd();
+    ASTNodePtr parseEquality();
+    ASTNodePtr parseComparison();
+    ASTNodePtr parseAddition();
+    ASTNodePtr parseMultiplication();
+    ASTNodePtr parseUnary();
+    ASTNodePtr parsePrimary();
+    ASTNodePtr parseSimpleAssignment();
+
+public:
+    // tokens have to outlive the builder
+    explicit ASTBuilder(const std::vector<GenericToken>& tokens, std::ostream& errors = std::cerr);
+
+    // Null when the tokens do not form a program
+    std::shared_ptr<ASTProgram> build();
+};
+
+// ASTBuilder(tokens).build()
 std::shared_ptr<ASTProgram> generateAST(const std::vector<GenericToken>& tokens, const std::string& sourceCode);
 
-#endif
\ No newline at end of file
+#endif
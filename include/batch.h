@@ -0,0 +1,21 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "program.h"
+#include <string>
+#include <vector>
+
+// The records of input: the lines between lines equal to delimiter, each
+// record ending in a newline. A blank line is the default delimiter.
+std::vector<std::string> splitRecords(const std::string& input, const std::string& delimiter);
+
+// a.out script.pc --batch: runs main once per record of stdin, with the
+// record as its input. Records are dealt out in runs to a pool of threads
+// workers, each with a ProgramContext of its own, and every record's
+// output is printed whole, in record order, followed by the errors its run
+// reported, on stderr. Returns the exit status, 1 if the program has no
+// main.
+int runBatch(const Program& program, const std::string& input, const std::string& delimiter,
+             unsigned threads);
+
+#endif // BATCH_H
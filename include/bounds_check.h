@@ -0,0 +1,15 @@
+#ifndef BOUNDS_CHECK_H
+#define BOUNDS_CHECK_H
+
+#include "ast.h"
+
+// Range analysis for counted loops of the form
+//     for (i = c; i < len(a); i = i + 1) { ... a[i] ... }
+// with c a non-negative int literal, or with the bound in n where
+// n = len(a) comes earlier in the same block and neither is assigned in
+// between. When the body assigns neither i, a nor n, every a[i] in it is
+// marked inBounds, so the engines index the array without converting or
+// checking i. Returns the number of accesses marked.
+int eliminateBoundsChecks(ASTProgram& program);
+
+#endif // BOUNDS_CHECK_H
@@ -0,0 +1,145 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "ast.h"
+#include "runtime.h"
+#include "parallel.h"
+#include "switch_table.h"
+#include "vectorize.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Stack-machine instruction set. Operands a/b are constant pool indices,
+// local slots, jump targets or counts depending on the opcode.
+#define BYTECODE_OPCODES(X) \
+    X(LOAD_CONST)        /* push constants[a] */                          \
+    X(LOAD_LOCAL)        /* push locals[a] */                             \
+    X(LOAD_LOCAL_CHECKED) /* push locals[a], reporting names[b] if unassigned */ \
+    X(LOAD_UNASSIGNED)   /* report names[a] as undefined, push undefined */ \
+    X(STORE_LOCAL)       /* locals[a] = pop */                            \
+    X(POP)                                                                \
+    X(ADD) X(SUB) X(MUL) X(DIV) X(MOD)                                    \
+    X(EQ) X(NE) X(LT) X(LE) X(GT) X(GE)                                   \
+    X(NEG) X(NOT)                                                         \
+    X(JUMP)              /* goto a */                                     \
+    X(JUMP_IF_FALSE)     /* pop, goto a when falsy */                     \
+    X(JUMP_IF_TRUE)      /* pop, goto a when truthy */                    \
+    X(CALL)              /* call functions[a] with b arguments */         \
+    X(TAILCALL)          /* return functions[a](b arguments), reusing the frame */ \
+    X(CALL_BUILTIN)      /* call built-in names[a] with b arguments */    \
+    X(MAKE_ARRAY)        /* pop a values into a new array */              \
+    X(INDEX)             /* pop index and array, push element */          \
+    X(INDEX_LOCAL_LOCAL_UNCHECKED) /* push locals[a][locals[b]], b an int in range if a is an array */ \
+    X(CONCAT_LOCAL)      /* locals[a] = locals[a] + pop b pieces, appending in place */ \
+    X(INPUT)             /* locals[a] = next input line */                \
+    X(OUTPUT)            /* pop and print */                              \
+    X(RETURN)            /* return pop */                                 \
+    X(RETURN_UNDEFINED)                                                   \
+    X(LOOP_EXIT)         /* end of a loop entry, hand the locals back */  \
+    X(VECTOR_LOOP)       /* run kernels[b], goto a when it ran the loop */ \
+    X(SWITCH_LOCAL)      /* goto the jumpTables[b] target for locals[a] */ \
+    X(REDUCE_TERM)       /* pop, log it as reductionTerms[a] of a parallel chunk */ \
+    /* superinstructions, formed by fuseSuperinstructions() */            \
+    X(ADD_LOCAL_CONST)   /* push locals[a] + constants[b] */              \
+    X(INDEX_LOCAL_LOCAL) /* push locals[a][locals[b]] */                  \
+    X(EQ_JUMP_IF_FALSE) X(NE_JUMP_IF_FALSE)                               \
+    X(LT_JUMP_IF_FALSE) X(LE_JUMP_IF_FALSE)                               \
+    X(GT_JUMP_IF_FALSE) X(GE_JUMP_IF_FALSE)                               \
+    /* typed variants, formed by specializeFunction() */                  \
+    X(ADD_INT) X(SUB_INT) X(MUL_INT) X(MOD_INT)  /* both operands int */  \
+    X(ADD_FLOAT) X(SUB_FLOAT) X(MUL_FLOAT) /* numbers, at least one float */ \
+    X(ADD_LOCAL_CONST_INT)                                                \
+    X(EQ_INT_JUMP_IF_FALSE) X(NE_INT_JUMP_IF_FALSE)                       \
+    X(LT_INT_JUMP_IF_FALSE) X(LE_INT_JUMP_IF_FALSE)                       \
+    X(GT_INT_JUMP_IF_FALSE) X(GE_INT_JUMP_IF_FALSE)
+
+enum class OpCode : uint8_t {
+#define BYTECODE_ENUM(name) name,
+    BYTECODE_OPCODES(BYTECODE_ENUM)
+#undef BYTECODE_ENUM
+    COUNT
+};
+
+const char* opCodeName(OpCode op);
+
+// Change in operand stack height when the instruction runs
+int stackEffect(OpCode op, int32_t a, int32_t b);
+
+// Key under which equal constants share one pool entry
+std::string constantKey(const RuntimeValue& value);
+
+struct Instr {
+    OpCode op;
+    int32_t a;
+    int32_t b;
+};
+
+// Targets of a SWITCH_LOCAL: the else code, then every arm of the table
+struct JumpTable {
+    std::shared_ptr<const SwitchTable> table;
+    std::vector<int32_t> targets;
+};
+
+struct CompiledFunction {
+    std::string name;
+    int paramCount;
+    int localCount;
+    int maxStack;
+    std::vector<std::string> localNames;
+    // Loop and chunk entries: the parameters the loop may read before it
+    // assigns them. Their loads are not checked, so the host has to have
+    // every one of them assigned to enter.
+    std::vector<int> readsBeforeAssigned;
+    std::vector<Instr> code;
+    std::vector<JumpTable> jumpTables;
+};
+
+// Vectorized loop and the slots of its kernel's inputs and outputs
+struct KernelCall {
+    std::shared_ptr<const VectorKernel> kernel;
+    std::vector<int> inputSlots;
+    std::vector<int> outputSlots;
+};
+
+// One term of a reduction statement in a parallel loop
+struct ReductionTerm {
+    const ParallelLoop::Reduction* reduction;
+    size_t term;
+};
+
+struct CompiledProgram {
+    std::vector<RuntimeValue> constants;
+    std::vector<std::string> names;
+    std::vector<CompiledFunction> functions;
+    std::unordered_map<std::string, int> functionIndex;
+    // Loop entry functions for on-stack replacement, see compileProgram()
+    std::unordered_map<const ASTFor*, int> loopEntries;
+    std::unordered_map<const ASTFor*, int> chunkEntries;
+    std::vector<KernelCall> kernels;
+    std::vector<ReductionTerm> reductionTerms;
+};
+
+// Lower every function of the program to bytecode. With fuse set, common
+// instruction pairs are merged into superinstructions afterwards.
+// With loopEntries set, every for loop also gets a function that starts at
+// its condition check. Its parameters are all locals of the enclosing
+// function; it ends in LOOP_EXIT, which writes them back to the arguments.
+// Checked parallel loops also get a chunk entry, which runs iterations
+// while the index is below the extra local $chunkEnd and hands reduction
+// terms to the host interpreter with REDUCE_TERM instead of applying them.
+CompiledProgram compileProgram(const ASTProgram& program, bool fuse = true, bool loopEntries = false);
+
+void fuseSuperinstructions(CompiledFunction& function);
+
+// Copy of function's code for calls whose arguments have the types in
+// paramTypes. Operand types are inferred from there through the body, and
+// operations whose operands are known to be ints or floats become typed
+// opcodes without type checks. Returns false when nothing could be typed.
+bool specializeFunction(const CompiledProgram& program, const CompiledFunction& function,
+                        const std::vector<RuntimeType>& paramTypes, std::vector<Instr>& code);
+
+void disassemble(const CompiledProgram& program, const CompiledFunction& function);
+
+#endif // BYTECODE_H
@@ -0,0 +1,64 @@
+#ifndef CLOSURE_COMPILER_H
+#define CLOSURE_COMPILER_H
+
+#include "ast.h"
+#include "interpreter.h"
+#include "memo.h"
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Execution state of one call in the closure backend
+struct ClosureFrame {
+    RuntimeValue* locals;
+    RuntimeValue returnValue;
+};
+
+// Each AST node is compiled once into one of these. Children, operators and
+// variable slots are bound into the callable, so running it involves no
+// type checks on the tree, name lookups or operator string compares.
+using ClosureExpr = std::function<RuntimeValue(ClosureFrame&)>;
+using ClosureCond = std::function<bool(ClosureFrame&)>;
+// Returns true once a return statement has executed
+using ClosureStmt = std::function<bool(ClosureFrame&)>;
+
+struct ClosureFunction {
+    std::string name;
+    int paramCount;
+    int localCount;
+    ClosureStmt body;
+};
+
+class ClosureEngine {
+private:
+    Interpreter host;
+    PayloadPool pool;
+
+    std::vector<ClosureFunction> functions;
+    std::unordered_map<std::string, int> functionIndex;
+    // Indexed like functions, null for functions that are not memoized
+    std::vector<std::unique_ptr<MemoTable>> memoTables;
+
+    friend class ClosureCompiler;
+
+public:
+    explicit ClosureEngine(const ASTProgram& program);
+
+    void execute();
+
+    // Caches results of the named functions, see findMemoizableFunctions()
+    void enableMemoization(const std::unordered_set<std::string>& names, size_t capacity);
+
+    // Lets spawn run program's functions on the given number of threads;
+    // spawned calls run on the tree-walker
+    void enableTasks(std::shared_ptr<ASTProgram> program, unsigned threads) {
+        host.load(program);
+        host.setThreads(threads);
+    }
+
+    RuntimeValue call(int index, std::vector<RuntimeValue>& args);
+};
+
+#endif // CLOSURE_COMPILER_H
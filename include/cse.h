@@ -0,0 +1,16 @@
+#ifndef CSE_H
+#define CSE_H
+
+#include "ast.h"
+
+// Common subexpression elimination inside each block. An operator or
+// indexing expression that is evaluated unconditionally by two or more
+// statements, or twice in one, without an assignment to one of its
+// variables in between, is computed once into a temporary ($cse0, $cse1,
+// ...) just before the statement of its first use and read from there
+// afterwards. Only where nothing in that statement that could call, print
+// or fail is evaluated ahead of the first use, so effects keep their order.
+// Returns the number of expressions shared.
+int eliminateCommonSubexpressions(ASTProgram& program);
+
+#endif // CSE_H
@@ -0,0 +1,16 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include <string>
+#include <vector>
+
+// a.out -jN a.pc b.pc ...: takes every file through the front end and the
+// bytecode compiler without running it, on a pool of jobs threads. Each
+// file's diagnostics are printed whole, in the order the files were given.
+// On its own this only checks the files; with emitImages (-jN --emit-pcb)
+// each one's bytecode is also saved next to it, a.pc as a.pcb, and a file
+// that cannot be saved fails. Unlike a.out --emit-pcb, calls are not
+// folded ahead of time. Returns the exit status, 1 if any file failed.
+int compileFiles(const std::vector<std::string>& paths, unsigned jobs, bool emitImages = false);
+
+#endif // DRIVER_H
@@ -0,0 +1,36 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "bytecode.h"
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+// Precompiled program files (.pcb): the bytecode a.out would run with
+// --vm, after every front-end and optimization pass, so that a run skips
+// tokenizing, parsing and compiling. The file is
+//   - a header: "PCB\0", IMAGE_VERSION, the payload's size and its FNV-1a
+//     checksum, all little-endian
+//   - the payload: the constant pool, the names (builtins and variables,
+//     each stored once), then every function with its code, switch tables
+//     and vector kernels, as flat little-endian fields.
+// Loading maps the file and decodes it in one pass into a CompiledProgram,
+// one vector per pool and function; there is no tree to rebuild.
+//
+// An image has no loop entries, so the VM runs it on its own without the
+// tree-walker; programs that spawn, which needs the tree, cannot be saved.
+const uint32_t IMAGE_VERSION = 2;
+
+// Writes program to path; false (after reporting) when it cannot be saved
+bool saveImage(const CompiledProgram& program, const std::string& path, std::ostream& errors = std::cerr);
+
+// Whether path starts with the .pcb magic
+bool isImage(const std::string& path);
+
+// Reads the image at path into program. Returns false (after reporting)
+// when the file is not an image of this version, its checksum does not
+// match, its code refers outside of its pools or a path through it would
+// underflow or overflow the function's stack or call with the wrong arity.
+bool loadImage(const std::string& path, CompiledProgram& program, std::ostream& errors = std::cerr);
+
+#endif // IMAGE_H
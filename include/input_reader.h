@@ -0,0 +1,41 @@
+#ifndef INPUT_READER_H
+#define INPUT_READER_H
+
+#include "runtime.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Buffered reader over a file descriptor. Input is pulled in large blocks
+// with read(2) and lines are handed out as views into the block buffer,
+// so splitting never copies. The buffer is allocated by the first read.
+class InputReader {
+private:
+    int fd;
+    size_t blockSize;
+    std::vector<char> buffer;
+    size_t begin;
+    size_t end;
+    bool eof;
+
+    bool fill();
+
+public:
+    explicit InputReader(int fd = 0, size_t blockSize = 1 << 20);
+
+    // Reads the lines of text instead of a descriptor
+    explicit InputReader(const std::string& text);
+
+    // The view stays valid until the next call on the reader.
+    bool readLine(std::string_view& line);
+
+    // Parse one line of whitespace-separated numbers into out. They stay
+    // RuntimeValues rather than a packed int or double array: arrays hold
+    // RuntimeValues everywhere else, and only map_file's read-only views
+    // are packed.
+    bool readNumbers(std::vector<RuntimeValue>& out);
+
+    std::string readAll();
+};
+
+#endif // INPUT_READER_H
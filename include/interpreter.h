@@ -3,12 +3,29 @@
 
 #include "ast.h"
 #include "runtime.h"
+#include "input_reader.h"
+#include "memo.h"
+#include "parallel.h"
+#include "switch_table.h"
+#include "task.h"
+#include "thread_pool.h"
+#include "vectorize.h"
+#include <atomic>
+#include <iostream>
+#include <mutex>
 #include <unordered_map>
 #include <string>
 #include <memory>
 
+class VM;
+struct CompiledProgram;
+struct ReductionTerm;
+
 class Interpreter {
 private:
+    // Recycles string/array payloads while this interpreter runs
+    PayloadPool pool;
+    
     std::unordered_map<std::string, RuntimeValue> variables;
     
     std::unordered_map<std::string, std::shared_ptr<ASTFunction>> functions;
@@ -18,13 +35,123 @@ private:
     bool hasReturnValue;
     RuntimeValue returnValue;
 
+    InputReader input;
+    std::ostream* output;
+    std::ostream* errors;
+    // Held while a line goes to output or errors, which this interpreter
+    // and its workers share with each other but not with other interpreters
+    std::mutex outputMutex;
+
+    // On-stack replacement: a for loop whose back edges reach osrThreshold
+    // continues in the bytecode VM, on the variables of the current frame
+    std::shared_ptr<ASTProgram> program;
+    int osrThreshold;
+    std::unordered_map<const ASTFor*, int> backEdges;
+    std::shared_ptr<const CompiledProgram> osrProgram;
+    std::unique_ptr<VM> osrVM;
+
+    // Memoization of pure recursive functions, off while memoCapacity is 0
+    size_t memoCapacity;
+    std::unordered_set<std::string> memoizable;
+    std::unordered_map<const ASTFunction*, MemoTable> memoTables;
+
+    // Calls and loop iterations evaluateConstant() may still run, -1 when
+    // there is no budget
+    long stepsLeft;
+
+    // Parallel for: chunks of iterations run on worker interpreters, one
+    // per pool thread. While a worker runs a chunk, its frame falls back to
+    // sharedFrame (the loop's frame) for names the chunk has not assigned,
+    // and reduction terms and output go to the chunk.
+    struct ParallelChunk;
+    unsigned threads;
+    std::vector<std::unique_ptr<Interpreter>> workers;
+    std::unique_ptr<WorkStealingPool> workerPool;
+    std::unordered_map<std::string, RuntimeValue>* sharedFrame;
+    const ParallelLoop* parallelLoop;
+    ParallelChunk* chunk;
+
+    // The interpreter a worker runs chunks or tasks for, null on that one
+    Interpreter* owner;
+
+    // spawn: calls run on a pool of their own, so that a chunk waiting in
+    // await never holds up the tasks. A task worker that waits in await
+    // runs other tasks meanwhile, on one interpreter per task it has
+    // going, indexed [worker][level].
+    std::once_flag tasksStarted;
+    std::vector<std::vector<std::unique_ptr<Interpreter>>> taskWorkers;
+    std::unique_ptr<WorkStealingPool> taskPool;
+    std::atomic<unsigned> nextTaskWorker;
+
+    RuntimeValue* findVariable(const std::string& name);
+    bool appendInPlace(const ASTAssignment& assignment);
+    void startOsrVM();
+    bool enterCompiledLoop(const ASTFor& loop);
+    bool runKernel(const VectorKernel& kernel);
+    bool runParallel(const ASTFor& loop);
+    void runChunk(const ASTFor& loop, std::unordered_map<std::string, RuntimeValue>& shared,
+                  int first, size_t iterations, ParallelChunk& result);
+    bool runCompiledChunk(const ASTFor& loop, int first, size_t iterations);
+    Interpreter* startWorker();
+    std::mutex& outputLock() { return owner ? owner->outputMutex : outputMutex; }
+    RuntimeValue spawnCall(const std::vector<RuntimeValue>& args);
+    RuntimeValue awaitTask(SpawnedTask& task);
+    void runTask(unsigned worker, const std::string& name, const std::vector<RuntimeValue>& args,
+                 SpawnedTask* task);
+    bool step() { return stepsLeft < 0 || takeStep(); }
+    bool takeStep();
+
 public:
-    Interpreter();
+    static constexpr int DEFAULT_OSR_THRESHOLD = 1000;
+    // Call depth that counts as running out of steps in evaluateConstant()
+    static constexpr size_t MAX_CONSTANT_DEPTH = 1000;
+    // Chunks a parallel loop is cut into per worker, so that stealing can
+    // even out iterations of different cost
+    static constexpr unsigned CHUNKS_PER_THREAD = 8;
+
+    // osrThreshold 0 keeps every loop in the tree-walker
+    explicit Interpreter(int osrThreshold = DEFAULT_OSR_THRESHOLD);
+    ~Interpreter();
+
+    // Keep up to capacity results per memoizable function
+    void enableMemoization(size_t capacity) { memoCapacity = capacity; }
+
+    // Worker threads for parallel for loops and spawned calls; 1 runs
+    // loops serially and spawned calls right away
+    void setThreads(unsigned count) { threads = count > 0 ? count : 1; }
     
     void execute(std::shared_ptr<ASTProgram> program);
+
+    // Registers the program's functions without running anything
+    void load(std::shared_ptr<ASTProgram> program);
+
+    // Runs main of the loaded program; false when there is none
+    bool runMain();
+
+    // Forgets the variables a run of main left behind. The functions, the
+    // compiled loops, the payload pool and the workers stay for the next run.
+    void reset();
+
+    // Input lines come from text instead of stdin, output goes to out
+    // instead of std::cout and errors at run time to setErrors()'s stream
+    // instead of std::cerr
+    void setInput(const std::string& text) { input = InputReader(text); }
+    void setOutput(std::ostream& out);
+    void setErrors(std::ostream& out);
+
+    // The loaded program compiled with loop entries, for on-stack
+    // replacement to use instead of compiling its own
+    void setCompiled(std::shared_ptr<const CompiledProgram> compiled) { osrProgram = std::move(compiled); }
+
+    // Evaluates expr with at most steps calls and loop iterations. Returns
+    // false when the budget ran out or an error was reported, which is then
+    // discarded, so that the expression can be left to run time instead.
+    bool evaluateConstant(const ASTNodePtr& expr, long steps, RuntimeValue& result);
     
     RuntimeValue evaluateExpression(ASTNodePtr expr);
     
+    bool evaluateCondition(const ASTNodePtr& expr);
+    
     void executeStatement(ASTNodePtr stmt);
     
     void setVariable(const std::string& name, const RuntimeValue& value);
@@ -32,10 +159,14 @@ public:
     
     RuntimeValue callFunction(const std::string& name, const std::vector<RuntimeValue>& args);
     
-    RuntimeValue handleBuiltinFunction(const std::string& name, const std::vector<RuntimeValue>& args);
+    static bool isBuiltinFunction(const std::string& name);
+    bool handleBuiltinFunction(const std::string& name, const std::vector<RuntimeValue>& args, RuntimeValue& result);
     
     RuntimeValue handleInput();
     void handleOutput(const RuntimeValue& value);
+
+    // A reduction term from a parallel chunk running in the VM
+    void logReductionTerm(const ReductionTerm& term, RuntimeValue value);
 };
 
 #endif // INTERPRETER_H
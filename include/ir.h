@@ -0,0 +1,170 @@
+#ifndef IR_H
+#define IR_H
+
+#include "ast.h"
+#include "bytecode.h"
+#include "runtime.h"
+#include "value_ops.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Mid-level SSA form of the function bodies, between the AST and a backend.
+// Every instruction defines at most one value, named by its index in
+// IRFunction::values; source variables only exist while lowering from the
+// AST. A block holds its phis first and ends in exactly one terminator.
+#define IR_OPCODES(X) \
+    X(CONST)        /* constants[a] */                                      \
+    X(PARAM)        /* argument a */                                        \
+    X(PHI)          /* operands[i] when arriving from preds[i] */           \
+    X(UNASSIGNED)   /* report names[a] as undefined, yields undefined */    \
+    X(CHECK)        /* operands[0], reporting names[a] as undefined when it \
+                       is undefined: a read that may precede assignment */  \
+    X(ADD) X(SUB) X(MUL) X(DIV) X(MOD)                                      \
+    X(EQ) X(NE) X(LT) X(LE) X(GT) X(GE)                                     \
+    X(NEG) X(NOT)                                                           \
+    X(CALL)         /* functions[a](operands) */                            \
+    X(CALL_BUILTIN) /* built-in names[a](operands) */                       \
+    X(MAKE_ARRAY)                                                           \
+    X(INDEX)        /* operands[0][operands[1]], a = 1 when known in bounds */ \
+    X(APPEND)       /* operands[0] + operands[1] + ..., appending in place  \
+                       when operands[0] is not used afterwards */           \
+    X(INPUT)                                                                \
+    X(OUTPUT)                                                               \
+    /* terminators */                                                       \
+    X(JUMP)         /* to succs[0] */                                       \
+    X(BRANCH)       /* to succs[0] when operands[0] is truthy, else succs[1] */ \
+    X(RETURN)       /* operands[0], undefined without operands */
+
+enum class IROp : uint8_t {
+#define IR_ENUM(name) name,
+    IR_OPCODES(IR_ENUM)
+#undef IR_ENUM
+    COUNT
+};
+
+const char* irOpName(IROp op);
+
+// The arithmetic and comparison ops are laid out like BinaryOp
+inline bool isBinary(IROp op) { return op >= IROp::ADD && op <= IROp::GE; }
+
+inline BinaryOp binaryOpOf(IROp op) {
+    return static_cast<BinaryOp>(static_cast<int>(op) - static_cast<int>(IROp::ADD));
+}
+
+inline bool isTerminator(IROp op) { return op >= IROp::JUMP; }
+
+struct IRInstr {
+    IROp op;
+    int32_t a = 0;
+    std::vector<int> operands;
+    int block = -1;
+    // Types the value can have at run time, ANY_TYPE until inferred
+    TypeSet type = ANY_TYPE;
+    // Source variable the value was assigned to, for dumps and slot names
+    std::string variable;
+    bool removed = false;
+};
+
+struct IRBlock {
+    // Value ids in execution order: phis, body, terminator
+    std::vector<int> instrs;
+    std::vector<int> preds;
+    std::vector<int> succs;
+    bool removed = false;
+};
+
+struct IRFunction {
+    std::string name;
+    int paramCount = 0;
+    std::vector<IRInstr> values;
+    // blocks[0] is the entry
+    std::vector<IRBlock> blocks;
+
+    int terminator(int block) const { return blocks[block].instrs.back(); }
+
+    // Uses of every value, counting each operand position once
+    std::vector<int> useCounts() const;
+
+    // Rewrites every operand through replacement (value -> value or -1) and
+    // marks the replaced values removed
+    void replaceValues(const std::vector<int>& replacement);
+
+    // Drops the edge from -> to, along with the phi operands for it
+    void removeEdge(int from, int to);
+
+    // Drops removed values from the blocks
+    void compact();
+
+    // CONST value for module.constants[index], kept in the entry block
+    int constant(int index);
+};
+
+struct IRModule {
+    std::vector<RuntimeValue> constants;
+    std::vector<std::string> names;
+    std::vector<IRFunction> functions;
+    std::unordered_map<std::string, int> functionIndex;
+    std::unordered_map<std::string, int> constantKeys;
+    std::unordered_map<std::string, int> nameKeys;
+
+    int constant(const RuntimeValue& value);
+    int name(const std::string& text);
+};
+
+// SSA construction straight from the AST, after Braun et al., "Simple and
+// Efficient Construction of Static Single Assignment Form": variables are
+// looked up through the predecessors on demand and phis that turn out to
+// merge a single value are dropped. Function indices match compileProgram().
+IRModule buildIR(const ASTProgram& program);
+
+// One transformation over a function. Returns whether anything changed.
+class IRPass {
+public:
+    virtual ~IRPass() = default;
+    virtual const char* name() const = 0;
+    virtual bool run(IRModule& module, IRFunction& function) = 0;
+};
+
+// Runs a pipeline of passes over every function of a module
+class PassManager {
+private:
+    std::vector<std::unique_ptr<IRPass>> passes;
+    int rounds;
+    bool dump;
+
+public:
+    static constexpr int MAX_LEVEL = 2;
+
+    explicit PassManager(int rounds = 1) : rounds(rounds), dump(false) {}
+
+    // -O0: none, -O1: type inference, constant folding, CFG cleanup and
+    // dead code elimination, -O2: adds value numbering and runs the whole
+    // pipeline until nothing changes
+    static PassManager forLevel(int level);
+
+    void add(std::unique_ptr<IRPass> pass) { passes.push_back(std::move(pass)); }
+    // Print each function as built and after every pass that changed it
+    void setDump(bool enabled) { dump = enabled; }
+
+    void run(IRModule& module);
+};
+
+// Edges from a block with several successors into a block with phis get a
+// block of their own, so the copies for the phis have a place to go.
+// Backends that leave SSA need this first.
+void splitCriticalEdges(IRFunction& function);
+
+// Blocks in reverse postorder from the entry; unreachable ones are left out
+std::vector<int> reversePostorder(const IRFunction& function);
+
+// Bytecode for every function, ready for the VM. Values used once right
+// after their definition stay on the operand stack; the others live in
+// local slots, shared between values that are never live at the same time.
+CompiledProgram lowerToBytecode(IRModule& module, bool fuse = true);
+
+void printIR(const IRModule& module, const IRFunction& function);
+
+#endif // IR_H
@@ -0,0 +1,71 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "bytecode.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Native code generation needs x86-64 and mmap/mprotect
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__))
+#define JIT_AVAILABLE 1
+#else
+#define JIT_AVAILABLE 0
+#endif
+
+// Returned in rax: value in the low half, a non-zero deopt flag in the high
+// half when a guard failed and the call has to be redone in the VM
+struct NativeResult {
+    int32_t value;
+    int32_t deopt;
+};
+
+// args holds the arguments in reverse order (last argument first), as they
+// sit on the native stack of a calling JIT function. depth is the number of
+// nested native calls still allowed before deoptimizing.
+using NativeFunction = NativeResult (*)(const int64_t* args, int64_t depth);
+
+// Baseline JIT for functions that only compute on integers: integer
+// constants and locals, + - * %, comparisons feeding branches, and calls to
+// other such functions. Every value is a 32-bit int; overflow, % by zero,
+// falling off the end and too deep recursion are guards that deoptimize.
+// Such functions have no side effects, so the VM can run the call again
+// from the start after a deopt.
+class NativeCode {
+private:
+    enum class State : uint8_t { UNKNOWN, COMPILED, REJECTED };
+
+    const CompiledProgram& program;
+    // Native calls go through this table, so its storage never moves
+    std::vector<void*> entries;
+    std::vector<State> states;
+    std::vector<std::pair<void*, size_t>> regions;
+
+    bool eligible(int functionIndex) const;
+    void emit(int functionIndex, std::vector<uint8_t>& code) const;
+
+public:
+    static constexpr int MAX_PARAMS = 16;
+    static constexpr int MAX_DEPTH = 10000;
+
+    explicit NativeCode(const CompiledProgram& program);
+    ~NativeCode();
+
+    NativeCode(const NativeCode&) = delete;
+    NativeCode& operator=(const NativeCode&) = delete;
+
+    // Compiles the function and everything it calls. Returns false if any of
+    // them uses something the JIT does not handle.
+    bool compile(int functionIndex);
+
+    // Keeps the function, and everything calling it, out of native code
+    void exclude(int functionIndex) { states[functionIndex] = State::REJECTED; }
+
+    bool rejected(int functionIndex) const { return states[functionIndex] == State::REJECTED; }
+
+    NativeFunction entry(int functionIndex) const {
+        return reinterpret_cast<NativeFunction>(entries[functionIndex]);
+    }
+};
+
+#endif // JIT_H
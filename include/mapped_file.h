@@ -0,0 +1,50 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+
+struct RuntimeValue;
+
+enum class MappedLayout {
+    LINES,
+    INT64,
+    FLOAT64
+};
+
+// Read-only view of a memory-mapped file as an array. Elements are
+// materialized on index; nothing is copied up front. Shared between
+// RuntimeValue copies through a reference count. Safe to index from
+// several threads at once.
+class MappedFile {
+private:
+    const char* data;
+    size_t length;
+    MappedLayout layout;
+
+    // Start offsets of the lines found so far, extended on demand
+    std::vector<size_t> lineStarts;
+    bool linesComplete;
+    std::mutex linesLock;
+
+    std::atomic<int> refCount;
+
+    MappedFile(const char* data, size_t length, MappedLayout layout);
+    ~MappedFile();
+
+    bool scanLinesUpTo(size_t index);
+
+public:
+    static MappedFile* open(const std::string& path, MappedLayout layout);
+
+    size_t size();
+    RuntimeValue at(size_t index);
+
+    void retain();
+    void release();
+};
+
+#endif // MAPPED_FILE_H
@@ -0,0 +1,56 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include "ast.h"
+#include "runtime.h"
+#include <cstddef>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Names of the functions whose results depend only on their arguments: no
+// input/output, no I/O built-ins and calls to pure functions only.
+// Variables are always local to the running call, so assignments cannot
+// leak out of a function.
+std::unordered_set<std::string> findPureFunctions(const ASTProgram& program);
+
+// The pure functions that call themselves, directly or through others
+std::unordered_set<std::string> findMemoizableFunctions(const ASTProgram& program);
+
+// Results of one function keyed by its arguments. Once capacity entries are
+// stored, the least recently used one is evicted.
+class MemoTable {
+private:
+    using Key = std::vector<RuntimeValue>;
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+    struct KeyEqual {
+        bool operator()(const Key& a, const Key& b) const;
+    };
+    struct Entry {
+        RuntimeValue result;
+        std::list<const Key*>::iterator age;
+    };
+
+    size_t capacity;
+    std::unordered_map<Key, Entry, KeyHash, KeyEqual> entries;
+    // Most recently used first
+    std::list<const Key*> ages;
+
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 100000;
+
+    explicit MemoTable(size_t capacity = DEFAULT_CAPACITY) : capacity(capacity) {}
+
+    // Only strings and scalars are used as keys
+    static bool memoizable(const RuntimeValue* args, size_t argc);
+
+    bool lookup(const RuntimeValue* args, size_t argc, RuntimeValue& result);
+    void store(const RuntimeValue* args, size_t argc, const RuntimeValue& result);
+};
+
+#endif // MEMO_H
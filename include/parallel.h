@@ -0,0 +1,52 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "ast.h"
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// What the iterations of a checked "parallel for" share. The loop is
+//     parallel for (i = start; i < end; i = i + step) { ... }
+// with i <= end allowed too, step a positive int literal and end not
+// depending on anything the body assigns. Every other name the body
+// assigns is either
+//   - private: assigned in each iteration before the iteration reads it,
+//     so iterations can run anywhere in any order, or
+//   - a reduction: only ever updated by s = s + e - f ... (any operators
+//     but && and || down the left spine), with s read nowhere else.
+// The body may not return or read input, directly or through a call.
+// Iterations then run on worker threads: reduction terms, output and the
+// last value of each private are applied in iteration order afterwards,
+// so the loop behaves exactly as it would run serially.
+struct ParallelLoop {
+    std::string index;
+    ASTNodePtr end;
+    bool inclusive = false;
+    int step = 1;
+
+    // The terms of one reduction statement, in evaluation order
+    struct Reduction {
+        std::string variable;
+        std::vector<std::pair<std::string, ASTNodePtr>> terms;
+    };
+    std::unordered_map<const ASTAssignment*, Reduction> reductions;
+
+    // Names the loop reads but never assigns, and the privates
+    std::vector<std::string> shared;
+    std::vector<std::string> privates;
+};
+
+// Checks every parallel for and attaches its ParallelLoop. Reports each
+// loop whose iterations would share a scalar or that breaks the other
+// rules above, and returns false if there was any.
+bool checkParallelLoops(ASTProgram& program, std::ostream& errors = std::cerr);
+
+// Checks that every spawn f(...) names a function of the program that does
+// not read input, directly or through a call: tasks run at any time, so
+// the order in which they would take input lines is unknown.
+bool checkSpawns(const ASTProgram& program, std::ostream& errors = std::cerr);
+
+#endif // PARALLEL_H
@@ -1,10 +1,52 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <iostream>
 #include <vector>
 #include <string>
 #include "tokenizer.h"
 
+// Checks a token stream against the grammar. Each Parser keeps its own
+// position and reports to its own stream, so several files can be checked
+// at once on different threads.
+class Parser {
+private:
+    const std::vector<GenericToken>& tokens;
+    const std::string& sourceCode;
+    std::ostream& errors;
+    size_t current;
+
+    void printErrorWithContext(const std::string& message, size_t position);
+    const GenericToken& peek() const;
+    const GenericToken& next();
+    bool matchSeparator(char symbol);
+    bool matchIdentifier();
+    bool matchOperator(const std::string& symbol);
+
+    bool parseProgram();
+    bool parseBlock();
+    bool parseStatementlist();
+    bool parseStatement();
+    bool parseAssignment();
+    bool parseInput();
+    bool parseOutput();
+    bool parseIf();
+    bool parseSimpleAssignment();
+    bool parseFor();
+    bool parseParallelFor();
+    bool parseExpression();
+    bool parseTerm();
+    bool parseFactor();
+    bool parseReturn();
+
+public:
+    // tokens and source have to outlive the parser
+    Parser(const std::vector<GenericToken>& tokens, const std::string& source, std::ostream& errors = std::cerr);
+
+    bool parse();
+};
+
+// Parser(tokens, source).parse(), reporting to std::cerr
 bool parseProgramInternal(const std::vector<GenericToken>& tokens, const std::string& source);
 
-#endif // PARSER_H
\ No newline at end of file
+#endif // PARSER_H
@@ -0,0 +1,34 @@
+#ifndef PARTIAL_EVAL_H
+#define PARTIAL_EVAL_H
+
+#include "ast.h"
+#include "interpreter.h"
+#include <memory>
+#include <string>
+#include <unordered_set>
+
+// Compile-time evaluation of calls to pure functions whose arguments are
+// constant expressions, e.g. is_even(4). The tree-walker runs each such call
+// before the program starts and the call is replaced by an ASTLiteral with
+// the result. Calls that need more than stepBudget calls and loop
+// iterations, report an error or produce an array are left alone.
+class PartialEvaluator {
+private:
+    Interpreter interpreter;
+    std::unordered_set<std::string> pure;
+    long stepBudget;
+    int folded;
+
+    bool isConstant(const ASTNodePtr& node) const;
+    void fold(ASTNodePtr& node);
+
+public:
+    static constexpr long DEFAULT_STEP_BUDGET = 10000;
+
+    explicit PartialEvaluator(long stepBudget = DEFAULT_STEP_BUDGET);
+
+    // Rewrites the program in place, returns the number of calls replaced
+    int run(const std::shared_ptr<ASTProgram>& program);
+};
+
+#endif // PARTIAL_EVAL_H
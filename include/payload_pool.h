@@ -0,0 +1,81 @@
+#ifndef PAYLOAD_POOL_H
+#define PAYLOAD_POOL_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+struct RuntimeValue;
+
+// The payloads behind STRING and ARRAY values. Copying a value shares its
+// payload; the count of sharing values is atomic, so values can be copied
+// from one thread to another. A shared payload is never changed: arrays
+// are never changed once built, and a string is copied out before an
+// in-place append unless its value holds the only reference.
+struct StringPayload : std::string {
+    std::atomic<int> refCount{1};
+};
+
+struct ArrayPayload : std::vector<RuntimeValue> {
+    std::atomic<int> refCount{1};
+};
+
+// Size-classed free lists for the payloads behind STRING and ARRAY runtime
+// values. Released payloads keep their capacity and
+// are handed out again for values of a similar size, so temporaries created
+// while evaluating a statement mostly avoid the global allocator. Each one
+// comes back as its last reference goes; there is no bulk release, and the
+// cached payloads are only freed with the pool.
+//
+// Each Interpreter owns a pool and makes it current for its thread while it
+// runs; outside of that a per-thread default pool is used. Payloads are plain
+// heap objects, so any pool may take back a payload another one handed out.
+class PayloadPool {
+private:
+    static constexpr size_t STRING_CLASSES = 4;
+    static constexpr size_t ARRAY_CLASSES = 4;
+    static constexpr size_t MAX_CACHED_PER_CLASS = 1024;
+
+    std::vector<StringPayload*> freeStrings[STRING_CLASSES];
+    std::vector<ArrayPayload*> freeArrays[ARRAY_CLASSES];
+
+    StringPayload* takeString(size_t length);
+    void giveString(StringPayload* str);
+    ArrayPayload* takeArray(size_t length);
+    void giveArray(ArrayPayload* array);
+
+    friend class PayloadPoolScope;
+
+public:
+    PayloadPool() = default;
+    PayloadPool(const PayloadPool&) = delete;
+    PayloadPool& operator=(const PayloadPool&) = delete;
+    ~PayloadPool();
+
+    static PayloadPool* current();
+
+    // New payloads hold one reference
+    static StringPayload* newString(const char* data, size_t length);
+    static ArrayPayload* newArray(const std::vector<RuntimeValue>& elements);
+    static ArrayPayload* newArray(std::vector<RuntimeValue>&& elements);
+
+    static void retain(StringPayload* str) { str->refCount.fetch_add(1, std::memory_order_relaxed); }
+    static void retain(ArrayPayload* array) { array->refCount.fetch_add(1, std::memory_order_relaxed); }
+
+    // Drop one reference, recycling the payload with the last one
+    static void release(StringPayload* str);
+    static void release(ArrayPayload* array);
+};
+
+// Makes a pool current on this thread for the lifetime of the scope
+class PayloadPoolScope {
+private:
+    PayloadPool* previous;
+
+public:
+    explicit PayloadPoolScope(PayloadPool& pool);
+    ~PayloadPoolScope();
+};
+
+#endif // PAYLOAD_POOL_H
@@ -0,0 +1,66 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <iostream>
+#include <memory>
+#include <string>
+
+struct ASTProgram;
+struct CompiledProgram;
+class Interpreter;
+
+// The embedding API of libpc: a source compiled once, through the same
+// front end and passes as a.out, and run any number of times.
+//
+//     auto program = Program::compile(source);
+//     std::ostringstream out;
+//     if (program) program->run("3\n4\n", out);
+//
+// A Program never changes once compiled, so one shared_ptr can be handed
+// to any number of threads, each calling run() at the same time. Every run
+// gets an interpreter of its own; what the runs share is the tree and the
+// bytecode that hot loops move to.
+class Program {
+private:
+    std::shared_ptr<ASTProgram> ast;
+    std::shared_ptr<const CompiledProgram> compiled;
+
+    Program() = default;
+
+    friend class ProgramContext;
+
+public:
+    // Null when the source does not compile; the reasons go to errors.
+    // Calls with constant arguments are not folded ahead of time as a.out
+    // does, since that runs the program's own code.
+    static std::shared_ptr<const Program> compile(const std::string& source,
+                                                  std::ostream& errors = std::cerr);
+
+    // Runs main with the lines of input as its input, whatever it outputs
+    // written to output and its errors at run time reported on errors.
+    // threads > 1 lets parallel for loops and spawn use that many worker
+    // threads for this run. Returns false when there is no main.
+    bool run(const std::string& input, std::ostream& output, std::ostream& errors = std::cerr,
+             unsigned threads = 1) const;
+};
+
+// An interpreter kept loaded with one Program, for running it many times
+// on one thread: each run only clears the variables the last one left, so
+// functions, compiled loops and allocations carry over.
+class ProgramContext {
+private:
+    std::unique_ptr<Interpreter> interpreter;
+
+public:
+    // program has to outlive the context
+    explicit ProgramContext(const Program& program, unsigned threads = 1);
+    ~ProgramContext();
+
+    ProgramContext(const ProgramContext&) = delete;
+    ProgramContext& operator=(const ProgramContext&) = delete;
+
+    // Program::run() on this context's interpreter
+    bool run(const std::string& input, std::ostream& output, std::ostream& errors = std::cerr);
+};
+
+#endif // PROGRAM_H
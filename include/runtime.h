@@ -5,6 +5,10 @@
 #include <vector>
 #include <memory>
 #include <iostream>
+#include "mapped_file.h"
+#include "payload_pool.h"
+
+class SpawnedTask;
 
 enum class RuntimeType {
     STRING,
@@ -12,6 +16,8 @@ enum class RuntimeType {
     FLOAT,
     BOOLEAN,
     ARRAY,
+    MAPPED_ARRAY,
+    TASK,
     UNDEFINED
 };
 
@@ -19,21 +25,23 @@ struct RuntimeValue {
     RuntimeType type;
     
     union {
-        std::string* stringValue;
+        StringPayload* stringValue;
         int intValue;
         double floatValue;
         bool boolValue;
-        std::vector<RuntimeValue>* arrayValue;
+        ArrayPayload* arrayValue;
+        MappedFile* mappedValue;
+        SpawnedTask* taskValue;
     };
     
     RuntimeValue() : type(RuntimeType::UNDEFINED) {}
     
     explicit RuntimeValue(const std::string& str) : type(RuntimeType::STRING) {
-        stringValue = new std::string(str);
+        stringValue = PayloadPool::newString(str.data(), str.size());
     }
     
     explicit RuntimeValue(const char* str) : type(RuntimeType::STRING) {
-        stringValue = new std::string(str);
+        stringValue = PayloadPool::newString(str, std::char_traits<char>::length(str));
     }
     
     explicit RuntimeValue(int val) : type(RuntimeType::INTEGER), intValue(val) {}
@@ -43,15 +51,37 @@ struct RuntimeValue {
     explicit RuntimeValue(bool val) : type(RuntimeType::BOOLEAN), boolValue(val) {}
     
     explicit RuntimeValue(const std::vector<RuntimeValue>& arr) : type(RuntimeType::ARRAY) {
-        arrayValue = new std::vector<RuntimeValue>(arr);
+        arrayValue = PayloadPool::newArray(arr);
+    }
+    
+    explicit RuntimeValue(std::vector<RuntimeValue>&& arr) : type(RuntimeType::ARRAY) {
+        arrayValue = PayloadPool::newArray(std::move(arr));
     }
     
+    // Takes over the caller's reference to the mapping
+    explicit RuntimeValue(MappedFile* mapped) : type(RuntimeType::MAPPED_ARRAY), mappedValue(mapped) {}
+    
+    // Takes over the caller's reference to the task
+    explicit RuntimeValue(SpawnedTask* task) : type(RuntimeType::TASK), taskValue(task) {}
+    
     RuntimeValue(const RuntimeValue& other);
     
+    // Moves steal the payload and leave other undefined
+    RuntimeValue(RuntimeValue&& other) noexcept : type(RuntimeType::UNDEFINED) {
+        takePayload(other);
+    }
+    
     RuntimeValue& operator=(const RuntimeValue& other);
+    RuntimeValue& operator=(RuntimeValue&& other) noexcept;
     
     ~RuntimeValue();
     
+    void takePayload(RuntimeValue& other) noexcept;
+    
+    // The string payload for an in-place change, copied first if other
+    // values share it
+    std::string& ownString();
+    
     std::string toString() const;
     void print() const;
 };
@@ -59,6 +89,7 @@ struct RuntimeValue {
 RuntimeValue stringToNumber(const RuntimeValue& value);
 
 RuntimeValue toBoolean(const RuntimeValue& value);
+bool isTruthy(const RuntimeValue& value);
 
 RuntimeValue performBinaryOperation(const RuntimeValue& left, const RuntimeValue& right, const std::string& op);
 
@@ -67,4 +98,19 @@ RuntimeValue performUnaryOperation(const RuntimeValue& operand, const std::strin
 bool isNumeric(const RuntimeValue& value);
 double getNumericValue(const RuntimeValue& value);
 
+// Where errors of a running program go: std::cerr, unless an
+// ErrorStreamScope on this thread names another stream
+std::ostream& runtimeErrors();
+
+// Makes errors the runtime error stream of this thread for the lifetime of
+// the scope
+class ErrorStreamScope {
+private:
+    std::ostream* previous;
+
+public:
+    explicit ErrorStreamScope(std::ostream& errors);
+    ~ErrorStreamScope();
+};
+
 #endif // RUNTIME_H
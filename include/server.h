@@ -0,0 +1,63 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "program.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Compiled programs by the hash of their source, the least recently used
+// one dropped when a new one would exceed capacity. Sources that fail to
+// compile are not kept, so their diagnostics come with every request.
+class ProgramCache {
+private:
+    struct Entry {
+        uint64_t hash;
+        std::string source;
+        std::shared_ptr<const Program> program;
+    };
+
+    size_t capacity;
+    std::mutex lock;
+    // Most recently used first
+    std::list<Entry> entries;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> byHash;
+
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 256;
+
+    explicit ProgramCache(size_t capacity = DEFAULT_CAPACITY) : capacity(capacity > 0 ? capacity : 1) {}
+
+    // FNV-1a over the source
+    static uint64_t hash(const std::string& source);
+
+    // The program for source, compiled on a miss; null when it does not
+    // compile, with the reasons in errors. Two threads missing on the same
+    // source at once both compile it.
+    std::shared_ptr<const Program> get(const std::string& source, std::ostream& errors);
+};
+
+// a.out --serve SOCKET: listens on a Unix domain socket and runs each
+// request on a pool of workers threads, with compiled programs kept in a
+// ProgramCache of cacheCapacity. Runs until killed. The socket is created
+// under umask 077, so only the user running the server can connect; an old
+// socket at the path is replaced, anything else there is an error.
+//
+// A frame is a 4-byte little-endian length, then that many bytes. A
+// request is three frames: "source", the script's source and the
+// program's input. Each reply frame comes after a kind byte:
+// 'o' for output, sent line by line as the program runs, 'e' for
+// diagnostics, from compiling and running, and, last, 'x' for the exit
+// status. A client that stalls for 30 seconds is disconnected.
+int serveRequests(const std::string& socketPath, unsigned workers, size_t cacheCapacity);
+
+// a.out --client SOCKET script.pc: sends the script's source and the whole
+// of stdin to the server, copies the output to stdout and the diagnostics
+// to stderr and returns the exit status the server sent.
+int sendRequest(const std::string& socketPath, const std::string& scriptPath);
+
+#endif // SERVER_H
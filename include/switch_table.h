@@ -0,0 +1,60 @@
+#ifndef SWITCH_TABLE_H
+#define SWITCH_TABLE_H
+
+#include "ast.h"
+#include "runtime.h"
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Dispatch for a chain of one variable against int and string literals
+//     if (x == 1) { ... } elif (x == "go") { ... } ... else { ... }
+// lookup() finds the arm the chain would take in one step, by the rules of
+// performBinaryOperation: a string matches string keys as text and int keys
+// by its numeric value, anything else matches every key numerically.
+class SwitchTable {
+public:
+    std::string variable;
+    // Arm bodies in chain order, and the final else block or null
+    std::vector<ASTNodePtr> arms;
+    ASTNodePtr otherwise;
+
+    // Index into arms, -1 for the else block
+    int lookup(const RuntimeValue& value) const;
+
+    // The arm of every int key, sorted by key, for callers that only ever
+    // look up ints; false when string keys make that incomplete
+    bool intCases(std::vector<std::pair<int, int>>& cases) const;
+
+    // Builds the lookup from the chain's (int or string literal, arm) keys,
+    // in chain order
+    void index(const std::vector<std::pair<RuntimeValue, int>>& keys);
+
+private:
+    friend class ImageWriter;
+    friend class ImageReader;
+
+    // First arm for each int key; keys close together use the dense table
+    // from denseBase, holes being -1
+    std::unordered_map<int, int> intArms;
+    std::vector<int> dense;
+    int denseBase = 0;
+    // First arm for each string key, and for the numeric value of each
+    // string key, which is what a non-string compares against
+    std::unordered_map<std::string, int> stringArms;
+    std::unordered_map<double, int> stringNumbers;
+
+    int intArm(int key) const;
+    int numericArm(double number) const;
+};
+
+// Chains need this many arms before they get a table
+constexpr int MIN_SWITCH_ARMS = 4;
+
+// Attaches a SwitchTable to every if/elif chain of at least MIN_SWITCH_ARMS
+// tests x == literal (or literal == x) of the same variable. Returns the
+// number of chains.
+int buildSwitchTables(ASTProgram& program);
+
+#endif // SWITCH_TABLE_H
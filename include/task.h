@@ -0,0 +1,40 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include "runtime.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+// The result of a call started by spawn, shared by the TASK values that
+// refer to it and the worker running the call. Refcounted like MappedFile:
+// create() hands out the first reference.
+class SpawnedTask {
+private:
+    std::atomic<int> refCount;
+    mutable std::mutex lock;
+    std::condition_variable finished;
+    bool done;
+    RuntimeValue result;
+
+    SpawnedTask() : refCount(1), done(false) {}
+
+public:
+    SpawnedTask(const SpawnedTask&) = delete;
+    SpawnedTask& operator=(const SpawnedTask&) = delete;
+
+    static SpawnedTask* create() { return new SpawnedTask(); }
+
+    void retain() { refCount.fetch_add(1, std::memory_order_relaxed); }
+    void release();
+
+    // Stores the call's result and wakes everyone waiting for it
+    void finish(RuntimeValue value);
+
+    bool isDone() const;
+
+    // Blocks until the call has finished, then returns its result
+    RuntimeValue wait();
+};
+
+#endif // TASK_H
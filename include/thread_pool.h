@@ -0,0 +1,59 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Worker threads that each run tasks from their own deque. A worker takes
+// its newest task first and, once its deque is empty, steals the oldest
+// task of another worker, so work dealt out unevenly still keeps every
+// thread busy.
+class WorkStealingPool {
+public:
+    // Runs on the worker with the given index
+    using Task = std::function<void(unsigned worker)>;
+
+    explicit WorkStealingPool(unsigned threads);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+
+    // Queues task on the deque of one worker; any worker may run it
+    void push(unsigned worker, Task task);
+
+    // Runs one queued task on the calling thread, which has to be the
+    // worker's own; false when there was none
+    bool runOne(unsigned worker);
+
+    // Hardware threads, at least 1
+    static unsigned defaultThreads();
+
+private:
+    struct Worker {
+        std::mutex lock;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    // Tasks queued on any deque, for idle workers to sleep on
+    std::mutex idleLock;
+    std::condition_variable idle;
+    size_t queued = 0;
+    bool stopping = false;
+
+    bool take(unsigned worker, Task& task);
+    void work(unsigned worker);
+};
+
+#endif // THREAD_POOL_H
@@ -3,6 +3,7 @@
 
 #include <string>
 #include <cstdio>
+#include <iostream>
 #include <vector>
 enum TokenType {
     INT,
@@ -46,6 +47,9 @@ enum TokenTypeKeyword {
     KEYWORD_ELSE,
     KEYWORD_ELIF,
     KEYWORD_FOR,
+    KEYWORD_PARALLEL,
+    KEYWORD_SPAWN,
+    KEYWORD_AWAIT,
     KEYWORD_RETURN,
     KEYWORD_UNKNOWN
 };
@@ -130,6 +134,11 @@ void printTokenIdentifier(const TokenIdentifier* token);
 TokenKeyword matchKeyword(const std::string& word, size_t position);
 TokenSeparator matchSeparator(char ch, size_t position);
 
-std::vector<GenericToken> tokenizeFile(FILE* file);
+// Lexical errors come back as TOKEN_ERROR tokens; an unclosed comment,
+// which ends the input, is reported on errors
+std::vector<GenericToken> tokenizeFile(FILE* file, std::ostream& errors = std::cerr);
+
+// tokenizeFile() over source in memory
+std::vector<GenericToken> tokenizeSource(const std::string& source, std::ostream& errors = std::cerr);
 
 #endif
@@ -0,0 +1,198 @@
+#ifndef VALUE_OPS_H
+#define VALUE_OPS_H
+
+#include "runtime.h"
+#include <climits>
+#include <cstdint>
+#include <string>
+
+// Inline fast paths for the binary operators, shared by the execution
+// engines. Integer and plain number operands are handled directly; anything
+// else goes through performBinaryOperation, so the coercion rules and error
+// messages stay in one place.
+
+enum class BinaryOp {
+    ADD, SUB, MUL, DIV, MOD,
+    EQ, NE, LT, LE, GT, GE,
+    INVALID
+};
+
+inline BinaryOp binaryOpFromSymbol(const std::string& symbol) {
+    if (symbol == "+") return BinaryOp::ADD;
+    if (symbol == "-") return BinaryOp::SUB;
+    if (symbol == "*") return BinaryOp::MUL;
+    if (symbol == "/") return BinaryOp::DIV;
+    if (symbol == "%") return BinaryOp::MOD;
+    if (symbol == "==") return BinaryOp::EQ;
+    if (symbol == "!=") return BinaryOp::NE;
+    if (symbol == "<") return BinaryOp::LT;
+    if (symbol == "<=") return BinaryOp::LE;
+    if (symbol == ">") return BinaryOp::GT;
+    if (symbol == ">=") return BinaryOp::GE;
+    return BinaryOp::INVALID;
+}
+
+inline const std::string& binaryOpSymbol(BinaryOp op) {
+    static const std::string symbols[] = {"+", "-", "*", "/", "%", "==", "!=", "<", "<=", ">", ">=", "?"};
+    return symbols[static_cast<int>(op)];
+}
+
+constexpr bool isComparison(BinaryOp op) {
+    return op >= BinaryOp::EQ && op <= BinaryOp::GE;
+}
+
+inline bool isPlainNumber(const RuntimeValue& value) {
+    return value.type == RuntimeType::INTEGER || value.type == RuntimeType::FLOAT;
+}
+
+inline double plainNumber(const RuntimeValue& value) {
+    return value.type == RuntimeType::INTEGER ? value.intValue : value.floatValue;
+}
+
+inline bool fitsInt(long long value) {
+    return value >= INT_MIN && value <= INT_MAX;
+}
+
+// left = left <op> right for the arithmetic operators
+inline void applyArithmetic(BinaryOp op, RuntimeValue& left, const RuntimeValue& right) {
+    if (left.type == RuntimeType::INTEGER && right.type == RuntimeType::INTEGER) {
+        // Results outside int range fall through to the generic path, which
+        // has its own conversion rules
+        long long a = left.intValue, b = right.intValue;
+        long long result;
+        bool done = true;
+        switch (op) {
+            case BinaryOp::ADD: result = a + b; break;
+            case BinaryOp::SUB: result = a - b; break;
+            case BinaryOp::MUL: result = a * b; break;
+            case BinaryOp::DIV:
+                if (b == 0) { done = false; result = 0; break; }
+                left = RuntimeValue(static_cast<double>(a) / static_cast<double>(b));
+                return;
+            case BinaryOp::MOD:
+                if (b == 0) { done = false; result = 0; break; }
+                result = b == -1 ? 0 : a % b;
+                break;
+            default: done = false; result = 0; break;
+        }
+        if (done && fitsInt(result)) {
+            left.intValue = static_cast<int>(result);
+            return;
+        }
+    } else if (isPlainNumber(left) && isPlainNumber(right) && op != BinaryOp::MOD) {
+        double a = plainNumber(left), b = plainNumber(right);
+        switch (op) {
+            case BinaryOp::ADD: left = RuntimeValue(a + b); return;
+            case BinaryOp::SUB: left = RuntimeValue(a - b); return;
+            case BinaryOp::MUL: left = RuntimeValue(a * b); return;
+            case BinaryOp::DIV:
+                if (b != 0) { left = RuntimeValue(a / b); return; }
+                break;
+            default: break;
+        }
+    }
+    left = performBinaryOperation(left, right, binaryOpSymbol(op));
+}
+
+inline bool applyComparison(BinaryOp op, const RuntimeValue& left, const RuntimeValue& right) {
+    if (left.type == RuntimeType::INTEGER && right.type == RuntimeType::INTEGER) {
+        int a = left.intValue, b = right.intValue;
+        switch (op) {
+            case BinaryOp::EQ: return a == b;
+            case BinaryOp::NE: return a != b;
+            case BinaryOp::LT: return a < b;
+            case BinaryOp::LE: return a <= b;
+            case BinaryOp::GT: return a > b;
+            case BinaryOp::GE: return a >= b;
+            default: break;
+        }
+    } else if (isPlainNumber(left) && isPlainNumber(right)) {
+        double a = plainNumber(left), b = plainNumber(right);
+        switch (op) {
+            case BinaryOp::EQ: return a == b;
+            case BinaryOp::NE: return a != b;
+            case BinaryOp::LT: return a < b;
+            case BinaryOp::LE: return a <= b;
+            case BinaryOp::GT: return a > b;
+            case BinaryOp::GE: return a >= b;
+            default: break;
+        }
+    }
+    return isTruthy(performBinaryOperation(left, right, binaryOpSymbol(op)));
+}
+
+// Overwrite value with a boolean, skipping the destructor for scalars
+inline void setBoolean(RuntimeValue& value, bool result) {
+    if (value.type == RuntimeType::STRING || value.type == RuntimeType::ARRAY ||
+        value.type == RuntimeType::MAPPED_ARRAY) {
+        value = RuntimeValue(result);
+        return;
+    }
+    value.type = RuntimeType::BOOLEAN;
+    value.boolValue = result;
+}
+
+// Same checks and messages as the ASTArrayAccess case of the interpreter
+inline RuntimeValue indexValue(const RuntimeValue& array, const RuntimeValue& index) {
+    if (array.type == RuntimeType::ARRAY) {
+        int idx = index.type == RuntimeType::INTEGER ? index.intValue
+                                                     : static_cast<int>(getNumericValue(index));
+        if (idx < 0 || idx >= static_cast<int>(array.arrayValue->size())) {
+            runtimeErrors() << "Error: Array index out of bounds" << std::endl;
+            return RuntimeValue();
+        }
+        return (*array.arrayValue)[idx];
+    }
+    if (array.type == RuntimeType::MAPPED_ARRAY) {
+        int idx = static_cast<int>(getNumericValue(index));
+        if (idx < 0 || static_cast<size_t>(idx) >= array.mappedValue->size()) {
+            runtimeErrors() << "Error: Array index out of bounds" << std::endl;
+            return RuntimeValue();
+        }
+        return array.mappedValue->at(idx);
+    }
+    runtimeErrors() << "Error: Trying to index non-array value" << std::endl;
+    return RuntimeValue();
+}
+
+// Set of RuntimeTypes, one bit per type, for static type inference
+using TypeSet = uint8_t;
+
+constexpr TypeSet typeBit(RuntimeType type) {
+    return static_cast<TypeSet>(1u << static_cast<int>(type));
+}
+
+constexpr int TYPE_COUNT = static_cast<int>(RuntimeType::UNDEFINED) + 1;
+constexpr TypeSet ANY_TYPE = static_cast<TypeSet>((1u << TYPE_COUNT) - 1);
+constexpr TypeSet INT_TYPE = typeBit(RuntimeType::INTEGER);
+constexpr TypeSet FLOAT_TYPE = typeBit(RuntimeType::FLOAT);
+constexpr TypeSet NUMBER_TYPES = INT_TYPE | FLOAT_TYPE;
+
+// Result type of ADD..MOD, following applyArithmetic/performBinaryOperation:
+// int results stay ints even on overflow, / always gives a float
+inline TypeSet arithmeticType(BinaryOp op, RuntimeType left, RuntimeType right) {
+    bool numbers = (typeBit(left) & NUMBER_TYPES) && (typeBit(right) & NUMBER_TYPES);
+    if (numbers) {
+        if (op == BinaryOp::DIV) return FLOAT_TYPE;
+        if (op == BinaryOp::MOD || (left == RuntimeType::INTEGER && right == RuntimeType::INTEGER)) return INT_TYPE;
+        return FLOAT_TYPE;
+    }
+    if (op == BinaryOp::ADD && left == RuntimeType::STRING && right == RuntimeType::STRING) {
+        return typeBit(RuntimeType::STRING);
+    }
+    return ANY_TYPE;
+}
+
+inline TypeSet arithmeticTypes(BinaryOp op, TypeSet left, TypeSet right) {
+    TypeSet result = 0;
+    for (int l = 0; l < TYPE_COUNT; ++l) {
+        if (!(left & (1u << l))) continue;
+        for (int r = 0; r < TYPE_COUNT; ++r) {
+            if (!(right & (1u << r))) continue;
+            result |= arithmeticType(op, static_cast<RuntimeType>(l), static_cast<RuntimeType>(r));
+        }
+    }
+    return result;
+}
+
+#endif // VALUE_OPS_H
@@ -0,0 +1,80 @@
+#ifndef VECTORIZE_H
+#define VECTORIZE_H
+
+#include "ast.h"
+#include "runtime.h"
+#include "value_ops.h"
+#include <string>
+#include <vector>
+
+// Native replacement for a counted loop
+//     for (i = c; i < len(a); i = i + 1) { t = a[i] * b[i]; s = s + t; }
+// whose body only assigns temporaries and accumulators (s = s + e - f ...
+// or s = e + s) from element-wise arithmetic over a[i], b[i],
+// i, literals and names the loop does not assign. The bound may also be a
+// variable n. Elements are gathered a chunk at a time and the arithmetic
+// runs over whole chunks in SIMD lanes; accumulators are summed in loop
+// order, so float results are bit-identical to the scalar loop.
+class VectorKernel {
+public:
+    // inputs[0] is the loop index, inputs[1] the array in len(a) or the
+    // bound variable; outputs[0] is the index again, then the
+    // accumulators, then the temporaries
+    std::vector<std::string> inputs;
+    std::vector<std::string> outputs;
+
+    // Runs the loop from the index's current value to the bound. Returns
+    // false without producing outputs whenever the scalar loop has to run
+    // instead: an input is missing or not a number, an array is shorter
+    // than the bound or its elements are not all ints or all floats, an int
+    // result leaves int range, a divisor is zero, or there is nothing to do.
+    bool run(const RuntimeValue* const* inputValues, RuntimeValue* outputValues) const;
+
+    // Same, on variables held in frame slots
+    bool runOnSlots(RuntimeValue* locals, const std::vector<int>& inputSlots,
+                    const std::vector<int>& outputSlots) const;
+
+private:
+    friend class LoopVectorizer;
+    friend class ImageWriter;
+    friend class ImageReader;
+
+    enum class NodeKind { ELEMENT, INDEX, CONSTANT, INVARIANT, NEGATE, BINARY };
+
+    // One value per iteration; operands come before their users
+    struct Node {
+        NodeKind kind;
+        BinaryOp op = BinaryOp::INVALID;
+        int left = -1;
+        int right = -1;
+        // inputs[] index for ELEMENT and INVARIANT
+        int input = -1;
+        double constant = 0;
+        bool intConstant = false;
+    };
+
+    // s = s + e - f adds e, then subtracts f
+    struct Term {
+        int node;
+        bool subtract;
+    };
+
+    struct Accumulator {
+        int input;
+        std::vector<Term> terms;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<Accumulator> accumulators;
+    // Node of each temporary, in the order of outputs
+    std::vector<int> temporaries;
+    // Whether inputs[1] is the array of len(a) rather than the bound itself
+    bool boundIsLength = false;
+};
+
+// Attaches a VectorKernel to every for loop it can replace. The engines
+// still fall back to the loop itself whenever the kernel declines to run.
+// Returns the number of loops vectorized.
+int vectorizeLoops(ASTProgram& program);
+
+#endif // VECTORIZE_H
@@ -0,0 +1,132 @@
+#ifndef VM_H
+#define VM_H
+
+#include "bytecode.h"
+#include "interpreter.h"
+#include "jit.h"
+#include "memo.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Threaded code uses GNU computed goto where available, a switch otherwise
+#if defined(__GNUC__)
+#define VM_THREADED 1
+#else
+#define VM_THREADED 0
+#endif
+
+// Executes a CompiledProgram. Built-ins and input/output are delegated to an
+// embedded Interpreter so both engines behave the same.
+class VM {
+private:
+    struct ThreadedInstr {
+        const void* handler;
+        OpCode op;
+        int32_t a;
+        int32_t b;
+    };
+
+    const CompiledProgram& program;
+    std::unique_ptr<Interpreter> ownHost;
+    Interpreter* host;
+    PayloadPool pool;
+
+    // Per-function code with handler addresses resolved, built on first call
+    std::vector<std::vector<ThreadedInstr>> threadedCode;
+
+    // Call frames of running bytecode; resume and top are the caller's
+    // instruction and stack height while it waits for a callee
+    struct Frame {
+        int function;
+        size_t base;
+        size_t resume;
+        size_t top;
+        // The code the caller runs, generic or specialized
+        const ThreadedInstr* code = nullptr;
+        // Leave this frame as soon as its callee returns
+        bool returnOnResume = false;
+        // Function whose memo table gets the result, with its arguments at
+        // memoArgs[memoStart]; -1 when the call is not memoized
+        int memoFunction = -1;
+        size_t memoStart = 0;
+    };
+    std::vector<Frame> frames;
+    std::vector<RuntimeValue> stack;
+    size_t maxDepth;
+
+    // Indexed by function, null for functions that are not memoized
+    std::vector<std::unique_ptr<MemoTable>> memoTables;
+    std::vector<RuntimeValue> memoArgs;
+
+    bool profiling;
+    std::vector<uint64_t> pairCounts;
+
+    // Copy of a function typed for one argument signature, see
+    // specializeFunction(). Empty code means the generic code is as good.
+    struct Specialization {
+        uint32_t signature;
+        std::vector<Instr> code;
+        std::vector<ThreadedInstr> threaded;
+    };
+
+    // Tier-up state per function: after jitThreshold calls with integer
+    // arguments the function is compiled to native code. Argument signatures
+    // seen specializeThreshold times get a specialized copy.
+    struct CallTier {
+        int calls = 0;
+        int deopts = 0;
+        bool mixedTypes = false;
+        std::vector<std::pair<uint32_t, int>> signatures;
+        std::vector<Specialization> specializations;
+    };
+    NativeCode native;
+    std::vector<CallTier> tiers;
+    int jitThreshold;
+    int specializeThreshold;
+
+    // Set by LOOP_EXIT
+    bool loopExited;
+
+    bool callNative(int functionIndex, RuntimeValue* args, int argc, RuntimeValue& result);
+    void enterFrame(int functionIndex, size_t base, RuntimeValue*& locals, RuntimeValue*& sp);
+    Specialization* specializationFor(int functionIndex, const RuntimeValue* args);
+
+    template <bool Profile>
+    RuntimeValue run(int functionIndex, RuntimeValue* args, int argc);
+
+public:
+    static constexpr int DEFAULT_JIT_THRESHOLD = 1000;
+    static constexpr size_t DEFAULT_MAX_DEPTH = 1000000;
+    static constexpr int DEFAULT_SPECIALIZE_THRESHOLD = 100;
+    // Specialized copies kept per function
+    static constexpr size_t MAX_SPECIALIZATIONS = 4;
+
+    // jitThreshold 0 keeps everything in the interpreter loop. Built-ins and
+    // I/O go to host when given, so input already buffered there is seen.
+    explicit VM(const CompiledProgram& program, bool profiling = false,
+                int jitThreshold = DEFAULT_JIT_THRESHOLD, Interpreter* host = nullptr);
+
+    void execute();
+
+    void setMaxDepth(size_t depth) { maxDepth = depth; }
+
+    // Calls with one argument signature before the function gets a copy
+    // specialized for it; 0 always runs the generic code
+    void setSpecializeThreshold(int threshold) { specializeThreshold = threshold; }
+
+    // Caches results of the named functions, see findMemoizableFunctions()
+    void enableMemoization(const std::unordered_set<std::string>& functions, size_t capacity);
+
+    RuntimeValue call(int functionIndex, RuntimeValue* args, int argc);
+
+    // Runs a loop entry function on locals. Returns true when the loop ran
+    // to completion and locals hold the updated values, false when the loop
+    // body returned from the enclosing function with result.
+    bool runLoop(int functionIndex, std::vector<RuntimeValue>& locals, RuntimeValue& result);
+
+    // Executed opcode pairs, most frequent first, on stderr
+    void printProfile(size_t limit = 15) const;
+};
+
+#endif // VM_H
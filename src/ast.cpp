@@ -1,4 +1,5 @@
 #include "../include/ast.h"
+#include <algorithm>
 
 void ASTLiteral::print(int indent) const {
     std::cout << std::string(indent, ' ') << "Literal: ";
@@ -39,7 +40,7 @@ void ASTFunctionCall::print(int indent) const {
 }
 
 void ASTArrayAccess::print(int indent) const {
-    std::cout << std::string(indent, ' ') << "ArrayAccess:\n";
+    std::cout << std::string(indent, ' ') << "ArrayAccess:" << (inBounds ? " (unchecked)" : "") << "\n";
     array->print(indent + 2);
     index->print(indent + 2);
 }
@@ -75,7 +76,7 @@ void ASTIf::print(int indent) const {
 }
 
 void ASTFor::print(int indent) const {
-    std::cout << std::string(indent, ' ') << "For:\n";
+    std::cout << std::string(indent, ' ') << (parallel ? "Parallel For:\n" : "For:\n");
     init->print(indent + 2);
     condition->print(indent + 2);
     increment->print(indent + 2);
@@ -100,3 +101,99 @@ void ASTProgram::print(int indent) const {
     for (const auto& fn : functions)
         fn->print(indent + 2);
 }
+
+
+static void collectStores(const ASTNodePtr& node, std::vector<std::string>& names) {
+    if (!node) return;
+    auto add = [&names](const std::string& name) {
+        if (std::find(names.begin(), names.end(), name) == names.end()) names.push_back(name);
+    };
+    if (auto assignment = std::dynamic_pointer_cast<ASTAssignment>(node)) {
+        add(assignment->variable);
+    } else if (auto input = std::dynamic_pointer_cast<ASTInput>(node)) {
+        add(input->variable);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(node)) {
+        collectStores(ifStmt->thenBlock, names);
+        collectStores(ifStmt->elseBlock, names);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(node)) {
+        collectStores(forStmt->init, names);
+        collectStores(forStmt->increment, names);
+        collectStores(forStmt->body, names);
+    } else if (auto block = std::dynamic_pointer_cast<ASTBlock>(node)) {
+        for (const auto& stmt : block->statements) collectStores(stmt, names);
+    }
+}
+
+std::vector<std::string> collectLocalNames(const ASTFunction& function) {
+    std::vector<std::string> names;
+    for (const auto& param : function.parameters) {
+        if (std::find(names.begin(), names.end(), param) == names.end()) names.push_back(param);
+    }
+    collectStores(function.body, names);
+    return names;
+}
+
+std::vector<std::string> collectAssignedNames(const ASTNodePtr& statement) {
+    std::vector<std::string> names;
+    collectStores(statement, names);
+    return names;
+}
+
+static void collectReads(const ASTNodePtr& node, std::vector<std::string>& names) {
+    if (!node) return;
+    if (auto identifier = std::dynamic_pointer_cast<ASTIdentifier>(node)) {
+        if (std::find(names.begin(), names.end(), identifier->name) == names.end()) {
+            names.push_back(identifier->name);
+        }
+    } else if (auto binary = std::dynamic_pointer_cast<ASTBinaryExpression>(node)) {
+        collectReads(binary->left, names);
+        collectReads(binary->right, names);
+    } else if (auto unary = std::dynamic_pointer_cast<ASTUnaryExpression>(node)) {
+        collectReads(unary->operand, names);
+    } else if (auto grouped = std::dynamic_pointer_cast<ASTGroupedExpression>(node)) {
+        collectReads(grouped->expression, names);
+    } else if (auto arrayLit = std::dynamic_pointer_cast<ASTArrayLiteral>(node)) {
+        for (const auto& elem : arrayLit->elements) collectReads(elem, names);
+    } else if (auto arrayAccess = std::dynamic_pointer_cast<ASTArrayAccess>(node)) {
+        collectReads(arrayAccess->array, names);
+        collectReads(arrayAccess->index, names);
+    } else if (auto funcCall = std::dynamic_pointer_cast<ASTFunctionCall>(node)) {
+        for (const auto& arg : funcCall->arguments) collectReads(arg, names);
+    } else if (auto assignment = std::dynamic_pointer_cast<ASTAssignment>(node)) {
+        collectReads(assignment->expression, names);
+    } else if (auto output = std::dynamic_pointer_cast<ASTOutput>(node)) {
+        collectReads(output->expression, names);
+    } else if (auto returnStmt = std::dynamic_pointer_cast<ASTReturn>(node)) {
+        collectReads(returnStmt->expression, names);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(node)) {
+        collectReads(ifStmt->condition, names);
+        collectReads(ifStmt->thenBlock, names);
+        collectReads(ifStmt->elseBlock, names);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(node)) {
+        collectReads(forStmt->init, names);
+        collectReads(forStmt->condition, names);
+        collectReads(forStmt->increment, names);
+        collectReads(forStmt->body, names);
+    } else if (auto block = std::dynamic_pointer_cast<ASTBlock>(node)) {
+        for (const auto& stmt : block->statements) collectReads(stmt, names);
+    }
+}
+
+std::vector<std::string> collectReadNames(const ASTNodePtr& node) {
+    std::vector<std::string> names;
+    collectReads(node, names);
+    return names;
+}
+
+ASTNode* unwrap(const ASTNodePtr& node) {
+    ASTNode* current = node.get();
+    while (auto grouped = dynamic_cast<ASTGroupedExpression*>(current)) {
+        current = grouped->expression.get();
+    }
+    return current;
+}
+
+bool isIdentifier(const ASTNodePtr& node, const std::string& name) {
+    auto identifier = dynamic_cast<ASTIdentifier*>(unwrap(node));
+    return identifier && identifier->name == name;
+}
@@ -3,22 +3,22 @@
 #include "../include/ast.h"
 #include "../include/tokenizer.h"
 
-static size_t current = 0;
-static const std::vector<GenericToken>* tokens = nullptr;
+ASTBuilder::ASTBuilder(const std::vector<GenericToken>& tokens, std::ostream& errors)
+    : tokens(tokens), errors(errors), current(0) {}
 
-static const GenericToken& peek() {
-    if (current < tokens->size()) return (*tokens)[current];
-    static GenericToken endToken = {TOKEN_ERROR, 0, {}, {}, {}, {}, {}, {"Unexpected end of input", 0}};
+const GenericToken& ASTBuilder::peek() const {
+    if (current < tokens.size()) return tokens[current];
+    static const GenericToken endToken = {TOKEN_ERROR, 0, {}, {}, {}, {}, {}, {"Unexpected end of input", 0}};
     return endToken;
 }
 
-static const GenericToken& next() {
-    if (current < tokens->size()) return (*tokens)[current++];
-    static GenericToken endToken = {TOKEN_ERROR, 0, {}, {}, {}, {}, {}, {"Unexpected end of input", 0}};
+const GenericToken& ASTBuilder::next() {
+    if (current < tokens.size()) return tokens[current++];
+    static const GenericToken endToken = {TOKEN_ERROR, 0, {}, {}, {}, {}, {}, {"Unexpected end of input", 0}};
     return endToken;
 }
 
-static bool matchSeparator(char symbol) {
+bool ASTBuilder::matchSeparator(char symbol) {
     if (peek().type == TOKEN_SEPARATOR && peek().separator.symbol == symbol) {
         next();
         return true;
@@ -26,7 +26,7 @@ static bool matchSeparator(char symbol) {
     return false;
 }
 
-static bool matchOperator(const std::string& symbol) {
+bool ASTBuilder::matchOperator(const std::string& symbol) {
     if (peek().type == TOKEN_OPERATOR && peek().op.symbol == symbol) {
         next();
         return true;
@@ -34,19 +34,6 @@ static bool matchOperator(const std::string& symbol) {
     return false;
 }
 
-static ASTNodePtr parseExpression();
-static ASTNodePtr parseStatement();
-static ASTNodePtr parseBlock();
-static ASTNodePtr parseLogicalOr();
-static ASTNodePtr parseLogicalAnd();
-static ASTNodePtr parseEquality();
-static ASTNodePtr parseComparison();
-static ASTNodePtr parseAddition();
-static ASTNodePtr parseMultiplication();
-static ASTNodePtr parseUnary();
-static ASTNodePtr parsePrimary();
-static ASTNodePtr parseSimpleAssignment();
-
 // Helper function to convert TokenLiteral to LiteralValue
 static LiteralValue convertTokenLiteral(const TokenLiteral& tokenLit) {
     switch (tokenLit.type) {
@@ -66,10 +53,13 @@ static LiteralValue convertTokenLiteral(const TokenLiteral& tokenLit) {
 }
 
 std::shared_ptr<ASTProgram> generateAST(const std::vector<GenericToken>& inputTokens, const std::string&) {
-    tokens = &inputTokens;
+    return ASTBuilder(inputTokens).build();
+}
+
+std::shared_ptr<ASTProgram> ASTBuilder::build() {
     current = 0;
     std::vector<ASTNodePtr> functions;
-    while (current < tokens->size()) {
+    while (current < tokens.size()) {
         if (peek().type == TOKEN_KEYWORD && peek().keyword.type == KEYWORD_DEF) {
             next();
             if (peek().type != TOKEN_IDENTIFIER) return nullptr;
@@ -86,14 +76,14 @@ std::shared_ptr<ASTProgram> generateAST(const std::vector<GenericToken>& inputTo
             ASTNodePtr body = parseBlock();
             functions.push_back(std::make_shared<ASTFunction>(name, params, body));
         } else {
-            std::cerr << "Expected function definition\n";
+            errors << "Expected function definition\n";
             return nullptr;
         }
     }
     return std::make_shared<ASTProgram>(functions);
 }
 
-static ASTNodePtr parseBlock() {
+ASTNodePtr ASTBuilder::parseBlock() {
     if (!matchSeparator('{')) return nullptr;
     std::vector<ASTNodePtr> statements;
     while (!(peek().type == TOKEN_SEPARATOR && peek().separator.symbol == '}')) {
@@ -105,7 +95,7 @@ static ASTNodePtr parseBlock() {
     return std::make_shared<ASTBlock>(statements);
 }
 
-static ASTNodePtr parseStatement() {
+ASTNodePtr ASTBuilder::parseStatement() {
     const GenericToken& token = peek();
     if (token.type == TOKEN_KEYWORD) {
         if (token.keyword.type == KEYWORD_INPUT) {
@@ -138,13 +128,36 @@ static ASTNodePtr parseStatement() {
             ASTNodePtr thenBlock = parseBlock();
             if (!thenBlock) return nullptr;
             
+            // elif arms, each nested in the else block of the one before
+            std::vector<std::pair<ASTNodePtr, ASTNodePtr>> arms = {{condition, thenBlock}};
+            while (peek().type == TOKEN_KEYWORD && peek().keyword.type == KEYWORD_ELIF) {
+                next();
+                if (!matchSeparator('(')) return nullptr;
+                ASTNodePtr armCondition = parseExpression();
+                if (!armCondition || !matchSeparator(')')) return nullptr;
+                ASTNodePtr armBlock = parseBlock();
+                if (!armBlock) return nullptr;
+                arms.push_back({armCondition, armBlock});
+            }
+            
             ASTNodePtr elseBlock = nullptr;
             if (peek().type == TOKEN_KEYWORD && peek().keyword.type == KEYWORD_ELSE) {
                 next();
                 elseBlock = parseBlock();
                 if (!elseBlock) return nullptr;
             }
+            for (size_t i = arms.size(); i-- > 1;) {
+                auto nested = std::make_shared<ASTIf>(arms[i].first, arms[i].second, elseBlock);
+                elseBlock = std::make_shared<ASTBlock>(std::vector<ASTNodePtr>{nested});
+            }
             return std::make_shared<ASTIf>(condition, thenBlock, elseBlock);
+        } else if (token.keyword.type == KEYWORD_PARALLEL) {
+            next();
+            if (peek().type != TOKEN_KEYWORD || peek().keyword.type != KEYWORD_FOR) return nullptr;
+            auto loop = std::dynamic_pointer_cast<ASTFor>(parseStatement());
+            if (!loop) return nullptr;
+            loop->parallel = true;
+            return loop;
         } else if (token.keyword.type == KEYWORD_FOR) {
             next();
             if (!matchSeparator('(')) return nullptr;
@@ -171,7 +184,7 @@ static ASTNodePtr parseStatement() {
 }
 
 // Helper function for simple assignments (used in for loops)
-static ASTNodePtr parseSimpleAssignment() {
+ASTNodePtr ASTBuilder::parseSimpleAssignment() {
     if (peek().type != TOKEN_IDENTIFIER) return nullptr;
     std::string name = peek().identifier.name;
     next();
@@ -181,11 +194,11 @@ static ASTNodePtr parseSimpleAssignment() {
     return std::make_shared<ASTAssignment>(name, expr);
 }
 
-static ASTNodePtr parseExpression() {
+ASTNodePtr ASTBuilder::parseExpression() {
     return parseLogicalOr();
 }
 
-static ASTNodePtr parseLogicalOr() {
+ASTNodePtr ASTBuilder::parseLogicalOr() {
     ASTNodePtr left = parseLogicalAnd();
     if (!left) return nullptr;
     
@@ -199,7 +212,7 @@ static ASTNodePtr parseLogicalOr() {
     return left;
 }
 
-static ASTNodePtr parseLogicalAnd() {
+ASTNodePtr ASTBuilder::parseLogicalAnd() {
     ASTNodePtr left = parseEquality();
     if (!left) return nullptr;
     
@@ -213,7 +226,7 @@ static ASTNodePtr parseLogicalAnd() {
     return left;
 }
 
-static ASTNodePtr parseEquality() {
+ASTNodePtr ASTBuilder::parseEquality() {
     ASTNodePtr left = parseComparison();
     if (!left) return nullptr;
     
@@ -228,7 +241,7 @@ static ASTNodePtr parseEquality() {
     return left;
 }
 
-static ASTNodePtr parseComparison() {
+ASTNodePtr ASTBuilder::parseComparison() {
     ASTNodePtr left = parseAddition();
     if (!left) return nullptr;
     
@@ -244,7 +257,7 @@ static ASTNodePtr parseComparison() {
     return left;
 }
 
-static ASTNodePtr parseAddition() {
+ASTNodePtr ASTBuilder::parseAddition() {
     ASTNodePtr left = parseMultiplication();
     if (!left) return nullptr;
     
@@ -259,7 +272,7 @@ static ASTNodePtr parseAddition() {
     return left;
 }
 
-static ASTNodePtr parseMultiplication() {
+ASTNodePtr ASTBuilder::parseMultiplication() {
     ASTNodePtr left = parseUnary();
     if (!left) return nullptr;
     
@@ -274,7 +287,7 @@ static ASTNodePtr parseMultiplication() {
     return left;
 }
 
-static ASTNodePtr parseUnary() {
+ASTNodePtr ASTBuilder::parseUnary() {
     if (peek().type == TOKEN_OPERATOR && 
         (peek().op.symbol == "-" || peek().op.symbol == "!")) {
         std::string op = peek().op.symbol;
@@ -283,12 +296,30 @@ static ASTNodePtr parseUnary() {
         if (!operand) return nullptr;
         return std::make_shared<ASTUnaryExpression>(op, operand);
     }
+    // await x is the built-in call await(x)
+    if (peek().type == TOKEN_KEYWORD && peek().keyword.type == KEYWORD_AWAIT) {
+        next();
+        ASTNodePtr task = parseUnary();
+        if (!task) return nullptr;
+        return std::make_shared<ASTFunctionCall>(std::make_shared<ASTIdentifier>("await"), std::vector<ASTNodePtr>{task});
+    }
     return parsePrimary();
 }
 
-static ASTNodePtr parsePrimary() {
+ASTNodePtr ASTBuilder::parsePrimary() {
     const GenericToken& token = peek();
     
+    // spawn f(a, b) is the built-in call spawn("f", a, b)
+    if (token.type == TOKEN_KEYWORD && token.keyword.type == KEYWORD_SPAWN) {
+        next();
+        auto call = std::dynamic_pointer_cast<ASTFunctionCall>(parsePrimary());
+        if (!call) return nullptr;
+        auto callee = std::dynamic_pointer_cast<ASTIdentifier>(call->callee);
+        std::vector<ASTNodePtr> args{std::make_shared<ASTLiteral>(callee->name)};
+        args.insert(args.end(), call->arguments.begin(), call->arguments.end());
+        return std::make_shared<ASTFunctionCall>(std::make_shared<ASTIdentifier>("spawn"), args);
+    }
+    
     if (token.type == TOKEN_LITERAL) {
         next();
         return std::make_shared<ASTLiteral>(convertTokenLiteral(token.literal));
@@ -0,0 +1,95 @@
+#include "../include/batch.h"
+#include "../include/thread_pool.h"
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+namespace {
+
+// Records per pool task, so that short records do not cost a task each
+// while long ones can still be stolen
+const size_t RUNS_PER_THREAD = 8;
+
+struct RunResult {
+    // Each record's output and runtime errors
+    std::vector<std::string> outputs;
+    std::vector<std::string> errors;
+    bool ok = true;
+    bool done = false;
+};
+
+} // namespace
+
+std::vector<std::string> splitRecords(const std::string& input, const std::string& delimiter) {
+    std::vector<std::string> records;
+    std::string record;
+    bool open = false;
+    size_t begin = 0;
+    while (begin < input.size()) {
+        size_t end = input.find('\n', begin);
+        if (end == std::string::npos) end = input.size();
+        if (input.compare(begin, end - begin, delimiter) == 0) {
+            records.push_back(std::move(record));
+            record.clear();
+            open = false;
+        } else {
+            record.append(input, begin, end - begin);
+            record += '\n';
+            open = true;
+        }
+        begin = end + 1;
+    }
+    if (open) records.push_back(std::move(record));
+    return records;
+}
+
+int runBatch(const Program& program, const std::string& input, const std::string& delimiter,
+             unsigned threads) {
+    std::vector<std::string> records = splitRecords(input, delimiter);
+    size_t runSize = std::max<size_t>(1, records.size() / (threads * RUNS_PER_THREAD));
+    size_t runCount = (records.size() + runSize - 1) / runSize;
+    std::vector<RunResult> results(runCount);
+    std::mutex doneLock;
+    std::condition_variable doneSignal;
+    bool ok = true;
+    {
+        // Made on first use by the worker's own thread
+        std::vector<std::unique_ptr<ProgramContext>> contexts(threads);
+        WorkStealingPool pool(threads);
+        for (size_t r = 0; r < runCount; ++r) {
+            pool.push(static_cast<unsigned>(r * threads / runCount), [&, r](unsigned worker) {
+                if (!contexts[worker]) contexts[worker] = std::make_unique<ProgramContext>(program);
+                std::vector<std::string> outputs, errors;
+                bool runOk = true;
+                size_t end = std::min(records.size(), (r + 1) * runSize);
+                for (size_t i = r * runSize; i < end; ++i) {
+                    std::ostringstream output, error;
+                    runOk = contexts[worker]->run(records[i], output, error) && runOk;
+                    outputs.push_back(output.str());
+                    errors.push_back(error.str());
+                }
+                std::lock_guard<std::mutex> guard(doneLock);
+                results[r].outputs = std::move(outputs);
+                results[r].errors = std::move(errors);
+                results[r].ok = runOk;
+                results[r].done = true;
+                doneSignal.notify_all();
+            });
+        }
+
+        // Printed in order while later runs are still going
+        for (size_t r = 0; r < runCount; ++r) {
+            std::unique_lock<std::mutex> lock(doneLock);
+            doneSignal.wait(lock, [&] { return results[r].done; });
+            for (size_t i = 0; i < results[r].outputs.size(); ++i) {
+                std::cout << results[r].outputs[i] << std::flush;
+                std::cerr << results[r].errors[i] << std::flush;
+            }
+            ok = ok && results[r].ok;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,147 @@
+#include "../include/bounds_check.h"
+#include <algorithm>
+
+namespace {
+
+bool isIntLiteral(const ASTNodePtr& node, int& value) {
+    auto literal = dynamic_cast<ASTLiteral*>(unwrap(node));
+    if (!literal || !std::holds_alternative<int>(literal->value)) return false;
+    value = std::get<int>(literal->value);
+    return true;
+}
+
+// The array a in len(a), or null
+const ASTIdentifier* lengthOf(const ASTNodePtr& node) {
+    auto call = dynamic_cast<ASTFunctionCall*>(unwrap(node));
+    if (!call || !isIdentifier(call->callee, "len") || call->arguments.size() != 1) return nullptr;
+    return dynamic_cast<ASTIdentifier*>(unwrap(call->arguments[0]));
+}
+
+// Marks a[i] in every expression under node
+int markAccesses(const ASTNodePtr& node, const std::string& array, const std::string& index) {
+    if (!node) return 0;
+    int marked = 0;
+    if (auto arrayAccess = std::dynamic_pointer_cast<ASTArrayAccess>(node)) {
+        // Plain identifiers only, the engines index those in place
+        auto arrayName = dynamic_cast<ASTIdentifier*>(arrayAccess->array.get());
+        auto indexName = dynamic_cast<ASTIdentifier*>(arrayAccess->index.get());
+        if (arrayName && indexName && arrayName->name == array && indexName->name == index) {
+            if (!arrayAccess->inBounds) marked++;
+            arrayAccess->inBounds = true;
+        }
+        marked += markAccesses(arrayAccess->array, array, index);
+        marked += markAccesses(arrayAccess->index, array, index);
+    } else if (auto binary = std::dynamic_pointer_cast<ASTBinaryExpression>(node)) {
+        marked += markAccesses(binary->left, array, index);
+        marked += markAccesses(binary->right, array, index);
+    } else if (auto unary = std::dynamic_pointer_cast<ASTUnaryExpression>(node)) {
+        marked += markAccesses(unary->operand, array, index);
+    } else if (auto grouped = std::dynamic_pointer_cast<ASTGroupedExpression>(node)) {
+        marked += markAccesses(grouped->expression, array, index);
+    } else if (auto arrayLit = std::dynamic_pointer_cast<ASTArrayLiteral>(node)) {
+        for (const auto& elem : arrayLit->elements) marked += markAccesses(elem, array, index);
+    } else if (auto funcCall = std::dynamic_pointer_cast<ASTFunctionCall>(node)) {
+        for (const auto& arg : funcCall->arguments) marked += markAccesses(arg, array, index);
+    } else if (auto assignment = std::dynamic_pointer_cast<ASTAssignment>(node)) {
+        marked += markAccesses(assignment->expression, array, index);
+    } else if (auto output = std::dynamic_pointer_cast<ASTOutput>(node)) {
+        marked += markAccesses(output->expression, array, index);
+    } else if (auto returnStmt = std::dynamic_pointer_cast<ASTReturn>(node)) {
+        marked += markAccesses(returnStmt->expression, array, index);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(node)) {
+        marked += markAccesses(ifStmt->condition, array, index);
+        marked += markAccesses(ifStmt->thenBlock, array, index);
+        marked += markAccesses(ifStmt->elseBlock, array, index);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(node)) {
+        marked += markAccesses(forStmt->init, array, index);
+        marked += markAccesses(forStmt->condition, array, index);
+        marked += markAccesses(forStmt->increment, array, index);
+        marked += markAccesses(forStmt->body, array, index);
+    } else if (auto block = std::dynamic_pointer_cast<ASTBlock>(node)) {
+        for (const auto& s : block->statements) marked += markAccesses(s, array, index);
+    }
+    return marked;
+}
+
+// The loop is statements[at] of its block
+int analyzeLoop(const ASTFor& loop, const std::vector<ASTNodePtr>& statements, size_t at) {
+    // i = c with c >= 0
+    auto init = std::dynamic_pointer_cast<ASTAssignment>(loop.init);
+    int start;
+    if (!init || !isIntLiteral(init->expression, start) || start < 0) return 0;
+    const std::string& index = init->variable;
+
+    // i = i + 1
+    auto increment = std::dynamic_pointer_cast<ASTAssignment>(loop.increment);
+    if (!increment || increment->variable != index) return 0;
+    auto step = dynamic_cast<ASTBinaryExpression*>(unwrap(increment->expression));
+    int one;
+    if (!step || step->op != "+" || !isIdentifier(step->left, index) ||
+        !isIntLiteral(step->right, one) || one != 1) {
+        return 0;
+    }
+
+    // i < len(a), or i < n after n = len(a) in the same block
+    auto condition = dynamic_cast<ASTBinaryExpression*>(unwrap(loop.condition));
+    if (!condition || condition->op != "<" || !isIdentifier(condition->left, index)) return 0;
+    std::vector<std::string> invariant = {index};
+    const ASTIdentifier* array = lengthOf(condition->right);
+    if (!array) {
+        auto bound = dynamic_cast<ASTIdentifier*>(unwrap(condition->right));
+        if (!bound || bound->name == index) return 0;
+        // Nearest assignment to n, and what is assigned after it
+        std::vector<std::string> assignedSince;
+        for (size_t i = at; i-- > 0;) {
+            auto assignment = std::dynamic_pointer_cast<ASTAssignment>(statements[i]);
+            if (assignment && assignment->variable == bound->name) {
+                array = lengthOf(assignment->expression);
+                break;
+            }
+            std::vector<std::string> names = collectAssignedNames(statements[i]);
+            assignedSince.insert(assignedSince.end(), names.begin(), names.end());
+        }
+        if (!array || array->name == bound->name) return 0;
+        for (const auto& name : assignedSince) {
+            if (name == bound->name || name == array->name) return 0;
+        }
+        invariant.push_back(bound->name);
+    }
+    if (array->name == index) return 0;
+    invariant.push_back(array->name);
+
+    for (const auto& name : collectAssignedNames(loop.body)) {
+        if (std::find(invariant.begin(), invariant.end(), name) != invariant.end()) return 0;
+    }
+    return markAccesses(loop.body, array->name, index);
+}
+
+int analyzeStatement(const ASTNodePtr& stmt) {
+    int marked = 0;
+    if (auto block = std::dynamic_pointer_cast<ASTBlock>(stmt)) {
+        for (size_t i = 0; i < block->statements.size(); ++i) {
+            const ASTNodePtr& s = block->statements[i];
+            if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(s)) {
+                marked += analyzeLoop(*forStmt, block->statements, i);
+            }
+            marked += analyzeStatement(s);
+        }
+    } else if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(stmt)) {
+        marked += analyzeStatement(ifStmt->thenBlock);
+        marked += analyzeStatement(ifStmt->elseBlock);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(stmt)) {
+        marked += analyzeStatement(forStmt->body);
+    }
+    return marked;
+}
+
+} // namespace
+
+int eliminateBoundsChecks(ASTProgram& program) {
+    int marked = 0;
+    for (const auto& node : program.functions) {
+        if (auto func = std::dynamic_pointer_cast<ASTFunction>(node)) {
+            marked += analyzeStatement(func->body);
+        }
+    }
+    return marked;
+}
@@ -0,0 +1,1042 @@
+#include "../include/bytecode.h"
+#include "../include/interpreter.h"
+#include "../include/value_ops.h"
+#include <algorithm>
+#include <cstdio>
+
+const char* opCodeName(OpCode op) {
+    static const char* const names[] = {
+#define BYTECODE_NAME(name) #name,
+        BYTECODE_OPCODES(BYTECODE_NAME)
+#undef BYTECODE_NAME
+    };
+    size_t index = static_cast<size_t>(op);
+    return index < static_cast<size_t>(OpCode::COUNT) ? names[index] : "?";
+}
+
+int stackEffect(OpCode op, int32_t a, int32_t b) {
+    switch (op) {
+        case OpCode::LOAD_CONST:
+        case OpCode::LOAD_LOCAL:
+        case OpCode::LOAD_LOCAL_CHECKED:
+        case OpCode::LOAD_UNASSIGNED:
+        case OpCode::ADD_LOCAL_CONST:
+        case OpCode::INDEX_LOCAL_LOCAL:
+        case OpCode::INDEX_LOCAL_LOCAL_UNCHECKED:
+            return 1;
+        case OpCode::STORE_LOCAL:
+        case OpCode::POP:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::JUMP_IF_TRUE:
+        case OpCode::OUTPUT:
+        case OpCode::REDUCE_TERM:
+        case OpCode::RETURN:
+        case OpCode::ADD: case OpCode::SUB: case OpCode::MUL:
+        case OpCode::DIV: case OpCode::MOD:
+        case OpCode::EQ: case OpCode::NE: case OpCode::LT:
+        case OpCode::LE: case OpCode::GT: case OpCode::GE:
+        case OpCode::INDEX:
+            return -1;
+        case OpCode::EQ_JUMP_IF_FALSE: case OpCode::NE_JUMP_IF_FALSE:
+        case OpCode::LT_JUMP_IF_FALSE: case OpCode::LE_JUMP_IF_FALSE:
+        case OpCode::GT_JUMP_IF_FALSE: case OpCode::GE_JUMP_IF_FALSE:
+            return -2;
+        case OpCode::CALL:
+        case OpCode::TAILCALL:
+        case OpCode::CALL_BUILTIN:
+            return 1 - b;
+        case OpCode::MAKE_ARRAY:
+            return 1 - a;
+        case OpCode::CONCAT_LOCAL:
+            return -b;
+        default:
+            return 0;
+    }
+}
+
+std::string constantKey(const RuntimeValue& value) {
+    switch (value.type) {
+        case RuntimeType::INTEGER: return "i" + std::to_string(value.intValue);
+        case RuntimeType::FLOAT: {
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "f%a", value.floatValue);
+            return buffer;
+        }
+        case RuntimeType::BOOLEAN: return value.boolValue ? "btrue" : "bfalse";
+        case RuntimeType::STRING: return "s" + *value.stringValue;
+        default: return "u";
+    }
+}
+
+namespace {
+
+// Shared constant/name pools for the whole program
+class ProgramBuilder {
+public:
+    CompiledProgram& program;
+    std::unordered_map<std::string, int> constantKeys;
+    std::unordered_map<std::string, int> nameKeys;
+
+    explicit ProgramBuilder(CompiledProgram& program) : program(program) {}
+
+    int constant(const RuntimeValue& value) {
+        std::string key = constantKey(value);
+        auto it = constantKeys.find(key);
+        if (it != constantKeys.end()) return it->second;
+        int index = static_cast<int>(program.constants.size());
+        program.constants.push_back(value);
+        constantKeys[key] = index;
+        return index;
+    }
+
+    int name(const std::string& text) {
+        auto it = nameKeys.find(text);
+        if (it != nameKeys.end()) return it->second;
+        int index = static_cast<int>(program.names.size());
+        program.names.push_back(text);
+        nameKeys[text] = index;
+        return index;
+    }
+};
+
+class FunctionCompiler {
+private:
+    ProgramBuilder& builder;
+    CompiledFunction& function;
+    std::unordered_map<std::string, int> slots;
+    int depth;
+    // Set while compiling the body of a chunk entry
+    const ParallelLoop* chunkOf = nullptr;
+    // Slots assigned on every path to the code being compiled; all of them
+    // after a return, where nothing is reached
+    std::vector<bool> assigned;
+    // Set for loop and chunk entries, whose parameters come from the host:
+    // reads before assignment go to function.readsBeforeAssigned instead
+    // of being checked
+    bool hostParams = false;
+
+    void emit(OpCode op, int32_t a = 0, int32_t b = 0) {
+        function.code.push_back({op, a, b});
+        depth += stackEffect(op, a, b);
+        if (depth > function.maxStack) function.maxStack = depth;
+    }
+
+    size_t here() const { return function.code.size(); }
+
+    void markAssigned(int slot) {
+        if (static_cast<size_t>(slot) >= assigned.size()) assigned.resize(slot + 1, false);
+        assigned[slot] = true;
+    }
+
+    void markAllAssigned() { assigned.assign(function.localNames.size(), true); }
+
+    // Whether slot can be read without a check that it was assigned
+    bool readsAssigned(int slot) {
+        if (static_cast<size_t>(slot) < assigned.size() && assigned[slot]) return true;
+        if (!hostParams) return false;
+        auto& reads = function.readsBeforeAssigned;
+        if (std::find(reads.begin(), reads.end(), slot) == reads.end()) reads.push_back(slot);
+        return true;
+    }
+
+    // Slots assigned after both of two paths
+    static std::vector<bool> meet(std::vector<bool> a, const std::vector<bool>& b) {
+        if (a.size() < b.size()) a.resize(b.size(), false);
+        for (size_t i = 0; i < a.size(); ++i) a[i] = a[i] && i < b.size() && b[i];
+        return a;
+    }
+
+    void patch(size_t at) { function.code[at].a = static_cast<int32_t>(here()); }
+
+    void patchAll(const std::vector<size_t>& jumps) {
+        for (size_t at : jumps) patch(at);
+    }
+
+    int slotFor(const std::string& name) {
+        auto it = slots.find(name);
+        if (it != slots.end()) return it->second;
+        int slot = static_cast<int>(function.localNames.size());
+        function.localNames.push_back(name);
+        slots[name] = slot;
+        return slot;
+    }
+
+    void compileLiteral(const ASTLiteral& literal) {
+        RuntimeValue value = std::visit([](const auto& val) -> RuntimeValue {
+            using T = std::decay_t<decltype(val)>;
+            if constexpr (std::is_same_v<T, char>) {
+                return RuntimeValue(std::string(1, val));
+            } else {
+                return RuntimeValue(val);
+            }
+        }, literal.value);
+        emit(OpCode::LOAD_CONST, builder.constant(value));
+    }
+
+    static OpCode binaryOpCode(const std::string& op) {
+        if (op == "+") return OpCode::ADD;
+        if (op == "-") return OpCode::SUB;
+        if (op == "*") return OpCode::MUL;
+        if (op == "/") return OpCode::DIV;
+        if (op == "%") return OpCode::MOD;
+        if (op == "==") return OpCode::EQ;
+        if (op == "!=") return OpCode::NE;
+        if (op == "<") return OpCode::LT;
+        if (op == "<=") return OpCode::LE;
+        if (op == ">") return OpCode::GT;
+        if (op == ">=") return OpCode::GE;
+        return OpCode::COUNT;
+    }
+
+    void compileExpression(const ASTNodePtr& expr) {
+        if (auto literal = std::dynamic_pointer_cast<ASTLiteral>(expr)) {
+            compileLiteral(*literal);
+            return;
+        }
+
+        if (auto identifier = std::dynamic_pointer_cast<ASTIdentifier>(expr)) {
+            auto it = slots.find(identifier->name);
+            if (it != slots.end() && readsAssigned(it->second)) {
+                emit(OpCode::LOAD_LOCAL, it->second);
+            } else if (it != slots.end()) {
+                // Assigned on some paths only, like a missing variable in
+                // Interpreter::getVariable() on the others
+                emit(OpCode::LOAD_LOCAL_CHECKED, it->second, builder.name(identifier->name));
+            } else {
+                emit(OpCode::LOAD_UNASSIGNED, builder.name(identifier->name));
+            }
+            return;
+        }
+
+        if (auto binary = std::dynamic_pointer_cast<ASTBinaryExpression>(expr)) {
+            if (binary->op == "&&" || binary->op == "||") {
+                // Short-circuit to a boolean, like Interpreter::evaluateCondition
+                std::vector<size_t> shortCircuit = binary->op == "&&"
+                    ? compileJumpIfFalse(expr) : compileJumpIfTrue(expr);
+                emit(OpCode::LOAD_CONST, builder.constant(RuntimeValue(binary->op == "&&")));
+                size_t skip = here();
+                emit(OpCode::JUMP);
+                depth--;
+                patchAll(shortCircuit);
+                emit(OpCode::LOAD_CONST, builder.constant(RuntimeValue(binary->op != "&&")));
+                patch(skip);
+                return;
+            }
+
+            OpCode op = binaryOpCode(binary->op);
+            compileExpression(binary->left);
+            compileExpression(binary->right);
+            if (op == OpCode::COUNT) {
+                std::cerr << "Error: Unknown binary operation: " << binary->op << std::endl;
+                emit(OpCode::POP);
+                emit(OpCode::POP);
+                emit(OpCode::LOAD_CONST, builder.constant(RuntimeValue()));
+                return;
+            }
+            emit(op);
+            return;
+        }
+
+        if (auto unary = std::dynamic_pointer_cast<ASTUnaryExpression>(expr)) {
+            compileExpression(unary->operand);
+            if (unary->op == "-") {
+                emit(OpCode::NEG);
+            } else if (unary->op == "!") {
+                emit(OpCode::NOT);
+            } else {
+                std::cerr << "Error: Unknown unary operation: " << unary->op << std::endl;
+                emit(OpCode::POP);
+                emit(OpCode::LOAD_CONST, builder.constant(RuntimeValue()));
+            }
+            return;
+        }
+
+        if (auto funcCall = std::dynamic_pointer_cast<ASTFunctionCall>(expr)) {
+            auto callee = std::dynamic_pointer_cast<ASTIdentifier>(funcCall->callee);
+            if (!callee) {
+                std::cerr << "Error: Invalid function call" << std::endl;
+                emit(OpCode::LOAD_CONST, builder.constant(RuntimeValue()));
+                return;
+            }
+            for (const auto& arg : funcCall->arguments) {
+                compileExpression(arg);
+            }
+            int argc = static_cast<int>(funcCall->arguments.size());
+            auto target = builder.program.functionIndex.find(callee->name);
+            if (!Interpreter::isBuiltinFunction(callee->name) && target != builder.program.functionIndex.end()) {
+                emit(OpCode::CALL, target->second, argc);
+            } else {
+                emit(OpCode::CALL_BUILTIN, builder.name(callee->name), argc);
+            }
+            return;
+        }
+
+        if (auto arrayLit = std::dynamic_pointer_cast<ASTArrayLiteral>(expr)) {
+            for (const auto& elem : arrayLit->elements) {
+                compileExpression(elem);
+            }
+            emit(OpCode::MAKE_ARRAY, static_cast<int32_t>(arrayLit->elements.size()));
+            return;
+        }
+
+        if (auto arrayAccess = std::dynamic_pointer_cast<ASTArrayAccess>(expr)) {
+            if (arrayAccess->inBounds) {
+                // Both are plain identifiers, see eliminateBoundsChecks()
+                auto array = slots.find(static_cast<ASTIdentifier&>(*arrayAccess->array).name);
+                auto index = slots.find(static_cast<ASTIdentifier&>(*arrayAccess->index).name);
+                if (array != slots.end() && index != slots.end()) {
+                    emit(OpCode::INDEX_LOCAL_LOCAL_UNCHECKED, array->second, index->second);
+                    return;
+                }
+            }
+            compileExpression(arrayAccess->array);
+            compileExpression(arrayAccess->index);
+            emit(OpCode::INDEX);
+            return;
+        }
+
+        if (auto grouped = std::dynamic_pointer_cast<ASTGroupedExpression>(expr)) {
+            compileExpression(grouped->expression);
+            return;
+        }
+
+        std::cerr << "Error: Unknown expression type" << std::endl;
+        emit(OpCode::LOAD_CONST, builder.constant(RuntimeValue()));
+    }
+
+    // Emit a test of expr that jumps when it is falsy. Returns the jumps to
+    // patch with the false target; falls through when truthy.
+    std::vector<size_t> compileJumpIfFalse(const ASTNodePtr& expr) {
+        if (auto binary = std::dynamic_pointer_cast<ASTBinaryExpression>(expr)) {
+            if (binary->op == "&&") {
+                std::vector<size_t> jumps = compileJumpIfFalse(binary->left);
+                std::vector<size_t> rest = compileJumpIfFalse(binary->right);
+                jumps.insert(jumps.end(), rest.begin(), rest.end());
+                return jumps;
+            }
+            if (binary->op == "||") {
+                std::vector<size_t> toTrue = compileJumpIfTrue(binary->left);
+                std::vector<size_t> jumps = compileJumpIfFalse(binary->right);
+                patchAll(toTrue);
+                return jumps;
+            }
+        } else if (auto unary = std::dynamic_pointer_cast<ASTUnaryExpression>(expr)) {
+            if (unary->op == "!") return compileJumpIfTrue(unary->operand);
+        } else if (auto grouped = std::dynamic_pointer_cast<ASTGroupedExpression>(expr)) {
+            return compileJumpIfFalse(grouped->expression);
+        }
+        compileExpression(expr);
+        size_t at = here();
+        emit(OpCode::JUMP_IF_FALSE);
+        return {at};
+    }
+
+    std::vector<size_t> compileJumpIfTrue(const ASTNodePtr& expr) {
+        if (auto binary = std::dynamic_pointer_cast<ASTBinaryExpression>(expr)) {
+            if (binary->op == "||") {
+                std::vector<size_t> jumps = compileJumpIfTrue(binary->left);
+                std::vector<size_t> rest = compileJumpIfTrue(binary->right);
+                jumps.insert(jumps.end(), rest.begin(), rest.end());
+                return jumps;
+            }
+            if (binary->op == "&&") {
+                std::vector<size_t> toFalse = compileJumpIfFalse(binary->left);
+                std::vector<size_t> jumps = compileJumpIfTrue(binary->right);
+                patchAll(toFalse);
+                return jumps;
+            }
+        } else if (auto unary = std::dynamic_pointer_cast<ASTUnaryExpression>(expr)) {
+            if (unary->op == "!") return compileJumpIfFalse(unary->operand);
+        } else if (auto grouped = std::dynamic_pointer_cast<ASTGroupedExpression>(expr)) {
+            return compileJumpIfTrue(grouped->expression);
+        }
+        compileExpression(expr);
+        size_t at = here();
+        emit(OpCode::JUMP_IF_TRUE);
+        return {at};
+    }
+
+    // "s = s + a + b ..." - see Interpreter::appendInPlace
+    bool compileAppend(const ASTAssignment& assignment) {
+        std::vector<const ASTNodePtr*> pieces;
+        ASTNode* node = assignment.expression.get();
+        while (true) {
+            if (auto grouped = dynamic_cast<ASTGroupedExpression*>(node)) {
+                node = grouped->expression.get();
+                continue;
+            }
+            auto binary = dynamic_cast<ASTBinaryExpression*>(node);
+            if (!binary || binary->op != "+") break;
+            pieces.push_back(&binary->right);
+            node = binary->left.get();
+        }
+        auto base = dynamic_cast<ASTIdentifier*>(node);
+        if (pieces.empty() || !base || base->name != assignment.variable) return false;
+        if (!readsAssigned(slotFor(assignment.variable))) return false;
+
+        for (auto it = pieces.rbegin(); it != pieces.rend(); ++it) {
+            compileExpression(**it);
+        }
+        emit(OpCode::CONCAT_LOCAL, slotFor(assignment.variable), static_cast<int32_t>(pieces.size()));
+        return true;
+    }
+
+    // "return f(...)" for a user function f becomes a jump into f
+    bool compileTailCall(const ASTNodePtr& expr) {
+        ASTNodePtr node = expr;
+        while (auto grouped = std::dynamic_pointer_cast<ASTGroupedExpression>(node)) {
+            node = grouped->expression;
+        }
+        auto funcCall = std::dynamic_pointer_cast<ASTFunctionCall>(node);
+        if (!funcCall) return false;
+        auto callee = std::dynamic_pointer_cast<ASTIdentifier>(funcCall->callee);
+        if (!callee || Interpreter::isBuiltinFunction(callee->name)) return false;
+        auto target = builder.program.functionIndex.find(callee->name);
+        if (target == builder.program.functionIndex.end()) return false;
+
+        for (const auto& arg : funcCall->arguments) {
+            compileExpression(arg);
+        }
+        emit(OpCode::TAILCALL, target->second, static_cast<int32_t>(funcCall->arguments.size()));
+        return true;
+    }
+
+    void compileStatement(const ASTNodePtr& stmt) {
+        if (!stmt) return;
+
+        if (auto assignment = std::dynamic_pointer_cast<ASTAssignment>(stmt)) {
+            if (chunkOf) {
+                auto reduction = chunkOf->reductions.find(assignment.get());
+                if (reduction != chunkOf->reductions.end()) {
+                    for (size_t t = 0; t < reduction->second.terms.size(); ++t) {
+                        compileExpression(reduction->second.terms[t].second);
+                        emit(OpCode::REDUCE_TERM, static_cast<int32_t>(builder.program.reductionTerms.size()));
+                        builder.program.reductionTerms.push_back({&reduction->second, t});
+                    }
+                    return;
+                }
+            }
+            if (compileAppend(*assignment)) return;
+            compileExpression(assignment->expression);
+            emit(OpCode::STORE_LOCAL, slotFor(assignment->variable));
+            markAssigned(slotFor(assignment->variable));
+            return;
+        }
+
+        if (auto input = std::dynamic_pointer_cast<ASTInput>(stmt)) {
+            emit(OpCode::INPUT, slotFor(input->variable));
+            markAssigned(slotFor(input->variable));
+            return;
+        }
+
+        if (auto output = std::dynamic_pointer_cast<ASTOutput>(stmt)) {
+            compileExpression(output->expression);
+            emit(OpCode::OUTPUT);
+            return;
+        }
+
+        if (auto returnStmt = std::dynamic_pointer_cast<ASTReturn>(stmt)) {
+            if (!compileTailCall(returnStmt->expression)) {
+                if (returnStmt->expression) {
+                    compileExpression(returnStmt->expression);
+                    emit(OpCode::RETURN);
+                } else {
+                    emit(OpCode::RETURN_UNDEFINED);
+                }
+            }
+            // Nothing after the return is reached
+            markAllAssigned();
+            return;
+        }
+
+        if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(stmt)) {
+            auto variable = ifStmt->switchTable ? slots.find(ifStmt->switchTable->variable) : slots.end();
+            if (variable != slots.end() && readsAssigned(variable->second)) {
+                compileSwitch(ifStmt->switchTable);
+                return;
+            }
+            std::vector<size_t> toElse = compileJumpIfFalse(ifStmt->condition);
+            std::vector<bool> before = assigned;
+            compileStatement(ifStmt->thenBlock);
+            if (ifStmt->elseBlock) {
+                size_t toEnd = here();
+                emit(OpCode::JUMP);
+                patchAll(toElse);
+                std::vector<bool> afterThen = std::move(assigned);
+                assigned = before;
+                compileStatement(ifStmt->elseBlock);
+                assigned = meet(std::move(afterThen), assigned);
+                patch(toEnd);
+            } else {
+                patchAll(toElse);
+                assigned = meet(std::move(before), assigned);
+            }
+            return;
+        }
+
+        if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(stmt)) {
+            compileStatement(forStmt->init);
+            size_t toKernelExit = compileKernelCall(*forStmt);
+            size_t loopHead = here();
+            std::vector<size_t> toExit = compileJumpIfFalse(forStmt->condition);
+            // The body may not run at all
+            std::vector<bool> before = assigned;
+            compileStatement(forStmt->body);
+            compileStatement(forStmt->increment);
+            assigned = std::move(before);
+            emit(OpCode::JUMP, static_cast<int32_t>(loopHead));
+            patchAll(toExit);
+            if (toKernelExit != SIZE_MAX) patch(toKernelExit);
+            return;
+        }
+
+        if (auto block = std::dynamic_pointer_cast<ASTBlock>(stmt)) {
+            for (const auto& s : block->statements) {
+                compileStatement(s);
+            }
+            return;
+        }
+
+        std::cerr << "Error: Unknown statement type" << std::endl;
+    }
+
+    // SWITCH_LOCAL, then the else code and every arm, each jumping to the end
+    void compileSwitch(const std::shared_ptr<const SwitchTable>& table) {
+        int index = static_cast<int>(function.jumpTables.size());
+        function.jumpTables.push_back({table, {}});
+        emit(OpCode::SWITCH_LOCAL, slots.at(table->variable), index);
+        std::vector<int32_t> targets;
+        std::vector<size_t> toEnd;
+        targets.push_back(static_cast<int32_t>(here()));
+        std::vector<bool> before = assigned;
+        if (table->otherwise) compileStatement(table->otherwise);
+        for (const auto& arm : table->arms) {
+            toEnd.push_back(here());
+            emit(OpCode::JUMP);
+            targets.push_back(static_cast<int32_t>(here()));
+            std::vector<bool> afterPrevious = std::move(assigned);
+            assigned = before;
+            compileStatement(arm);
+            assigned = meet(std::move(afterPrevious), assigned);
+        }
+        patchAll(toEnd);
+        function.jumpTables[index].targets = std::move(targets);
+    }
+
+    // VECTOR_LOOP for a vectorized loop, to be patched to its exit; SIZE_MAX
+    // when the loop has no kernel or reads names that never get a slot
+    size_t compileKernelCall(const ASTFor& loop) {
+        if (!loop.kernel) return SIZE_MAX;
+        KernelCall call{loop.kernel, {}, {}};
+        for (const auto& name : loop.kernel->inputs) {
+            auto it = slots.find(name);
+            if (it == slots.end() || !readsAssigned(it->second)) return SIZE_MAX;
+            call.inputSlots.push_back(it->second);
+        }
+        for (const auto& name : loop.kernel->outputs) {
+            call.outputSlots.push_back(slotFor(name));
+        }
+        size_t at = here();
+        emit(OpCode::VECTOR_LOOP, 0, static_cast<int32_t>(builder.program.kernels.size()));
+        builder.program.kernels.push_back(std::move(call));
+        return at;
+    }
+
+public:
+    FunctionCompiler(ProgramBuilder& builder, CompiledFunction& function)
+        : builder(builder), function(function), depth(0) {}
+
+    void compile(const ASTFunction& source) {
+        function.name = source.name;
+        function.paramCount = static_cast<int>(source.parameters.size());
+        function.maxStack = 0;
+        // Every name the function can ever store to gets a slot up front;
+        // loads of other names can only ever see an undefined variable.
+        for (const auto& name : collectLocalNames(source)) {
+            slotFor(name);
+        }
+        for (const auto& param : source.parameters) markAssigned(slotFor(param));
+        compileStatement(source.body);
+        emit(OpCode::RETURN_UNDEFINED);
+        function.localCount = static_cast<int>(function.localNames.size());
+    }
+
+    // Entry into loop, which is inside source, at its condition check
+    void compileLoopEntry(const ASTFunction& source, const ASTFor& loop) {
+        function.name = source.name + "$loop";
+        function.maxStack = 0;
+        hostParams = true;
+        for (const auto& name : collectLocalNames(source)) {
+            slotFor(name);
+        }
+        size_t loopHead = here();
+        std::vector<size_t> toExit = compileJumpIfFalse(loop.condition);
+        compileStatement(loop.body);
+        compileStatement(loop.increment);
+        emit(OpCode::JUMP, static_cast<int32_t>(loopHead));
+        patchAll(toExit);
+        emit(OpCode::LOOP_EXIT);
+        function.localCount = static_cast<int>(function.localNames.size());
+        function.paramCount = function.localCount;
+    }
+
+    // Entry into a chunk of the parallel loop inside source, see
+    // compileProgram()
+    void compileChunkEntry(const ASTFunction& source, const ASTFor& loop) {
+        const ParallelLoop& plan = *loop.parallelLoop;
+        function.name = source.name + "$chunk";
+        function.maxStack = 0;
+        hostParams = true;
+        for (const auto& name : collectLocalNames(source)) {
+            slotFor(name);
+        }
+        slotFor("$chunkEnd");
+        auto inChunk = std::make_shared<ASTBinaryExpression>(
+            std::make_shared<ASTIdentifier>(plan.index), std::make_shared<ASTIdentifier>("$chunkEnd"), "<");
+        size_t loopHead = here();
+        std::vector<size_t> toExit = compileJumpIfFalse(inChunk);
+        chunkOf = &plan;
+        compileStatement(loop.body);
+        chunkOf = nullptr;
+        compileStatement(loop.increment);
+        emit(OpCode::JUMP, static_cast<int32_t>(loopHead));
+        patchAll(toExit);
+        emit(OpCode::LOOP_EXIT);
+        function.localCount = static_cast<int>(function.localNames.size());
+        function.paramCount = function.localCount;
+    }
+};
+
+void collectLoops(const ASTNodePtr& stmt, std::vector<const ASTFor*>& loops) {
+    if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(stmt)) {
+        collectLoops(ifStmt->thenBlock, loops);
+        collectLoops(ifStmt->elseBlock, loops);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(stmt)) {
+        loops.push_back(forStmt.get());
+        collectLoops(forStmt->body, loops);
+    } else if (auto block = std::dynamic_pointer_cast<ASTBlock>(stmt)) {
+        for (const auto& s : block->statements) {
+            collectLoops(s, loops);
+        }
+    }
+}
+
+bool isJump(OpCode op) {
+    switch (op) {
+        case OpCode::JUMP:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::JUMP_IF_TRUE:
+        case OpCode::EQ_JUMP_IF_FALSE: case OpCode::NE_JUMP_IF_FALSE:
+        case OpCode::LT_JUMP_IF_FALSE: case OpCode::LE_JUMP_IF_FALSE:
+        case OpCode::GT_JUMP_IF_FALSE: case OpCode::GE_JUMP_IF_FALSE:
+        case OpCode::EQ_INT_JUMP_IF_FALSE: case OpCode::NE_INT_JUMP_IF_FALSE:
+        case OpCode::LT_INT_JUMP_IF_FALSE: case OpCode::LE_INT_JUMP_IF_FALSE:
+        case OpCode::GT_INT_JUMP_IF_FALSE: case OpCode::GE_INT_JUMP_IF_FALSE:
+        case OpCode::VECTOR_LOOP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+OpCode compareJumpFor(OpCode compare) {
+    switch (compare) {
+        case OpCode::EQ: return OpCode::EQ_JUMP_IF_FALSE;
+        case OpCode::NE: return OpCode::NE_JUMP_IF_FALSE;
+        case OpCode::LT: return OpCode::LT_JUMP_IF_FALSE;
+        case OpCode::LE: return OpCode::LE_JUMP_IF_FALSE;
+        case OpCode::GT: return OpCode::GT_JUMP_IF_FALSE;
+        case OpCode::GE: return OpCode::GE_JUMP_IF_FALSE;
+        default: return OpCode::COUNT;
+    }
+}
+
+} // namespace
+
+// Peephole pass merging the most frequent instruction pairs measured with
+// --profile-ops. A sequence is only merged when no jump lands inside it.
+void fuseSuperinstructions(CompiledFunction& function) {
+    const std::vector<Instr>& code = function.code;
+    std::vector<bool> isTarget(code.size() + 1, false);
+    for (const Instr& instr : code) {
+        if (isJump(instr.op)) isTarget[instr.a] = true;
+    }
+    for (const JumpTable& jumpTable : function.jumpTables) {
+        for (int32_t target : jumpTable.targets) isTarget[target] = true;
+    }
+
+    auto free = [&](size_t start, size_t count) {
+        if (start + count > code.size()) return false;
+        for (size_t i = start + 1; i < start + count; ++i) {
+            if (isTarget[i]) return false;
+        }
+        return true;
+    };
+
+    std::vector<Instr> fused;
+    std::vector<int32_t> newIndex(code.size() + 1, 0);
+    size_t i = 0;
+    while (i < code.size()) {
+        size_t start = i;
+        newIndex[i] = static_cast<int32_t>(fused.size());
+        const Instr& instr = code[i];
+
+        if (instr.op == OpCode::LOAD_LOCAL && free(i, 3) &&
+            code[i + 1].op == OpCode::LOAD_CONST && code[i + 2].op == OpCode::ADD) {
+            fused.push_back({OpCode::ADD_LOCAL_CONST, instr.a, code[i + 1].a});
+            i += 3;
+        } else if (instr.op == OpCode::LOAD_LOCAL && free(i, 3) &&
+                   code[i + 1].op == OpCode::LOAD_LOCAL && code[i + 2].op == OpCode::INDEX) {
+            fused.push_back({OpCode::INDEX_LOCAL_LOCAL, instr.a, code[i + 1].a});
+            i += 3;
+        } else if (compareJumpFor(instr.op) != OpCode::COUNT && free(i, 2) &&
+                   code[i + 1].op == OpCode::JUMP_IF_FALSE) {
+            fused.push_back({compareJumpFor(instr.op), code[i + 1].a, 0});
+            i += 2;
+        } else {
+            fused.push_back(instr);
+            i += 1;
+        }
+
+        for (size_t k = start + 1; k < i; ++k) {
+            newIndex[k] = newIndex[start];
+        }
+    }
+    newIndex[code.size()] = static_cast<int32_t>(fused.size());
+
+    for (Instr& instr : fused) {
+        if (isJump(instr.op)) instr.a = newIndex[instr.a];
+    }
+    for (JumpTable& jumpTable : function.jumpTables) {
+        for (int32_t& target : jumpTable.targets) target = newIndex[target];
+    }
+    function.code = std::move(fused);
+}
+
+namespace {
+
+// The arithmetic opcodes are laid out like BinaryOp
+TypeSet arithmeticTypes(OpCode op, TypeSet left, TypeSet right) {
+    return arithmeticTypes(static_cast<BinaryOp>(static_cast<int>(op) - static_cast<int>(OpCode::ADD)), left, right);
+}
+
+// Types of the locals and the operand stack before one instruction
+struct TypeState {
+    int depth = -1; // -1 until the instruction is reached
+    std::vector<TypeSet> slots;
+};
+
+} // namespace
+
+bool specializeFunction(const CompiledProgram& program, const CompiledFunction& function,
+                        const std::vector<RuntimeType>& paramTypes, std::vector<Instr>& code) {
+    const std::vector<Instr>& source = function.code;
+    const int localCount = function.localCount;
+    if (source.empty() || static_cast<int>(paramTypes.size()) != function.paramCount) return false;
+
+    // Forward dataflow over the code; type sets only grow, so it terminates
+    std::vector<TypeState> states(source.size());
+    states[0].depth = 0;
+    states[0].slots.assign(localCount + function.maxStack, typeBit(RuntimeType::UNDEFINED));
+    for (size_t i = 0; i < paramTypes.size(); ++i) {
+        states[0].slots[i] = typeBit(paramTypes[i]);
+    }
+    std::vector<size_t> pending = {0};
+
+    auto merge = [&](size_t target, const TypeState& state) {
+        if (target >= source.size()) return false;
+        TypeState& known = states[target];
+        if (known.depth < 0) {
+            known = state;
+            pending.push_back(target);
+            return true;
+        }
+        // The compiler keeps stack heights consistent at join points
+        if (known.depth != state.depth) return false;
+        bool changed = false;
+        for (size_t i = 0; i < known.slots.size(); ++i) {
+            TypeSet joined = known.slots[i] | state.slots[i];
+            if (joined != known.slots[i]) {
+                known.slots[i] = joined;
+                changed = true;
+            }
+        }
+        if (changed) pending.push_back(target);
+        return true;
+    };
+
+    while (!pending.empty()) {
+        size_t pc = pending.back();
+        pending.pop_back();
+        TypeState state = states[pc];
+        const Instr& instr = source[pc];
+        TypeSet* locals = state.slots.data();
+        TypeSet* stack = locals + localCount;
+        int& depth = state.depth;
+        bool fallsThrough = true;
+        bool jumps = false;
+
+        auto pop = [&](int count) {
+            depth -= count;
+            return depth >= 0;
+        };
+        auto push = [&](TypeSet type) {
+            if (depth >= function.maxStack) return false;
+            stack[depth++] = type;
+            return true;
+        };
+
+        bool ok = true;
+        switch (instr.op) {
+            case OpCode::LOAD_CONST:
+                ok = push(typeBit(program.constants[instr.a].type));
+                break;
+            case OpCode::LOAD_LOCAL:
+            case OpCode::LOAD_LOCAL_CHECKED:
+                ok = push(locals[instr.a]);
+                break;
+            case OpCode::LOAD_UNASSIGNED:
+                ok = push(typeBit(RuntimeType::UNDEFINED));
+                break;
+            case OpCode::STORE_LOCAL:
+                ok = pop(1);
+                if (ok) locals[instr.a] = stack[depth];
+                break;
+            case OpCode::POP:
+            case OpCode::OUTPUT:
+            case OpCode::REDUCE_TERM:
+                ok = pop(1);
+                break;
+            case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV: case OpCode::MOD:
+                ok = pop(2) && push(arithmeticTypes(instr.op, stack[depth], stack[depth + 1]));
+                break;
+            case OpCode::EQ: case OpCode::NE: case OpCode::LT:
+            case OpCode::LE: case OpCode::GT: case OpCode::GE:
+                ok = pop(2) && push(typeBit(RuntimeType::BOOLEAN));
+                break;
+            case OpCode::NEG: {
+                ok = pop(1);
+                TypeSet operand = ok ? stack[depth] : 0;
+                ok = ok && push((operand & ~NUMBER_TYPES) ? ANY_TYPE : operand);
+                break;
+            }
+            case OpCode::NOT:
+                ok = pop(1) && push(typeBit(RuntimeType::BOOLEAN));
+                break;
+            case OpCode::JUMP:
+                fallsThrough = false;
+                jumps = true;
+                break;
+            case OpCode::JUMP_IF_FALSE:
+            case OpCode::JUMP_IF_TRUE:
+                ok = pop(1);
+                jumps = true;
+                break;
+            case OpCode::CALL:
+            case OpCode::CALL_BUILTIN:
+                ok = pop(instr.b) && push(ANY_TYPE);
+                break;
+            case OpCode::MAKE_ARRAY:
+                ok = pop(instr.a) && push(typeBit(RuntimeType::ARRAY));
+                break;
+            case OpCode::INDEX:
+                ok = pop(2) && push(ANY_TYPE);
+                break;
+            case OpCode::CONCAT_LOCAL: {
+                ok = pop(instr.b);
+                TypeSet target = locals[instr.a];
+                for (int i = 0; ok && i < instr.b; ++i) {
+                    target = arithmeticTypes(OpCode::ADD, target, stack[depth + i]);
+                }
+                locals[instr.a] = target;
+                break;
+            }
+            case OpCode::INPUT:
+                locals[instr.a] = ANY_TYPE;
+                break;
+            case OpCode::ADD_LOCAL_CONST:
+                ok = push(arithmeticTypes(OpCode::ADD, locals[instr.a],
+                                          typeBit(program.constants[instr.b].type)));
+                break;
+            case OpCode::INDEX_LOCAL_LOCAL:
+            case OpCode::INDEX_LOCAL_LOCAL_UNCHECKED:
+                ok = push(ANY_TYPE);
+                break;
+            case OpCode::EQ_JUMP_IF_FALSE: case OpCode::NE_JUMP_IF_FALSE:
+            case OpCode::LT_JUMP_IF_FALSE: case OpCode::LE_JUMP_IF_FALSE:
+            case OpCode::GT_JUMP_IF_FALSE: case OpCode::GE_JUMP_IF_FALSE:
+                ok = pop(2);
+                jumps = true;
+                break;
+            case OpCode::SWITCH_LOCAL:
+                for (int32_t target : function.jumpTables[instr.b].targets) {
+                    ok = ok && merge(target, state);
+                }
+                fallsThrough = false;
+                break;
+            case OpCode::VECTOR_LOOP: {
+                // A kernel that ran the loop left numbers in its outputs,
+                // and an int in the index
+                const KernelCall& call = program.kernels[instr.b];
+                TypeState finished = state;
+                for (int slot : call.outputSlots) finished.slots[slot] = NUMBER_TYPES;
+                finished.slots[call.outputSlots[0]] = INT_TYPE;
+                ok = merge(instr.a, finished);
+                break;
+            }
+            default:
+                // Returns and tail calls end the path; typed opcodes are
+                // never part of the input
+                fallsThrough = false;
+                break;
+        }
+        if (!ok) return false;
+        if (fallsThrough && !merge(pc + 1, state)) return false;
+        if (jumps && !merge(instr.a, state)) return false;
+    }
+
+    code = source;
+    bool typed = false;
+    for (size_t pc = 0; pc < code.size(); ++pc) {
+        const TypeState& state = states[pc];
+        if (state.depth < 0) continue;
+        Instr& instr = code[pc];
+        const TypeSet* stack = state.slots.data() + localCount;
+        TypeSet left = state.depth >= 2 ? stack[state.depth - 2] : 0;
+        TypeSet right = state.depth >= 2 ? stack[state.depth - 1] : 0;
+        bool ints = left == INT_TYPE && right == INT_TYPE;
+        // Any float operand sends both through the double path
+        bool floats = left && right && !(left & ~NUMBER_TYPES) && !(right & ~NUMBER_TYPES) &&
+                      (left == FLOAT_TYPE || right == FLOAT_TYPE);
+        OpCode typedOp = OpCode::COUNT;
+        switch (instr.op) {
+            case OpCode::ADD:
+                typedOp = ints ? OpCode::ADD_INT : floats ? OpCode::ADD_FLOAT : OpCode::COUNT;
+                break;
+            case OpCode::SUB:
+                typedOp = ints ? OpCode::SUB_INT : floats ? OpCode::SUB_FLOAT : OpCode::COUNT;
+                break;
+            case OpCode::MUL:
+                typedOp = ints ? OpCode::MUL_INT : floats ? OpCode::MUL_FLOAT : OpCode::COUNT;
+                break;
+            case OpCode::MOD:
+                if (ints) typedOp = OpCode::MOD_INT;
+                break;
+            case OpCode::ADD_LOCAL_CONST:
+                if (state.slots[instr.a] == INT_TYPE &&
+                    program.constants[instr.b].type == RuntimeType::INTEGER) {
+                    typedOp = OpCode::ADD_LOCAL_CONST_INT;
+                }
+                break;
+            case OpCode::EQ_JUMP_IF_FALSE: case OpCode::NE_JUMP_IF_FALSE:
+            case OpCode::LT_JUMP_IF_FALSE: case OpCode::LE_JUMP_IF_FALSE:
+            case OpCode::GT_JUMP_IF_FALSE: case OpCode::GE_JUMP_IF_FALSE:
+                if (ints) {
+                    typedOp = static_cast<OpCode>(static_cast<int>(OpCode::EQ_INT_JUMP_IF_FALSE) +
+                                                  static_cast<int>(instr.op) -
+                                                  static_cast<int>(OpCode::EQ_JUMP_IF_FALSE));
+                }
+                break;
+            default:
+                break;
+        }
+        if (typedOp != OpCode::COUNT) {
+            instr.op = typedOp;
+            typed = true;
+        }
+    }
+    return typed;
+}
+
+CompiledProgram compileProgram(const ASTProgram& program, bool fuse, bool loopEntries) {
+    CompiledProgram compiled;
+    ProgramBuilder builder(compiled);
+
+    // Indices first, so calls can be resolved regardless of definition order
+    std::vector<std::shared_ptr<ASTFunction>> sources;
+    for (const auto& node : program.functions) {
+        auto func = std::dynamic_pointer_cast<ASTFunction>(node);
+        if (!func) continue;
+        auto existing = compiled.functionIndex.find(func->name);
+        if (existing != compiled.functionIndex.end()) {
+            // Later definitions replace earlier ones, as in Interpreter::execute
+            sources[existing->second] = func;
+            continue;
+        }
+        compiled.functionIndex[func->name] = static_cast<int>(sources.size());
+        sources.push_back(func);
+    }
+
+    compiled.functions.resize(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i) {
+        FunctionCompiler compiler(builder, compiled.functions[i]);
+        compiler.compile(*sources[i]);
+        if (fuse) fuseSuperinstructions(compiled.functions[i]);
+    }
+
+    if (loopEntries) {
+        for (const auto& source : sources) {
+            std::vector<const ASTFor*> loops;
+            collectLoops(source->body, loops);
+            for (const ASTFor* loop : loops) {
+                CompiledFunction entry;
+                FunctionCompiler compiler(builder, entry);
+                compiler.compileLoopEntry(*source, *loop);
+                if (fuse) fuseSuperinstructions(entry);
+                compiled.loopEntries[loop] = static_cast<int>(compiled.functions.size());
+                compiled.functions.push_back(std::move(entry));
+                if (!loop->parallelLoop) continue;
+                CompiledFunction chunkEntry;
+                FunctionCompiler chunkCompiler(builder, chunkEntry);
+                chunkCompiler.compileChunkEntry(*source, *loop);
+                if (fuse) fuseSuperinstructions(chunkEntry);
+                compiled.chunkEntries[loop] = static_cast<int>(compiled.functions.size());
+                compiled.functions.push_back(std::move(chunkEntry));
+            }
+        }
+    }
+    return compiled;
+}
+
+void disassemble(const CompiledProgram& program, const CompiledFunction& function) {
+    std::cout << "Function " << function.name << " (params " << function.paramCount
+              << ", locals " << function.localCount << ", stack " << function.maxStack << ")\n";
+    for (size_t i = 0; i < function.code.size(); ++i) {
+        const Instr& instr = function.code[i];
+        std::cout << "  " << i << ": " << opCodeName(instr.op) << " " << instr.a << " " << instr.b;
+        switch (instr.op) {
+            case OpCode::LOAD_CONST:
+                std::cout << "    ; " << program.constants[instr.a].toString();
+                break;
+            case OpCode::LOAD_LOCAL:
+            case OpCode::STORE_LOCAL:
+            case OpCode::CONCAT_LOCAL:
+            case OpCode::INPUT:
+                std::cout << "    ; " << function.localNames[instr.a];
+                break;
+            case OpCode::LOAD_LOCAL_CHECKED:
+                std::cout << "    ; " << program.names[instr.b];
+                break;
+            case OpCode::SWITCH_LOCAL: {
+                const std::vector<int32_t>& targets = function.jumpTables[instr.b].targets;
+                std::cout << "    ; " << function.localNames[instr.a] << ", else " << targets[0] << ", arms";
+                for (size_t t = 1; t < targets.size(); ++t) std::cout << " " << targets[t];
+                break;
+            }
+            case OpCode::CALL:
+            case OpCode::TAILCALL:
+                std::cout << "    ; " << program.functions[instr.a].name;
+                break;
+            case OpCode::CALL_BUILTIN:
+            case OpCode::LOAD_UNASSIGNED:
+                std::cout << "    ; " << program.names[instr.a];
+                break;
+            case OpCode::REDUCE_TERM:
+                std::cout << "    ; " << program.reductionTerms[instr.a].reduction->variable;
+                break;
+            default:
+                break;
+        }
+        std::cout << "\n";
+    }
+}
@@ -0,0 +1,589 @@
+#include "../include/closure_compiler.h"
+#include "../include/value_ops.h"
+
+static RuntimeValue literalValue(const ASTLiteral& literal) {
+    return std::visit([](const auto& val) -> RuntimeValue {
+        using T = std::decay_t<decltype(val)>;
+        if constexpr (std::is_same_v<T, char>) {
+            return RuntimeValue(std::string(1, val));
+        } else {
+            return RuntimeValue(val);
+        }
+    }, literal.value);
+}
+
+// Compiles the body of one function against the engine's function table
+class ClosureCompiler {
+private:
+    ClosureEngine& engine;
+    std::unordered_map<std::string, int> slots;
+    // Slots assigned on every path to the code being compiled; all of them
+    // after a return, where nothing is reached
+    std::vector<bool> assigned;
+
+    // Slot of a variable that is assigned on every path here, -1 for other
+    // expressions
+    int slotOf(const ASTNodePtr& node) {
+        if (auto identifier = dynamic_cast<ASTIdentifier*>(unwrap(node))) {
+            auto it = slots.find(identifier->name);
+            if (it != slots.end() && assigned[it->second]) return it->second;
+        }
+        return -1;
+    }
+
+    // Slots assigned after both of two paths
+    static std::vector<bool> meet(std::vector<bool> a, const std::vector<bool>& b) {
+        for (size_t i = 0; i < a.size(); ++i) a[i] = a[i] && b[i];
+        return a;
+    }
+
+    template <BinaryOp Op>
+    static ClosureExpr binary(ClosureExpr left, ClosureExpr right) {
+        if constexpr (isComparison(Op)) {
+            return [left, right](ClosureFrame& frame) {
+                RuntimeValue l = left(frame);
+                RuntimeValue r = right(frame);
+                return RuntimeValue(applyComparison(Op, l, r));
+            };
+        } else {
+            return [left, right](ClosureFrame& frame) {
+                RuntimeValue l = left(frame);
+                RuntimeValue r = right(frame);
+                applyArithmetic(Op, l, r);
+                return l;
+            };
+        }
+    }
+
+    // local <op> constant, the shape of most loop counters and tests
+    template <BinaryOp Op>
+    static ClosureExpr binaryLocalConst(int slot, RuntimeValue constant) {
+        if constexpr (isComparison(Op)) {
+            return [slot, constant](ClosureFrame& frame) {
+                return RuntimeValue(applyComparison(Op, frame.locals[slot], constant));
+            };
+        } else {
+            return [slot, constant](ClosureFrame& frame) {
+                RuntimeValue l = frame.locals[slot];
+                applyArithmetic(Op, l, constant);
+                return l;
+            };
+        }
+    }
+
+    template <BinaryOp Op>
+    ClosureExpr binaryFor(const ASTBinaryExpression& node) {
+        int slot = slotOf(node.left);
+        auto constant = dynamic_cast<ASTLiteral*>(unwrap(node.right));
+        if (slot >= 0 && constant) {
+            return binaryLocalConst<Op>(slot, literalValue(*constant));
+        }
+        return binary<Op>(compileExpression(node.left), compileExpression(node.right));
+    }
+
+    ClosureExpr compileBinary(const ASTBinaryExpression& node) {
+        switch (binaryOpFromSymbol(node.op)) {
+            case BinaryOp::ADD: return binaryFor<BinaryOp::ADD>(node);
+            case BinaryOp::SUB: return binaryFor<BinaryOp::SUB>(node);
+            case BinaryOp::MUL: return binaryFor<BinaryOp::MUL>(node);
+            case BinaryOp::DIV: return binaryFor<BinaryOp::DIV>(node);
+            case BinaryOp::MOD: return binaryFor<BinaryOp::MOD>(node);
+            case BinaryOp::EQ: return binaryFor<BinaryOp::EQ>(node);
+            case BinaryOp::NE: return binaryFor<BinaryOp::NE>(node);
+            case BinaryOp::LT: return binaryFor<BinaryOp::LT>(node);
+            case BinaryOp::LE: return binaryFor<BinaryOp::LE>(node);
+            case BinaryOp::GT: return binaryFor<BinaryOp::GT>(node);
+            case BinaryOp::GE: return binaryFor<BinaryOp::GE>(node);
+            default: break;
+        }
+        ClosureExpr left = compileExpression(node.left);
+        ClosureExpr right = compileExpression(node.right);
+        std::string op = node.op;
+        return [left, right, op](ClosureFrame& frame) {
+            RuntimeValue l = left(frame);
+            RuntimeValue r = right(frame);
+            return performBinaryOperation(l, r, op);
+        };
+    }
+
+    ClosureExpr compileCall(const ASTFunctionCall& node) {
+        auto callee = std::dynamic_pointer_cast<ASTIdentifier>(node.callee);
+        if (!callee) {
+            return [](ClosureFrame&) {
+                runtimeErrors() << "Error: Invalid function call" << std::endl;
+                return RuntimeValue();
+            };
+        }
+
+        std::vector<ClosureExpr> arguments;
+        for (const auto& arg : node.arguments) {
+            arguments.push_back(compileExpression(arg));
+        }
+
+        ClosureEngine* target = &engine;
+        std::string name = callee->name;
+        auto index = engine.functionIndex.find(name);
+        if (!Interpreter::isBuiltinFunction(name) && index != engine.functionIndex.end()) {
+            int function = index->second;
+            return [target, function, arguments](ClosureFrame& frame) {
+                std::vector<RuntimeValue> args;
+                args.reserve(arguments.size());
+                for (const auto& arg : arguments) args.push_back(arg(frame));
+                return target->call(function, args);
+            };
+        }
+
+        return [target, name, arguments](ClosureFrame& frame) {
+            std::vector<RuntimeValue> args;
+            args.reserve(arguments.size());
+            for (const auto& arg : arguments) args.push_back(arg(frame));
+            RuntimeValue result;
+            if (!target->host.handleBuiltinFunction(name, args, result)) {
+                runtimeErrors() << "Error: Undefined function '" << name << "'" << std::endl;
+            }
+            return result;
+        };
+    }
+
+    ClosureExpr compileExpression(const ASTNodePtr& expr) {
+        ASTNode* node = unwrap(expr);
+
+        if (auto literal = dynamic_cast<ASTLiteral*>(node)) {
+            RuntimeValue value = literalValue(*literal);
+            return [value](ClosureFrame&) { return value; };
+        }
+
+        if (auto identifier = dynamic_cast<ASTIdentifier*>(node)) {
+            auto it = slots.find(identifier->name);
+            if (it == slots.end()) {
+                std::string name = identifier->name;
+                return [name](ClosureFrame&) {
+                    runtimeErrors() << "Error: Undefined variable '" << name << "'" << std::endl;
+                    return RuntimeValue();
+                };
+            }
+            int slot = it->second;
+            if (assigned[slot]) {
+                return [slot](ClosureFrame& frame) { return frame.locals[slot]; };
+            }
+            // Assigned on some paths only, like a missing variable in
+            // Interpreter::getVariable() on the others
+            std::string name = identifier->name;
+            return [slot, name](ClosureFrame& frame) {
+                if (frame.locals[slot].type == RuntimeType::UNDEFINED) {
+                    runtimeErrors() << "Error: Undefined variable '" << name << "'" << std::endl;
+                }
+                return frame.locals[slot];
+            };
+        }
+
+        if (auto binary = dynamic_cast<ASTBinaryExpression*>(node)) {
+            if (binary->op == "&&" || binary->op == "||") {
+                ClosureCond condition = compileCondition(expr);
+                return [condition](ClosureFrame& frame) { return RuntimeValue(condition(frame)); };
+            }
+            return compileBinary(*binary);
+        }
+
+        if (auto unary = dynamic_cast<ASTUnaryExpression*>(node)) {
+            if (unary->op == "!") {
+                ClosureCond condition = compileCondition(unary->operand);
+                return [condition](ClosureFrame& frame) { return RuntimeValue(!condition(frame)); };
+            }
+            ClosureExpr operand = compileExpression(unary->operand);
+            std::string op = unary->op;
+            return [operand, op](ClosureFrame& frame) {
+                return performUnaryOperation(operand(frame), op);
+            };
+        }
+
+        if (auto funcCall = dynamic_cast<ASTFunctionCall*>(node)) {
+            return compileCall(*funcCall);
+        }
+
+        if (auto arrayLit = dynamic_cast<ASTArrayLiteral*>(node)) {
+            std::vector<ClosureExpr> elements;
+            for (const auto& elem : arrayLit->elements) {
+                elements.push_back(compileExpression(elem));
+            }
+            return [elements](ClosureFrame& frame) {
+                std::vector<RuntimeValue> values;
+                values.reserve(elements.size());
+                for (const auto& elem : elements) values.push_back(elem(frame));
+                return RuntimeValue(std::move(values));
+            };
+        }
+
+        if (auto arrayAccess = dynamic_cast<ASTArrayAccess*>(node)) {
+            int slot = slotOf(arrayAccess->array);
+            int indexSlot = slotOf(arrayAccess->index);
+            if (arrayAccess->inBounds && slot >= 0 && indexSlot >= 0) {
+                // The index is an int in range, see eliminateBoundsChecks()
+                return [slot, indexSlot](ClosureFrame& frame) {
+                    const RuntimeValue& array = frame.locals[slot];
+                    if (array.type == RuntimeType::ARRAY) return (*array.arrayValue)[frame.locals[indexSlot].intValue];
+                    return indexValue(array, frame.locals[indexSlot]);
+                };
+            }
+            ClosureExpr index = compileExpression(arrayAccess->index);
+            if (slot >= 0) {
+                // Index the local in place instead of copying the array out
+                return [slot, index](ClosureFrame& frame) {
+                    RuntimeValue idx = index(frame);
+                    return indexValue(frame.locals[slot], idx);
+                };
+            }
+            ClosureExpr array = compileExpression(arrayAccess->array);
+            return [array, index](ClosureFrame& frame) {
+                RuntimeValue arr = array(frame);
+                RuntimeValue idx = index(frame);
+                return indexValue(arr, idx);
+            };
+        }
+
+        return [](ClosureFrame&) {
+            runtimeErrors() << "Error: Unknown expression type" << std::endl;
+            return RuntimeValue();
+        };
+    }
+
+    // Same short-circuit rules as Interpreter::evaluateCondition
+    ClosureCond compileCondition(const ASTNodePtr& expr) {
+        ASTNode* node = unwrap(expr);
+        if (auto binary = dynamic_cast<ASTBinaryExpression*>(node)) {
+            if (binary->op == "&&") {
+                ClosureCond left = compileCondition(binary->left);
+                ClosureCond right = compileCondition(binary->right);
+                return [left, right](ClosureFrame& frame) { return left(frame) && right(frame); };
+            }
+            if (binary->op == "||") {
+                ClosureCond left = compileCondition(binary->left);
+                ClosureCond right = compileCondition(binary->right);
+                return [left, right](ClosureFrame& frame) { return left(frame) || right(frame); };
+            }
+        } else if (auto unary = dynamic_cast<ASTUnaryExpression*>(node)) {
+            if (unary->op == "!") {
+                ClosureCond operand = compileCondition(unary->operand);
+                return [operand](ClosureFrame& frame) { return !operand(frame); };
+            }
+        }
+        ClosureExpr value = compileExpression(expr);
+        return [value](ClosureFrame& frame) { return isTruthy(value(frame)); };
+    }
+
+    // "s = s + a + b ..." - see Interpreter::appendInPlace
+    bool compileAppend(const ASTAssignment& assignment, ClosureStmt& result) {
+        std::vector<const ASTNodePtr*> pieces;
+        ASTNode* node = assignment.expression.get();
+        while (true) {
+            if (auto grouped = dynamic_cast<ASTGroupedExpression*>(node)) {
+                node = grouped->expression.get();
+                continue;
+            }
+            auto binary = dynamic_cast<ASTBinaryExpression*>(node);
+            if (!binary || binary->op != "+") break;
+            pieces.push_back(&binary->right);
+            node = binary->left.get();
+        }
+        auto base = dynamic_cast<ASTIdentifier*>(node);
+        if (pieces.empty() || !base || base->name != assignment.variable) return false;
+        if (!assigned[slots.at(assignment.variable)]) return false;
+
+        std::vector<ClosureExpr> compiled;
+        for (auto it = pieces.rbegin(); it != pieces.rend(); ++it) {
+            compiled.push_back(compileExpression(**it));
+        }
+        int slot = slots.at(assignment.variable);
+
+        if (compiled.size() == 1) {
+            ClosureExpr piece = compiled[0];
+            result = [slot, piece](ClosureFrame& frame) {
+                RuntimeValue value = piece(frame);
+                RuntimeValue& target = frame.locals[slot];
+                if (target.type == RuntimeType::STRING && value.type == RuntimeType::STRING) {
+                    target.ownString().append(*value.stringValue);
+                } else {
+                    applyArithmetic(BinaryOp::ADD, target, value);
+                }
+                return false;
+            };
+            return true;
+        }
+
+        result = [slot, compiled](ClosureFrame& frame) {
+            std::vector<RuntimeValue> values;
+            values.reserve(compiled.size());
+            for (const auto& piece : compiled) values.push_back(piece(frame));
+            RuntimeValue& target = frame.locals[slot];
+            size_t i = 0;
+            if (target.type == RuntimeType::STRING) {
+                while (i < values.size() && values[i].type == RuntimeType::STRING) {
+                    target.ownString().append(*values[i].stringValue);
+                    i++;
+                }
+            }
+            for (; i < values.size(); i++) {
+                applyArithmetic(BinaryOp::ADD, target, values[i]);
+            }
+            return false;
+        };
+        return true;
+    }
+
+    // Native run of a vectorized loop, true when it ran the whole loop; empty
+    // when the loop has no kernel or reads names that never get a slot
+    ClosureCond compileKernel(const ASTFor& loop) {
+        if (!loop.kernel) return nullptr;
+        std::vector<int> inputSlots;
+        std::vector<int> outputSlots;
+        for (const auto& name : loop.kernel->inputs) {
+            auto it = slots.find(name);
+            if (it == slots.end() || !assigned[it->second]) return nullptr;
+            inputSlots.push_back(it->second);
+        }
+        for (const auto& name : loop.kernel->outputs) {
+            outputSlots.push_back(slots.at(name));
+        }
+        std::shared_ptr<const VectorKernel> kernel = loop.kernel;
+        return [kernel, inputSlots, outputSlots](ClosureFrame& frame) {
+            return kernel->runOnSlots(frame.locals, inputSlots, outputSlots);
+        };
+    }
+
+    // One table lookup instead of the chain's tests
+    ClosureStmt compileSwitch(std::shared_ptr<const SwitchTable> table) {
+        int slot = slots.at(table->variable);
+        std::vector<bool> before = assigned;
+        std::vector<bool> after = assigned;
+        std::vector<ClosureStmt> arms;
+        for (size_t i = 0; i < table->arms.size(); ++i) {
+            assigned = before;
+            arms.push_back(compileStatement(table->arms[i]));
+            after = i == 0 ? assigned : meet(std::move(after), assigned);
+        }
+        assigned = before;
+        ClosureStmt otherwise = table->otherwise ? compileStatement(table->otherwise) : nullptr;
+        assigned = table->arms.empty() ? assigned : meet(std::move(after), assigned);
+        return [table, slot, arms, otherwise](ClosureFrame& frame) {
+            int arm = table->lookup(frame.locals[slot]);
+            if (arm >= 0) return arms[arm](frame);
+            return otherwise ? otherwise(frame) : false;
+        };
+    }
+
+    ClosureStmt compileStatement(const ASTNodePtr& stmt) {
+        if (!stmt) {
+            return [](ClosureFrame&) { return false; };
+        }
+
+        if (auto assignment = std::dynamic_pointer_cast<ASTAssignment>(stmt)) {
+            ClosureStmt append;
+            if (compileAppend(*assignment, append)) return append;
+            int slot = slots.at(assignment->variable);
+            ClosureExpr value = compileExpression(assignment->expression);
+            assigned[slot] = true;
+            return [slot, value](ClosureFrame& frame) {
+                frame.locals[slot] = value(frame);
+                return false;
+            };
+        }
+
+        if (auto input = std::dynamic_pointer_cast<ASTInput>(stmt)) {
+            int slot = slots.at(input->variable);
+            assigned[slot] = true;
+            Interpreter* host = &engine.host;
+            return [slot, host](ClosureFrame& frame) {
+                frame.locals[slot] = host->handleInput();
+                return false;
+            };
+        }
+
+        if (auto output = std::dynamic_pointer_cast<ASTOutput>(stmt)) {
+            ClosureExpr value = compileExpression(output->expression);
+            Interpreter* host = &engine.host;
+            return [value, host](ClosureFrame& frame) {
+                host->handleOutput(value(frame));
+                return false;
+            };
+        }
+
+        if (auto returnStmt = std::dynamic_pointer_cast<ASTReturn>(stmt)) {
+            // Nothing after the return is reached
+            std::vector<bool> after(assigned.size(), true);
+            if (!returnStmt->expression) {
+                assigned = std::move(after);
+                return [](ClosureFrame& frame) {
+                    frame.returnValue = RuntimeValue();
+                    return true;
+                };
+            }
+            ClosureExpr value = compileExpression(returnStmt->expression);
+            assigned = std::move(after);
+            return [value](ClosureFrame& frame) {
+                frame.returnValue = value(frame);
+                return true;
+            };
+        }
+
+        if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(stmt)) {
+            auto variable = ifStmt->switchTable ? slots.find(ifStmt->switchTable->variable) : slots.end();
+            if (variable != slots.end() && assigned[variable->second]) {
+                return compileSwitch(ifStmt->switchTable);
+            }
+            ClosureCond condition = compileCondition(ifStmt->condition);
+            std::vector<bool> before = assigned;
+            ClosureStmt thenBlock = compileStatement(ifStmt->thenBlock);
+            if (!ifStmt->elseBlock) {
+                assigned = meet(std::move(before), assigned);
+                return [condition, thenBlock](ClosureFrame& frame) {
+                    return condition(frame) && thenBlock(frame);
+                };
+            }
+            std::vector<bool> afterThen = std::move(assigned);
+            assigned = std::move(before);
+            ClosureStmt elseBlock = compileStatement(ifStmt->elseBlock);
+            assigned = meet(std::move(afterThen), assigned);
+            return [condition, thenBlock, elseBlock](ClosureFrame& frame) {
+                return condition(frame) ? thenBlock(frame) : elseBlock(frame);
+            };
+        }
+
+        if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(stmt)) {
+            ClosureStmt init = compileStatement(forStmt->init);
+            ClosureCond condition = compileCondition(forStmt->condition);
+            // The body may not run at all
+            std::vector<bool> before = assigned;
+            ClosureStmt body = compileStatement(forStmt->body);
+            ClosureStmt increment = compileStatement(forStmt->increment);
+            assigned = std::move(before);
+            if (ClosureCond kernel = compileKernel(*forStmt)) {
+                return [init, kernel, condition, body, increment](ClosureFrame& frame) {
+                    init(frame);
+                    if (kernel(frame)) return false;
+                    while (condition(frame)) {
+                        if (body(frame)) return true;
+                        increment(frame);
+                    }
+                    return false;
+                };
+            }
+            return [init, condition, body, increment](ClosureFrame& frame) {
+                init(frame);
+                while (condition(frame)) {
+                    if (body(frame)) return true;
+                    increment(frame);
+                }
+                return false;
+            };
+        }
+
+        if (auto block = std::dynamic_pointer_cast<ASTBlock>(stmt)) {
+            std::vector<ClosureStmt> statements;
+            for (const auto& s : block->statements) {
+                statements.push_back(compileStatement(s));
+            }
+            if (statements.size() == 1) return statements[0];
+            return [statements](ClosureFrame& frame) {
+                for (const auto& s : statements) {
+                    if (s(frame)) return true;
+                }
+                return false;
+            };
+        }
+
+        return [](ClosureFrame&) {
+            runtimeErrors() << "Error: Unknown statement type" << std::endl;
+            return false;
+        };
+    }
+
+public:
+    explicit ClosureCompiler(ClosureEngine& engine) : engine(engine) {}
+
+    void compile(const ASTFunction& source, ClosureFunction& function) {
+        std::vector<std::string> names = collectLocalNames(source);
+        for (size_t i = 0; i < names.size(); ++i) {
+            slots[names[i]] = static_cast<int>(i);
+        }
+        function.name = source.name;
+        function.paramCount = static_cast<int>(source.parameters.size());
+        function.localCount = static_cast<int>(names.size());
+        assigned.assign(names.size(), false);
+        for (const auto& param : source.parameters) assigned[slots.at(param)] = true;
+        function.body = compileStatement(source.body);
+    }
+};
+
+ClosureEngine::ClosureEngine(const ASTProgram& program) {
+    std::vector<std::shared_ptr<ASTFunction>> sources;
+    for (const auto& node : program.functions) {
+        auto func = std::dynamic_pointer_cast<ASTFunction>(node);
+        if (!func) continue;
+        auto existing = functionIndex.find(func->name);
+        if (existing != functionIndex.end()) {
+            sources[existing->second] = func;
+            continue;
+        }
+        functionIndex[func->name] = static_cast<int>(sources.size());
+        sources.push_back(func);
+    }
+
+    functions.resize(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i) {
+        ClosureCompiler compiler(*this);
+        compiler.compile(*sources[i], functions[i]);
+    }
+}
+
+void ClosureEngine::execute() {
+    PayloadPoolScope poolScope(pool);
+
+    auto main = functionIndex.find("main");
+    if (main == functionIndex.end()) {
+        runtimeErrors() << "Error: No main function found!" << std::endl;
+        return;
+    }
+    std::cout << "=== Executing Program ===" << std::endl;
+    std::vector<RuntimeValue> args;
+    call(main->second, args);
+}
+
+RuntimeValue ClosureEngine::call(int index, std::vector<RuntimeValue>& args) {
+    const ClosureFunction& function = functions[index];
+    if (static_cast<int>(args.size()) != function.paramCount) {
+        runtimeErrors() << "Error: Function '" << function.name << "' expects " << function.paramCount
+                  << " arguments, got " << args.size() << std::endl;
+        return RuntimeValue();
+    }
+
+    MemoTable* memo = memoTables.empty() ? nullptr : memoTables[index].get();
+    if (memo) {
+        RuntimeValue cached;
+        if (!MemoTable::memoizable(args.data(), args.size())) {
+            memo = nullptr;
+        } else if (memo->lookup(args.data(), args.size(), cached)) {
+            return cached;
+        }
+    }
+
+    std::vector<RuntimeValue> locals(function.localCount);
+    for (size_t i = 0; i < args.size(); ++i) {
+        locals[i] = memo ? args[i] : std::move(args[i]);
+    }
+    ClosureFrame frame{locals.data(), RuntimeValue()};
+    bool returned = function.body(frame);
+    if (memo) memo->store(args.data(), args.size(), frame.returnValue);
+    if (returned) {
+        return std::move(frame.returnValue);
+    }
+    return RuntimeValue();
+}
+
+void ClosureEngine::enableMemoization(const std::unordered_set<std::string>& names, size_t capacity) {
+    memoTables.clear();
+    memoTables.resize(functions.size());
+    for (const auto& name : names) {
+        auto it = functionIndex.find(name);
+        if (it != functionIndex.end()) memoTables[it->second] = std::make_unique<MemoTable>(capacity);
+    }
+}
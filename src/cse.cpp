@@ -0,0 +1,272 @@
+#include "../include/cse.h"
+#include <functional>
+#include <map>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+
+bool isLogical(const std::string& op) {
+    return op == "&&" || op == "||";
+}
+
+// These give the same result with their operands swapped under every
+// coercion rule. + does not: on two strings it concatenates.
+bool isCommutative(const std::string& op) {
+    return op == "*" || op == "==" || op == "!=";
+}
+
+// Structural key of an expression, false when it cannot be shared (calls,
+// array literals, short-circuit operators). reads collects its variables.
+bool expressionKey(const ASTNodePtr& node, std::string& key, std::set<std::string>& reads) {
+    if (auto literal = std::dynamic_pointer_cast<ASTLiteral>(node)) {
+        // Type tags keep 1, 1.0 and "1" apart
+        std::ostringstream out;
+        std::visit([&](const auto& val) { out << literal->value.index() << ':' << val; }, literal->value);
+        std::string text = out.str();
+        key = std::to_string(text.size()) + "#" + text;
+        return true;
+    }
+    if (auto identifier = std::dynamic_pointer_cast<ASTIdentifier>(node)) {
+        key = "$" + identifier->name + ";";
+        reads.insert(identifier->name);
+        return true;
+    }
+    if (auto grouped = std::dynamic_pointer_cast<ASTGroupedExpression>(node)) {
+        return expressionKey(grouped->expression, key, reads);
+    }
+    if (auto unary = std::dynamic_pointer_cast<ASTUnaryExpression>(node)) {
+        std::string operand;
+        if (!expressionKey(unary->operand, operand, reads)) return false;
+        key = "(" + unary->op + " " + operand + ")";
+        return true;
+    }
+    if (auto binary = std::dynamic_pointer_cast<ASTBinaryExpression>(node)) {
+        if (isLogical(binary->op)) return false;
+        std::string left, right;
+        if (!expressionKey(binary->left, left, reads) || !expressionKey(binary->right, right, reads)) return false;
+        if (isCommutative(binary->op) && right < left) std::swap(left, right);
+        key = "(" + left + " " + binary->op + " " + right + ")";
+        return true;
+    }
+    if (auto arrayAccess = std::dynamic_pointer_cast<ASTArrayAccess>(node)) {
+        std::string array, index;
+        if (!expressionKey(arrayAccess->array, array, reads) || !expressionKey(arrayAccess->index, index, reads)) {
+            return false;
+        }
+        key = "[" + array + " " + index + "]";
+        return true;
+    }
+    return false;
+}
+
+// Calls visit on node and, while it returns true, on every subexpression
+// that is evaluated whenever node is: not the right side of && and ||
+void visitUnconditional(ASTNodePtr& node, const std::function<bool(ASTNodePtr&)>& visit) {
+    if (!node || !visit(node)) return;
+    if (auto binary = std::dynamic_pointer_cast<ASTBinaryExpression>(node)) {
+        visitUnconditional(binary->left, visit);
+        if (!isLogical(binary->op)) visitUnconditional(binary->right, visit);
+    } else if (auto unary = std::dynamic_pointer_cast<ASTUnaryExpression>(node)) {
+        visitUnconditional(unary->operand, visit);
+    } else if (auto grouped = std::dynamic_pointer_cast<ASTGroupedExpression>(node)) {
+        visitUnconditional(grouped->expression, visit);
+    } else if (auto arrayLit = std::dynamic_pointer_cast<ASTArrayLiteral>(node)) {
+        for (auto& elem : arrayLit->elements) visitUnconditional(elem, visit);
+    } else if (auto arrayAccess = std::dynamic_pointer_cast<ASTArrayAccess>(node)) {
+        visitUnconditional(arrayAccess->array, visit);
+        visitUnconditional(arrayAccess->index, visit);
+    } else if (auto funcCall = std::dynamic_pointer_cast<ASTFunctionCall>(node)) {
+        for (auto& arg : funcCall->arguments) visitUnconditional(arg, visit);
+    }
+}
+
+// The expression a statement evaluates before anything else happens.
+// Loop conditions run again after the body, so for loops have none here.
+ASTNodePtr* statementExpression(const ASTNodePtr& stmt) {
+    if (auto assignment = std::dynamic_pointer_cast<ASTAssignment>(stmt)) return &assignment->expression;
+    if (auto output = std::dynamic_pointer_cast<ASTOutput>(stmt)) return &output->expression;
+    if (auto returnStmt = std::dynamic_pointer_cast<ASTReturn>(stmt)) return &returnStmt->expression;
+    if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(stmt)) return &ifStmt->condition;
+    return nullptr;
+}
+
+// The "s = s + a + b" shape is appended in place by the engines, so the
+// partial sums along its left spine must stay where they are
+void appendSpine(const ASTNodePtr& stmt, std::set<const ASTNode*>& spine) {
+    auto assignment = std::dynamic_pointer_cast<ASTAssignment>(stmt);
+    if (!assignment) return;
+    std::vector<const ASTNode*> nodes;
+    ASTNode* node = assignment->expression.get();
+    while (true) {
+        if (auto grouped = dynamic_cast<ASTGroupedExpression*>(node)) {
+            node = grouped->expression.get();
+            continue;
+        }
+        auto binary = dynamic_cast<ASTBinaryExpression*>(node);
+        if (!binary || binary->op != "+") break;
+        nodes.push_back(binary);
+        node = binary->left.get();
+    }
+    auto base = dynamic_cast<ASTIdentifier*>(node);
+    if (base && base->name == assignment->variable) spine.insert(nodes.begin(), nodes.end());
+}
+
+// Optimizes the blocks of one function; temporaries are numbered per function
+class BlockOptimizer {
+private:
+    int nextTemp;
+    int shared;
+
+    void optimizeBlock(ASTBlock& block);
+
+public:
+    BlockOptimizer() : nextTemp(0), shared(0) {}
+
+    // Every block nested in stmt, innermost first
+    int optimize(const ASTNodePtr& stmt) {
+        if (auto block = std::dynamic_pointer_cast<ASTBlock>(stmt)) {
+            for (const auto& s : block->statements) optimize(s);
+            optimizeBlock(*block);
+        } else if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(stmt)) {
+            optimize(ifStmt->thenBlock);
+            optimize(ifStmt->elseBlock);
+        } else if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(stmt)) {
+            optimize(forStmt->body);
+        }
+        return shared;
+    }
+};
+
+void BlockOptimizer::optimizeBlock(ASTBlock& block) {
+    std::vector<ASTNodePtr>& statements = block.statements;
+
+    // Pass 1: name every candidate occurrence after its expression and the
+    // assignments its variables have seen so far in the block, and count
+    std::map<std::string, int> generation;
+    std::unordered_map<const ASTNodePtr*, std::string> groupOf;
+    std::map<std::string, int> counts;
+    for (const auto& stmt : statements) {
+        if (ASTNodePtr* root = statementExpression(stmt)) {
+            std::set<const ASTNode*> spine;
+            appendSpine(stmt, spine);
+            visitUnconditional(*root, [&](ASTNodePtr& node) {
+                bool operation = std::dynamic_pointer_cast<ASTBinaryExpression>(node) ||
+                                 std::dynamic_pointer_cast<ASTUnaryExpression>(node) ||
+                                 std::dynamic_pointer_cast<ASTArrayAccess>(node);
+                if (!operation || spine.count(node.get())) return true;
+                std::string key;
+                std::set<std::string> reads;
+                // Constant expressions are cheap enough as they are
+                if (!expressionKey(node, key, reads) || reads.empty()) return true;
+                for (const auto& name : reads) {
+                    key += "@" + std::to_string(generation[name]);
+                }
+                groupOf[&node] = key;
+                counts[key]++;
+                return true;
+            });
+        }
+        for (const auto& name : collectAssignedNames(stmt)) generation[name]++;
+    }
+
+    // Pass 2: outermost repeated occurrences win, in evaluation order
+    struct Group {
+        size_t firstStatement;
+        std::vector<ASTNodePtr*> slots;
+    };
+    std::map<std::string, Group> groups;
+    std::vector<std::string> order;
+    for (size_t i = 0; i < statements.size(); ++i) {
+        ASTNodePtr* root = statementExpression(statements[i]);
+        if (!root) continue;
+        visitUnconditional(*root, [&](ASTNodePtr& node) {
+            auto group = groupOf.find(&node);
+            if (group == groupOf.end() || counts[group->second] < 2) return true;
+            auto inserted = groups.emplace(group->second, Group{i, {}});
+            if (inserted.second) order.push_back(group->second);
+            inserted.first->second.slots.push_back(&node);
+            return false;
+        });
+    }
+
+    // Pass 3: the temporary is computed before the whole statement, so the
+    // first occurrence has to be the first thing there that can call,
+    // print or fail; reading variables aside
+    std::unordered_map<const ASTNodePtr*, std::string> groupAt;
+    for (const auto& key : order) {
+        const Group& group = groups[key];
+        // Its other occurrences were inside larger shared expressions
+        if (group.slots.size() < 2) continue;
+        for (ASTNodePtr* slot : group.slots) groupAt[slot] = key;
+    }
+    std::set<std::string> hoistable;
+    for (const auto& stmt : statements) {
+        ASTNodePtr* root = statementExpression(stmt);
+        if (!root) continue;
+        bool clean = true;
+        std::function<void(ASTNodePtr&)> walk = [&](ASTNodePtr& node) {
+            if (!node) return;
+            auto at = groupAt.find(&node);
+            if (at != groupAt.end()) {
+                if (groups[at->second].slots[0] == &node && clean) hoistable.insert(at->second);
+                // Reads the temporary
+                if (hoistable.count(at->second)) return;
+            }
+            if (std::dynamic_pointer_cast<ASTLiteral>(node) || std::dynamic_pointer_cast<ASTIdentifier>(node)) return;
+            if (auto grouped = std::dynamic_pointer_cast<ASTGroupedExpression>(node)) {
+                walk(grouped->expression);
+                return;
+            }
+            // Operands in the order they are evaluated, then the operation
+            if (auto binary = std::dynamic_pointer_cast<ASTBinaryExpression>(node)) {
+                walk(binary->left);
+                walk(binary->right);
+            } else if (auto unary = std::dynamic_pointer_cast<ASTUnaryExpression>(node)) {
+                walk(unary->operand);
+            } else if (auto arrayLit = std::dynamic_pointer_cast<ASTArrayLiteral>(node)) {
+                for (auto& elem : arrayLit->elements) walk(elem);
+            } else if (auto arrayAccess = std::dynamic_pointer_cast<ASTArrayAccess>(node)) {
+                walk(arrayAccess->array);
+                walk(arrayAccess->index);
+            } else if (auto funcCall = std::dynamic_pointer_cast<ASTFunctionCall>(node)) {
+                for (auto& arg : funcCall->arguments) walk(arg);
+            }
+            clean = false;
+        };
+        walk(*root);
+    }
+
+    std::vector<std::vector<ASTNodePtr>> hoisted(statements.size());
+    for (const auto& key : order) {
+        Group& group = groups[key];
+        if (!hoistable.count(key)) continue;
+        std::string temp = "$cse" + std::to_string(nextTemp++);
+        hoisted[group.firstStatement].push_back(std::make_shared<ASTAssignment>(temp, *group.slots[0]));
+        for (ASTNodePtr* slot : group.slots) {
+            *slot = std::make_shared<ASTIdentifier>(temp);
+        }
+        shared++;
+    }
+
+    std::vector<ASTNodePtr> rewritten;
+    for (size_t i = 0; i < statements.size(); ++i) {
+        for (auto& assignment : hoisted[i]) rewritten.push_back(std::move(assignment));
+        rewritten.push_back(std::move(statements[i]));
+    }
+    statements = std::move(rewritten);
+}
+
+} // namespace
+
+int eliminateCommonSubexpressions(ASTProgram& program) {
+    int shared = 0;
+    for (const auto& node : program.functions) {
+        if (auto func = std::dynamic_pointer_cast<ASTFunction>(node)) {
+            BlockOptimizer optimizer;
+            shared += optimizer.optimize(func->body);
+        }
+    }
+    return shared;
+}
@@ -0,0 +1,107 @@
+#include "../include/driver.h"
+#include "../include/ast_generator.h"
+#include "../include/bounds_check.h"
+#include "../include/bytecode.h"
+#include "../include/cse.h"
+#include "../include/image.h"
+#include "../include/parallel.h"
+#include "../include/parser.h"
+#include "../include/switch_table.h"
+#include "../include/thread_pool.h"
+#include "../include/tokenizer.h"
+#include "../include/vectorize.h"
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+namespace {
+
+struct FileResult {
+    std::string diagnostics;
+    bool ok = false;
+    bool done = false;
+};
+
+// path with its extension replaced by .pcb
+std::string imagePathFor(const std::string& path) {
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path + ".pcb";
+    return path.substr(0, dot) + ".pcb";
+}
+
+// The steps main takes before running a file, but partial evaluation,
+// which runs the program's own code. With emitImage the bytecode is saved
+// next to the file.
+bool compileFile(const std::string& path, bool emitImage, std::ostream& errors) {
+    std::ifstream in(path);
+    if (!in) {
+        errors << "Failed to open file: " << path << "\n";
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    std::string source = buffer.str();
+    std::vector<GenericToken> tokens = tokenizeSource(source, errors);
+
+    for (const auto& token : tokens) {
+        if (token.type == TOKEN_ERROR) {
+            errors << "Error at position " << token.error.position << ": " << token.error.message << "\n";
+        }
+    }
+    if (!Parser(tokens, source, errors).parse()) {
+        errors << "Parsing failed!\n";
+        return false;
+    }
+    auto ast = ASTBuilder(tokens, errors).build();
+    if (!ast) {
+        errors << "AST generation failed!\n";
+        return false;
+    }
+    eliminateCommonSubexpressions(*ast);
+    eliminateBoundsChecks(*ast);
+    vectorizeLoops(*ast);
+    buildSwitchTables(*ast);
+    bool ok = checkParallelLoops(*ast, errors);
+    ok = checkSpawns(*ast, errors) && ok;
+    if (!ok) return false;
+    CompiledProgram compiled = compileProgram(*ast);
+    return !emitImage || saveImage(compiled, imagePathFor(path), errors);
+}
+
+} // namespace
+
+int compileFiles(const std::vector<std::string>& paths, unsigned jobs, bool emitImages) {
+    std::vector<FileResult> results(paths.size());
+    std::mutex doneLock;
+    std::condition_variable doneSignal;
+    {
+        WorkStealingPool pool(jobs);
+        for (size_t i = 0; i < paths.size(); ++i) {
+            pool.push(static_cast<unsigned>(i), [&, i](unsigned) {
+                std::ostringstream errors;
+                bool ok = compileFile(paths[i], emitImages, errors);
+                std::lock_guard<std::mutex> guard(doneLock);
+                results[i].diagnostics = errors.str();
+                results[i].ok = ok;
+                results[i].done = true;
+                doneSignal.notify_all();
+            });
+        }
+
+        // Reported in order while later files are still compiling
+        for (size_t i = 0; i < paths.size(); ++i) {
+            std::unique_lock<std::mutex> lock(doneLock);
+            doneSignal.wait(lock, [&] { return results[i].done; });
+            std::cerr << results[i].diagnostics;
+            std::cout << paths[i] << (results[i].ok ? ": ok" : ": failed") << std::endl;
+        }
+    }
+
+    size_t failed = 0;
+    for (const auto& result : results) failed += result.ok ? 0 : 1;
+    std::cout << "Compiled " << paths.size() - failed << " of " << paths.size() << " files" << std::endl;
+    return failed > 0 ? 1 : 0;
+}
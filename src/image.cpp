@@ -0,0 +1,675 @@
+#include "../include/image.h"
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+const char IMAGE_MAGIC[4] = {'P', 'C', 'B', '\0'};
+// Magic, version, payload size, checksum
+const size_t HEADER_SIZE = 4 + 4 + 8 + 8;
+
+uint64_t littleEndian(const char* bytes, int count) {
+    uint64_t value = 0;
+    for (int i = 0; i < count; ++i) value |= static_cast<uint64_t>(static_cast<uint8_t>(bytes[i])) << (8 * i);
+    return value;
+}
+
+uint64_t checksum(const char* data, size_t length) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < length; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+// Operand a is a jump target
+bool jumpsTo(OpCode op) {
+    switch (op) {
+        case OpCode::JUMP:
+        case OpCode::JUMP_IF_FALSE:
+        case OpCode::JUMP_IF_TRUE:
+        case OpCode::EQ_JUMP_IF_FALSE: case OpCode::NE_JUMP_IF_FALSE:
+        case OpCode::LT_JUMP_IF_FALSE: case OpCode::LE_JUMP_IF_FALSE:
+        case OpCode::GT_JUMP_IF_FALSE: case OpCode::GE_JUMP_IF_FALSE:
+        case OpCode::EQ_INT_JUMP_IF_FALSE: case OpCode::NE_INT_JUMP_IF_FALSE:
+        case OpCode::LT_INT_JUMP_IF_FALSE: case OpCode::LE_INT_JUMP_IF_FALSE:
+        case OpCode::GT_INT_JUMP_IF_FALSE: case OpCode::GE_INT_JUMP_IF_FALSE:
+        case OpCode::VECTOR_LOOP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+// Little-endian fields appended to a byte string
+class ImageWriter {
+private:
+    std::string bytes;
+
+    void u8(uint8_t value) { bytes += static_cast<char>(value); }
+
+    void u32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) u8(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    void i32(int32_t value) { u32(static_cast<uint32_t>(value)); }
+
+    void u64(uint64_t value) {
+        for (int i = 0; i < 8; ++i) u8(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    void f64(double value) {
+        uint64_t raw;
+        std::memcpy(&raw, &value, sizeof(raw));
+        u64(raw);
+    }
+
+    void string(const std::string& text) {
+        u32(static_cast<uint32_t>(text.size()));
+        bytes += text;
+    }
+
+    void strings(const std::vector<std::string>& texts) {
+        u32(static_cast<uint32_t>(texts.size()));
+        for (const auto& text : texts) string(text);
+    }
+
+    void ints(const std::vector<int>& values) {
+        u32(static_cast<uint32_t>(values.size()));
+        for (int value : values) i32(value);
+    }
+
+    bool constant(const RuntimeValue& value) {
+        u8(static_cast<uint8_t>(value.type));
+        switch (value.type) {
+            case RuntimeType::INTEGER: i32(value.intValue); return true;
+            case RuntimeType::FLOAT: f64(value.floatValue); return true;
+            case RuntimeType::BOOLEAN: u8(value.boolValue ? 1 : 0); return true;
+            case RuntimeType::STRING: string(*value.stringValue); return true;
+            case RuntimeType::UNDEFINED: return true;
+            default: return false;
+        }
+    }
+
+    void table(const SwitchTable& table) {
+        string(table.variable);
+        i32(static_cast<int32_t>(table.arms.size()));
+        u32(static_cast<uint32_t>(table.intArms.size()));
+        for (const auto& [key, arm] : table.intArms) {
+            i32(key);
+            i32(arm);
+        }
+        ints(table.dense);
+        i32(table.denseBase);
+        u32(static_cast<uint32_t>(table.stringArms.size()));
+        for (const auto& [key, arm] : table.stringArms) {
+            string(key);
+            i32(arm);
+        }
+        u32(static_cast<uint32_t>(table.stringNumbers.size()));
+        for (const auto& [key, arm] : table.stringNumbers) {
+            f64(key);
+            i32(arm);
+        }
+    }
+
+    void kernel(const VectorKernel& kernel) {
+        strings(kernel.inputs);
+        strings(kernel.outputs);
+        u32(static_cast<uint32_t>(kernel.nodes.size()));
+        for (const auto& node : kernel.nodes) {
+            u8(static_cast<uint8_t>(node.kind));
+            u8(static_cast<uint8_t>(node.op));
+            i32(node.left);
+            i32(node.right);
+            i32(node.input);
+            f64(node.constant);
+            u8(node.intConstant ? 1 : 0);
+        }
+        u32(static_cast<uint32_t>(kernel.accumulators.size()));
+        for (const auto& accumulator : kernel.accumulators) {
+            i32(accumulator.input);
+            u32(static_cast<uint32_t>(accumulator.terms.size()));
+            for (const auto& term : accumulator.terms) {
+                i32(term.node);
+                u8(term.subtract ? 1 : 0);
+            }
+        }
+        ints(kernel.temporaries);
+        u8(kernel.boundIsLength ? 1 : 0);
+    }
+
+public:
+    bool write(const CompiledProgram& program, std::ostream& errors) {
+        if (!program.loopEntries.empty() || !program.reductionTerms.empty()) {
+            errors << "Error: a program compiled with loop entries cannot be saved" << std::endl;
+            return false;
+        }
+        for (const auto& name : program.names) {
+            if (name == "spawn") {
+                errors << "Error: a program that spawns cannot be saved, spawned calls run on the tree" << std::endl;
+                return false;
+            }
+        }
+
+        // The reader rejects these, see ImageReader::validStack()
+        for (const auto& function : program.functions) {
+            for (const auto& instr : function.code) {
+                if ((instr.op == OpCode::CALL || instr.op == OpCode::TAILCALL) &&
+                    instr.b != program.functions[instr.a].paramCount) {
+                    errors << "Error: '" << function.name << "' calls '" << program.functions[instr.a].name
+                           << "' with " << instr.b << " arguments, it takes "
+                           << program.functions[instr.a].paramCount << "; the program cannot be saved" << std::endl;
+                    return false;
+                }
+            }
+        }
+
+        u32(static_cast<uint32_t>(program.constants.size()));
+        for (const auto& value : program.constants) {
+            if (!constant(value)) {
+                errors << "Error: constant " << value.toString() << " cannot be saved" << std::endl;
+                return false;
+            }
+        }
+        strings(program.names);
+        u32(static_cast<uint32_t>(program.kernels.size()));
+        for (const auto& call : program.kernels) {
+            kernel(*call.kernel);
+            ints(call.inputSlots);
+            ints(call.outputSlots);
+        }
+        u32(static_cast<uint32_t>(program.functions.size()));
+        for (const auto& function : program.functions) {
+            string(function.name);
+            i32(function.paramCount);
+            i32(function.localCount);
+            i32(function.maxStack);
+            strings(function.localNames);
+            u32(static_cast<uint32_t>(function.code.size()));
+            for (const auto& instr : function.code) {
+                u8(static_cast<uint8_t>(instr.op));
+                i32(instr.a);
+                i32(instr.b);
+            }
+            u32(static_cast<uint32_t>(function.jumpTables.size()));
+            for (const auto& jumpTable : function.jumpTables) {
+                table(*jumpTable.table);
+                ints(jumpTable.targets);
+            }
+        }
+        return true;
+    }
+
+    // The header, then the payload
+    std::string image() const {
+        ImageWriter header;
+        header.bytes.append(IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+        header.u32(IMAGE_VERSION);
+        header.u64(bytes.size());
+        header.u64(checksum(bytes.data(), bytes.size()));
+        return header.bytes + bytes;
+    }
+};
+
+// Decodes what ImageWriter wrote. Every read is bounds-checked; after the
+// first one that runs past the end, reads return zeros and read() fails.
+class ImageReader {
+private:
+    const char* data;
+    size_t length;
+    size_t at = 0;
+    bool failed = false;
+
+    bool has(size_t count) {
+        if (failed || length - at < count) {
+            failed = true;
+            return false;
+        }
+        return true;
+    }
+
+    uint8_t u8() {
+        if (!has(1)) return 0;
+        return static_cast<uint8_t>(data[at++]);
+    }
+
+    uint32_t u32() {
+        if (!has(4)) return 0;
+        at += 4;
+        return static_cast<uint32_t>(littleEndian(data + at - 4, 4));
+    }
+
+    int32_t i32() { return static_cast<int32_t>(u32()); }
+
+    uint64_t u64() {
+        uint64_t low = u32();
+        return low | static_cast<uint64_t>(u32()) << 32;
+    }
+
+    double f64() {
+        uint64_t raw = u64();
+        double value;
+        std::memcpy(&value, &raw, sizeof(value));
+        return value;
+    }
+
+    // A count of items at least minSize bytes each, which has to fit in
+    // what is left, so that a corrupt count cannot reserve gigabytes
+    uint32_t count(size_t minSize) {
+        uint32_t n = u32();
+        if (minSize > 0 && !has(static_cast<size_t>(n) * minSize)) return 0;
+        return n;
+    }
+
+    std::string string() {
+        uint32_t size = count(1);
+        if (!has(size)) return "";
+        std::string text(data + at, size);
+        at += size;
+        return text;
+    }
+
+    std::vector<std::string> strings() {
+        std::vector<std::string> texts(count(4));
+        for (auto& text : texts) text = string();
+        return texts;
+    }
+
+    std::vector<int> ints() {
+        std::vector<int> values(count(4));
+        for (auto& value : values) value = i32();
+        return values;
+    }
+
+    RuntimeValue constant() {
+        auto type = static_cast<RuntimeType>(u8());
+        switch (type) {
+            case RuntimeType::INTEGER: return RuntimeValue(static_cast<int>(i32()));
+            case RuntimeType::FLOAT: return RuntimeValue(f64());
+            case RuntimeType::BOOLEAN: return RuntimeValue(u8() != 0);
+            case RuntimeType::STRING: return RuntimeValue(string());
+            case RuntimeType::UNDEFINED: return RuntimeValue();
+            default:
+                failed = true;
+                return RuntimeValue();
+        }
+    }
+
+    // arms is only sized: the VM jumps to targets instead
+    std::shared_ptr<SwitchTable> table() {
+        auto table = std::make_shared<SwitchTable>();
+        table->variable = string();
+        // The targets that follow take more than a byte per arm
+        int arms = i32();
+        if (arms < 0 || !has(static_cast<size_t>(arms))) return table;
+        table->arms.resize(static_cast<size_t>(arms));
+        for (uint32_t n = count(8); n > 0; --n) {
+            int key = i32();
+            table->intArms[key] = i32();
+        }
+        table->dense = ints();
+        table->denseBase = i32();
+        for (uint32_t n = count(8); n > 0; --n) {
+            std::string key = string();
+            table->stringArms[key] = i32();
+        }
+        for (uint32_t n = count(12); n > 0; --n) {
+            double key = f64();
+            table->stringNumbers[key] = i32();
+        }
+        return table;
+    }
+
+    std::shared_ptr<VectorKernel> kernel() {
+        auto kernel = std::make_shared<VectorKernel>();
+        kernel->inputs = strings();
+        kernel->outputs = strings();
+        kernel->nodes.resize(count(23));
+        for (auto& node : kernel->nodes) {
+            node.kind = static_cast<VectorKernel::NodeKind>(u8());
+            node.op = static_cast<BinaryOp>(u8());
+            node.left = i32();
+            node.right = i32();
+            node.input = i32();
+            node.constant = f64();
+            node.intConstant = u8() != 0;
+        }
+        kernel->accumulators.resize(count(8));
+        for (auto& accumulator : kernel->accumulators) {
+            accumulator.input = i32();
+            accumulator.terms.resize(count(5));
+            for (auto& term : accumulator.terms) {
+                term.node = i32();
+                term.subtract = u8() != 0;
+            }
+        }
+        kernel->temporaries = ints();
+        kernel->boundIsLength = u8() != 0;
+        return kernel;
+    }
+
+    // Operands index what they name. Kernels index their own nodes and
+    // inputs; a kernel's slots are checked against the frame of every
+    // function that runs it.
+    bool validKernel(const VectorKernel& kernel) const {
+        int inputs = static_cast<int>(kernel.inputs.size());
+        if (inputs < 2 || kernel.outputs.empty()) return false;
+        for (size_t i = 0; i < kernel.nodes.size(); ++i) {
+            const auto& node = kernel.nodes[i];
+            int before = static_cast<int>(i);
+            if (static_cast<int>(node.kind) > static_cast<int>(VectorKernel::NodeKind::BINARY)) return false;
+            bool usesInput = node.kind == VectorKernel::NodeKind::ELEMENT ||
+                             node.kind == VectorKernel::NodeKind::INVARIANT;
+            if (usesInput && (node.input < 0 || node.input >= inputs)) return false;
+            if (node.kind == VectorKernel::NodeKind::NEGATE && (node.left < 0 || node.left >= before)) return false;
+            if (node.kind == VectorKernel::NodeKind::BINARY &&
+                (node.left < 0 || node.left >= before || node.right < 0 || node.right >= before)) {
+                return false;
+            }
+        }
+        int nodes = static_cast<int>(kernel.nodes.size());
+        for (const auto& accumulator : kernel.accumulators) {
+            if (accumulator.input < 0 || accumulator.input >= inputs) return false;
+            for (const auto& term : accumulator.terms) {
+                if (term.node < 0 || term.node >= nodes) return false;
+            }
+        }
+        for (int node : kernel.temporaries) {
+            if (node < 0 || node >= nodes) return false;
+        }
+        return kernel.outputs.size() == 1 + kernel.accumulators.size() + kernel.temporaries.size();
+    }
+
+    bool validCode(const CompiledProgram& program, const CompiledFunction& function) const {
+        auto within = [](int32_t index, size_t size) { return index >= 0 && static_cast<size_t>(index) < size; };
+        size_t locals = static_cast<size_t>(function.localCount);
+        if (function.paramCount < 0 || function.paramCount > function.localCount || function.maxStack < 0 ||
+            function.localNames.size() != locals || function.code.empty()) {
+            return false;
+        }
+        for (const auto& jumpTable : function.jumpTables) {
+            if (jumpTable.targets.size() != jumpTable.table->arms.size() + 1) return false;
+            for (int32_t target : jumpTable.targets) {
+                if (!within(target, function.code.size())) return false;
+            }
+            for (const auto& [key, arm] : jumpTable.table->intArms) {
+                if (!within(arm, jumpTable.table->arms.size())) return false;
+            }
+            for (int arm : jumpTable.table->dense) {
+                if (arm != -1 && !within(arm, jumpTable.table->arms.size())) return false;
+            }
+            for (const auto& [key, arm] : jumpTable.table->stringArms) {
+                if (!within(arm, jumpTable.table->arms.size())) return false;
+            }
+            for (const auto& [key, arm] : jumpTable.table->stringNumbers) {
+                if (!within(arm, jumpTable.table->arms.size())) return false;
+            }
+        }
+        for (const auto& instr : function.code) {
+            if (static_cast<int>(instr.op) >= static_cast<int>(OpCode::COUNT)) return false;
+            if (jumpsTo(instr.op) && !within(instr.a, function.code.size())) return false;
+            switch (instr.op) {
+                case OpCode::LOAD_CONST:
+                    if (!within(instr.a, program.constants.size())) return false;
+                    break;
+                case OpCode::LOAD_LOCAL:
+                case OpCode::STORE_LOCAL:
+                case OpCode::CONCAT_LOCAL:
+                case OpCode::INPUT:
+                    if (!within(instr.a, locals)) return false;
+                    break;
+                case OpCode::INDEX_LOCAL_LOCAL:
+                case OpCode::INDEX_LOCAL_LOCAL_UNCHECKED:
+                    if (!within(instr.a, locals) || !within(instr.b, locals)) return false;
+                    break;
+                case OpCode::ADD_LOCAL_CONST:
+                    if (!within(instr.a, locals) || !within(instr.b, program.constants.size())) return false;
+                    break;
+                case OpCode::LOAD_UNASSIGNED:
+                case OpCode::CALL_BUILTIN:
+                    if (!within(instr.a, program.names.size())) return false;
+                    break;
+                case OpCode::LOAD_LOCAL_CHECKED:
+                    if (!within(instr.a, locals) || !within(instr.b, program.names.size())) return false;
+                    break;
+                case OpCode::CALL:
+                case OpCode::TAILCALL:
+                    if (!within(instr.a, program.functions.size())) return false;
+                    break;
+                case OpCode::SWITCH_LOCAL:
+                    if (!within(instr.a, locals) || !within(instr.b, function.jumpTables.size())) return false;
+                    break;
+                case OpCode::VECTOR_LOOP: {
+                    if (!within(instr.b, program.kernels.size())) return false;
+                    const KernelCall& call = program.kernels[instr.b];
+                    if (call.inputSlots.size() != call.kernel->inputs.size() ||
+                        call.outputSlots.size() != call.kernel->outputs.size()) {
+                        return false;
+                    }
+                    for (int slot : call.inputSlots) {
+                        if (!within(slot, locals)) return false;
+                    }
+                    for (int slot : call.outputSlots) {
+                        if (!within(slot, locals)) return false;
+                    }
+                    break;
+                }
+                case OpCode::REDUCE_TERM:
+                case OpCode::LOOP_EXIT:
+                    return false;
+                // Typed variants trust their operands' types; they are only
+                // formed at run time, by specializeFunction()
+                case OpCode::ADD_INT: case OpCode::SUB_INT: case OpCode::MUL_INT: case OpCode::MOD_INT:
+                case OpCode::ADD_FLOAT: case OpCode::SUB_FLOAT: case OpCode::MUL_FLOAT:
+                case OpCode::ADD_LOCAL_CONST_INT:
+                case OpCode::EQ_INT_JUMP_IF_FALSE: case OpCode::NE_INT_JUMP_IF_FALSE:
+                case OpCode::LT_INT_JUMP_IF_FALSE: case OpCode::LE_INT_JUMP_IF_FALSE:
+                case OpCode::GT_INT_JUMP_IF_FALSE: case OpCode::GE_INT_JUMP_IF_FALSE:
+                    return false;
+                default:
+                    break;
+            }
+        }
+        return validStack(program, function);
+    }
+
+    // Values op takes off the stack before pushing its result
+    static int popCount(const Instr& instr) {
+        switch (instr.op) {
+            case OpCode::STORE_LOCAL:
+            case OpCode::POP:
+            case OpCode::NEG:
+            case OpCode::NOT:
+            case OpCode::JUMP_IF_FALSE:
+            case OpCode::JUMP_IF_TRUE:
+            case OpCode::OUTPUT:
+            case OpCode::RETURN:
+                return 1;
+            case OpCode::ADD: case OpCode::SUB: case OpCode::MUL:
+            case OpCode::DIV: case OpCode::MOD:
+            case OpCode::EQ: case OpCode::NE: case OpCode::LT:
+            case OpCode::LE: case OpCode::GT: case OpCode::GE:
+            case OpCode::INDEX:
+            case OpCode::EQ_JUMP_IF_FALSE: case OpCode::NE_JUMP_IF_FALSE:
+            case OpCode::LT_JUMP_IF_FALSE: case OpCode::LE_JUMP_IF_FALSE:
+            case OpCode::GT_JUMP_IF_FALSE: case OpCode::GE_JUMP_IF_FALSE:
+                return 2;
+            case OpCode::CALL:
+            case OpCode::TAILCALL:
+            case OpCode::CALL_BUILTIN:
+            case OpCode::CONCAT_LOCAL:
+                return instr.b;
+            case OpCode::MAKE_ARRAY:
+                return instr.a;
+            default:
+                return 0;
+        }
+    }
+
+    // The VM sizes a frame by maxStack and trusts the code to stay in it.
+    // Follows every path from the entry: each instruction must be reached
+    // with one stack depth, pop no more than is there, stay within
+    // maxStack, and every call must pass the callee's parameter count.
+    // No path may run off the end of the code.
+    bool validStack(const CompiledProgram& program, const CompiledFunction& function) const {
+        size_t size = function.code.size();
+        std::vector<int> depthAt(size, -1);
+        std::vector<size_t> pending;
+        auto reach = [&](size_t target, int depth) {
+            if (target >= size) return false;
+            if (depthAt[target] == -1) {
+                depthAt[target] = depth;
+                pending.push_back(target);
+                return true;
+            }
+            return depthAt[target] == depth;
+        };
+        reach(0, 0);
+
+        while (!pending.empty()) {
+            size_t pc = pending.back();
+            pending.pop_back();
+            const Instr& instr = function.code[pc];
+            int depth = depthAt[pc];
+            int pops = popCount(instr);
+            if (pops < 0 || pops > depth) return false;
+            if ((instr.op == OpCode::CALL || instr.op == OpCode::TAILCALL) &&
+                instr.b != program.functions[instr.a].paramCount) {
+                return false;
+            }
+            depth += stackEffect(instr.op, instr.a, instr.b);
+            if (depth > function.maxStack) return false;
+
+            switch (instr.op) {
+                case OpCode::RETURN:
+                case OpCode::RETURN_UNDEFINED:
+                case OpCode::TAILCALL:
+                    break;
+                case OpCode::JUMP:
+                    if (!reach(static_cast<size_t>(instr.a), depth)) return false;
+                    break;
+                case OpCode::SWITCH_LOCAL:
+                    for (int32_t target : function.jumpTables[instr.b].targets) {
+                        if (!reach(static_cast<size_t>(target), depth)) return false;
+                    }
+                    break;
+                default:
+                    if (jumpsTo(instr.op) && !reach(static_cast<size_t>(instr.a), depth)) return false;
+                    if (!reach(pc + 1, depth)) return false;
+                    break;
+            }
+        }
+        return true;
+    }
+
+public:
+    ImageReader(const char* data, size_t length) : data(data), length(length) {}
+
+    bool read(CompiledProgram& program) {
+        program.constants.resize(count(1));
+        for (auto& value : program.constants) value = constant();
+        program.names = strings();
+        program.kernels.resize(count(4));
+        for (auto& call : program.kernels) {
+            call.kernel = kernel();
+            call.inputSlots = ints();
+            call.outputSlots = ints();
+            if (!failed && !validKernel(*call.kernel)) return false;
+        }
+        program.functions.resize(count(4));
+        for (size_t f = 0; f < program.functions.size(); ++f) {
+            CompiledFunction& function = program.functions[f];
+            function.name = string();
+            function.paramCount = i32();
+            function.localCount = i32();
+            function.maxStack = i32();
+            function.localNames = strings();
+            function.code.resize(count(9));
+            for (auto& instr : function.code) {
+                instr.op = static_cast<OpCode>(u8());
+                instr.a = i32();
+                instr.b = i32();
+            }
+            function.jumpTables.resize(count(4));
+            for (auto& jumpTable : function.jumpTables) {
+                jumpTable.table = table();
+                jumpTable.targets = ints();
+            }
+            program.functionIndex[function.name] = static_cast<int>(f);
+        }
+        if (failed || at != length) return false;
+        for (const auto& function : program.functions) {
+            if (!validCode(program, function)) return false;
+        }
+        return true;
+    }
+};
+
+bool saveImage(const CompiledProgram& program, const std::string& path, std::ostream& errors) {
+    ImageWriter writer;
+    if (!writer.write(program, errors)) return false;
+    std::string image = writer.image();
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.write(image.data(), static_cast<std::streamsize>(image.size()))) {
+        errors << "Error: Cannot write file '" << path << "'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool isImage(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[sizeof(IMAGE_MAGIC)];
+    return in.read(magic, sizeof(magic)) && std::memcmp(magic, IMAGE_MAGIC, sizeof(magic)) == 0;
+}
+
+bool loadImage(const std::string& path, CompiledProgram& program, std::ostream& errors) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        errors << "Error: Cannot open file '" << path << "'" << std::endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < HEADER_SIZE) {
+        errors << "Error: '" << path << "' is not a program image" << std::endl;
+        ::close(fd);
+        return false;
+    }
+    size_t length = static_cast<size_t>(info.st_size);
+    void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        errors << "Error: Cannot map file '" << path << "'" << std::endl;
+        return false;
+    }
+    madvise(mapped, length, MADV_SEQUENTIAL);
+    const char* data = static_cast<const char*>(mapped);
+
+    uint64_t version = littleEndian(data + 4, 4);
+    uint64_t size = littleEndian(data + 8, 8);
+    bool ok = false;
+    if (std::memcmp(data, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0) {
+        errors << "Error: '" << path << "' is not a program image" << std::endl;
+    } else if (version != IMAGE_VERSION) {
+        errors << "Error: '" << path << "' is a version " << version << " image, expected version "
+               << IMAGE_VERSION << std::endl;
+    } else if (size != length - HEADER_SIZE) {
+        errors << "Error: '" << path << "' is truncated" << std::endl;
+    } else if (littleEndian(data + 16, 8) != checksum(data + HEADER_SIZE, size)) {
+        errors << "Error: '" << path << "' is corrupt, its checksum does not match" << std::endl;
+    } else if (!ImageReader(data + HEADER_SIZE, size).read(program)) {
+        errors << "Error: '" << path << "' holds invalid code" << std::endl;
+    } else {
+        ok = true;
+    }
+    munmap(mapped, length);
+    return ok;
+}
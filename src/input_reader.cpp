@@ -0,0 +1,123 @@
+#include "../include/input_reader.h"
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+InputReader::InputReader(int fd, size_t blockSize)
+    : fd(fd), blockSize(blockSize), begin(0), end(0), eof(false) {}
+
+// All of the text is buffered up front, so fill() never reads
+InputReader::InputReader(const std::string& text)
+    : fd(-1), blockSize(0), buffer(text.begin(), text.end()), begin(0), end(text.size()), eof(true) {}
+
+// Pull the next block from the descriptor. Unconsumed bytes are moved to the
+// front first, and the buffer doubles when a single line fills all of it.
+bool InputReader::fill() {
+    if (eof) return false;
+
+    if (buffer.empty()) buffer.resize(blockSize);
+    if (begin > 0) {
+        std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+    }
+    if (end == buffer.size()) {
+        buffer.resize(buffer.size() * 2);
+    }
+
+    while (true) {
+        ssize_t n = ::read(fd, buffer.data() + end, buffer.size() - end);
+        if (n > 0) {
+            end += static_cast<size_t>(n);
+            return true;
+        }
+        if (n < 0 && errno == EINTR) continue;
+        eof = true;
+        return false;
+    }
+}
+
+bool InputReader::readLine(std::string_view& line) {
+    size_t scanned = begin;
+    while (true) {
+        const char* start = buffer.data() + scanned;
+        const char* newline = end > scanned ? static_cast<const char*>(std::memchr(start, '\n', end - scanned)) : nullptr;
+        if (newline) {
+            size_t lineEnd = static_cast<size_t>(newline - buffer.data());
+            line = std::string_view(buffer.data() + begin, lineEnd - begin);
+            begin = lineEnd + 1;
+            return true;
+        }
+
+        // fill() may slide the unread bytes to the front of the buffer
+        size_t consumed = end - begin;
+        if (!fill()) break;
+        scanned = begin + consumed;
+    }
+
+    // Last line without a trailing newline
+    if (begin == end) return false;
+    line = std::string_view(buffer.data() + begin, end - begin);
+    begin = end;
+    return true;
+}
+
+// Numbers are parsed straight out of the line view. Integers that fit in an
+// int stay INTEGER, anything else goes through strtod; tokens that are not
+// numbers become 0, same as stringToNumber.
+static RuntimeValue parseNumberToken(const char* text, size_t length) {
+    size_t i = 0;
+    bool negative = false;
+    if (text[i] == '-' || text[i] == '+') {
+        negative = text[i] == '-';
+        i++;
+    }
+
+    long long value = 0;
+    size_t digitsStart = i;
+    while (i < length && text[i] >= '0' && text[i] <= '9' && value <= INT_MAX) {
+        value = value * 10 + (text[i] - '0');
+        i++;
+    }
+    if (i == length && i > digitsStart) {
+        if (negative) value = -value;
+        if (value >= INT_MIN && value <= INT_MAX) {
+            return RuntimeValue(static_cast<int>(value));
+        }
+    }
+
+    char local[64];
+    if (length >= sizeof(local)) return RuntimeValue(0);
+    std::memcpy(local, text, length);
+    local[length] = '\0';
+    char* parsedEnd = nullptr;
+    double floatValue = std::strtod(local, &parsedEnd);
+    if (parsedEnd != local + length) return RuntimeValue(0);
+    return RuntimeValue(floatValue);
+}
+
+bool InputReader::readNumbers(std::vector<RuntimeValue>& out) {
+    std::string_view line;
+    if (!readLine(line)) return false;
+
+    size_t i = 0;
+    while (i < line.size()) {
+        while (i < line.size() && isspace(static_cast<unsigned char>(line[i]))) i++;
+        size_t start = i;
+        while (i < line.size() && !isspace(static_cast<unsigned char>(line[i]))) i++;
+        if (i > start) {
+            out.push_back(parseNumberToken(line.data() + start, i - start));
+        }
+    }
+    return true;
+}
+
+std::string InputReader::readAll() {
+    while (fill()) {}
+    std::string rest(buffer.data() + begin, end - begin);
+    begin = end;
+    return rest;
+}
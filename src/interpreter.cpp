@@ -1,26 +1,162 @@
 #include "../include/interpreter.h"
+#include "../include/bytecode.h"
+#include "../include/vm.h"
+#include <algorithm>
+#include <climits>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
 #include <sstream>
 
-Interpreter::Interpreter() : hasReturnValue(false) {}
+namespace {
+// The task pool worker this thread is, -1 on other threads, and the tasks
+// it has going at once
+thread_local int taskWorker = -1;
+thread_local size_t taskDepth = 0;
+
+// The runtime error stream of one thread running the program. Lines are
+// kept until flushed (std::endl) and then written to errors whole, under
+// lock, since workers on other threads report to the same stream.
+class ThreadErrors : public std::streambuf {
+private:
+    std::ostream& errors;
+    std::mutex& lock;
+    std::string pending;
+    std::ostream stream;
+    ErrorStreamScope scope;
+
+protected:
+    int overflow(int ch) override {
+        if (ch == traits_type::eof()) return traits_type::not_eof(ch);
+        pending += static_cast<char>(ch);
+        return ch;
+    }
+
+    std::streamsize xsputn(const char* data, std::streamsize count) override {
+        pending.append(data, static_cast<size_t>(count));
+        return count;
+    }
+
+    int sync() override {
+        if (pending.empty()) return 0;
+        std::lock_guard<std::mutex> guard(lock);
+        errors << pending << std::flush;
+        pending.clear();
+        return 0;
+    }
+
+public:
+    ThreadErrors(std::ostream& errors, std::mutex& lock) : errors(errors), lock(lock), stream(this), scope(stream) {}
+    ~ThreadErrors() override { sync(); }
+};
+}
+
+// What one chunk of a parallel for leaves to be applied in iteration order
+struct Interpreter::ParallelChunk {
+    struct Term {
+        const ParallelLoop::Reduction* reduction;
+        size_t term;
+        RuntimeValue value;
+    };
+    std::vector<Term> terms;
+    std::string output;
+    // The last value the chunk assigned to each private
+    std::unordered_map<std::string, RuntimeValue> frame;
+    bool done = false;
+};
+
+Interpreter::Interpreter(int osrThreshold)
+    : hasReturnValue(false), output(&std::cout), errors(&std::cerr), osrThreshold(osrThreshold), memoCapacity(0), stepsLeft(-1),
+      threads(WorkStealingPool::defaultThreads()), sharedFrame(nullptr), parallelLoop(nullptr),
+      chunk(nullptr), owner(nullptr), nextTaskWorker(0) {}
+
+Interpreter::~Interpreter() = default;
 
 // Main execution - finds and runs the main function
 void Interpreter::execute(std::shared_ptr<ASTProgram> program) {
     // First, register all functions
+    load(program);
+    
+    // Look for main function and execute it
+    if (functions.find("main") != functions.end()) {
+        std::cout << "=== Executing Program ===" << std::endl;
+    }
+    runMain();
+}
+
+bool Interpreter::runMain() {
+    PayloadPoolScope poolScope(pool);
+    ThreadErrors errorScope(*errors, outputLock());
+    
+    if (memoCapacity > 0) {
+        memoizable = findMemoizableFunctions(*program);
+        for (const auto& name : memoizable) {
+            memoTables.emplace(functions[name].get(), MemoTable(memoCapacity));
+        }
+    }
+    
+    if (functions.find("main") == functions.end()) {
+        runtimeErrors() << "Error: No main function found!" << std::endl;
+        return false;
+    }
+    callFunction("main", {});
+    return true;
+}
+
+// Task workers write output themselves; chunk workers hand it back
+void Interpreter::setOutput(std::ostream& out) {
+    output = &out;
+    for (auto& levels : taskWorkers) {
+        for (auto& worker : levels) worker->setOutput(out);
+    }
+}
+
+// Every worker reports its errors itself
+void Interpreter::setErrors(std::ostream& out) {
+    errors = &out;
+    for (auto& worker : workers) worker->errors = &out;
+    for (auto& levels : taskWorkers) {
+        for (auto& worker : levels) worker->setErrors(out);
+    }
+}
+
+void Interpreter::reset() {
+    variables.clear();
+    callStack.clear();
+    hasReturnValue = false;
+    returnValue = RuntimeValue();
+}
+
+void Interpreter::load(std::shared_ptr<ASTProgram> program) {
+    this->program = program;
     for (const auto& funcNode : program->functions) {
         auto func = std::dynamic_pointer_cast<ASTFunction>(funcNode);
         if (func) {
             functions[func->name] = func;
         }
     }
-    
-    // Look for main function and execute it
-    if (functions.find("main") != functions.end()) {
-        std::cout << "=== Executing Program ===" << std::endl;
-        callFunction("main", {});
-    } else {
-        std::cerr << "Error: No main function found!" << std::endl;
+}
+
+bool Interpreter::evaluateConstant(const ASTNodePtr& expr, long steps, RuntimeValue& result) {
+    PayloadPoolScope poolScope(pool);
+    std::ostringstream reported;
+    ErrorStreamScope errorScope(reported);
+    stepsLeft = steps;
+    result = evaluateExpression(expr);
+    bool finished = stepsLeft > 0;
+    stepsLeft = -1;
+    return finished && reported.str().empty();
+}
+
+// Takes one step from the budget of evaluateConstant(). Once it is used up
+// calls return undefined and loops stop, so the evaluation unwinds quickly.
+bool Interpreter::takeStep() {
+    if (stepsLeft == 0 || callStack.size() >= MAX_CONSTANT_DEPTH) {
+        stepsLeft = 0;
+        return false;
     }
+    --stepsLeft;
+    return true;
 }
 
 // THE CORE: Evaluate expressions and return RuntimeValue
@@ -52,6 +188,9 @@ RuntimeValue Interpreter::evaluateExpression(ASTNodePtr expr) {
     
     // Binary expressions - use our type coercion system!
     if (auto binary = std::dynamic_pointer_cast<ASTBinaryExpression>(expr)) {
+        if (binary->op == "&&" || binary->op == "||") {
+            return RuntimeValue(evaluateCondition(expr));
+        }
         RuntimeValue left = evaluateExpression(binary->left);
         RuntimeValue right = evaluateExpression(binary->right);
         return performBinaryOperation(left, right, binary->op);
@@ -67,7 +206,7 @@ RuntimeValue Interpreter::evaluateExpression(ASTNodePtr expr) {
     if (auto funcCall = std::dynamic_pointer_cast<ASTFunctionCall>(expr)) {
         auto callee = std::dynamic_pointer_cast<ASTIdentifier>(funcCall->callee);
         if (!callee) {
-            std::cerr << "Error: Invalid function call" << std::endl;
+            runtimeErrors() << "Error: Invalid function call" << std::endl;
             return RuntimeValue();
         }
         
@@ -91,17 +230,36 @@ RuntimeValue Interpreter::evaluateExpression(ASTNodePtr expr) {
     
     // Array access
     if (auto arrayAccess = std::dynamic_pointer_cast<ASTArrayAccess>(expr)) {
+        // Proven in range: index the variable where it is, without copying
+        // the array out or converting the index
+        if (arrayAccess->inBounds) {
+            RuntimeValue* array = findVariable(static_cast<ASTIdentifier&>(*arrayAccess->array).name);
+            RuntimeValue* index = findVariable(static_cast<ASTIdentifier&>(*arrayAccess->index).name);
+            if (array && index && array->type == RuntimeType::ARRAY) {
+                return (*array->arrayValue)[index->intValue];
+            }
+        }
+        
         RuntimeValue array = evaluateExpression(arrayAccess->array);
         RuntimeValue index = evaluateExpression(arrayAccess->index);
         
+        if (array.type == RuntimeType::MAPPED_ARRAY) {
+            int idx = static_cast<int>(getNumericValue(index));
+            if (idx < 0 || static_cast<size_t>(idx) >= array.mappedValue->size()) {
+                runtimeErrors() << "Error: Array index out of bounds" << std::endl;
+                return RuntimeValue();
+            }
+            return array.mappedValue->at(idx);
+        }
+        
         if (array.type != RuntimeType::ARRAY) {
-            std::cerr << "Error: Trying to index non-array value" << std::endl;
+            runtimeErrors() << "Error: Trying to index non-array value" << std::endl;
             return RuntimeValue();
         }
         
         int idx = static_cast<int>(getNumericValue(index));
         if (idx < 0 || idx >= static_cast<int>(array.arrayValue->size())) {
-            std::cerr << "Error: Array index out of bounds" << std::endl;
+            runtimeErrors() << "Error: Array index out of bounds" << std::endl;
             return RuntimeValue();
         }
         
@@ -113,14 +271,46 @@ RuntimeValue Interpreter::evaluateExpression(ASTNodePtr expr) {
         return evaluateExpression(grouped->expression);
     }
     
-    std::cerr << "Error: Unknown expression type" << std::endl;
+    runtimeErrors() << "Error: Unknown expression type" << std::endl;
     return RuntimeValue();
 }
 
+// Evaluate an expression for its truth value. && and || short-circuit, so
+// the right operand is only evaluated when it decides the result.
+bool Interpreter::evaluateCondition(const ASTNodePtr& expr) {
+    if (auto binary = dynamic_cast<ASTBinaryExpression*>(expr.get())) {
+        if (binary->op == "&&") {
+            return evaluateCondition(binary->left) && evaluateCondition(binary->right);
+        }
+        if (binary->op == "||") {
+            return evaluateCondition(binary->left) || evaluateCondition(binary->right);
+        }
+    } else if (auto unary = dynamic_cast<ASTUnaryExpression*>(expr.get())) {
+        if (unary->op == "!") {
+            return !evaluateCondition(unary->operand);
+        }
+    } else if (auto grouped = dynamic_cast<ASTGroupedExpression*>(expr.get())) {
+        return evaluateCondition(grouped->expression);
+    }
+    return isTruthy(evaluateExpression(expr));
+}
+
 // Execute statements - perform actions
 void Interpreter::executeStatement(ASTNodePtr stmt) {
     // Assignment statements
     if (auto assignment = std::dynamic_pointer_cast<ASTAssignment>(stmt)) {
+        // Inside a parallel chunk, reductions only log their terms
+        if (chunk) {
+            auto reduction = parallelLoop->reductions.find(assignment.get());
+            if (reduction != parallelLoop->reductions.end()) {
+                const auto& terms = reduction->second.terms;
+                for (size_t t = 0; t < terms.size(); ++t) {
+                    chunk->terms.push_back({&reduction->second, t, evaluateExpression(terms[t].second)});
+                }
+                return;
+            }
+        }
+        if (appendInPlace(*assignment)) return;
         RuntimeValue value = evaluateExpression(assignment->expression);
         setVariable(assignment->variable, value);
         return;
@@ -153,10 +343,21 @@ void Interpreter::executeStatement(ASTNodePtr stmt) {
     
     // If statements
     if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(stmt)) {
-        RuntimeValue condition = evaluateExpression(ifStmt->condition);
-        RuntimeValue condBool = toBoolean(condition);
-        
-        if (condBool.boolValue) {
+        // A chain of tests of one variable goes straight to its arm; an
+        // undefined variable is left to the tests, which report it
+        if (ifStmt->switchTable) {
+            const SwitchTable& table = *ifStmt->switchTable;
+            if (RuntimeValue* value = findVariable(table.variable)) {
+                int arm = table.lookup(*value);
+                if (arm >= 0) {
+                    executeStatement(table.arms[arm]);
+                } else if (table.otherwise) {
+                    executeStatement(table.otherwise);
+                }
+                return;
+            }
+        }
+        if (evaluateCondition(ifStmt->condition)) {
             executeStatement(ifStmt->thenBlock);
         } else if (ifStmt->elseBlock) {
             executeStatement(ifStmt->elseBlock);
@@ -168,12 +369,14 @@ void Interpreter::executeStatement(ASTNodePtr stmt) {
     if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(stmt)) {
         // Execute initialization
         executeStatement(forStmt->init);
+        if (forStmt->kernel && runKernel(*forStmt->kernel)) return;
+        if (forStmt->parallelLoop && runParallel(*forStmt)) return;
+        
+        int* loopCount = osrThreshold > 0 ? &backEdges[forStmt.get()] : nullptr;
         
         // Loop while condition is true
         while (true) {
-            RuntimeValue condition = evaluateExpression(forStmt->condition);
-            RuntimeValue condBool = toBoolean(condition);
-            if (!condBool.boolValue) break;
+            if (!evaluateCondition(forStmt->condition) || !step()) break;
             
             // Execute body
             executeStatement(forStmt->body);
@@ -181,6 +384,12 @@ void Interpreter::executeStatement(ASTNodePtr stmt) {
             
             // Execute increment
             executeStatement(forStmt->increment);
+            
+            // Hot loop - run the remaining iterations as bytecode
+            if (loopCount && ++*loopCount >= osrThreshold) {
+                if (enterCompiledLoop(*forStmt)) break;
+                *loopCount = INT_MIN;  // no loop entry, stop counting
+            }
         }
         return;
     }
@@ -194,7 +403,7 @@ void Interpreter::executeStatement(ASTNodePtr stmt) {
         return;
     }
     
-    std::cerr << "Error: Unknown statement type" << std::endl;
+    runtimeErrors() << "Error: Unknown statement type" << std::endl;
 }
 
 // Variable management
@@ -209,46 +418,430 @@ void Interpreter::setVariable(const std::string& name, const RuntimeValue& value
 }
 
 RuntimeValue Interpreter::getVariable(const std::string& name) {
-    // Check local scope first (if in function)
+    if (RuntimeValue* slot = findVariable(name)) {
+        return *slot;
+    }
+    
+    runtimeErrors() << "Error: Undefined variable '" << name << "'" << std::endl;
+    return RuntimeValue();  // undefined
+}
+
+// Runs a vectorized loop natively; false when the loop itself has to run
+bool Interpreter::runKernel(const VectorKernel& kernel) {
+    std::vector<const RuntimeValue*> inputs;
+    inputs.reserve(kernel.inputs.size());
+    for (const auto& name : kernel.inputs) inputs.push_back(findVariable(name));
+    std::vector<RuntimeValue> outputs(kernel.outputs.size());
+    if (!kernel.run(inputs.data(), outputs.data())) return false;
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        setVariable(kernel.outputs[i], outputs[i]);
+    }
+    return true;
+}
+
+// Storage of a variable, local scope first - nullptr if undefined
+RuntimeValue* Interpreter::findVariable(const std::string& name) {
     if (!callStack.empty()) {
         auto& locals = callStack.back();
-        if (locals.find(name) != locals.end()) {
-            return locals[name];
+        auto it = locals.find(name);
+        if (it != locals.end()) {
+            return &it->second;
         }
     }
     
-    // Check global scope
-    if (variables.find(name) != variables.end()) {
-        return variables[name];
+    // Loop variables a parallel chunk reads but never assigns
+    if (sharedFrame && callStack.size() == 1) {
+        auto shared = sharedFrame->find(name);
+        if (shared != sharedFrame->end()) {
+            return &shared->second;
+        }
     }
     
-    std::cerr << "Error: Undefined variable '" << name << "'" << std::endl;
-    return RuntimeValue();  // undefined
+    auto it = variables.find(name);
+    if (it != variables.end()) {
+        return &it->second;
+    }
+    return nullptr;
+}
+
+// Runs a checked parallel for on the worker pool, right after its init.
+// False when the loop has to run serially instead: there is one thread, a
+// worker or evaluateConstant() is running it, or the index and end are not
+// numbers the iterations can be counted from.
+bool Interpreter::runParallel(const ASTFor& loop) {
+    const ParallelLoop& plan = *loop.parallelLoop;
+    if (threads < 2 || callStack.empty() || owner || stepsLeft >= 0) return false;
+    RuntimeValue* index = findVariable(plan.index);
+    if (!index || index->type != RuntimeType::INTEGER) return false;
+    RuntimeValue end = evaluateExpression(plan.end);
+    if (end.type != RuntimeType::INTEGER && end.type != RuntimeType::FLOAT) return false;
+
+    // Iterations of the serial loop; the index has to stay an int throughout
+    long long first = index->intValue;
+    double limit = getNumericValue(end);
+    auto runs = [&](long long value) {
+        return plan.inclusive ? value <= limit : value < limit;
+    };
+    if (!runs(first) || !((limit - first) / plan.step < INT_MAX)) return false;
+    long long count = static_cast<long long>((limit - first) / plan.step) + 1;
+    while (count > 0 && !runs(first + (count - 1) * plan.step)) count--;
+    while (runs(first + count * plan.step)) count++;
+    if (count < 2 || first + count * plan.step > INT_MAX) return false;
+
+    if (!workerPool) {
+        workerPool = std::make_unique<WorkStealingPool>(threads);
+        for (unsigned w = 0; w < threads; ++w) workers.push_back(std::unique_ptr<Interpreter>(startWorker()));
+    }
+
+    // Each worker is dealt a contiguous run of chunks, earliest on top
+    size_t total = static_cast<size_t>(count);
+    size_t chunkSize = std::max<size_t>(1, total / (threads * CHUNKS_PER_THREAD));
+    size_t chunkCount = (total + chunkSize - 1) / chunkSize;
+    std::vector<ParallelChunk> chunks(chunkCount);
+    std::mutex doneLock;
+    std::condition_variable doneSignal;
+    auto& frame = callStack.back();
+    for (unsigned w = 0; w < threads; ++w) {
+        size_t from = chunkCount * w / threads;
+        size_t to = chunkCount * (w + 1) / threads;
+        for (size_t c = to; c-- > from;) {
+            workerPool->push(w, [&, c](unsigned worker) {
+                size_t offset = c * chunkSize;
+                int start = static_cast<int>(first + static_cast<long long>(offset) * plan.step);
+                workers[worker]->runChunk(loop, frame, start, std::min(chunkSize, total - offset), chunks[c]);
+                std::lock_guard<std::mutex> guard(doneLock);
+                chunks[c].done = true;
+                doneSignal.notify_all();
+            });
+        }
+    }
+
+    // Chunks are applied in order as they finish. Reductions fold into
+    // copies and privates collect apart from the frame, which the workers
+    // are still reading.
+    std::unordered_map<std::string, RuntimeValue> results;
+    for (size_t c = 0; c < chunkCount; ++c) {
+        {
+            std::unique_lock<std::mutex> lock(doneLock);
+            doneSignal.wait(lock, [&] { return chunks[c].done; });
+        }
+        ParallelChunk& done = chunks[c];
+        if (!done.output.empty()) {
+            std::lock_guard<std::mutex> guard(outputLock());
+            *output << done.output << std::flush;
+        }
+        for (auto& term : done.terms) {
+            const std::string& name = term.reduction->variable;
+            auto total = results.find(name);
+            if (total == results.end()) total = results.emplace(name, getVariable(name)).first;
+            const std::string& op = term.reduction->terms[term.term].first;
+            RuntimeValue& value = total->second;
+            if (op == "+" && value.type == RuntimeType::STRING && term.value.type == RuntimeType::STRING) {
+                value.ownString().append(*term.value.stringValue);
+            } else {
+                value = performBinaryOperation(value, term.value, op);
+            }
+        }
+        for (auto& [name, value] : done.frame) results[name] = std::move(value);
+        done = ParallelChunk();
+    }
+    for (auto& [name, value] : results) setVariable(name, value);
+    setVariable(plan.index, RuntimeValue(static_cast<int>(first + count * plan.step)));
+    return true;
+}
+
+// Runs iterations first, first + step, ... of a parallel for on this worker
+void Interpreter::runChunk(const ASTFor& loop, std::unordered_map<std::string, RuntimeValue>& shared,
+                           int first, size_t iterations, ParallelChunk& result) {
+    PayloadPoolScope poolScope(pool);
+    ThreadErrors errorScope(*errors, outputLock());
+    const ParallelLoop& plan = *loop.parallelLoop;
+    sharedFrame = &shared;
+    parallelLoop = &plan;
+    chunk = &result;
+    callStack.emplace_back();
+    if (!runCompiledChunk(loop, first, iterations)) {
+        for (size_t k = 0; k < iterations; ++k) {
+            callStack.back()[plan.index] = RuntimeValue(static_cast<int>(first + static_cast<long long>(k) * plan.step));
+            executeStatement(loop.body);
+        }
+    }
+    callStack.back().erase(plan.index);
+    result.frame = std::move(callStack.back());
+    callStack.pop_back();
+    sharedFrame = nullptr;
+    parallelLoop = nullptr;
+    chunk = nullptr;
+}
+
+// Runs a chunk through the loop's chunk entry in the VM, on copies of the
+// shared variables. False when OSR is off or the chunk may read a variable
+// that is not set, so it has to be tree-walked.
+bool Interpreter::runCompiledChunk(const ASTFor& loop, int first, size_t iterations) {
+    if (osrThreshold <= 0) return false;
+    startOsrVM();
+    auto entry = osrProgram->chunkEntries.find(&loop);
+    if (entry == osrProgram->chunkEntries.end()) return false;
+
+    const ParallelLoop& plan = *parallelLoop;
+    const CompiledFunction& function = osrProgram->functions[entry->second];
+    for (int slot : function.readsBeforeAssigned) {
+        const std::string& name = function.localNames[slot];
+        if (name != plan.index && name != "$chunkEnd" &&
+            (std::find(plan.shared.begin(), plan.shared.end(), name) == plan.shared.end() ||
+             !sharedFrame->count(name))) {
+            return false;
+        }
+    }
+    std::vector<RuntimeValue> locals(function.localCount);
+    for (int i = 0; i < function.localCount; ++i) {
+        const std::string& name = function.localNames[i];
+        if (name == plan.index) {
+            locals[i] = RuntimeValue(first);
+        } else if (name == "$chunkEnd") {
+            locals[i] = RuntimeValue(static_cast<int>(first + static_cast<long long>(iterations) * plan.step));
+        } else if (std::find(plan.shared.begin(), plan.shared.end(), name) != plan.shared.end()) {
+            auto value = sharedFrame->find(name);
+            if (value != sharedFrame->end()) locals[i] = value->second;
+        }
+    }
+
+    RuntimeValue result;
+    osrVM->runLoop(entry->second, locals, result);
+    auto& frame = callStack.back();
+    for (int i = 0; i < function.localCount; ++i) {
+        const std::string& name = function.localNames[i];
+        if (locals[i].type != RuntimeType::UNDEFINED &&
+            std::find(plan.privates.begin(), plan.privates.end(), name) != plan.privates.end()) {
+            frame[name] = std::move(locals[i]);
+        }
+    }
+    return true;
+}
+
+// A worker interpreter for this one's pools
+Interpreter* Interpreter::startWorker() {
+    Interpreter* worker = new Interpreter(osrThreshold);
+    worker->load(program);
+    worker->owner = this;
+    worker->output = output;
+    worker->errors = errors;
+    return worker;
+}
+
+// spawn("f", args...): f(args...) as a task on the pool of the interpreter
+// running main. A task worker queues it on its own deque; other threads
+// deal their spawns out in turn.
+RuntimeValue Interpreter::spawnCall(const std::vector<RuntimeValue>& args) {
+    if (args.empty() || args[0].type != RuntimeType::STRING || !functions.count(*args[0].stringValue)) {
+        runtimeErrors() << "Error: spawn of undefined function '" << (args.empty() ? "" : args[0].toString())
+                  << "'" << std::endl;
+        return RuntimeValue();
+    }
+    std::string name = *args[0].stringValue;
+    std::vector<RuntimeValue> callArgs(args.begin() + 1, args.end());
+    SpawnedTask* task = SpawnedTask::create();
+    Interpreter* root = owner ? owner : this;
+    if (root->threads < 2 || stepsLeft >= 0) {
+        task->finish(callFunction(name, callArgs));
+        return RuntimeValue(task);
+    }
+
+    std::call_once(root->tasksStarted, [root] {
+        root->taskWorkers.resize(root->threads);
+        root->taskPool = std::make_unique<WorkStealingPool>(root->threads);
+    });
+    unsigned worker = taskWorker >= 0 ? static_cast<unsigned>(taskWorker) : root->nextTaskWorker++;
+    task->retain();
+    root->taskPool->push(worker, [root, name, callArgs, task](unsigned w) {
+        root->runTask(w, name, callArgs, task);
+    });
+    return RuntimeValue(task);
+}
+
+// A task worker runs other tasks while it waits, so tasks that wait on
+// tasks cannot hold up every worker
+RuntimeValue Interpreter::awaitTask(SpawnedTask& task) {
+    Interpreter* root = owner ? owner : this;
+    if (taskWorker >= 0) {
+        while (!task.isDone() && root->taskPool->runOne(static_cast<unsigned>(taskWorker))) {}
+    }
+    return task.wait();
+}
+
+// Runs a spawned call on pool worker w, on the interpreter for the number
+// of tasks the worker already has going
+void Interpreter::runTask(unsigned worker, const std::string& name, const std::vector<RuntimeValue>& args,
+                          SpawnedTask* task) {
+    taskWorker = static_cast<int>(worker);
+    auto& levels = taskWorkers[worker];
+    if (levels.size() <= taskDepth) levels.emplace_back(startWorker());
+    Interpreter& runner = *levels[taskDepth];
+    taskDepth++;
+    RuntimeValue result;
+    {
+        PayloadPoolScope poolScope(runner.pool);
+        ThreadErrors errorScope(*runner.errors, runner.outputLock());
+        result = runner.callFunction(name, args);
+    }
+    taskDepth--;
+    task->finish(std::move(result));
+    task->release();
+}
+
+// Fast path for "s = s + a + b ...;" when s holds a string. The pieces are
+// appended to the variable's own buffer instead of building a fresh string
+// per '+', so a loop growing s costs O(n) copied bytes rather than O(n^2).
+// Returns false (nothing evaluated) when the statement has another shape.
+bool Interpreter::appendInPlace(const ASTAssignment& assignment) {
+    std::vector<const ASTNodePtr*> pieces;
+    ASTNode* node = assignment.expression.get();
+    while (true) {
+        if (auto grouped = dynamic_cast<ASTGroupedExpression*>(node)) {
+            node = grouped->expression.get();
+            continue;
+        }
+        auto binary = dynamic_cast<ASTBinaryExpression*>(node);
+        if (!binary || binary->op != "+") break;
+        pieces.push_back(&binary->right);
+        node = binary->left.get();
+    }
+    
+    auto base = dynamic_cast<ASTIdentifier*>(node);
+    if (pieces.empty() || !base || base->name != assignment.variable) return false;
+    
+    RuntimeValue* target = findVariable(assignment.variable);
+    if (!target || target->type != RuntimeType::STRING) return false;
+    
+    // Evaluate left to right, as the tree would. Calls may grow callStack,
+    // so the variable is looked up again afterwards.
+    std::vector<RuntimeValue> values;
+    values.reserve(pieces.size());
+    for (auto it = pieces.rbegin(); it != pieces.rend(); ++it) {
+        values.push_back(evaluateExpression(**it));
+    }
+    target = findVariable(assignment.variable);
+    
+    // string + string concatenates; anything else follows the usual coercion
+    size_t i = 0;
+    while (i < values.size() && values[i].type == RuntimeType::STRING) {
+        target->ownString().append(*values[i].stringValue);
+        i++;
+    }
+    if (i < values.size()) {
+        RuntimeValue result = *target;
+        for (; i < values.size(); i++) {
+            result = performBinaryOperation(result, values[i], "+");
+        }
+        setVariable(assignment.variable, result);
+    }
+    return true;
+}
+
+// Compiles the program with its loop entries on first use
+void Interpreter::startOsrVM() {
+    if (osrVM) return;
+    if (!osrProgram) osrProgram = std::make_shared<CompiledProgram>(compileProgram(*program, true, true));
+    osrVM = std::make_unique<VM>(*osrProgram, false, VM::DEFAULT_JIT_THRESHOLD, this);
+    if (memoCapacity > 0) osrVM->enableMemoization(memoizable, memoCapacity);
+}
+
+// Transfers a running loop into the VM at its condition check. The current
+// frame's variables become the locals of the loop entry function and are
+// written back when the loop finishes. Loops that may read a variable that
+// is not set stay in the tree-walker, which reports it.
+bool Interpreter::enterCompiledLoop(const ASTFor& loop) {
+    if (!program || callStack.empty()) return false;
+    startOsrVM();
+    auto entry = osrProgram->loopEntries.find(&loop);
+    if (entry == osrProgram->loopEntries.end()) return false;
+
+    const CompiledFunction& function = osrProgram->functions[entry->second];
+    auto& frame = callStack.back();
+    bool inChunk = sharedFrame && callStack.size() == 1;
+    for (int slot : function.readsBeforeAssigned) {
+        const std::string& name = function.localNames[slot];
+        if (frame.count(name)) continue;
+        if (!inChunk || !sharedFrame->count(name) ||
+            std::find(parallelLoop->shared.begin(), parallelLoop->shared.end(), name) == parallelLoop->shared.end()) {
+            return false;
+        }
+    }
+    std::vector<RuntimeValue> locals(function.localCount);
+    for (int i = 0; i < function.localCount; ++i) {
+        auto it = frame.find(function.localNames[i]);
+        if (it != frame.end()) locals[i] = std::move(it->second);
+    }
+    // A parallel chunk's loop gets copies of the shared variables it reads,
+    // which it cannot assign and which are not written back
+    std::vector<bool> shared(function.localCount, false);
+    if (inChunk) {
+        const std::vector<std::string>& reads = parallelLoop->shared;
+        for (int i = 0; i < function.localCount; ++i) {
+            const std::string& name = function.localNames[i];
+            if (locals[i].type != RuntimeType::UNDEFINED || frame.count(name) ||
+                std::find(reads.begin(), reads.end(), name) == reads.end()) {
+                continue;
+            }
+            auto value = sharedFrame->find(name);
+            if (value != sharedFrame->end()) {
+                locals[i] = value->second;
+                shared[i] = true;
+            }
+        }
+    }
+
+    RuntimeValue result;
+    if (!osrVM->runLoop(entry->second, locals, result)) {
+        returnValue = std::move(result);
+        hasReturnValue = true;
+        return true;
+    }
+    for (int i = 0; i < function.localCount; ++i) {
+        const std::string& name = function.localNames[i];
+        if (shared[i]) continue;
+        if (locals[i].type != RuntimeType::UNDEFINED || frame.count(name)) {
+            frame[name] = std::move(locals[i]);
+        }
+    }
+    return true;
 }
 
 // Function call handling
 RuntimeValue Interpreter::callFunction(const std::string& name, const std::vector<RuntimeValue>& args) {
     // Check for built-in functions first
-    RuntimeValue builtinResult = handleBuiltinFunction(name, args);
-    if (builtinResult.type != RuntimeType::UNDEFINED) {
+    RuntimeValue builtinResult;
+    if (handleBuiltinFunction(name, args, builtinResult)) {
         return builtinResult;
     }
     
     // Look up user-defined function
     if (functions.find(name) == functions.end()) {
-        std::cerr << "Error: Undefined function '" << name << "'" << std::endl;
+        runtimeErrors() << "Error: Undefined function '" << name << "'" << std::endl;
         return RuntimeValue();
     }
     
     auto func = functions[name];
+    if (!step()) return RuntimeValue();
     
     // Check parameter count
     if (args.size() != func->parameters.size()) {
-        std::cerr << "Error: Function '" << name << "' expects " << func->parameters.size() 
+        runtimeErrors() << "Error: Function '" << name << "' expects " << func->parameters.size() 
                   << " arguments, got " << args.size() << std::endl;
         return RuntimeValue();
     }
     
+    // Pure recursive functions answer repeated arguments from their table
+    MemoTable* memo = nullptr;
+    if (!memoTables.empty()) {
+        auto table = memoTables.find(func.get());
+        if (table != memoTables.end() && MemoTable::memoizable(args.data(), args.size())) {
+            memo = &table->second;
+            RuntimeValue cached;
+            if (memo->lookup(args.data(), args.size(), cached)) return cached;
+        }
+    }
+    
     // Create new scope for function
     std::unordered_map<std::string, RuntimeValue> localScope;
     
@@ -258,7 +851,7 @@ RuntimeValue Interpreter::callFunction(const std::string& name, const std::vecto
     }
     
     // Push scope
-    callStack.push_back(localScope);
+    callStack.push_back(std::move(localScope));
     
     // Execute function body
     hasReturnValue = false;
@@ -268,29 +861,124 @@ RuntimeValue Interpreter::callFunction(const std::string& name, const std::vecto
     callStack.pop_back();
     
     // Return value
+    RuntimeValue result;  // undefined return
     if (hasReturnValue) {
-        RuntimeValue result = returnValue;
+        result = returnValue;
         hasReturnValue = false;
-        return result;
     }
-    
-    return RuntimeValue();  // undefined return
+    if (memo) memo->store(args.data(), args.size(), result);
+    return result;
 }
 
-// Built-in functions (none for now, but extensible)
-RuntimeValue Interpreter::handleBuiltinFunction(const std::string& name, const std::vector<RuntimeValue>& args) {
-    // Add built-in functions here if needed
-    return RuntimeValue();  // undefined = not a built-in
+bool Interpreter::isBuiltinFunction(const std::string& name) {
+    return name == "len" || name == "read_numbers" || name == "read_all" || name == "map_file" ||
+           name == "spawn" || name == "await";
+}
+
+// Built-in functions - returns false if name is not a built-in
+bool Interpreter::handleBuiltinFunction(const std::string& name, const std::vector<RuntimeValue>& args, RuntimeValue& result) {
+    // len(x) - element count of an array, character count of a string
+    if (name == "len") {
+        if (args.size() != 1) {
+            runtimeErrors() << "Error: len expects 1 argument, got " << args.size() << std::endl;
+            result = RuntimeValue();
+        } else if (args[0].type == RuntimeType::ARRAY) {
+            result = RuntimeValue(static_cast<int>(args[0].arrayValue->size()));
+        } else if (args[0].type == RuntimeType::MAPPED_ARRAY) {
+            result = RuntimeValue(static_cast<int>(args[0].mappedValue->size()));
+        } else if (args[0].type == RuntimeType::STRING) {
+            result = RuntimeValue(static_cast<int>(args[0].stringValue->size()));
+        } else {
+            runtimeErrors() << "Error: len expects an array or string" << std::endl;
+            result = RuntimeValue();
+        }
+        return true;
+    }
+
+    // read_numbers() - next input line parsed into an array of numbers
+    if (name == "read_numbers") {
+        std::vector<RuntimeValue> numbers;
+        input.readNumbers(numbers);
+        result = RuntimeValue(std::move(numbers));
+        return true;
+    }
+
+    // read_all() - everything left on input as one string
+    if (name == "read_all") {
+        result = RuntimeValue(input.readAll());
+        return true;
+    }
+
+    // map_file(path [, layout]) - read-only array view of a file, with layout
+    // "lines" (default), "int64" or "float64"
+    if (name == "map_file") {
+        result = RuntimeValue();
+        if (args.empty() || args.size() > 2) {
+            runtimeErrors() << "Error: map_file expects 1 or 2 arguments, got " << args.size() << std::endl;
+            return true;
+        }
+        
+        MappedLayout layout = MappedLayout::LINES;
+        if (args.size() == 2) {
+            std::string mode = args[1].toString();
+            if (mode == "int64") {
+                layout = MappedLayout::INT64;
+            } else if (mode == "float64") {
+                layout = MappedLayout::FLOAT64;
+            } else if (mode != "lines") {
+                runtimeErrors() << "Error: Unknown map_file layout '" << mode << "'" << std::endl;
+                return true;
+            }
+        }
+        
+        MappedFile* mapped = MappedFile::open(args[0].toString(), layout);
+        if (mapped) {
+            result = RuntimeValue(mapped);
+        }
+        return true;
+    }
+
+    // spawn("f", args...) - what spawn f(args...) compiles to
+    if (name == "spawn") {
+        result = spawnCall(args);
+        return true;
+    }
+
+    // await(task) - the task's result once its call has returned
+    if (name == "await") {
+        if (args.size() != 1 || args[0].type != RuntimeType::TASK) {
+            runtimeErrors() << "Error: await expects a task" << std::endl;
+            result = RuntimeValue();
+        } else {
+            result = awaitTask(*args[0].taskValue);
+        }
+        return true;
+    }
+
+    return false;
 }
 
 // Input handling - always returns string (your requirement)
 RuntimeValue Interpreter::handleInput() {
-    std::string input;
-    std::getline(std::cin, input);
-    return RuntimeValue(input);  // Always string!
+    std::string_view line;
+    if (!input.readLine(line)) {
+        return RuntimeValue("");
+    }
+    return RuntimeValue(std::string(line));  // Always string!
 }
 
 // Output handling - prints the value
 void Interpreter::handleOutput(const RuntimeValue& value) {
-    std::cout << value.toString() << std::endl;
+    if (chunk) {
+        chunk->output += value.toString();
+        chunk->output += '\n';
+        return;
+    }
+    std::string line = value.toString();
+    std::lock_guard<std::mutex> guard(outputLock());
+    *output << line << std::endl;
+}
+
+void Interpreter::logReductionTerm(const ReductionTerm& term, RuntimeValue value) {
+    chunk->terms.push_back({term.reduction, term.term, std::move(value)});
 }
@@ -0,0 +1,249 @@
+#include "../include/ir.h"
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+
+const char* irOpName(IROp op) {
+    static const char* const names[] = {
+#define IR_NAME(name) #name,
+        IR_OPCODES(IR_NAME)
+#undef IR_NAME
+    };
+    size_t index = static_cast<size_t>(op);
+    return index < static_cast<size_t>(IROp::COUNT) ? names[index] : "?";
+}
+
+std::vector<int> IRFunction::useCounts() const {
+    std::vector<int> counts(values.size(), 0);
+    for (const IRBlock& block : blocks) {
+        if (block.removed) continue;
+        for (int id : block.instrs) {
+            if (values[id].removed) continue;
+            for (int operand : values[id].operands) counts[operand]++;
+        }
+    }
+    return counts;
+}
+
+void IRFunction::replaceValues(const std::vector<int>& replacement) {
+    auto resolve = [&](int value) {
+        while (value < static_cast<int>(replacement.size()) && replacement[value] >= 0) {
+            value = replacement[value];
+        }
+        return value;
+    };
+    for (size_t id = 0; id < values.size(); ++id) {
+        if (id < replacement.size() && replacement[id] >= 0) {
+            values[id].removed = true;
+            continue;
+        }
+        for (int& operand : values[id].operands) operand = resolve(operand);
+    }
+}
+
+void IRFunction::removeEdge(int from, int to) {
+    std::vector<int>& succs = blocks[from].succs;
+    auto succ = std::find(succs.begin(), succs.end(), to);
+    if (succ != succs.end()) succs.erase(succ);
+
+    IRBlock& target = blocks[to];
+    auto pred = std::find(target.preds.begin(), target.preds.end(), from);
+    if (pred == target.preds.end()) return;
+    size_t index = pred - target.preds.begin();
+    target.preds.erase(pred);
+    for (int id : target.instrs) {
+        IRInstr& instr = values[id];
+        if (instr.op != IROp::PHI) break;
+        instr.operands.erase(instr.operands.begin() + index);
+    }
+}
+
+void IRFunction::compact() {
+    for (IRBlock& block : blocks) {
+        if (block.removed) {
+            for (int id : block.instrs) values[id].removed = true;
+            block.instrs.clear();
+            block.preds.clear();
+            block.succs.clear();
+            continue;
+        }
+        block.instrs.erase(std::remove_if(block.instrs.begin(), block.instrs.end(),
+                                          [&](int id) { return values[id].removed; }),
+                           block.instrs.end());
+    }
+}
+
+int IRFunction::constant(int index) {
+    // Constants sit at the top of the entry block, after the parameters
+    std::vector<int>& entry = blocks[0].instrs;
+    size_t at = 0;
+    for (; at < entry.size(); ++at) {
+        const IRInstr& instr = values[entry[at]];
+        if (instr.op == IROp::CONST && instr.a == index && !instr.removed) return entry[at];
+        if (instr.op != IROp::CONST && instr.op != IROp::PARAM) break;
+    }
+    int id = static_cast<int>(values.size());
+    IRInstr instr;
+    instr.op = IROp::CONST;
+    instr.a = index;
+    instr.block = 0;
+    values.push_back(std::move(instr));
+    entry.insert(entry.begin() + at, id);
+    return id;
+}
+
+int IRModule::constant(const RuntimeValue& value) {
+    std::string key = constantKey(value);
+    auto it = constantKeys.find(key);
+    if (it != constantKeys.end()) return it->second;
+    int index = static_cast<int>(constants.size());
+    constants.push_back(value);
+    constantKeys[key] = index;
+    return index;
+}
+
+int IRModule::name(const std::string& text) {
+    auto it = nameKeys.find(text);
+    if (it != nameKeys.end()) return it->second;
+    int index = static_cast<int>(names.size());
+    names.push_back(text);
+    nameKeys[text] = index;
+    return index;
+}
+
+void splitCriticalEdges(IRFunction& function) {
+    size_t blockCount = function.blocks.size();
+    for (size_t from = 0; from < blockCount; ++from) {
+        if (function.blocks[from].removed || function.blocks[from].succs.size() < 2) continue;
+        for (size_t i = 0; i < function.blocks[from].succs.size(); ++i) {
+            int to = function.blocks[from].succs[i];
+            const IRBlock& target = function.blocks[to];
+            if (target.instrs.empty() || function.values[target.instrs[0]].op != IROp::PHI) continue;
+
+            int middle = static_cast<int>(function.blocks.size());
+            int jump = static_cast<int>(function.values.size());
+            IRInstr instr;
+            instr.op = IROp::JUMP;
+            instr.block = middle;
+            function.values.push_back(std::move(instr));
+            IRBlock block;
+            block.instrs = {jump};
+            block.preds = {static_cast<int>(from)};
+            block.succs = {to};
+            function.blocks.push_back(std::move(block));
+
+            function.blocks[from].succs[i] = middle;
+            // With both branch targets equal, the earlier edge was already
+            // moved, so the first remaining entry belongs to this one
+            std::vector<int>& preds = function.blocks[to].preds;
+            *std::find(preds.begin(), preds.end(), static_cast<int>(from)) = middle;
+        }
+    }
+}
+
+std::vector<int> reversePostorder(const IRFunction& function) {
+    std::vector<int> order;
+    std::vector<bool> visited(function.blocks.size(), false);
+    // Successors are visited last to first, so the first one (the then
+    // branch or loop body) comes right after its block
+    std::vector<std::pair<int, int>> stack = {{0, static_cast<int>(function.blocks[0].succs.size())}};
+    visited[0] = true;
+    while (!stack.empty()) {
+        auto& top = stack.back();
+        if (top.second == 0) {
+            order.push_back(top.first);
+            stack.pop_back();
+            continue;
+        }
+        int next = function.blocks[top.first].succs[--top.second];
+        if (!visited[next]) {
+            visited[next] = true;
+            stack.push_back({next, static_cast<int>(function.blocks[next].succs.size())});
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+namespace {
+
+std::string typeName(TypeSet type) {
+    if (type == ANY_TYPE) return "any";
+    if (type == 0) return "none";
+    static const char* const names[] = {"str", "int", "float", "bool", "array", "mapped", "undef"};
+    std::string text;
+    for (int i = 0; i < TYPE_COUNT; ++i) {
+        if (!(type & (1u << i))) continue;
+        if (!text.empty()) text += "|";
+        text += names[i];
+    }
+    return text;
+}
+
+std::string lowerName(IROp op) {
+    std::string text = irOpName(op);
+    for (char& c : text) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return text;
+}
+
+} // namespace
+
+void printIR(const IRModule& module, const IRFunction& function) {
+    std::cout << "function " << function.name << " (params " << function.paramCount << ")\n";
+    for (size_t b = 0; b < function.blocks.size(); ++b) {
+        const IRBlock& block = function.blocks[b];
+        if (block.removed) continue;
+        std::cout << "bb" << b << ":";
+        if (!block.preds.empty()) {
+            std::cout << "    ; preds";
+            for (int pred : block.preds) std::cout << " bb" << pred;
+        }
+        std::cout << "\n";
+        for (int id : block.instrs) {
+            const IRInstr& instr = function.values[id];
+            std::cout << "    ";
+            if (!isTerminator(instr.op) && instr.op != IROp::OUTPUT) {
+                std::cout << "%" << id << ":" << typeName(instr.type) << " = ";
+            }
+            std::cout << lowerName(instr.op);
+            switch (instr.op) {
+                case IROp::CONST: {
+                    const RuntimeValue& value = module.constants[instr.a];
+                    if (value.type == RuntimeType::STRING) {
+                        std::cout << " \"" << *value.stringValue << "\"";
+                    } else {
+                        std::cout << " " << value.toString();
+                    }
+                    break;
+                }
+                case IROp::PARAM:
+                    std::cout << " " << instr.a;
+                    break;
+                case IROp::UNASSIGNED:
+                case IROp::CHECK:
+                    std::cout << " " << module.names[instr.a];
+                    break;
+                case IROp::CALL:
+                    std::cout << " " << module.functions[instr.a].name;
+                    break;
+                case IROp::CALL_BUILTIN:
+                    std::cout << " " << module.names[instr.a];
+                    break;
+                default:
+                    break;
+            }
+            for (size_t i = 0; i < instr.operands.size(); ++i) {
+                std::cout << (i == 0 ? " " : ", ") << "%" << instr.operands[i];
+                if (instr.op == IROp::PHI) std::cout << " bb" << block.preds[i];
+            }
+            if (instr.op == IROp::INDEX && instr.a) std::cout << " (unchecked)";
+            if (instr.op == IROp::JUMP || instr.op == IROp::BRANCH) {
+                for (size_t i = 0; i < block.succs.size(); ++i) {
+                    std::cout << (i == 0 && instr.op == IROp::JUMP ? " " : ", ") << "bb" << block.succs[i];
+                }
+            }
+            if (!instr.variable.empty()) std::cout << "    ; " << instr.variable;
+            std::cout << "\n";
+        }
+    }
+}
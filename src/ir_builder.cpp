@@ -0,0 +1,519 @@
+#include "../include/ir.h"
+#include "../include/interpreter.h"
+#include <unordered_set>
+
+namespace {
+
+class FunctionBuilder {
+private:
+    IRModule& module;
+    IRFunction& function;
+    // Names stored to somewhere in the function; reading any other name
+    // reports an undefined variable
+    std::unordered_set<std::string> locals;
+    std::vector<std::unordered_map<std::string, int>> currentDef;
+    std::vector<bool> sealed;
+    std::vector<std::vector<std::pair<std::string, int>>> incompletePhis;
+    // Trivial phis and the value they stand for
+    std::unordered_map<int, int> forwarded;
+    // Phis whose operands are being read, not to be judged yet
+    std::unordered_set<int> filling;
+    int current;
+
+    int newBlock() {
+        int id = static_cast<int>(function.blocks.size());
+        function.blocks.emplace_back();
+        currentDef.emplace_back();
+        sealed.push_back(false);
+        incompletePhis.emplace_back();
+        return id;
+    }
+
+    int add(IROp op, std::vector<int> operands = {}, int32_t a = 0) {
+        int id = static_cast<int>(function.values.size());
+        IRInstr instr;
+        instr.op = op;
+        instr.a = a;
+        instr.operands = std::move(operands);
+        instr.block = current;
+        function.values.push_back(std::move(instr));
+        function.blocks[current].instrs.push_back(id);
+        return id;
+    }
+
+    int constant(const RuntimeValue& value) {
+        int id = function.constant(module.constant(value));
+        function.values[id].type = typeBit(value.type);
+        return id;
+    }
+
+    void addEdge(int from, int to) {
+        function.blocks[from].succs.push_back(to);
+        function.blocks[to].preds.push_back(from);
+    }
+
+    void jumpTo(int target) {
+        add(IROp::JUMP);
+        addEdge(current, target);
+    }
+
+    void branch(int condition, int ifTrue, int ifFalse) {
+        add(IROp::BRANCH, {condition});
+        addEdge(current, ifTrue);
+        addEdge(current, ifFalse);
+    }
+
+    int resolve(int value) const {
+        auto it = forwarded.find(value);
+        while (it != forwarded.end()) {
+            value = it->second;
+            it = forwarded.find(value);
+        }
+        return value;
+    }
+
+    int newPhi(int block) {
+        int id = static_cast<int>(function.values.size());
+        IRInstr instr;
+        instr.op = IROp::PHI;
+        instr.block = block;
+        function.values.push_back(std::move(instr));
+        std::vector<int>& instrs = function.blocks[block].instrs;
+        size_t at = 0;
+        while (at < instrs.size() && function.values[instrs[at]].op == IROp::PHI) ++at;
+        instrs.insert(instrs.begin() + at, id);
+        return id;
+    }
+
+    void writeVariable(const std::string& name, int block, int value) {
+        currentDef[block][name] = value;
+    }
+
+    int readVariable(const std::string& name, int block) {
+        auto it = currentDef[block].find(name);
+        if (it != currentDef[block].end()) return resolve(it->second);
+
+        int value;
+        const std::vector<int>& preds = function.blocks[block].preds;
+        if (!sealed[block]) {
+            // More predecessors may follow, complete the phi in sealBlock()
+            value = newPhi(block);
+            function.values[value].variable = name;
+            incompletePhis[block].push_back({name, value});
+        } else if (preds.size() == 1) {
+            value = readVariable(name, preds[0]);
+        } else if (preds.empty()) {
+            // Assigned later in the function, or only on other paths
+            value = constant(RuntimeValue());
+        } else {
+            value = newPhi(block);
+            function.values[value].variable = name;
+            // Break cycles through loops before visiting the predecessors
+            writeVariable(name, block, value);
+            value = addPhiOperands(name, value);
+        }
+        writeVariable(name, block, value);
+        return value;
+    }
+
+    int addPhiOperands(const std::string& name, int phi) {
+        int block = function.values[phi].block;
+        filling.insert(phi);
+        for (int pred : function.blocks[block].preds) {
+            int operand = readVariable(name, pred);
+            function.values[phi].operands.push_back(operand);
+        }
+        filling.erase(phi);
+        return tryRemoveTrivialPhi(phi);
+    }
+
+    // A phi that only merges one value (besides itself) is that value
+    int tryRemoveTrivialPhi(int phi) {
+        int same = -1;
+        for (int operand : function.values[phi].operands) {
+            operand = resolve(operand);
+            if (operand == same || operand == phi) continue;
+            if (same >= 0) return phi;
+            same = operand;
+        }
+        if (same < 0) same = constant(RuntimeValue());
+        forwarded[phi] = same;
+        function.values[phi].removed = true;
+
+        for (size_t user = 0; user < function.values.size(); ++user) {
+            const IRInstr& instr = function.values[user];
+            if (instr.op != IROp::PHI || instr.removed || static_cast<int>(user) == phi ||
+                filling.count(static_cast<int>(user))) {
+                continue;
+            }
+            for (int operand : instr.operands) {
+                if (resolve(operand) == same && operand != same) {
+                    tryRemoveTrivialPhi(static_cast<int>(user));
+                    break;
+                }
+            }
+        }
+        return same;
+    }
+
+    void sealBlock(int block) {
+        for (const auto& pending : incompletePhis[block]) {
+            addPhiOperands(pending.first, pending.second);
+        }
+        incompletePhis[block].clear();
+        sealed[block] = true;
+    }
+
+    bool terminated() const {
+        const std::vector<int>& instrs = function.blocks[current].instrs;
+        return !instrs.empty() && isTerminator(function.values[instrs.back()].op);
+    }
+
+    void lowerCondition(const ASTNodePtr& expr, int ifTrue, int ifFalse) {
+        if (!expr) {
+            jumpTo(ifTrue);
+            return;
+        }
+        if (auto binary = std::dynamic_pointer_cast<ASTBinaryExpression>(expr)) {
+            if (binary->op == "&&" || binary->op == "||") {
+                int rest = newBlock();
+                if (binary->op == "&&") {
+                    lowerCondition(binary->left, rest, ifFalse);
+                } else {
+                    lowerCondition(binary->left, ifTrue, rest);
+                }
+                sealBlock(rest);
+                current = rest;
+                lowerCondition(binary->right, ifTrue, ifFalse);
+                return;
+            }
+        } else if (auto unary = std::dynamic_pointer_cast<ASTUnaryExpression>(expr)) {
+            if (unary->op == "!") {
+                lowerCondition(unary->operand, ifFalse, ifTrue);
+                return;
+            }
+        } else if (auto grouped = std::dynamic_pointer_cast<ASTGroupedExpression>(expr)) {
+            lowerCondition(grouped->expression, ifTrue, ifFalse);
+            return;
+        }
+        branch(lowerExpression(expr), ifTrue, ifFalse);
+    }
+
+    int lowerExpression(const ASTNodePtr& expr) {
+        if (auto literal = std::dynamic_pointer_cast<ASTLiteral>(expr)) {
+            return constant(std::visit([](const auto& val) -> RuntimeValue {
+                using T = std::decay_t<decltype(val)>;
+                if constexpr (std::is_same_v<T, char>) {
+                    return RuntimeValue(std::string(1, val));
+                } else {
+                    return RuntimeValue(val);
+                }
+            }, literal->value));
+        }
+
+        if (auto identifier = std::dynamic_pointer_cast<ASTIdentifier>(expr)) {
+            if (locals.count(identifier->name)) return readChecked(identifier->name);
+            return add(IROp::UNASSIGNED, {}, module.name(identifier->name));
+        }
+
+        if (auto binary = std::dynamic_pointer_cast<ASTBinaryExpression>(expr)) {
+            if (binary->op == "&&" || binary->op == "||") {
+                // Short-circuit to a boolean, like Interpreter::evaluateCondition
+                int ifTrue = newBlock();
+                int ifFalse = newBlock();
+                int join = newBlock();
+                lowerCondition(expr, ifTrue, ifFalse);
+                sealBlock(ifTrue);
+                sealBlock(ifFalse);
+                current = ifTrue;
+                int yes = constant(RuntimeValue(true));
+                jumpTo(join);
+                current = ifFalse;
+                int no = constant(RuntimeValue(false));
+                jumpTo(join);
+                sealBlock(join);
+                current = join;
+                int phi = newPhi(join);
+                function.values[phi].operands = {yes, no};
+                return phi;
+            }
+
+            int left = lowerExpression(binary->left);
+            int right = lowerExpression(binary->right);
+            BinaryOp op = binaryOpFromSymbol(binary->op);
+            if (op == BinaryOp::INVALID) {
+                std::cerr << "Error: Unknown binary operation: " << binary->op << std::endl;
+                return constant(RuntimeValue());
+            }
+            return add(static_cast<IROp>(static_cast<int>(IROp::ADD) + static_cast<int>(op)), {left, right});
+        }
+
+        if (auto unary = std::dynamic_pointer_cast<ASTUnaryExpression>(expr)) {
+            int operand = lowerExpression(unary->operand);
+            if (unary->op == "-") return add(IROp::NEG, {operand});
+            if (unary->op == "!") return add(IROp::NOT, {operand});
+            std::cerr << "Error: Unknown unary operation: " << unary->op << std::endl;
+            return constant(RuntimeValue());
+        }
+
+        if (auto funcCall = std::dynamic_pointer_cast<ASTFunctionCall>(expr)) {
+            auto callee = std::dynamic_pointer_cast<ASTIdentifier>(funcCall->callee);
+            if (!callee) {
+                std::cerr << "Error: Invalid function call" << std::endl;
+                return constant(RuntimeValue());
+            }
+            std::vector<int> args;
+            for (const auto& arg : funcCall->arguments) {
+                args.push_back(lowerExpression(arg));
+            }
+            auto target = module.functionIndex.find(callee->name);
+            if (!Interpreter::isBuiltinFunction(callee->name) && target != module.functionIndex.end()) {
+                return add(IROp::CALL, std::move(args), target->second);
+            }
+            return add(IROp::CALL_BUILTIN, std::move(args), module.name(callee->name));
+        }
+
+        if (auto arrayLit = std::dynamic_pointer_cast<ASTArrayLiteral>(expr)) {
+            std::vector<int> elements;
+            for (const auto& elem : arrayLit->elements) {
+                elements.push_back(lowerExpression(elem));
+            }
+            return add(IROp::MAKE_ARRAY, std::move(elements));
+        }
+
+        if (auto arrayAccess = std::dynamic_pointer_cast<ASTArrayAccess>(expr)) {
+            int array = lowerExpression(arrayAccess->array);
+            int index = lowerExpression(arrayAccess->index);
+            return add(IROp::INDEX, {array, index}, arrayAccess->inBounds ? 1 : 0);
+        }
+
+        if (auto grouped = std::dynamic_pointer_cast<ASTGroupedExpression>(expr)) {
+            return lowerExpression(grouped->expression);
+        }
+
+        std::cerr << "Error: Unknown expression type" << std::endl;
+        return constant(RuntimeValue());
+    }
+
+    // "s = s + a + b ..." - see Interpreter::appendInPlace
+    bool lowerAppend(const ASTAssignment& assignment) {
+        std::vector<const ASTNodePtr*> pieces;
+        ASTNode* node = assignment.expression.get();
+        while (true) {
+            if (auto grouped = dynamic_cast<ASTGroupedExpression*>(node)) {
+                node = grouped->expression.get();
+                continue;
+            }
+            auto binary = dynamic_cast<ASTBinaryExpression*>(node);
+            if (!binary || binary->op != "+") break;
+            pieces.push_back(&binary->right);
+            node = binary->left.get();
+        }
+        auto base = dynamic_cast<ASTIdentifier*>(node);
+        if (pieces.empty() || !base || base->name != assignment.variable) return false;
+
+        std::vector<int> operands = {readChecked(assignment.variable)};
+        for (auto it = pieces.rbegin(); it != pieces.rend(); ++it) {
+            operands.push_back(lowerExpression(**it));
+        }
+        assign(assignment.variable, add(IROp::APPEND, std::move(operands)));
+        return true;
+    }
+
+    // The undefined that readVariable() finds before any assignment
+    bool isUnassigned(int value) const {
+        const IRInstr& instr = function.values[value];
+        return instr.op == IROp::CONST && module.constants[instr.a].type == RuntimeType::UNDEFINED;
+    }
+
+    // Reads name where it may not have been assigned yet on every path, as
+    // a CHECK that build() drops again if it was
+    int readChecked(const std::string& name) {
+        int value = readVariable(name, current);
+        if (function.values[value].op != IROp::PHI && !isUnassigned(value)) return value;
+        return add(IROp::CHECK, {value}, module.name(name));
+    }
+
+    // Drops the checks of values that are assigned on every path: all but
+    // the phis that merge the unassigned undefined, directly or through
+    // other phis
+    void removeAssignedChecks() {
+        std::vector<bool> maybeUnassigned(function.values.size(), false);
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t id = 0; id < function.values.size(); ++id) {
+                const IRInstr& instr = function.values[id];
+                if (instr.op != IROp::PHI || instr.removed || maybeUnassigned[id]) continue;
+                for (int operand : instr.operands) {
+                    if (isUnassigned(operand) || maybeUnassigned[operand]) {
+                        maybeUnassigned[id] = true;
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+        }
+        std::vector<int> replacement(function.values.size(), -1);
+        for (size_t id = 0; id < function.values.size(); ++id) {
+            const IRInstr& instr = function.values[id];
+            if (instr.op != IROp::CHECK || instr.removed) continue;
+            int checked = instr.operands[0];
+            if (!isUnassigned(checked) && !maybeUnassigned[checked]) replacement[id] = checked;
+        }
+        function.replaceValues(replacement);
+    }
+
+    void assign(const std::string& name, int value) {
+        IRInstr& instr = function.values[value];
+        if (instr.variable.empty() && instr.op != IROp::CONST) instr.variable = name;
+        writeVariable(name, current, value);
+    }
+
+    void lowerStatement(const ASTNodePtr& stmt) {
+        if (!stmt) return;
+
+        if (auto assignment = std::dynamic_pointer_cast<ASTAssignment>(stmt)) {
+            if (lowerAppend(*assignment)) return;
+            assign(assignment->variable, lowerExpression(assignment->expression));
+            return;
+        }
+
+        if (auto input = std::dynamic_pointer_cast<ASTInput>(stmt)) {
+            assign(input->variable, add(IROp::INPUT));
+            return;
+        }
+
+        if (auto output = std::dynamic_pointer_cast<ASTOutput>(stmt)) {
+            add(IROp::OUTPUT, {lowerExpression(output->expression)});
+            return;
+        }
+
+        if (auto returnStmt = std::dynamic_pointer_cast<ASTReturn>(stmt)) {
+            if (returnStmt->expression) {
+                add(IROp::RETURN, {lowerExpression(returnStmt->expression)});
+            } else {
+                add(IROp::RETURN);
+            }
+            // Anything after the return goes to a block nothing jumps to
+            current = newBlock();
+            sealBlock(current);
+            return;
+        }
+
+        if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(stmt)) {
+            int thenBlock = newBlock();
+            int elseBlock = ifStmt->elseBlock ? newBlock() : -1;
+            int join = newBlock();
+            lowerCondition(ifStmt->condition, thenBlock, elseBlock >= 0 ? elseBlock : join);
+            sealBlock(thenBlock);
+            current = thenBlock;
+            lowerStatement(ifStmt->thenBlock);
+            jumpTo(join);
+            if (elseBlock >= 0) {
+                sealBlock(elseBlock);
+                current = elseBlock;
+                lowerStatement(ifStmt->elseBlock);
+                jumpTo(join);
+            }
+            sealBlock(join);
+            current = join;
+            return;
+        }
+
+        if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(stmt)) {
+            lowerStatement(forStmt->init);
+            int header = newBlock();
+            jumpTo(header);
+            int body = newBlock();
+            int exit = newBlock();
+            current = header;
+            lowerCondition(forStmt->condition, body, exit);
+            sealBlock(body);
+            current = body;
+            lowerStatement(forStmt->body);
+            lowerStatement(forStmt->increment);
+            jumpTo(header);
+            sealBlock(header);
+            sealBlock(exit);
+            current = exit;
+            return;
+        }
+
+        if (auto block = std::dynamic_pointer_cast<ASTBlock>(stmt)) {
+            for (const auto& s : block->statements) {
+                lowerStatement(s);
+            }
+            return;
+        }
+
+        std::cerr << "Error: Unknown statement type" << std::endl;
+    }
+
+    // Drops the blocks after returns that nothing jumps to
+    void removeUnreachable() {
+        std::vector<bool> reachable(function.blocks.size(), false);
+        for (int block : reversePostorder(function)) reachable[block] = true;
+        for (size_t block = 0; block < function.blocks.size(); ++block) {
+            if (reachable[block]) continue;
+            std::vector<int> succs = function.blocks[block].succs;
+            for (int succ : succs) function.removeEdge(static_cast<int>(block), succ);
+            function.blocks[block].removed = true;
+        }
+    }
+
+public:
+    FunctionBuilder(IRModule& module, IRFunction& function)
+        : module(module), function(function), current(0) {}
+
+    void build(const ASTFunction& source) {
+        function.name = source.name;
+        function.paramCount = static_cast<int>(source.parameters.size());
+        for (const auto& name : collectLocalNames(source)) {
+            locals.insert(name);
+        }
+
+        current = newBlock();
+        sealBlock(current);
+        for (size_t i = 0; i < source.parameters.size(); ++i) {
+            int param = add(IROp::PARAM, {}, static_cast<int32_t>(i));
+            assign(source.parameters[i], param);
+        }
+        lowerStatement(source.body);
+        if (!terminated()) add(IROp::RETURN);
+
+        std::vector<int> replacement(function.values.size(), -1);
+        for (const auto& entry : forwarded) replacement[entry.first] = resolve(entry.first);
+        function.replaceValues(replacement);
+        removeAssignedChecks();
+        removeUnreachable();
+        function.compact();
+    }
+};
+
+} // namespace
+
+IRModule buildIR(const ASTProgram& program) {
+    IRModule module;
+
+    // Same indices as compileProgram(), later definitions replace earlier ones
+    std::vector<std::shared_ptr<ASTFunction>> sources;
+    for (const auto& node : program.functions) {
+        auto func = std::dynamic_pointer_cast<ASTFunction>(node);
+        if (!func) continue;
+        auto existing = module.functionIndex.find(func->name);
+        if (existing != module.functionIndex.end()) {
+            sources[existing->second] = func;
+            continue;
+        }
+        module.functionIndex[func->name] = static_cast<int>(sources.size());
+        sources.push_back(func);
+    }
+
+    module.functions.resize(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i) {
+        FunctionBuilder builder(module, module.functions[i]);
+        builder.build(*sources[i]);
+    }
+    return module;
+}
@@ -0,0 +1,532 @@
+#include "../include/ir.h"
+#include <algorithm>
+#include <unordered_set>
+
+namespace {
+
+class FunctionLowering {
+private:
+    const IRModule& module;
+    IRFunction& function;
+    CompiledFunction& out;
+    std::vector<int> order;
+    std::vector<int> uses;
+    std::vector<int> user;
+    std::vector<bool> usedByPhi;
+    // Computed on the operand stack at its only use instead of in a slot
+    std::vector<bool> inlined;
+    // Per block, the instructions emitted as statements, in order
+    std::vector<std::vector<int>> roots;
+    std::vector<int> slot;
+    int depth;
+    std::vector<size_t> blockStart;
+    std::vector<std::pair<size_t, int>> jumps;
+
+    const IRInstr& value(int id) const { return function.values[id]; }
+
+    static bool producesValue(IROp op) { return op != IROp::OUTPUT && !isTerminator(op); }
+
+    // Used once, later in the same block, by something other than a phi
+    bool stackable(int id) const {
+        switch (value(id).op) {
+            case IROp::CONST:
+            case IROp::PARAM:
+            case IROp::PHI:
+            case IROp::INPUT:
+            case IROp::APPEND:
+            case IROp::OUTPUT:
+            case IROp::JUMP:
+            case IROp::BRANCH:
+            case IROp::RETURN:
+                return false;
+            default:
+                // CHECK reads its operand from a slot, see emitTree()
+                return uses[id] == 1 && !usedByPhi[id] && value(user[id]).block == value(id).block &&
+                       value(user[id]).op != IROp::CHECK;
+        }
+    }
+
+    bool needsSlot(int id) const {
+        const IRInstr& instr = value(id);
+        if (!producesValue(instr.op) || instr.op == IROp::CONST || inlined[id]) return false;
+        // INPUT and APPEND always write their result into a slot
+        return uses[id] > 0 || instr.op == IROp::PARAM || instr.op == IROp::INPUT || instr.op == IROp::APPEND;
+    }
+
+    void countUses() {
+        uses = function.useCounts();
+        user.assign(function.values.size(), -1);
+        usedByPhi.assign(function.values.size(), false);
+        for (int block : order) {
+            for (int id : function.blocks[block].instrs) {
+                for (int operand : value(id).operands) {
+                    user[operand] = id;
+                    if (value(id).op == IROp::PHI) usedByPhi[operand] = true;
+                }
+            }
+        }
+    }
+
+    // Operands stay on the stack when they are evaluated in the order the
+    // instruction needs them and nothing with effects runs in between
+    void stackify(int block) {
+        std::vector<int> pending;
+        for (int id : function.blocks[block].instrs) {
+            const IRInstr& instr = value(id);
+            if (instr.op == IROp::CONST || instr.op == IROp::PARAM || instr.op == IROp::PHI) continue;
+
+            std::vector<int> wanted;
+            for (int operand : instr.operands) {
+                if (stackable(operand)) wanted.push_back(operand);
+            }
+            bool root = !stackable(id);
+            bool onTop = wanted.size() <= pending.size() &&
+                         std::equal(wanted.begin(), wanted.end(), pending.end() - wanted.size());
+            // Whatever instr does not consume has to run before it
+            size_t flushed = !onTop ? pending.size() : root ? pending.size() - wanted.size() : 0;
+            for (size_t i = 0; i < flushed; ++i) roots[block].push_back(pending[i]);
+            pending.erase(pending.begin(), pending.begin() + flushed);
+            if (onTop) {
+                for (int operand : wanted) inlined[operand] = true;
+                pending.resize(pending.size() - wanted.size());
+            }
+            if (root) {
+                roots[block].push_back(id);
+            } else {
+                pending.push_back(id);
+            }
+        }
+    }
+
+    // Slotted values read while evaluating id, including its inlined operands
+    void collectReads(int id, std::vector<int>& reads) const {
+        for (int operand : value(id).operands) {
+            if (value(operand).op == IROp::CONST) continue;
+            if (inlined[operand]) {
+                collectReads(operand, reads);
+            } else {
+                reads.push_back(operand);
+            }
+        }
+    }
+
+    // Phi operands read by the copies at the end of block
+    void collectPhiReads(int block, std::vector<int>& reads) const {
+        for (int succ : function.blocks[block].succs) {
+            const IRBlock& target = function.blocks[succ];
+            size_t index = std::find(target.preds.begin(), target.preds.end(), block) - target.preds.begin();
+            for (int id : target.instrs) {
+                const IRInstr& phi = value(id);
+                if (phi.op != IROp::PHI) break;
+                if (!needsSlot(id)) continue;
+                int operand = phi.operands[index];
+                if (value(operand).op != IROp::CONST) reads.push_back(operand);
+            }
+        }
+    }
+
+    std::vector<std::unordered_set<int>> buildInterference() {
+        size_t count = function.values.size();
+        std::vector<std::vector<char>> liveIn(function.blocks.size(), std::vector<char>(count, 0));
+        std::vector<std::vector<char>> liveOut = liveIn;
+
+        // Upward exposed reads and definitions of each block
+        std::vector<std::vector<int>> reads(function.blocks.size());
+        std::vector<std::vector<char>> defined(function.blocks.size(), std::vector<char>(count, 0));
+        for (int block : order) {
+            for (int id : function.blocks[block].instrs) {
+                if (needsSlot(id)) defined[block][id] = 1;
+            }
+            std::vector<int> all;
+            for (int root : roots[block]) collectReads(root, all);
+            for (int id : all) {
+                if (!defined[block][id]) reads[block].push_back(id);
+            }
+        }
+
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (auto it = order.rbegin(); it != order.rend(); ++it) {
+                int block = *it;
+                std::vector<char> out(count, 0);
+                for (int succ : function.blocks[block].succs) {
+                    for (size_t id = 0; id < count; ++id) {
+                        if (liveIn[succ][id]) out[id] = 1;
+                    }
+                }
+                std::vector<int> phiReads;
+                collectPhiReads(block, phiReads);
+                for (int id : phiReads) out[id] = 1;
+
+                std::vector<char> in(count, 0);
+                for (size_t id = 0; id < count; ++id) {
+                    if (out[id] && !defined[block][id]) in[id] = 1;
+                }
+                for (int id : reads[block]) in[id] = 1;
+                if (out != liveOut[block] || in != liveIn[block]) {
+                    liveOut[block] = std::move(out);
+                    liveIn[block] = std::move(in);
+                    changed = true;
+                }
+            }
+        }
+
+        std::vector<std::unordered_set<int>> interference(count);
+        auto interfere = [&](int a, int b) {
+            if (a == b) return;
+            interference[a].insert(b);
+            interference[b].insert(a);
+        };
+        for (int block : order) {
+            std::vector<char> live = liveOut[block];
+            std::vector<int> members;
+            for (size_t id = 0; id < count; ++id) {
+                if (live[id]) members.push_back(static_cast<int>(id));
+            }
+            auto forEachLive = [&](auto action) {
+                size_t kept = 0;
+                for (int id : members) {
+                    if (!live[id]) continue;
+                    members[kept++] = id;
+                    action(id);
+                }
+                members.resize(kept);
+            };
+
+            const std::vector<int>& blockRoots = roots[block];
+            for (auto it = blockRoots.rbegin(); it != blockRoots.rend(); ++it) {
+                int root = *it;
+                if (needsSlot(root)) {
+                    forEachLive([&](int other) { interfere(root, other); });
+                    live[root] = 0;
+                }
+                std::vector<int> rootReads;
+                collectReads(root, rootReads);
+                for (int id : rootReads) {
+                    if (!live[id]) {
+                        live[id] = 1;
+                        members.push_back(id);
+                    }
+                }
+            }
+            // Phis and parameters are all written on entry to the block
+            std::vector<int> entryDefs;
+            for (int id : function.blocks[block].instrs) {
+                IROp op = value(id).op;
+                if ((op == IROp::PHI || op == IROp::PARAM) && needsSlot(id)) entryDefs.push_back(id);
+            }
+            for (int id : entryDefs) {
+                forEachLive([&](int other) { interfere(id, other); });
+                for (int other : entryDefs) interfere(id, other);
+            }
+        }
+        return interference;
+    }
+
+    // Gives every slotted value a local slot. Phis share one with their
+    // operands, and APPEND with its target, unless they interfere; then the
+    // copy or in-place append comes for free.
+    void assignSlots() {
+        size_t count = function.values.size();
+        std::vector<std::unordered_set<int>> interference = buildInterference();
+
+        std::vector<int> parent(count);
+        std::vector<std::vector<int>> members(count);
+        std::vector<int> param(count, -1);
+        for (size_t id = 0; id < count; ++id) {
+            parent[id] = static_cast<int>(id);
+            members[id] = {static_cast<int>(id)};
+            if (value(static_cast<int>(id)).op == IROp::PARAM) param[id] = value(static_cast<int>(id)).a;
+        }
+        auto find = [&](int id) {
+            while (parent[id] != id) id = parent[id] = parent[parent[id]];
+            return id;
+        };
+        auto tryUnion = [&](int a, int b) {
+            a = find(a);
+            b = find(b);
+            if (a == b || (param[a] >= 0 && param[b] >= 0)) return;
+            for (int member : members[a]) {
+                for (int other : interference[member]) {
+                    if (find(other) == b) return;
+                }
+            }
+            if (members[a].size() < members[b].size()) std::swap(a, b);
+            parent[b] = a;
+            members[a].insert(members[a].end(), members[b].begin(), members[b].end());
+            members[b].clear();
+            if (param[a] < 0) param[a] = param[b];
+        };
+
+        for (int block : order) {
+            for (int root : roots[block]) {
+                const IRInstr& instr = value(root);
+                if (instr.op == IROp::APPEND && needsSlot(instr.operands[0])) tryUnion(root, instr.operands[0]);
+            }
+        }
+        for (int block : order) {
+            for (int id : function.blocks[block].instrs) {
+                const IRInstr& instr = value(id);
+                if (instr.op != IROp::PHI) break;
+                if (!needsSlot(id)) continue;
+                for (int operand : instr.operands) {
+                    if (needsSlot(operand)) tryUnion(id, operand);
+                }
+            }
+        }
+
+        // Greedy colouring of the classes; parameters arrive in their slots
+        std::vector<int> color(count, -1);
+        std::vector<int> classes;
+        for (size_t id = 0; id < count; ++id) {
+            if (needsSlot(static_cast<int>(id)) && find(static_cast<int>(id)) == static_cast<int>(id)) {
+                classes.push_back(static_cast<int>(id));
+                if (param[id] >= 0) color[id] = param[id];
+            }
+        }
+        int slotCount = function.paramCount;
+        for (int root : classes) {
+            if (color[root] >= 0) continue;
+            std::vector<bool> taken;
+            for (int member : members[root]) {
+                for (int other : interference[member]) {
+                    int c = color[find(other)];
+                    if (c < 0) continue;
+                    if (static_cast<size_t>(c) >= taken.size()) taken.resize(c + 1, false);
+                    taken[c] = true;
+                }
+            }
+            int c = 0;
+            while (static_cast<size_t>(c) < taken.size() && taken[c]) ++c;
+            color[root] = c;
+            slotCount = std::max(slotCount, c + 1);
+        }
+
+        slot.assign(count, -1);
+        out.localNames.assign(slotCount, "");
+        for (size_t id = 0; id < count; ++id) {
+            if (!needsSlot(static_cast<int>(id))) continue;
+            slot[id] = color[find(static_cast<int>(id))];
+            const std::string& name = value(static_cast<int>(id)).variable;
+            if (out.localNames[slot[id]].empty() && !name.empty()) out.localNames[slot[id]] = name;
+        }
+        for (int s = 0; s < slotCount; ++s) {
+            if (out.localNames[s].empty()) out.localNames[s] = "$t" + std::to_string(s);
+        }
+        out.localCount = slotCount;
+    }
+
+    void emit(OpCode op, int32_t a = 0, int32_t b = 0) {
+        out.code.push_back({op, a, b});
+        depth += stackEffect(op, a, b);
+        if (depth > out.maxStack) out.maxStack = depth;
+    }
+
+    void emitJump(OpCode op, int target) {
+        jumps.push_back({out.code.size(), target});
+        emit(op);
+    }
+
+    // Pushes the value of id
+    void emitValue(int id) {
+        const IRInstr& instr = value(id);
+        if (instr.op == IROp::CONST) {
+            emit(OpCode::LOAD_CONST, instr.a);
+        } else if (inlined[id]) {
+            emitTree(id);
+        } else {
+            emit(OpCode::LOAD_LOCAL, slot[id]);
+        }
+    }
+
+    void emitOperands(const IRInstr& instr) {
+        for (int operand : instr.operands) emitValue(operand);
+    }
+
+    // Computes id onto the stack
+    void emitTree(int id) {
+        const IRInstr& instr = value(id);
+        int32_t argc = static_cast<int32_t>(instr.operands.size());
+        switch (instr.op) {
+            case IROp::UNASSIGNED:
+                emit(OpCode::LOAD_UNASSIGNED, instr.a);
+                break;
+            case IROp::CHECK: {
+                const IRInstr& checked = value(instr.operands[0]);
+                if (checked.op != IROp::CONST) {
+                    emit(OpCode::LOAD_LOCAL_CHECKED, slot[instr.operands[0]], instr.a);
+                } else if (module.constants[checked.a].type == RuntimeType::UNDEFINED) {
+                    emit(OpCode::LOAD_UNASSIGNED, instr.a);
+                } else {
+                    emit(OpCode::LOAD_CONST, checked.a);
+                }
+                break;
+            }
+            case IROp::NEG:
+                emitOperands(instr);
+                emit(OpCode::NEG);
+                break;
+            case IROp::NOT:
+                emitOperands(instr);
+                emit(OpCode::NOT);
+                break;
+            case IROp::CALL:
+                emitOperands(instr);
+                emit(OpCode::CALL, instr.a, argc);
+                break;
+            case IROp::CALL_BUILTIN:
+                emitOperands(instr);
+                emit(OpCode::CALL_BUILTIN, instr.a, argc);
+                break;
+            case IROp::MAKE_ARRAY:
+                emitOperands(instr);
+                emit(OpCode::MAKE_ARRAY, argc);
+                break;
+            case IROp::INDEX: {
+                int array = instr.operands[0];
+                int index = instr.operands[1];
+                if (instr.a && slot[array] >= 0 && slot[index] >= 0) {
+                    emit(OpCode::INDEX_LOCAL_LOCAL_UNCHECKED, slot[array], slot[index]);
+                } else {
+                    emitOperands(instr);
+                    emit(OpCode::INDEX);
+                }
+                break;
+            }
+            default:
+                // ADD..GE, laid out like the opcodes
+                emitOperands(instr);
+                emit(static_cast<OpCode>(static_cast<int>(OpCode::ADD) + static_cast<int>(binaryOpOf(instr.op))));
+                break;
+        }
+    }
+
+    // Parallel copies into the phis of the successor: every source is
+    // loaded before any phi slot is written
+    void emitPhiCopies(int block, int succ) {
+        const IRBlock& target = function.blocks[succ];
+        size_t index = std::find(target.preds.begin(), target.preds.end(), block) - target.preds.begin();
+        std::vector<int> targets;
+        for (int id : target.instrs) {
+            const IRInstr& phi = value(id);
+            if (phi.op != IROp::PHI) break;
+            if (!needsSlot(id)) continue;
+            int operand = phi.operands[index];
+            if (value(operand).op != IROp::CONST && slot[operand] == slot[id]) continue;
+            emitValue(operand);
+            targets.push_back(slot[id]);
+        }
+        for (auto it = targets.rbegin(); it != targets.rend(); ++it) {
+            emit(OpCode::STORE_LOCAL, *it);
+        }
+    }
+
+    void emitRoot(int id, int block, int next) {
+        const IRInstr& instr = value(id);
+        switch (instr.op) {
+            case IROp::JUMP:
+                emitPhiCopies(block, function.blocks[block].succs[0]);
+                if (function.blocks[block].succs[0] != next) emitJump(OpCode::JUMP, function.blocks[block].succs[0]);
+                return;
+            case IROp::BRANCH: {
+                int ifTrue = function.blocks[block].succs[0];
+                int ifFalse = function.blocks[block].succs[1];
+                emitValue(instr.operands[0]);
+                if (ifTrue == next) {
+                    emitJump(OpCode::JUMP_IF_FALSE, ifFalse);
+                } else if (ifFalse == next) {
+                    emitJump(OpCode::JUMP_IF_TRUE, ifTrue);
+                } else {
+                    emitJump(OpCode::JUMP_IF_FALSE, ifFalse);
+                    emitJump(OpCode::JUMP, ifTrue);
+                }
+                return;
+            }
+            case IROp::RETURN: {
+                if (instr.operands.empty()) {
+                    emit(OpCode::RETURN_UNDEFINED);
+                    return;
+                }
+                int result = instr.operands[0];
+                if (value(result).op == IROp::CALL && inlined[result]) {
+                    emitOperands(value(result));
+                    emit(OpCode::TAILCALL, value(result).a, static_cast<int32_t>(value(result).operands.size()));
+                    return;
+                }
+                emitValue(result);
+                emit(OpCode::RETURN);
+                return;
+            }
+            case IROp::OUTPUT:
+                emitOperands(instr);
+                emit(OpCode::OUTPUT);
+                return;
+            case IROp::INPUT:
+                emit(OpCode::INPUT, slot[id]);
+                return;
+            case IROp::APPEND: {
+                int target = instr.operands[0];
+                if (value(target).op == IROp::CONST || slot[target] != slot[id]) {
+                    emitValue(target);
+                    emit(OpCode::STORE_LOCAL, slot[id]);
+                }
+                for (size_t i = 1; i < instr.operands.size(); ++i) emitValue(instr.operands[i]);
+                emit(OpCode::CONCAT_LOCAL, slot[id], static_cast<int32_t>(instr.operands.size() - 1));
+                return;
+            }
+            default:
+                emitTree(id);
+                if (slot[id] >= 0) {
+                    emit(OpCode::STORE_LOCAL, slot[id]);
+                } else {
+                    emit(OpCode::POP);
+                }
+                return;
+        }
+    }
+
+public:
+    FunctionLowering(const IRModule& module, IRFunction& function, CompiledFunction& out)
+        : module(module), function(function), out(out), depth(0) {}
+
+    void lower() {
+        splitCriticalEdges(function);
+        order = reversePostorder(function);
+        countUses();
+        inlined.assign(function.values.size(), false);
+        roots.assign(function.blocks.size(), {});
+        for (int block : order) stackify(block);
+        assignSlots();
+
+        out.name = function.name;
+        out.paramCount = function.paramCount;
+        out.maxStack = 0;
+        blockStart.assign(function.blocks.size(), 0);
+        for (size_t i = 0; i < order.size(); ++i) {
+            int block = order[i];
+            int next = i + 1 < order.size() ? order[i + 1] : -1;
+            blockStart[block] = out.code.size();
+            for (int root : roots[block]) emitRoot(root, block, next);
+        }
+        for (const auto& jump : jumps) {
+            out.code[jump.first].a = static_cast<int32_t>(blockStart[jump.second]);
+        }
+    }
+};
+
+} // namespace
+
+CompiledProgram lowerToBytecode(IRModule& module, bool fuse) {
+    CompiledProgram compiled;
+    compiled.constants = module.constants;
+    compiled.names = module.names;
+    compiled.functionIndex = module.functionIndex;
+    compiled.functions.resize(module.functions.size());
+    for (size_t i = 0; i < module.functions.size(); ++i) {
+        FunctionLowering lowering(module, module.functions[i], compiled.functions[i]);
+        lowering.lower();
+        if (fuse) fuseSuperinstructions(compiled.functions[i]);
+    }
+    return compiled;
+}
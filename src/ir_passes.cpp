@@ -0,0 +1,633 @@
+#include "../include/ir.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+// Whether evaluating the instruction does anything besides producing its
+// value: I/O, calls, or an error message for some operand types
+bool hasEffects(const IRModule& module, const IRFunction& function, const IRInstr& instr) {
+    auto type = [&](size_t i) { return function.values[instr.operands[i]].type; };
+    // Non-zero constant divisor, as checked by performBinaryOperation
+    auto safeDivisor = [&]() {
+        const IRInstr& divisor = function.values[instr.operands[1]];
+        if (divisor.op != IROp::CONST) return false;
+        double value = getNumericValue(module.constants[divisor.a]);
+        return value != 0 && static_cast<int>(value) != 0;
+    };
+    const TypeSet addable = NUMBER_TYPES | typeBit(RuntimeType::STRING);
+
+    switch (instr.op) {
+        case IROp::CONST:
+        case IROp::PARAM:
+        case IROp::PHI:
+        case IROp::MAKE_ARRAY:
+        case IROp::NEG:
+        case IROp::NOT:
+        case IROp::SUB:
+        case IROp::MUL:
+        case IROp::EQ: case IROp::NE: case IROp::LT:
+        case IROp::LE: case IROp::GT: case IROp::GE:
+            return false;
+        case IROp::ADD:
+            // Anything but numbers and strings is an unknown operation
+            return (type(0) & ~addable) || (type(1) & ~addable);
+        case IROp::DIV:
+        case IROp::MOD:
+            return !safeDivisor();
+        case IROp::APPEND:
+            for (size_t i = 0; i < instr.operands.size(); ++i) {
+                if (type(i) & ~addable) return true;
+            }
+            return false;
+        case IROp::CHECK:
+            return type(0) & typeBit(RuntimeType::UNDEFINED);
+        default:
+            return true;
+    }
+}
+
+// Runs op on constant operands the way the VM would. Fails when that
+// reports an error, so the message still appears at run time.
+bool evaluate(const IRModule& module, const IRFunction& function, const IRInstr& instr, RuntimeValue& result) {
+    std::vector<const RuntimeValue*> operands;
+    for (int operand : instr.operands) {
+        const IRInstr& source = function.values[operand];
+        if (source.op != IROp::CONST) return false;
+        operands.push_back(&module.constants[source.a]);
+    }
+
+    std::ostringstream errors;
+    ErrorStreamScope errorScope(errors);
+    bool folded = true;
+    if (isBinary(instr.op)) {
+        BinaryOp op = binaryOpOf(instr.op);
+        if (isComparison(op)) {
+            result = RuntimeValue(applyComparison(op, *operands[0], *operands[1]));
+        } else {
+            result = *operands[0];
+            applyArithmetic(op, result, *operands[1]);
+        }
+    } else if (instr.op == IROp::NEG) {
+        result = performUnaryOperation(*operands[0], "-");
+    } else if (instr.op == IROp::NOT) {
+        result = RuntimeValue(!isTruthy(*operands[0]));
+    } else if (instr.op == IROp::APPEND) {
+        result = *operands[0];
+        for (size_t i = 1; i < operands.size(); ++i) {
+            applyArithmetic(BinaryOp::ADD, result, *operands[i]);
+        }
+    } else {
+        folded = false;
+    }
+    return folded && errors.str().empty() && result.type != RuntimeType::ARRAY;
+}
+
+// Forward dataflow over the type sets: values start out empty and only
+// grow, so the loop stops at the smallest solution
+class TypeInference : public IRPass {
+public:
+    const char* name() const override { return "types"; }
+
+    bool run(IRModule& module, IRFunction& function) override {
+        std::vector<int> order = reversePostorder(function);
+        std::vector<TypeSet> before(function.values.size());
+        for (int block : order) {
+            for (int id : function.blocks[block].instrs) {
+                before[id] = function.values[id].type;
+                function.values[id].type = 0;
+            }
+        }
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (int block : order) {
+                for (int id : function.blocks[block].instrs) {
+                    IRInstr& instr = function.values[id];
+                    TypeSet type = infer(module, function, instr);
+                    if (type != instr.type) {
+                        instr.type = type;
+                        changed = true;
+                    }
+                }
+            }
+        }
+        for (int block : order) {
+            for (int id : function.blocks[block].instrs) {
+                if (function.values[id].type != before[id]) return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    static TypeSet infer(const IRModule& module, const IRFunction& function, const IRInstr& instr) {
+        auto type = [&](size_t i) { return function.values[instr.operands[i]].type; };
+        switch (instr.op) {
+            case IROp::CONST:
+                return typeBit(module.constants[instr.a].type);
+            case IROp::PHI: {
+                TypeSet merged = 0;
+                for (size_t i = 0; i < instr.operands.size(); ++i) merged |= type(i);
+                return merged;
+            }
+            case IROp::UNASSIGNED:
+                return typeBit(RuntimeType::UNDEFINED);
+            case IROp::CHECK:
+                return type(0);
+            case IROp::ADD: case IROp::SUB: case IROp::MUL: case IROp::DIV: case IROp::MOD:
+                return arithmeticTypes(binaryOpOf(instr.op), type(0), type(1));
+            case IROp::EQ: case IROp::NE: case IROp::LT:
+            case IROp::LE: case IROp::GT: case IROp::GE:
+            case IROp::NOT:
+                return typeBit(RuntimeType::BOOLEAN);
+            case IROp::NEG: {
+                // Ints stay ints, everything else becomes a double
+                TypeSet operand = type(0);
+                return static_cast<TypeSet>(((operand & INT_TYPE) ? INT_TYPE : 0) |
+                                            ((operand & ~INT_TYPE) ? FLOAT_TYPE : 0));
+            }
+            case IROp::MAKE_ARRAY:
+                return typeBit(RuntimeType::ARRAY);
+            case IROp::APPEND: {
+                TypeSet result = type(0);
+                for (size_t i = 1; i < instr.operands.size(); ++i) {
+                    result = arithmeticTypes(BinaryOp::ADD, result, type(i));
+                }
+                return result;
+            }
+            case IROp::INPUT:
+                return typeBit(RuntimeType::STRING);
+            case IROp::OUTPUT:
+            case IROp::JUMP:
+            case IROp::BRANCH:
+            case IROp::RETURN:
+                return 0;
+            default:
+                return ANY_TYPE;
+        }
+    }
+};
+
+// Operations and branches on constants are done at compile time. Appends
+// onto values that are never strings become plain additions, which the
+// later passes and backends know more about, and checks of values that are
+// never undefined are dropped.
+class ConstantFolding : public IRPass {
+public:
+    const char* name() const override { return "fold"; }
+
+    bool run(IRModule& module, IRFunction& function) override {
+        bool changed = false;
+        std::vector<int> replacement(function.values.size(), -1);
+        std::vector<int> appends;
+        for (int block : reversePostorder(function)) {
+            for (int id : function.blocks[block].instrs) {
+                IRInstr& instr = function.values[id];
+                // Operands folded earlier in this run are still to be
+                // replaced, so look through them
+                for (int& operand : instr.operands) {
+                    if (replacement[operand] >= 0) operand = replacement[operand];
+                }
+                if (instr.op == IROp::BRANCH) {
+                    const IRInstr& condition = function.values[instr.operands[0]];
+                    if (condition.op != IROp::CONST) continue;
+                    const std::vector<int>& succs = function.blocks[block].succs;
+                    int dropped = isTruthy(module.constants[condition.a]) ? succs[1] : succs[0];
+                    function.removeEdge(block, dropped);
+                    instr.op = IROp::JUMP;
+                    instr.operands.clear();
+                    changed = true;
+                    continue;
+                }
+                if (instr.op == IROp::CHECK && !hasEffects(module, function, instr)) {
+                    replacement[id] = instr.operands[0];
+                    changed = true;
+                    continue;
+                }
+                RuntimeValue result;
+                if (!evaluate(module, function, instr, result)) {
+                    if (instr.op == IROp::APPEND && !(function.values[instr.operands[0]].type & typeBit(RuntimeType::STRING)) &&
+                        !hasEffects(module, function, instr)) {
+                        appends.push_back(id);
+                    }
+                    continue;
+                }
+                int folded = function.constant(module.constant(result));
+                function.values[folded].type = typeBit(result.type);
+                replacement.resize(function.values.size(), -1);
+                replacement[id] = folded;
+                changed = true;
+            }
+        }
+        for (int id : appends) {
+            splitAppend(function, id);
+            changed = true;
+        }
+        if (changed) {
+            function.replaceValues(replacement);
+            function.compact();
+        }
+        return changed;
+    }
+
+private:
+    // t + a + b ... as ((t + a) + b) ...; without effects the pieces may as
+    // well be added one at a time
+    static void splitAppend(IRFunction& function, int id) {
+        std::vector<int> operands = function.values[id].operands;
+        int block = function.values[id].block;
+        std::vector<int>& instrs = function.blocks[block].instrs;
+        size_t at = std::find(instrs.begin(), instrs.end(), id) - instrs.begin();
+        int sum = operands[0];
+        for (size_t i = 1; i + 1 < operands.size(); ++i) {
+            IRInstr partial;
+            partial.op = IROp::ADD;
+            partial.operands = {sum, operands[i]};
+            partial.block = block;
+            partial.type = arithmeticTypes(BinaryOp::ADD, function.values[sum].type, function.values[operands[i]].type);
+            sum = static_cast<int>(function.values.size());
+            function.values.push_back(std::move(partial));
+            instrs.insert(instrs.begin() + at++, sum);
+        }
+        IRInstr& instr = function.values[id];
+        instr.op = IROp::ADD;
+        instr.operands = {sum, operands.back()};
+    }
+};
+
+// Phis left with one distinct operand after other passes
+class PhiSimplification : public IRPass {
+public:
+    const char* name() const override { return "phi"; }
+
+    bool run(IRModule&, IRFunction& function) override {
+        bool changed = false;
+        bool again = true;
+        while (again) {
+            again = false;
+            std::vector<int> replacement(function.values.size(), -1);
+            for (const IRBlock& block : function.blocks) {
+                if (block.removed) continue;
+                for (int id : block.instrs) {
+                    const IRInstr& instr = function.values[id];
+                    if (instr.op != IROp::PHI) break;
+                    int same = -1;
+                    bool trivial = true;
+                    for (int operand : instr.operands) {
+                        if (operand == id || operand == same) continue;
+                        if (same >= 0) {
+                            trivial = false;
+                            break;
+                        }
+                        same = operand;
+                    }
+                    if (trivial && same >= 0) {
+                        replacement[id] = same;
+                        again = true;
+                    }
+                }
+            }
+            if (again) {
+                function.replaceValues(replacement);
+                function.compact();
+                changed = true;
+            }
+        }
+        return changed;
+    }
+};
+
+// Removes unreachable blocks, merges straight-line chains of blocks and
+// threads jumps through blocks that only jump on
+class CFGSimplification : public IRPass {
+public:
+    const char* name() const override { return "cfg"; }
+
+    bool run(IRModule&, IRFunction& function) override {
+        bool changed = false;
+        bool again = true;
+        while (again) {
+            again = removeUnreachable(function) | mergeChains(function) | threadJumps(function);
+            changed |= again;
+        }
+        return changed;
+    }
+
+private:
+    static bool removeUnreachable(IRFunction& function) {
+        std::vector<bool> reachable(function.blocks.size(), false);
+        for (int block : reversePostorder(function)) reachable[block] = true;
+
+        bool changed = false;
+        for (size_t block = 0; block < function.blocks.size(); ++block) {
+            IRBlock& dead = function.blocks[block];
+            if (dead.removed || reachable[block]) continue;
+            std::vector<int> succs = dead.succs;
+            for (int succ : succs) function.removeEdge(static_cast<int>(block), succ);
+            dead.removed = true;
+            changed = true;
+        }
+        // A branch to the same block either way is a jump
+        for (size_t block = 0; block < function.blocks.size(); ++block) {
+            IRBlock& source = function.blocks[block];
+            if (source.removed || source.succs.size() != 2 || source.succs[0] != source.succs[1]) continue;
+            const IRBlock& target = function.blocks[source.succs[0]];
+            if (!target.instrs.empty() && function.values[target.instrs[0]].op == IROp::PHI) continue;
+            function.removeEdge(static_cast<int>(block), source.succs[0]);
+            IRInstr& branch = function.values[function.terminator(static_cast<int>(block))];
+            branch.op = IROp::JUMP;
+            branch.operands.clear();
+            changed = true;
+        }
+        if (changed) function.compact();
+        return changed;
+    }
+
+    // B -> S where S has no other predecessor: S's instructions move into B
+    static bool mergeChains(IRFunction& function) {
+        bool changed = false;
+        for (size_t block = 0; block < function.blocks.size(); ++block) {
+            while (true) {
+                IRBlock& source = function.blocks[block];
+                if (source.removed || source.succs.size() != 1) break;
+                int next = source.succs[0];
+                IRBlock& target = function.blocks[next];
+                if (next == static_cast<int>(block) || next == 0 || target.preds.size() != 1) break;
+
+                std::vector<int> replacement(function.values.size(), -1);
+                function.values[source.instrs.back()].removed = true;
+                source.instrs.pop_back();
+                for (int id : target.instrs) {
+                    IRInstr& instr = function.values[id];
+                    if (instr.op == IROp::PHI) {
+                        replacement[id] = instr.operands[0];
+                        continue;
+                    }
+                    instr.block = static_cast<int>(block);
+                    source.instrs.push_back(id);
+                }
+                source.succs = target.succs;
+                for (int succ : target.succs) {
+                    for (int& pred : function.blocks[succ].preds) {
+                        if (pred == next) pred = static_cast<int>(block);
+                    }
+                }
+                target.instrs.clear();
+                target.preds.clear();
+                target.succs.clear();
+                target.removed = true;
+                function.replaceValues(replacement);
+                function.compact();
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    // Predecessors of a block holding only a jump go straight to its target
+    static bool threadJumps(IRFunction& function) {
+        bool changed = false;
+        for (size_t block = 1; block < function.blocks.size(); ++block) {
+            IRBlock& empty = function.blocks[block];
+            if (empty.removed || empty.instrs.size() != 1 || empty.succs.size() != 1) continue;
+            if (function.values[empty.instrs[0]].op != IROp::JUMP) continue;
+            int target = empty.succs[0];
+            if (target == static_cast<int>(block)) continue;
+            IRBlock& next = function.blocks[target];
+
+            // Phis in the target get the operand of the empty block for each
+            // new predecessor, which only works for one edge per block
+            bool hasPhis = function.values[next.instrs[0]].op == IROp::PHI;
+            if (hasPhis) {
+                bool clash = false;
+                for (int pred : empty.preds) {
+                    if (std::count(next.preds.begin(), next.preds.end(), pred) ||
+                        std::count(empty.preds.begin(), empty.preds.end(), pred) > 1) {
+                        clash = true;
+                    }
+                }
+                if (clash) continue;
+            }
+
+            size_t index = std::find(next.preds.begin(), next.preds.end(), static_cast<int>(block)) - next.preds.begin();
+            std::vector<int> preds = empty.preds;
+            for (size_t i = 0; i < preds.size(); ++i) {
+                int pred = preds[i];
+                for (int& succ : function.blocks[pred].succs) {
+                    if (succ == static_cast<int>(block)) succ = target;
+                }
+                if (i == 0) {
+                    next.preds[index] = pred;
+                    continue;
+                }
+                next.preds.push_back(pred);
+                for (int id : next.instrs) {
+                    IRInstr& phi = function.values[id];
+                    if (phi.op != IROp::PHI) break;
+                    phi.operands.push_back(phi.operands[index]);
+                }
+            }
+            if (preds.empty()) {
+                function.removeEdge(static_cast<int>(block), target);
+            }
+            function.values[empty.instrs[0]].removed = true;
+            empty.instrs.clear();
+            empty.preds.clear();
+            empty.succs.clear();
+            empty.removed = true;
+            changed = true;
+        }
+        if (changed) function.compact();
+        return changed;
+    }
+};
+
+// Drops instructions whose values are never used and that have no effects
+class DeadCodeElimination : public IRPass {
+public:
+    const char* name() const override { return "dce"; }
+
+    bool run(IRModule& module, IRFunction& function) override {
+        std::vector<bool> live(function.values.size(), false);
+        std::vector<int> pending;
+        for (const IRBlock& block : function.blocks) {
+            if (block.removed) continue;
+            for (int id : block.instrs) {
+                const IRInstr& instr = function.values[id];
+                // Parameters keep their place in the calling convention
+                if (instr.op == IROp::PARAM || hasEffects(module, function, instr)) {
+                    live[id] = true;
+                    pending.push_back(id);
+                }
+            }
+        }
+        while (!pending.empty()) {
+            int id = pending.back();
+            pending.pop_back();
+            for (int operand : function.values[id].operands) {
+                if (!live[operand]) {
+                    live[operand] = true;
+                    pending.push_back(operand);
+                }
+            }
+        }
+
+        bool changed = false;
+        for (const IRBlock& block : function.blocks) {
+            if (block.removed) continue;
+            for (int id : block.instrs) {
+                if (!live[id]) {
+                    function.values[id].removed = true;
+                    changed = true;
+                }
+            }
+        }
+        if (changed) function.compact();
+        return changed;
+    }
+};
+
+// Dominator-based value numbering: a pure operation repeating one that
+// dominates it, on the same operands, reuses that value
+class GlobalValueNumbering : public IRPass {
+public:
+    const char* name() const override { return "gvn"; }
+
+    bool run(IRModule& module, IRFunction& function) override {
+        std::vector<int> order = reversePostorder(function);
+        std::vector<int> idom = dominators(function, order);
+        std::vector<std::vector<int>> children(function.blocks.size());
+        for (int block : order) {
+            if (block != 0) children[idom[block]].push_back(block);
+        }
+
+        std::vector<int> replacement(function.values.size(), -1);
+        std::unordered_map<std::string, int> available;
+        bool changed = false;
+        // Scopes follow the dominator tree: what a block adds is dropped
+        // again once its subtree is done
+        std::vector<std::pair<int, std::vector<std::string>>> stack = {{0, {}}};
+        std::vector<size_t> nextChild(function.blocks.size(), 0);
+        visit(module, function, 0, available, stack.back().second, replacement, changed);
+        while (!stack.empty()) {
+            int block = stack.back().first;
+            if (nextChild[block] < children[block].size()) {
+                int child = children[block][nextChild[block]++];
+                stack.push_back({child, {}});
+                visit(module, function, child, available, stack.back().second, replacement, changed);
+                continue;
+            }
+            for (const std::string& key : stack.back().second) available.erase(key);
+            stack.pop_back();
+        }
+        if (changed) {
+            function.replaceValues(replacement);
+            function.compact();
+        }
+        return changed;
+    }
+
+private:
+    static void visit(const IRModule& module, IRFunction& function, int block,
+                      std::unordered_map<std::string, int>& available, std::vector<std::string>& added,
+                      std::vector<int>& replacement, bool& changed) {
+        for (int id : function.blocks[block].instrs) {
+            IRInstr& instr = function.values[id];
+            for (int& operand : instr.operands) {
+                if (replacement[operand] >= 0) operand = replacement[operand];
+            }
+            if (instr.op == IROp::CONST || instr.op == IROp::PARAM || instr.op == IROp::PHI ||
+                instr.op == IROp::MAKE_ARRAY || isTerminator(instr.op) ||
+                hasEffects(module, function, instr)) {
+                continue;
+            }
+            std::vector<int> operands = instr.operands;
+            // == and != give the same result either way round; so does *,
+            // which converts both sides alike
+            if (instr.op == IROp::EQ || instr.op == IROp::NE || instr.op == IROp::MUL) {
+                std::sort(operands.begin(), operands.end());
+            }
+            std::string key = std::to_string(static_cast<int>(instr.op)) + ":" + std::to_string(instr.a);
+            for (int operand : operands) key += "," + std::to_string(operand);
+            auto it = available.find(key);
+            if (it != available.end()) {
+                replacement[id] = it->second;
+                changed = true;
+                continue;
+            }
+            available[key] = id;
+            added.push_back(key);
+        }
+    }
+
+    // Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm"
+    static std::vector<int> dominators(const IRFunction& function, const std::vector<int>& order) {
+        std::vector<int> position(function.blocks.size(), -1);
+        for (size_t i = 0; i < order.size(); ++i) position[order[i]] = static_cast<int>(i);
+        std::vector<int> idom(function.blocks.size(), -1);
+        idom[0] = 0;
+        bool changed = true;
+        while (changed) {
+            changed = false;
+            for (size_t i = 1; i < order.size(); ++i) {
+                int block = order[i];
+                int dominator = -1;
+                for (int pred : function.blocks[block].preds) {
+                    if (position[pred] < 0 || idom[pred] < 0) continue;
+                    if (dominator < 0) {
+                        dominator = pred;
+                        continue;
+                    }
+                    int a = pred, b = dominator;
+                    while (a != b) {
+                        while (position[a] > position[b]) a = idom[a];
+                        while (position[b] > position[a]) b = idom[b];
+                    }
+                    dominator = a;
+                }
+                if (dominator != idom[block]) {
+                    idom[block] = dominator;
+                    changed = true;
+                }
+            }
+        }
+        return idom;
+    }
+};
+
+} // namespace
+
+PassManager PassManager::forLevel(int level) {
+    PassManager manager(level >= 2 ? 4 : 1);
+    if (level <= 0) return manager;
+    manager.add(std::make_unique<TypeInference>());
+    manager.add(std::make_unique<ConstantFolding>());
+    manager.add(std::make_unique<PhiSimplification>());
+    manager.add(std::make_unique<CFGSimplification>());
+    if (level >= 2) manager.add(std::make_unique<GlobalValueNumbering>());
+    manager.add(std::make_unique<DeadCodeElimination>());
+    return manager;
+}
+
+void PassManager::run(IRModule& module) {
+    for (IRFunction& function : module.functions) {
+        if (dump) {
+            std::cout << "; " << function.name << " as built\n";
+            printIR(module, function);
+        }
+        for (int round = 0; round < rounds; ++round) {
+            bool changed = false;
+            for (const auto& pass : passes) {
+                if (!pass->run(module, function)) continue;
+                changed = true;
+                if (dump) {
+                    std::cout << "; " << function.name << " after " << pass->name() << "\n";
+                    printIR(module, function);
+                }
+            }
+            if (!changed) break;
+        }
+    }
+}
@@ -0,0 +1,461 @@
+#include "../include/jit.h"
+#include <cstring>
+
+#if JIT_AVAILABLE
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+// The handful of x86-64 encodings the JIT needs. Operand stack values live
+// on the machine stack, locals in the frame below the saved rbp.
+struct Assembler {
+    std::vector<uint8_t>& out;
+
+    explicit Assembler(std::vector<uint8_t>& out) : out(out) {}
+
+    void bytes(std::initializer_list<uint8_t> list) { out.insert(out.end(), list); }
+
+    void u32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    void u64(uint64_t value) {
+        for (int i = 0; i < 8; ++i) out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+
+    // Emits a zero rel32 and returns its position for patch()
+    size_t rel32() {
+        size_t at = out.size();
+        u32(0);
+        return at;
+    }
+
+    void patch(size_t at, size_t target) {
+        int32_t rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+        std::memcpy(&out[at], &rel, sizeof(rel));
+    }
+};
+
+// Condition codes for jcc (0F 80+cc)
+const uint8_t CC_OVERFLOW = 0x0;
+const uint8_t CC_EQUAL = 0x4;
+const uint8_t CC_NOT_EQUAL = 0x5;
+const uint8_t CC_GREATER_EQUAL = 0xD;
+
+uint8_t conditionFor(OpCode op) {
+    switch (op) {
+        case OpCode::EQ: case OpCode::EQ_JUMP_IF_FALSE: return 0x4;
+        case OpCode::NE: case OpCode::NE_JUMP_IF_FALSE: return 0x5;
+        case OpCode::LT: case OpCode::LT_JUMP_IF_FALSE: return 0xC;
+        case OpCode::LE: case OpCode::LE_JUMP_IF_FALSE: return 0xE;
+        case OpCode::GT: case OpCode::GT_JUMP_IF_FALSE: return 0xF;
+        default: return 0xD;
+    }
+}
+
+// Inverting the low bit of a condition code negates it
+uint8_t negate(uint8_t condition) {
+    return condition ^ 1;
+}
+
+bool isCompareJump(OpCode op) {
+    return op >= OpCode::EQ_JUMP_IF_FALSE && op <= OpCode::GE_JUMP_IF_FALSE;
+}
+
+bool isJump(OpCode op) {
+    return op == OpCode::JUMP || op == OpCode::JUMP_IF_FALSE || op == OpCode::JUMP_IF_TRUE ||
+           isCompareJump(op);
+}
+
+int32_t localOffset(int slot) {
+    // [rbp - 8] holds the remaining call depth
+    return -8 * (slot + 2);
+}
+
+}
+
+NativeCode::NativeCode(const CompiledProgram& program)
+    : program(program), entries(program.functions.size(), nullptr),
+      states(program.functions.size(), State::UNKNOWN) {}
+
+NativeCode::~NativeCode() {
+#if JIT_AVAILABLE
+    for (const auto& region : regions) {
+        munmap(region.first, region.second);
+    }
+#endif
+}
+
+bool NativeCode::eligible(int functionIndex) const {
+    const CompiledFunction& function = program.functions[functionIndex];
+    if (function.paramCount > MAX_PARAMS || function.localCount < function.paramCount ||
+        function.localCount > 64) {
+        return false;
+    }
+
+    const std::vector<Instr>& code = function.code;
+    size_t count = code.size();
+    std::vector<bool> jumpTarget(count + 1, false);
+    for (const Instr& instr : code) {
+        if (isJump(instr.op)) {
+            if (instr.a < 0 || static_cast<size_t>(instr.a) >= count) return false;
+            jumpTarget[instr.a] = true;
+        }
+    }
+    std::vector<std::pair<int, int>> cases;
+    for (const JumpTable& jumpTable : function.jumpTables) {
+        // Native locals are ints, which only match int keys
+        if (!jumpTable.table->intCases(cases)) return false;
+        for (int32_t target : jumpTable.targets) {
+            if (target < 0 || static_cast<size_t>(target) >= count) return false;
+        }
+    }
+
+    auto isIntConstant = [&](int index) {
+        return program.constants[index].type == RuntimeType::INTEGER;
+    };
+
+    for (size_t i = 0; i < count; ++i) {
+        const Instr& instr = code[i];
+        switch (instr.op) {
+            case OpCode::LOAD_CONST:
+                if (!isIntConstant(instr.a)) return false;
+                break;
+            case OpCode::ADD_LOCAL_CONST:
+                if (!isIntConstant(instr.b)) return false;
+                break;
+            case OpCode::EQ: case OpCode::NE: case OpCode::LT:
+            case OpCode::LE: case OpCode::GT: case OpCode::GE:
+                // Booleans are never materialized, so a comparison has to
+                // feed the branch right after it
+                if (i + 1 >= count || jumpTarget[i + 1] ||
+                    (code[i + 1].op != OpCode::JUMP_IF_FALSE && code[i + 1].op != OpCode::JUMP_IF_TRUE)) {
+                    return false;
+                }
+                break;
+            case OpCode::CALL:
+            case OpCode::TAILCALL:
+                if (program.functions[instr.a].paramCount != instr.b) return false;
+                break;
+            case OpCode::LOAD_LOCAL: case OpCode::STORE_LOCAL: case OpCode::POP:
+            case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::MOD:
+            case OpCode::NEG: case OpCode::JUMP: case OpCode::JUMP_IF_FALSE: case OpCode::JUMP_IF_TRUE:
+            case OpCode::CONCAT_LOCAL: case OpCode::RETURN: case OpCode::RETURN_UNDEFINED:
+            case OpCode::SWITCH_LOCAL:
+            case OpCode::EQ_JUMP_IF_FALSE: case OpCode::NE_JUMP_IF_FALSE:
+            case OpCode::LT_JUMP_IF_FALSE: case OpCode::LE_JUMP_IF_FALSE:
+            case OpCode::GT_JUMP_IF_FALSE: case OpCode::GE_JUMP_IF_FALSE:
+                break;
+            default:
+                return false;
+        }
+    }
+
+    // Every local has to be assigned before it is read on all paths, since
+    // native code has no way to represent an undefined value
+    std::vector<uint64_t> assigned(count, ~0ULL);
+    std::vector<bool> reached(count, false);
+    std::vector<size_t> worklist = {0};
+    assigned[0] = function.paramCount == 64 ? ~0ULL : (1ULL << function.paramCount) - 1;
+    reached[0] = true;
+    while (!worklist.empty()) {
+        size_t i = worklist.back();
+        worklist.pop_back();
+        const Instr& instr = code[i];
+        uint64_t mask = assigned[i];
+
+        bool reads = instr.op == OpCode::LOAD_LOCAL || instr.op == OpCode::CONCAT_LOCAL ||
+                     instr.op == OpCode::ADD_LOCAL_CONST || instr.op == OpCode::SWITCH_LOCAL;
+        if (reads && !(mask & (1ULL << instr.a))) return false;
+        if (instr.op == OpCode::STORE_LOCAL) mask |= 1ULL << instr.a;
+
+        std::vector<size_t> successors;
+        if (instr.op == OpCode::RETURN || instr.op == OpCode::RETURN_UNDEFINED ||
+            instr.op == OpCode::TAILCALL) {
+        } else if (instr.op == OpCode::JUMP) {
+            successors.push_back(instr.a);
+        } else if (instr.op == OpCode::SWITCH_LOCAL) {
+            for (int32_t target : function.jumpTables[instr.b].targets) successors.push_back(target);
+        } else {
+            successors.push_back(i + 1);
+            if (isJump(instr.op)) successors.push_back(instr.a);
+        }
+        for (size_t next : successors) {
+            if (next >= count) continue;
+            uint64_t merged = reached[next] ? (assigned[next] & mask) : mask;
+            if (!reached[next] || merged != assigned[next]) {
+                assigned[next] = merged;
+                reached[next] = true;
+                worklist.push_back(next);
+            }
+        }
+    }
+    return true;
+}
+
+void NativeCode::emit(int functionIndex, std::vector<uint8_t>& out) const {
+    const CompiledFunction& function = program.functions[functionIndex];
+    const std::vector<Instr>& code = function.code;
+    Assembler as(out);
+
+    std::vector<size_t> offsets(code.size() + 1, 0);
+    std::vector<std::pair<size_t, int>> jumps;
+    std::vector<size_t> deopts;
+
+    auto jcc = [&](uint8_t condition) {
+        as.bytes({0x0F, static_cast<uint8_t>(0x80 | condition)});
+        return as.rel32();
+    };
+    auto deoptIf = [&](uint8_t condition) { deopts.push_back(jcc(condition)); };
+    auto local = [&](int slot) { as.u32(static_cast<uint32_t>(localOffset(slot))); };
+
+    // push rbp; mov rbp, rsp; sub rsp, frame
+    as.bytes({0x55, 0x48, 0x89, 0xE5, 0x48, 0x81, 0xEC});
+    as.u32(8 * (function.localCount + 1));
+    // test rsi, rsi; jz deopt; dec rsi; mov [rbp - 8], rsi
+    as.bytes({0x48, 0x85, 0xF6});
+    deoptIf(CC_EQUAL);
+    as.bytes({0x48, 0xFF, 0xCE, 0x48, 0x89, 0xB5});
+    as.u32(static_cast<uint32_t>(-8));
+    for (int i = 0; i < function.paramCount; ++i) {
+        // mov rax, [rdi + arg]; mov [rbp + local], rax
+        as.bytes({0x48, 0x8B, 0x87});
+        as.u32(8 * (function.paramCount - 1 - i));
+        as.bytes({0x48, 0x89, 0x85});
+        local(i);
+    }
+
+    for (size_t i = 0; i < code.size(); ++i) {
+        offsets[i] = out.size();
+        const Instr& instr = code[i];
+        switch (instr.op) {
+            case OpCode::LOAD_CONST:
+                // push imm32
+                as.bytes({0x68});
+                as.u32(static_cast<uint32_t>(program.constants[instr.a].intValue));
+                break;
+            case OpCode::LOAD_LOCAL:
+                // push qword [rbp + local]
+                as.bytes({0xFF, 0xB5});
+                local(instr.a);
+                break;
+            case OpCode::STORE_LOCAL:
+                // pop rax; mov [rbp + local], rax
+                as.bytes({0x58, 0x48, 0x89, 0x85});
+                local(instr.a);
+                break;
+            case OpCode::POP:
+                as.bytes({0x58});
+                break;
+            case OpCode::ADD:
+            case OpCode::SUB:
+            case OpCode::MUL:
+                // pop rcx; pop rax; add/sub/imul eax, ecx; jo deopt; push rax
+                as.bytes({0x59, 0x58});
+                if (instr.op == OpCode::ADD) as.bytes({0x01, 0xC8});
+                else if (instr.op == OpCode::SUB) as.bytes({0x29, 0xC8});
+                else as.bytes({0x0F, 0xAF, 0xC1});
+                deoptIf(CC_OVERFLOW);
+                as.bytes({0x50});
+                break;
+            case OpCode::MOD:
+                // pop rcx; pop rax; test ecx, ecx; jz deopt
+                as.bytes({0x59, 0x58, 0x85, 0xC9});
+                deoptIf(CC_EQUAL);
+                // cmp ecx, -1; jne +4; xor eax, eax; jmp +5; cdq; idiv ecx; mov eax, edx; push rax
+                as.bytes({0x83, 0xF9, 0xFF, 0x75, 0x04, 0x31, 0xC0, 0xEB, 0x05,
+                          0x99, 0xF7, 0xF9, 0x89, 0xD0, 0x50});
+                break;
+            case OpCode::NEG:
+                // pop rax; neg eax; jo deopt; push rax
+                as.bytes({0x58, 0xF7, 0xD8});
+                deoptIf(CC_OVERFLOW);
+                as.bytes({0x50});
+                break;
+            case OpCode::JUMP:
+                as.bytes({0xE9});
+                jumps.push_back({as.rel32(), instr.a});
+                break;
+            case OpCode::JUMP_IF_FALSE:
+            case OpCode::JUMP_IF_TRUE:
+                // pop rax; test eax, eax; jz/jnz target
+                as.bytes({0x58, 0x85, 0xC0});
+                jumps.push_back({jcc(instr.op == OpCode::JUMP_IF_FALSE ? CC_EQUAL : CC_NOT_EQUAL), instr.a});
+                break;
+            case OpCode::EQ: case OpCode::NE: case OpCode::LT:
+            case OpCode::LE: case OpCode::GT: case OpCode::GE: {
+                // Fused with the branch that follows, see eligible()
+                const Instr& branch = code[++i];
+                offsets[i] = out.size();
+                uint8_t condition = conditionFor(instr.op);
+                if (branch.op == OpCode::JUMP_IF_FALSE) condition = negate(condition);
+                // pop rcx; pop rax; cmp eax, ecx; jcc target
+                as.bytes({0x59, 0x58, 0x39, 0xC8});
+                jumps.push_back({jcc(condition), branch.a});
+                break;
+            }
+            case OpCode::EQ_JUMP_IF_FALSE: case OpCode::NE_JUMP_IF_FALSE:
+            case OpCode::LT_JUMP_IF_FALSE: case OpCode::LE_JUMP_IF_FALSE:
+            case OpCode::GT_JUMP_IF_FALSE: case OpCode::GE_JUMP_IF_FALSE:
+                as.bytes({0x59, 0x58, 0x39, 0xC8});
+                jumps.push_back({jcc(negate(conditionFor(instr.op))), instr.a});
+                break;
+            case OpCode::CALL:
+            case OpCode::TAILCALL:
+                // Native tail calls stay real calls; the depth guard hands
+                // deep chains to the VM, which reuses frames
+                // mov rdi, rsp; mov rsi, [rbp - 8]; mov rax, &entries[a]; call [rax]
+                as.bytes({0x48, 0x89, 0xE7, 0x48, 0x8B, 0xB5});
+                as.u32(static_cast<uint32_t>(-8));
+                as.bytes({0x48, 0xB8});
+                as.u64(reinterpret_cast<uint64_t>(&entries[instr.a]));
+                as.bytes({0xFF, 0x10});
+                if (instr.b > 0) {
+                    // add rsp, arguments
+                    as.bytes({0x48, 0x81, 0xC4});
+                    as.u32(8 * instr.b);
+                }
+                // mov rcx, rax; shr rcx, 32; jnz deopt; push rax
+                as.bytes({0x48, 0x89, 0xC1, 0x48, 0xC1, 0xE9, 0x20});
+                deoptIf(CC_NOT_EQUAL);
+                if (instr.op == OpCode::TAILCALL) {
+                    // mov eax, eax; mov rsp, rbp; pop rbp; ret
+                    as.bytes({0x89, 0xC0, 0x48, 0x89, 0xEC, 0x5D, 0xC3});
+                } else {
+                    as.bytes({0x50});
+                }
+                break;
+            case OpCode::CONCAT_LOCAL:
+                for (int piece = 0; piece < instr.b; ++piece) {
+                    // mov eax, [rbp + local]; add eax, [rsp + piece]; jo deopt; mov [rbp + local], eax
+                    as.bytes({0x8B, 0x85});
+                    local(instr.a);
+                    as.bytes({0x03, 0x84, 0x24});
+                    as.u32(8 * (instr.b - 1 - piece));
+                    deoptIf(CC_OVERFLOW);
+                    as.bytes({0x89, 0x85});
+                    local(instr.a);
+                }
+                as.bytes({0x48, 0x81, 0xC4});
+                as.u32(8 * instr.b);
+                break;
+            case OpCode::ADD_LOCAL_CONST:
+                // mov eax, [rbp + local]; add eax, imm32; jo deopt; push rax
+                as.bytes({0x8B, 0x85});
+                local(instr.a);
+                as.bytes({0x05});
+                as.u32(static_cast<uint32_t>(program.constants[instr.b].intValue));
+                deoptIf(CC_OVERFLOW);
+                as.bytes({0x50});
+                break;
+            case OpCode::SWITCH_LOCAL: {
+                // mov eax, [rbp + local], then a binary search of the keys
+                const std::vector<int32_t>& targets = function.jumpTables[instr.b].targets;
+                std::vector<std::pair<int, int>> cases;
+                function.jumpTables[instr.b].table->intCases(cases);
+                as.bytes({0x8B, 0x85});
+                local(instr.a);
+                auto search = [&](auto& self, size_t low, size_t high) -> void {
+                    if (high - low <= 4) {
+                        for (size_t c = low; c < high; ++c) {
+                            // cmp eax, key; je arm
+                            as.bytes({0x3D});
+                            as.u32(static_cast<uint32_t>(cases[c].first));
+                            jumps.push_back({jcc(CC_EQUAL), targets[cases[c].second + 1]});
+                        }
+                        // jmp else
+                        as.bytes({0xE9});
+                        jumps.push_back({as.rel32(), targets[0]});
+                        return;
+                    }
+                    size_t middle = low + (high - low) / 2;
+                    // cmp eax, key; jge upper half
+                    as.bytes({0x3D});
+                    as.u32(static_cast<uint32_t>(cases[middle].first));
+                    size_t upper = jcc(CC_GREATER_EQUAL);
+                    self(self, low, middle);
+                    as.patch(upper, out.size());
+                    self(self, middle, high);
+                };
+                search(search, 0, cases.size());
+                break;
+            }
+            case OpCode::RETURN:
+                // pop rax; mov eax, eax; mov rsp, rbp; pop rbp; ret
+                as.bytes({0x58, 0x89, 0xC0, 0x48, 0x89, 0xEC, 0x5D, 0xC3});
+                break;
+            case OpCode::RETURN_UNDEFINED:
+            default:
+                // Undefined results are left to the VM
+                as.bytes({0xE9});
+                deopts.push_back(as.rel32());
+                break;
+        }
+    }
+    offsets[code.size()] = out.size();
+
+    // deopt: mov rax, 1 << 32; mov rsp, rbp; pop rbp; ret
+    size_t deopt = out.size();
+    as.bytes({0x48, 0xB8});
+    as.u64(1ULL << 32);
+    as.bytes({0x48, 0x89, 0xEC, 0x5D, 0xC3});
+
+    for (const auto& jump : jumps) as.patch(jump.first, offsets[jump.second]);
+    for (size_t at : deopts) as.patch(at, deopt);
+}
+
+bool NativeCode::compile(int functionIndex) {
+    if (states[functionIndex] == State::COMPILED) return true;
+    if (states[functionIndex] == State::REJECTED) return false;
+#if !JIT_AVAILABLE
+    states[functionIndex] = State::REJECTED;
+    return false;
+#else
+    // The function and all functions reachable through its calls
+    std::vector<int> pending;
+    std::vector<bool> seen(program.functions.size(), false);
+    std::vector<int> stack = {functionIndex};
+    while (!stack.empty()) {
+        int index = stack.back();
+        stack.pop_back();
+        if (seen[index] || states[index] == State::COMPILED) continue;
+        seen[index] = true;
+        if (states[index] == State::REJECTED || !eligible(index)) {
+            states[index] = State::REJECTED;
+            states[functionIndex] = State::REJECTED;
+            return false;
+        }
+        pending.push_back(index);
+        for (const Instr& instr : program.functions[index].code) {
+            if (instr.op == OpCode::CALL || instr.op == OpCode::TAILCALL) stack.push_back(instr.a);
+        }
+    }
+
+    std::vector<uint8_t> code;
+    std::vector<size_t> starts;
+    for (int index : pending) {
+        starts.push_back(code.size());
+        emit(index, code);
+    }
+
+    void* memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        states[functionIndex] = State::REJECTED;
+        return false;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, code.size());
+        states[functionIndex] = State::REJECTED;
+        return false;
+    }
+    regions.push_back({memory, code.size()});
+
+    for (size_t i = 0; i < pending.size(); ++i) {
+        entries[pending[i]] = static_cast<uint8_t*>(memory) + starts[i];
+        states[pending[i]] = State::COMPILED;
+    }
+    return true;
+#endif
+}
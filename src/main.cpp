@@ -6,6 +6,20 @@
 #include "../include/parser.h"
 #include "../include/ast_generator.h"
 #include "../include/interpreter.h"
+#include "../include/bytecode.h"
+#include "../include/vm.h"
+#include "../include/closure_compiler.h"
+#include "../include/batch.h"
+#include "../include/driver.h"
+#include "../include/image.h"
+#include "../include/server.h"
+#include "../include/partial_eval.h"
+#include "../include/cse.h"
+#include "../include/bounds_check.h"
+#include "../include/vectorize.h"
+#include "../include/switch_table.h"
+#include "../include/parallel.h"
+#include "../include/ir.h"
 
 using namespace std;
 
@@ -24,18 +38,92 @@ string readSourceFile(const string& path) {
 int main(int argc, char* argv[]) {
     if (argc < 2) {
         cerr << "Usage: " << argv[0] << " <source_file> [options]\n";
+        cerr << "       " << argv[0] << " -jN [--emit-pcb] <source_file>...   Check the files without running them, N at a time; --emit-pcb saves each as a .pcb\n";
+        cerr << "       " << argv[0] << " --serve <socket> [--workers N] [--cache N]   Run scripts sent to a Unix socket\n";
+        cerr << "       " << argv[0] << " --client <socket> <source_file>   Run the file on the server, stdin as its input\n";
         cerr << "Options:\n";
         cerr << "  --interpret    Run with interpreter (default)\n";
+        cerr << "  --osr-threshold N  Loop iterations before the interpreter moves a loop to the VM (0 = never)\n";
+        cerr << "  --threads N    Worker threads for parallel for loops and spawn (default: hardware threads)\n";
+        cerr << "  --batch        Run main once per record of stdin, on --threads N threads, output in record order\n";
+        cerr << "  --delimiter L  With --batch: the line that separates records (default: a blank line)\n";
+        cerr << "  --vm           Run on the bytecode virtual machine\n";
+        cerr << "  --closure      Run on the closure-compiled backend\n";
+        cerr << "  --jit-threshold N  With --vm: calls before a function is compiled to native code (0 = never)\n";
+        cerr << "  --max-depth N  With --vm: maximum call depth (default 1000000)\n";
+        cerr << "  --specialize-threshold N  With --vm: calls with the same argument types before a typed copy is made (0 = never)\n";
+        cerr << "  --fold-steps N Budget for evaluating pure calls with constant arguments before running (0 = off, default 10000)\n";
+        cerr << "  --no-cse       Keep repeated expressions within a block as they are\n";
+        cerr << "  --no-vectorize Run element-wise array loops one iteration at a time\n";
+        cerr << "  --memoize      Cache results of pure recursive functions by argument\n";
+        cerr << "  --memo-limit N With --memoize: results kept per function (default 100000)\n";
+        cerr << "  --profile-ops  With --vm: count executed opcode pairs (no superinstructions)\n";
+        cerr << "  -O0, -O1, -O2  With --vm: compile through the SSA IR with this level of optimization\n";
+        cerr << "  --dump-ir      Print the SSA IR as built and after each pass that changes it\n";
+        cerr << "  --dump-bytecode  Print the compiled bytecode\n";
+        cerr << "  --emit-pcb F   Save the compiled bytecode to F instead of running; a.out F runs it on the VM\n";
         cerr << "  --compile      Generate code (future feature)\n";
         cerr << "  --check-types  Type checking only (future feature)\n";
         return 1;
     }
+    // Driver mode: -jN (or -j N) and any number of files
+    string first = argv[1];
+    if (first.compare(0, 2, "-j") == 0) {
+        int i = 2;
+        unsigned jobs = first.size() > 2 ? strtoul(first.c_str() + 2, nullptr, 10) : 0;
+        if (first.size() == 2 && argc > 2) jobs = strtoul(argv[i++], nullptr, 10);
+        bool emitImages = i < argc && string(argv[i]) == "--emit-pcb";
+        if (emitImages) i++;
+        vector<string> paths(argv + i, argv + argc);
+        if (jobs == 0 || paths.empty()) {
+            cerr << "Usage: " << argv[0] << " -jN [--emit-pcb] <source_file>..." << endl;
+            return 1;
+        }
+        return compileFiles(paths, jobs, emitImages);
+    }
+
+    // Server mode: --serve SOCKET, and the client of it
+    if (first == "--serve" && argc > 2) {
+        unsigned workers = WorkStealingPool::defaultThreads();
+        size_t cacheCapacity = ProgramCache::DEFAULT_CAPACITY;
+        for (int i = 3; i + 1 < argc; i += 2) {
+            if (string(argv[i]) == "--workers") {
+                workers = strtoul(argv[i + 1], nullptr, 10);
+            } else if (string(argv[i]) == "--cache") {
+                cacheCapacity = strtoul(argv[i + 1], nullptr, 10);
+            }
+        }
+        return serveRequests(argv[2], workers > 0 ? workers : 1, cacheCapacity);
+    }
+    if (first == "--client" && argc > 3) {
+        return sendRequest(argv[2], argv[3]);
+    }
+
     string filename = argv[1];
     
     // Parse command line options
     bool useInterpreter = true;
     bool compileOnly = false;
     bool typeCheckOnly = false;
+    bool useVM = false;
+    bool useClosures = false;
+    bool profileOps = false;
+    bool dumpBytecode = false;
+    bool dumpIR = false;
+    int optLevel = -1;
+    int jitThreshold = VM::DEFAULT_JIT_THRESHOLD;
+    int osrThreshold = Interpreter::DEFAULT_OSR_THRESHOLD;
+    size_t maxDepth = VM::DEFAULT_MAX_DEPTH;
+    int specializeThreshold = VM::DEFAULT_SPECIALIZE_THRESHOLD;
+    long foldSteps = PartialEvaluator::DEFAULT_STEP_BUDGET;
+    bool cse = true;
+    bool vectorize = true;
+    bool memoize = false;
+    size_t memoLimit = MemoTable::DEFAULT_CAPACITY;
+    unsigned threads = WorkStealingPool::defaultThreads();
+    bool batch = false;
+    string delimiter;
+    string imagePath;
     
     for (int i = 2; i < argc; i++) {
         if (string(argv[i]) == "--compile") {
@@ -45,19 +133,78 @@ int main(int argc, char* argv[]) {
             typeCheckOnly = true;
         } else if (string(argv[i]) == "--interpret") {
             useInterpreter = true;
+        } else if (string(argv[i]) == "--vm") {
+            useVM = true;
+        } else if (string(argv[i]) == "--closure") {
+            useClosures = true;
+        } else if (string(argv[i]) == "--profile-ops") {
+            useVM = true;
+            profileOps = true;
+        } else if (string(argv[i]) == "--jit-threshold" && i + 1 < argc) {
+            jitThreshold = atoi(argv[++i]);
+        } else if (string(argv[i]) == "--osr-threshold" && i + 1 < argc) {
+            osrThreshold = atoi(argv[++i]);
+        } else if (string(argv[i]) == "--max-depth" && i + 1 < argc) {
+            maxDepth = strtoul(argv[++i], nullptr, 10);
+        } else if (string(argv[i]) == "--specialize-threshold" && i + 1 < argc) {
+            specializeThreshold = atoi(argv[++i]);
+        } else if (string(argv[i]) == "--fold-steps" && i + 1 < argc) {
+            foldSteps = atol(argv[++i]);
+        } else if (string(argv[i]) == "--no-cse") {
+            cse = false;
+        } else if (string(argv[i]) == "--no-vectorize") {
+            vectorize = false;
+        } else if (string(argv[i]) == "--memoize") {
+            memoize = true;
+        } else if (string(argv[i]) == "--memo-limit" && i + 1 < argc) {
+            memoLimit = strtoul(argv[++i], nullptr, 10);
+        } else if (string(argv[i]) == "--threads" && i + 1 < argc) {
+            threads = strtoul(argv[++i], nullptr, 10);
+        } else if (string(argv[i]) == "--batch") {
+            batch = true;
+        } else if (string(argv[i]) == "--delimiter" && i + 1 < argc) {
+            delimiter = argv[++i];
+        } else if (string(argv[i]) == "--emit-pcb" && i + 1 < argc) {
+            imagePath = argv[++i];
+        } else if (string(argv[i]) == "--dump-bytecode") {
+            dumpBytecode = true;
+        } else if (string(argv[i]) == "--dump-ir") {
+            dumpIR = true;
+        } else if (string(argv[i]).size() == 3 && string(argv[i]).compare(0, 2, "-O") == 0 &&
+                   argv[i][2] >= '0' && argv[i][2] <= '0' + PassManager::MAX_LEVEL) {
+            optLevel = argv[i][2] - '0';
         }
     }
     
+    // A precompiled image skips the front end and runs on the VM
+    if (isImage(filename)) {
+        CompiledProgram compiled;
+        if (!loadImage(filename, compiled)) return 1;
+        if (dumpBytecode) {
+            for (const auto& function : compiled.functions) {
+                disassemble(compiled, function);
+            }
+        }
+        Interpreter host(osrThreshold);
+        host.setThreads(threads);
+        VM vm(compiled, profileOps, jitThreshold, &host);
+        vm.setMaxDepth(maxDepth);
+        vm.setSpecializeThreshold(specializeThreshold);
+        vm.execute();
+        if (profileOps) vm.printProfile();
+        return 0;
+    }
+
     string source = readSourceFile(filename);
 
-    FILE* file = fopen(filename.c_str(), "r");
-    if (!file) {
-        cerr << "Failed to open file!" << endl;
-        return 1;
+    // Batch mode compiles once and runs every record on the same contexts
+    if (batch) {
+        auto program = Program::compile(source);
+        if (!program) return 1;
+        return runBatch(*program, InputReader(0).readAll(), delimiter, threads > 0 ? threads : 1);
     }
 
-    vector<GenericToken> tokens = tokenizeFile(file);
-    fclose(file);
+    vector<GenericToken> tokens = tokenizeSource(source);
 
     for (const auto& token : tokens) {
         cout << "Token at " << token.position << ": ";
@@ -85,15 +232,70 @@ int main(int argc, char* argv[]) {
         if (ast) {
             cout << "AST generation successful!" << endl;
             
+            if (foldSteps > 0) {
+                PartialEvaluator evaluator(foldSteps);
+                evaluator.run(ast);
+            }
+            if (cse) eliminateCommonSubexpressions(*ast);
+            eliminateBoundsChecks(*ast);
+            if (vectorize) vectorizeLoops(*ast);
+            buildSwitchTables(*ast);
+            if (!checkParallelLoops(*ast)) {
+                cerr << "Parallel loop check failed!" << endl;
+                return 1;
+            }
+            if (!checkSpawns(*ast)) {
+                cerr << "Spawn check failed!" << endl;
+                return 1;
+            }
+            
             if (typeCheckOnly) {
                 cout << "Type checking only - not implemented yet" << endl;
                 // TODO: Add type checker here
             } else if (compileOnly) {
                 cout << "Code generation - not implemented yet" << endl;
                 // TODO: Add LLVM code generator here
+            } else if (useClosures) {
+                ClosureEngine engine(*ast);
+                engine.enableTasks(ast, threads);
+                if (memoize) engine.enableMemoization(findMemoizableFunctions(*ast), memoLimit);
+                engine.execute();
+            } else if (useVM || dumpBytecode || dumpIR || !imagePath.empty()) {
+                CompiledProgram compiled;
+                if (optLevel >= 0 || dumpIR) {
+                    IRModule module = buildIR(*ast);
+                    PassManager passes = PassManager::forLevel(optLevel);
+                    passes.setDump(dumpIR);
+                    passes.run(module);
+                    compiled = lowerToBytecode(module, !profileOps);
+                } else {
+                    compiled = compileProgram(*ast, !profileOps);
+                }
+                if (dumpBytecode) {
+                    for (const auto& function : compiled.functions) {
+                        disassemble(compiled, function);
+                    }
+                }
+                if (!imagePath.empty()) {
+                    if (!saveImage(compiled, imagePath)) return 1;
+                    cout << "Wrote " << imagePath << endl;
+                } else if (useVM) {
+                    // Spawned calls run on the tree-walker of the host
+                    Interpreter host(osrThreshold);
+                    host.load(ast);
+                    host.setThreads(threads);
+                    VM vm(compiled, profileOps, jitThreshold, &host);
+                    vm.setMaxDepth(maxDepth);
+                    vm.setSpecializeThreshold(specializeThreshold);
+                    if (memoize) vm.enableMemoization(findMemoizableFunctions(*ast), memoLimit);
+                    vm.execute();
+                    if (profileOps) vm.printProfile();
+                }
             } else if (useInterpreter) {
                 // Execute with interpreter (current working system)
-                Interpreter interpreter;
+                Interpreter interpreter(osrThreshold);
+                if (memoize) interpreter.enableMemoization(memoLimit);
+                interpreter.setThreads(threads);
                 interpreter.execute(ast);
             }
         } else {
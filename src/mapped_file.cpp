@@ -0,0 +1,122 @@
+#include "../include/mapped_file.h"
+#include "../include/runtime.h"
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const char* data, size_t length, MappedLayout layout)
+    : data(data), length(length), layout(layout), linesComplete(false), refCount(1) {
+    if (layout == MappedLayout::LINES) {
+        if (length > 0) lineStarts.push_back(0);
+        else linesComplete = true;
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (data) munmap(const_cast<char*>(data), length);
+}
+
+// Map the whole file read-only. Returns nullptr (after reporting) on failure.
+MappedFile* MappedFile::open(const std::string& path, MappedLayout layout) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        runtimeErrors() << "Error: Cannot open file '" << path << "'" << std::endl;
+        return nullptr;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        runtimeErrors() << "Error: Cannot stat file '" << path << "'" << std::endl;
+        ::close(fd);
+        return nullptr;
+    }
+
+    size_t length = static_cast<size_t>(info.st_size);
+    const char* data = nullptr;
+    if (length > 0) {
+        void* mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED) {
+            runtimeErrors() << "Error: Cannot map file '" << path << "'" << std::endl;
+            ::close(fd);
+            return nullptr;
+        }
+        madvise(mapped, length, MADV_SEQUENTIAL);
+        data = static_cast<const char*>(mapped);
+    }
+    ::close(fd);
+
+    return new MappedFile(data, length, layout);
+}
+
+// Extend the line index until it covers index, or the file ends
+bool MappedFile::scanLinesUpTo(size_t index) {
+    while (index >= lineStarts.size() && !linesComplete) {
+        size_t from = lineStarts.back();
+        const char* newline = static_cast<const char*>(std::memchr(data + from, '\n', length - from));
+        size_t nextStart = newline ? static_cast<size_t>(newline - data) + 1 : length;
+        if (nextStart >= length) {
+            linesComplete = true;
+        } else {
+            lineStarts.push_back(nextStart);
+        }
+    }
+    return index < lineStarts.size();
+}
+
+size_t MappedFile::size() {
+    switch (layout) {
+        case MappedLayout::LINES: {
+            std::lock_guard<std::mutex> guard(linesLock);
+            scanLinesUpTo(SIZE_MAX - 1);
+            return lineStarts.size();
+        }
+        case MappedLayout::INT64:
+            return length / sizeof(int64_t);
+        case MappedLayout::FLOAT64:
+            return length / sizeof(double);
+    }
+    return 0;
+}
+
+// Materialize one element. Caller is responsible for bounds.
+RuntimeValue MappedFile::at(size_t index) {
+    switch (layout) {
+        case MappedLayout::LINES: {
+            size_t start;
+            {
+                std::lock_guard<std::mutex> guard(linesLock);
+                if (!scanLinesUpTo(index)) return RuntimeValue();
+                start = lineStarts[index];
+            }
+            const char* newline = static_cast<const char*>(std::memchr(data + start, '\n', length - start));
+            size_t stop = newline ? static_cast<size_t>(newline - data) : length;
+            return RuntimeValue(std::string(data + start, stop - start));
+        }
+        case MappedLayout::INT64: {
+            int64_t value;
+            std::memcpy(&value, data + index * sizeof(int64_t), sizeof(value));
+            if (value >= INT_MIN && value <= INT_MAX) {
+                return RuntimeValue(static_cast<int>(value));
+            }
+            return RuntimeValue(static_cast<double>(value));
+        }
+        case MappedLayout::FLOAT64: {
+            double value;
+            std::memcpy(&value, data + index * sizeof(double), sizeof(value));
+            return RuntimeValue(value);
+        }
+    }
+    return RuntimeValue();
+}
+
+void MappedFile::retain() {
+    refCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void MappedFile::release() {
+    if (refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+}
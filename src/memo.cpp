@@ -0,0 +1,203 @@
+#include "../include/memo.h"
+#include "../include/interpreter.h"
+#include <functional>
+
+namespace {
+
+// Facts about one function body needed by the purity analysis
+struct FunctionFacts {
+    bool doesIO = false;
+    std::unordered_set<std::string> calls;
+};
+
+void collectFacts(const ASTNodePtr& node, FunctionFacts& facts) {
+    if (!node) return;
+
+    if (std::dynamic_pointer_cast<ASTInput>(node) || std::dynamic_pointer_cast<ASTOutput>(node)) {
+        facts.doesIO = true;
+        if (auto output = std::dynamic_pointer_cast<ASTOutput>(node)) collectFacts(output->expression, facts);
+    } else if (auto funcCall = std::dynamic_pointer_cast<ASTFunctionCall>(node)) {
+        auto callee = std::dynamic_pointer_cast<ASTIdentifier>(funcCall->callee);
+        if (!callee) {
+            facts.doesIO = true;
+        } else if (Interpreter::isBuiltinFunction(callee->name)) {
+            // Everything but len reads input or files
+            if (callee->name != "len") facts.doesIO = true;
+        } else {
+            facts.calls.insert(callee->name);
+        }
+        for (const auto& arg : funcCall->arguments) collectFacts(arg, facts);
+    } else if (auto binary = std::dynamic_pointer_cast<ASTBinaryExpression>(node)) {
+        collectFacts(binary->left, facts);
+        collectFacts(binary->right, facts);
+    } else if (auto unary = std::dynamic_pointer_cast<ASTUnaryExpression>(node)) {
+        collectFacts(unary->operand, facts);
+    } else if (auto grouped = std::dynamic_pointer_cast<ASTGroupedExpression>(node)) {
+        collectFacts(grouped->expression, facts);
+    } else if (auto arrayLit = std::dynamic_pointer_cast<ASTArrayLiteral>(node)) {
+        for (const auto& elem : arrayLit->elements) collectFacts(elem, facts);
+    } else if (auto arrayAccess = std::dynamic_pointer_cast<ASTArrayAccess>(node)) {
+        collectFacts(arrayAccess->array, facts);
+        collectFacts(arrayAccess->index, facts);
+    } else if (auto assignment = std::dynamic_pointer_cast<ASTAssignment>(node)) {
+        collectFacts(assignment->expression, facts);
+    } else if (auto returnStmt = std::dynamic_pointer_cast<ASTReturn>(node)) {
+        collectFacts(returnStmt->expression, facts);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(node)) {
+        collectFacts(ifStmt->condition, facts);
+        collectFacts(ifStmt->thenBlock, facts);
+        collectFacts(ifStmt->elseBlock, facts);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(node)) {
+        collectFacts(forStmt->init, facts);
+        collectFacts(forStmt->condition, facts);
+        collectFacts(forStmt->increment, facts);
+        collectFacts(forStmt->body, facts);
+    } else if (auto block = std::dynamic_pointer_cast<ASTBlock>(node)) {
+        for (const auto& s : block->statements) collectFacts(s, facts);
+    }
+}
+
+void mix(size_t& seed, size_t value) {
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+// Later definitions replace earlier ones, as in Interpreter::execute
+std::unordered_map<std::string, FunctionFacts> collectProgramFacts(const ASTProgram& program) {
+    std::unordered_map<std::string, FunctionFacts> facts;
+    for (const auto& node : program.functions) {
+        if (auto func = std::dynamic_pointer_cast<ASTFunction>(node)) {
+            FunctionFacts functionFacts;
+            collectFacts(func->body, functionFacts);
+            facts[func->name] = std::move(functionFacts);
+        }
+    }
+    return facts;
+}
+
+// Assume everything is pure and drop functions until nothing changes,
+// so recursive functions can be proven pure
+std::unordered_set<std::string> pureFunctions(const std::unordered_map<std::string, FunctionFacts>& facts) {
+    std::unordered_set<std::string> pure;
+    for (const auto& entry : facts) {
+        if (!entry.second.doesIO) pure.insert(entry.first);
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = pure.begin(); it != pure.end();) {
+            bool callsImpure = false;
+            // Unknown callees are reported at run time, so they count as impure
+            for (const auto& callee : facts.at(*it).calls) {
+                if (!pure.count(callee)) callsImpure = true;
+            }
+            if (callsImpure) {
+                it = pure.erase(it);
+                changed = true;
+            } else {
+                ++it;
+            }
+        }
+    }
+    return pure;
+}
+
+}
+
+std::unordered_set<std::string> findPureFunctions(const ASTProgram& program) {
+    return pureFunctions(collectProgramFacts(program));
+}
+
+std::unordered_set<std::string> findMemoizableFunctions(const ASTProgram& program) {
+    std::unordered_map<std::string, FunctionFacts> facts = collectProgramFacts(program);
+    std::unordered_set<std::string> pure = pureFunctions(facts);
+
+    // Non-recursive functions are cheaper to run again than to look up
+    std::unordered_set<std::string> memoizable;
+    for (const auto& name : pure) {
+        std::unordered_set<std::string> reached;
+        const auto& calls = facts.at(name).calls;
+        std::vector<std::string> pending(calls.begin(), calls.end());
+        while (!pending.empty()) {
+            std::string callee = pending.back();
+            pending.pop_back();
+            if (!reached.insert(callee).second) continue;
+            for (const auto& next : facts.at(callee).calls) pending.push_back(next);
+        }
+        if (reached.count(name)) memoizable.insert(name);
+    }
+    return memoizable;
+}
+
+size_t MemoTable::KeyHash::operator()(const Key& key) const {
+    size_t seed = key.size();
+    for (const RuntimeValue& value : key) {
+        mix(seed, static_cast<size_t>(value.type));
+        switch (value.type) {
+            case RuntimeType::INTEGER: mix(seed, std::hash<int>()(value.intValue)); break;
+            case RuntimeType::FLOAT: mix(seed, std::hash<double>()(value.floatValue)); break;
+            case RuntimeType::BOOLEAN: mix(seed, value.boolValue); break;
+            case RuntimeType::STRING: mix(seed, std::hash<std::string>()(*value.stringValue)); break;
+            default: break;
+        }
+    }
+    return seed;
+}
+
+bool MemoTable::KeyEqual::operator()(const Key& a, const Key& b) const {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (a[i].type != b[i].type) return false;
+        switch (a[i].type) {
+            case RuntimeType::INTEGER: if (a[i].intValue != b[i].intValue) return false; break;
+            case RuntimeType::FLOAT: if (a[i].floatValue != b[i].floatValue) return false; break;
+            case RuntimeType::BOOLEAN: if (a[i].boolValue != b[i].boolValue) return false; break;
+            case RuntimeType::STRING: if (*a[i].stringValue != *b[i].stringValue) return false; break;
+            default: break;
+        }
+    }
+    return true;
+}
+
+bool MemoTable::memoizable(const RuntimeValue* args, size_t argc) {
+    for (size_t i = 0; i < argc; ++i) {
+        switch (args[i].type) {
+            case RuntimeType::INTEGER:
+            case RuntimeType::FLOAT:
+            case RuntimeType::BOOLEAN:
+            case RuntimeType::STRING:
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+bool MemoTable::lookup(const RuntimeValue* args, size_t argc, RuntimeValue& result) {
+    if (entries.empty()) return false;
+    Key key(args, args + argc);
+    auto it = entries.find(key);
+    if (it == entries.end()) return false;
+    ages.splice(ages.begin(), ages, it->second.age);
+    result = it->second.result;
+    return true;
+}
+
+void MemoTable::store(const RuntimeValue* args, size_t argc, const RuntimeValue& result) {
+    if (capacity == 0) return;
+    auto inserted = entries.emplace(Key(args, args + argc), Entry{result, ages.end()});
+    Entry& entry = inserted.first->second;
+    if (!inserted.second) {
+        // A recursive call got there first
+        entry.result = result;
+        ages.splice(ages.begin(), ages, entry.age);
+        return;
+    }
+    ages.push_front(&inserted.first->first);
+    entry.age = ages.begin();
+    if (entries.size() > capacity) {
+        auto oldest = entries.find(*ages.back());
+        ages.pop_back();
+        entries.erase(oldest);
+    }
+}
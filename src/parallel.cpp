@@ -0,0 +1,331 @@
+#include "../include/parallel.h"
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <unordered_set>
+
+namespace {
+
+using NameSet = std::unordered_set<std::string>;
+
+bool readsInput(const std::string& builtin) {
+    return builtin == "read_numbers" || builtin == "read_all";
+}
+
+// Calls visit on node and, while it returns true, on everything under it.
+// Callees are not visited, only the arguments of a call.
+void visitNodes(const ASTNodePtr& node, const std::function<bool(const ASTNodePtr&)>& visit) {
+    if (!node || !visit(node)) return;
+    if (auto binary = std::dynamic_pointer_cast<ASTBinaryExpression>(node)) {
+        visitNodes(binary->left, visit);
+        visitNodes(binary->right, visit);
+    } else if (auto unary = std::dynamic_pointer_cast<ASTUnaryExpression>(node)) {
+        visitNodes(unary->operand, visit);
+    } else if (auto grouped = std::dynamic_pointer_cast<ASTGroupedExpression>(node)) {
+        visitNodes(grouped->expression, visit);
+    } else if (auto arrayLit = std::dynamic_pointer_cast<ASTArrayLiteral>(node)) {
+        for (const auto& elem : arrayLit->elements) visitNodes(elem, visit);
+    } else if (auto arrayAccess = std::dynamic_pointer_cast<ASTArrayAccess>(node)) {
+        visitNodes(arrayAccess->array, visit);
+        visitNodes(arrayAccess->index, visit);
+    } else if (auto funcCall = std::dynamic_pointer_cast<ASTFunctionCall>(node)) {
+        for (const auto& arg : funcCall->arguments) visitNodes(arg, visit);
+    } else if (auto assignment = std::dynamic_pointer_cast<ASTAssignment>(node)) {
+        visitNodes(assignment->expression, visit);
+    } else if (auto output = std::dynamic_pointer_cast<ASTOutput>(node)) {
+        visitNodes(output->expression, visit);
+    } else if (auto returnStmt = std::dynamic_pointer_cast<ASTReturn>(node)) {
+        visitNodes(returnStmt->expression, visit);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(node)) {
+        visitNodes(ifStmt->condition, visit);
+        visitNodes(ifStmt->thenBlock, visit);
+        visitNodes(ifStmt->elseBlock, visit);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(node)) {
+        visitNodes(forStmt->init, visit);
+        visitNodes(forStmt->condition, visit);
+        visitNodes(forStmt->increment, visit);
+        visitNodes(forStmt->body, visit);
+    } else if (auto block = std::dynamic_pointer_cast<ASTBlock>(node)) {
+        for (const auto& stmt : block->statements) visitNodes(stmt, visit);
+    }
+}
+
+std::string calleeName(const ASTFunctionCall& call) {
+    auto callee = dynamic_cast<ASTIdentifier*>(call.callee.get());
+    return callee ? callee->name : std::string();
+}
+
+// Functions that read input, directly or through the functions they call
+NameSet findInputFunctions(const ASTProgram& program) {
+    std::vector<std::shared_ptr<ASTFunction>> functions;
+    for (const auto& node : program.functions) {
+        if (auto func = std::dynamic_pointer_cast<ASTFunction>(node)) functions.push_back(func);
+    }
+    NameSet readers;
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (const auto& func : functions) {
+            if (readers.count(func->name)) continue;
+            bool reads = false;
+            visitNodes(func->body, [&](const ASTNodePtr& node) {
+                if (std::dynamic_pointer_cast<ASTInput>(node)) reads = true;
+                if (auto call = std::dynamic_pointer_cast<ASTFunctionCall>(node)) {
+                    std::string name = calleeName(*call);
+                    if (readsInput(name) || readers.count(name)) reads = true;
+                }
+                return !reads;
+            });
+            if (reads) {
+                readers.insert(func->name);
+                changed = true;
+            }
+        }
+    }
+    return readers;
+}
+
+// Checks one loop against the rules in parallel.h
+class ParallelChecker {
+private:
+    const std::string& function;
+    const NameSet& readers;
+    std::ostream& errors;
+    std::shared_ptr<ParallelLoop> plan = std::make_shared<ParallelLoop>();
+    NameSet assigned;
+    NameSet reductionNames;
+    NameSet reported;
+    bool ok = true;
+
+    void fail(const std::string& message) {
+        if (!reported.insert(message).second) return;
+        errors << "Error: parallel for in '" << function << "' " << message << std::endl;
+        ok = false;
+    }
+
+    bool header(const ASTFor& loop);
+    void findReductions(const ASTNodePtr& body);
+    void checkReads(const ASTNodePtr& expr, const NameSet& defined);
+    void checkStatement(const ASTNodePtr& stmt, NameSet& defined);
+
+public:
+    ParallelChecker(const std::string& function, const NameSet& readers, std::ostream& errors)
+        : function(function), readers(readers), errors(errors) {}
+
+    std::shared_ptr<ParallelLoop> check(const ASTFor& loop);
+};
+
+// i = start; i < end (or <=); i = i + step
+bool ParallelChecker::header(const ASTFor& loop) {
+    auto init = std::dynamic_pointer_cast<ASTAssignment>(loop.init);
+    auto condition = dynamic_cast<ASTBinaryExpression*>(unwrap(loop.condition));
+    auto increment = std::dynamic_pointer_cast<ASTAssignment>(loop.increment);
+    if (!init || !condition || !increment) return false;
+    plan->index = init->variable;
+    if ((condition->op != "<" && condition->op != "<=") || !isIdentifier(condition->left, plan->index)) {
+        return false;
+    }
+    plan->end = condition->right;
+    plan->inclusive = condition->op == "<=";
+
+    auto sum = dynamic_cast<ASTBinaryExpression*>(unwrap(increment->expression));
+    if (increment->variable != plan->index || !sum || sum->op != "+" ||
+        !isIdentifier(sum->left, plan->index)) {
+        return false;
+    }
+    auto step = dynamic_cast<ASTLiteral*>(unwrap(sum->right));
+    if (!step || !std::holds_alternative<int>(step->value) || std::get<int>(step->value) <= 0) return false;
+    plan->step = std::get<int>(step->value);
+    return true;
+}
+
+// Names whose every assignment is s = s op e ..., with s read nowhere else
+void ParallelChecker::findReductions(const ASTNodePtr& body) {
+    std::unordered_map<std::string, std::vector<const ASTAssignment*>> stores;
+    std::unordered_map<std::string, size_t> reads;
+    visitNodes(body, [&](const ASTNodePtr& node) {
+        if (auto assignment = std::dynamic_pointer_cast<ASTAssignment>(node)) {
+            stores[assignment->variable].push_back(assignment.get());
+        } else if (auto identifier = std::dynamic_pointer_cast<ASTIdentifier>(node)) {
+            reads[identifier->name]++;
+        }
+        return true;
+    });
+
+    for (const auto& [name, assignments] : stores) {
+        if (name == plan->index) continue;
+        std::unordered_map<const ASTAssignment*, ParallelLoop::Reduction> found;
+        for (const ASTAssignment* assignment : assignments) {
+            ParallelLoop::Reduction reduction{name, {}};
+            ASTNodePtr node = assignment->expression;
+            while (auto binary = dynamic_cast<ASTBinaryExpression*>(unwrap(node))) {
+                if (binary->op == "&&" || binary->op == "||") break;
+                reduction.terms.insert(reduction.terms.begin(), {binary->op, binary->right});
+                node = binary->left;
+            }
+            bool termReadsName = false;
+            for (const auto& term : reduction.terms) {
+                visitNodes(term.second, [&](const ASTNodePtr& n) {
+                    if (isIdentifier(n, name)) termReadsName = true;
+                    return true;
+                });
+            }
+            if (!isIdentifier(node, name) || reduction.terms.empty() || termReadsName) break;
+            found.emplace(assignment, std::move(reduction));
+        }
+        if (found.size() != assignments.size() || reads[name] != assignments.size()) continue;
+        reductionNames.insert(name);
+        plan->reductions.insert(found.begin(), found.end());
+    }
+}
+
+void ParallelChecker::checkReads(const ASTNodePtr& expr, const NameSet& defined) {
+    visitNodes(expr, [&](const ASTNodePtr& node) {
+        if (auto identifier = std::dynamic_pointer_cast<ASTIdentifier>(node)) {
+            const std::string& name = identifier->name;
+            if (assigned.count(name) && !defined.count(name)) {
+                fail("writes shared scalar '" + name + "', which an iteration reads before assigning it");
+            }
+        } else if (auto call = std::dynamic_pointer_cast<ASTFunctionCall>(node)) {
+            std::string name = calleeName(*call);
+            if (readsInput(name) || readers.count(name)) fail("reads input through '" + name + "'");
+        }
+        return true;
+    });
+}
+
+// Follows the body in execution order; defined holds the names every path
+// to this point has assigned in the current iteration
+void ParallelChecker::checkStatement(const ASTNodePtr& stmt, NameSet& defined) {
+    if (auto assignment = std::dynamic_pointer_cast<ASTAssignment>(stmt)) {
+        auto reduction = plan->reductions.find(assignment.get());
+        if (reduction != plan->reductions.end()) {
+            for (const auto& term : reduction->second.terms) checkReads(term.second, defined);
+            return;
+        }
+        checkReads(assignment->expression, defined);
+        defined.insert(assignment->variable);
+    } else if (std::dynamic_pointer_cast<ASTInput>(stmt)) {
+        fail("reads input");
+    } else if (auto output = std::dynamic_pointer_cast<ASTOutput>(stmt)) {
+        checkReads(output->expression, defined);
+    } else if (std::dynamic_pointer_cast<ASTReturn>(stmt)) {
+        fail("returns from inside the loop");
+    } else if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(stmt)) {
+        checkReads(ifStmt->condition, defined);
+        NameSet thenDefined = defined;
+        checkStatement(ifStmt->thenBlock, thenDefined);
+        if (ifStmt->elseBlock) {
+            NameSet elseDefined = defined;
+            checkStatement(ifStmt->elseBlock, elseDefined);
+            for (const auto& name : thenDefined) {
+                if (elseDefined.count(name)) defined.insert(name);
+            }
+        }
+    } else if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(stmt)) {
+        // The body may not run, so only the init counts afterwards
+        checkStatement(forStmt->init, defined);
+        NameSet inner = defined;
+        checkReads(forStmt->condition, inner);
+        checkStatement(forStmt->body, inner);
+        checkStatement(forStmt->increment, inner);
+    } else if (auto block = std::dynamic_pointer_cast<ASTBlock>(stmt)) {
+        for (const auto& s : block->statements) checkStatement(s, defined);
+    }
+}
+
+std::shared_ptr<ParallelLoop> ParallelChecker::check(const ASTFor& loop) {
+    if (!header(loop)) {
+        fail("needs the header i = start; i < end; i = i + step with a positive int step");
+        return nullptr;
+    }
+    for (const auto& name : collectAssignedNames(loop.body)) assigned.insert(name);
+    if (assigned.count(plan->index)) fail("assigns its index '" + plan->index + "' in the body");
+
+    // The end is evaluated once, before any iteration runs
+    visitNodes(plan->end, [&](const ASTNodePtr& node) {
+        if (auto identifier = std::dynamic_pointer_cast<ASTIdentifier>(node)) {
+            if (assigned.count(identifier->name) || identifier->name == plan->index) {
+                fail("has an end that depends on '" + identifier->name + "', which the loop assigns");
+            }
+        } else if (auto call = std::dynamic_pointer_cast<ASTFunctionCall>(node)) {
+            if (calleeName(*call) != "len") fail("calls '" + calleeName(*call) + "' in its end condition");
+        }
+        return true;
+    });
+
+    findReductions(loop.body);
+    NameSet defined = {plan->index};
+    checkStatement(loop.body, defined);
+
+    for (const auto& name : assigned) {
+        if (!reductionNames.count(name)) plan->privates.push_back(name);
+    }
+    NameSet shared;
+    for (const auto& name : collectReadNames(loop.body)) {
+        if (name != plan->index && !assigned.count(name) && shared.insert(name).second) {
+            plan->shared.push_back(name);
+        }
+    }
+    return ok ? plan : nullptr;
+}
+
+bool checkStatements(const ASTNodePtr& stmt, const std::string& function, const NameSet& readers,
+                     std::ostream& errors) {
+    bool ok = true;
+    if (auto block = std::dynamic_pointer_cast<ASTBlock>(stmt)) {
+        for (const auto& s : block->statements) ok = checkStatements(s, function, readers, errors) && ok;
+    } else if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(stmt)) {
+        ok = checkStatements(ifStmt->thenBlock, function, readers, errors) && ok;
+        ok = checkStatements(ifStmt->elseBlock, function, readers, errors) && ok;
+    } else if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(stmt)) {
+        if (forStmt->parallel) {
+            forStmt->parallelLoop = ParallelChecker(function, readers, errors).check(*forStmt);
+            ok = forStmt->parallelLoop != nullptr;
+        }
+        ok = checkStatements(forStmt->body, function, readers, errors) && ok;
+    }
+    return ok;
+}
+
+} // namespace
+
+bool checkSpawns(const ASTProgram& program, std::ostream& errors) {
+    NameSet readers = findInputFunctions(program);
+    NameSet defined;
+    for (const auto& node : program.functions) {
+        if (auto func = std::dynamic_pointer_cast<ASTFunction>(node)) defined.insert(func->name);
+    }
+    bool ok = true;
+    for (const auto& node : program.functions) {
+        auto func = std::dynamic_pointer_cast<ASTFunction>(node);
+        if (!func) continue;
+        visitNodes(func->body, [&](const ASTNodePtr& node) {
+            auto call = std::dynamic_pointer_cast<ASTFunctionCall>(node);
+            if (!call || calleeName(*call) != "spawn" || call->arguments.empty()) return true;
+            auto target = std::dynamic_pointer_cast<ASTLiteral>(call->arguments[0]);
+            auto name = target ? std::get_if<std::string>(&target->value) : nullptr;
+            if (!name) return true;
+            if (!defined.count(*name)) {
+                errors << "Error: spawn in '" << func->name << "' of undefined function '" << *name << "'" << std::endl;
+                ok = false;
+            } else if (readers.count(*name)) {
+                errors << "Error: spawn in '" << func->name << "' of '" << *name << "', which reads input" << std::endl;
+                ok = false;
+            }
+            return true;
+        });
+    }
+    return ok;
+}
+
+bool checkParallelLoops(ASTProgram& program, std::ostream& errors) {
+    NameSet readers = findInputFunctions(program);
+    bool ok = true;
+    for (const auto& node : program.functions) {
+        if (auto func = std::dynamic_pointer_cast<ASTFunction>(node)) {
+            ok = checkStatements(func->body, func->name, readers, errors) && ok;
+        }
+    }
+    return ok;
+}
@@ -5,95 +5,69 @@
 
 using namespace std;
 
-static size_t current = 0;
-static const std::vector<GenericToken>* tokens = nullptr;
-static const std::string* sourceCode = nullptr;
+Parser::Parser(const std::vector<GenericToken>& tokens, const std::string& source, std::ostream& errors)
+    : tokens(tokens), sourceCode(source), errors(errors), current(0) {}
+
+bool parseProgramInternal(const std::vector<GenericToken>& inputTokens, const std::string& source) {
+    return Parser(inputTokens, source).parse();
+}
+
+bool Parser::parse() {
+    current = 0;
+    return parseProgram();
+}
 
 // Print detailed error context
-void printErrorWithContext(const std::string& message, size_t position) {
-    std::cerr << message << " at position " << position << "\n";
+void Parser::printErrorWithContext(const std::string& message, size_t position) {
+    errors << message << " at position " << position << "\n";
 
-    if (!sourceCode || position >= sourceCode->size()) return;
+    if (position >= sourceCode.size()) return;
 
     size_t lineStart = position, lineEnd = position;
-    while (lineStart > 0 && (*sourceCode)[lineStart - 1] != '\n') lineStart--;
-    while (lineEnd < sourceCode->size() && (*sourceCode)[lineEnd] != '\n') lineEnd++;
+    while (lineStart > 0 && sourceCode[lineStart - 1] != '\n') lineStart--;
+    while (lineEnd < sourceCode.size() && sourceCode[lineEnd] != '\n') lineEnd++;
 
-    std::string line = sourceCode->substr(lineStart, lineEnd - lineStart);
-    std::cerr << "  " << line << "\n  ";
+    std::string line = sourceCode.substr(lineStart, lineEnd - lineStart);
+    errors << "  " << line << "\n  ";
 
     for (size_t i = lineStart; i < position; ++i) {
-        std::cerr << ((*sourceCode)[i] == '\t' ? '\t' : ' ');
+        errors << (sourceCode[i] == '\t' ? '\t' : ' ');
     }
-    std::cerr << "^\n";
-}
-static bool parseProgram();  // ← Add this line before using it
-
-bool parseProgramInternal(const std::vector<GenericToken>& inputTokens, const std::string& source) {
-    tokens = &inputTokens;
-    sourceCode = &source;
-    current = 0;
-    return parseProgram();  // defined below
+    errors << "^\n";
 }
 
-
-static const GenericToken& peek() {
-    if (current < tokens->size()) return (*tokens)[current];
-    static GenericToken endToken = {TOKEN_ERROR, 0, {}, {}, {}, {}, {}, {"Unexpected end of input", 0}};
+const GenericToken& Parser::peek() const {
+    if (current < tokens.size()) return tokens[current];
+    static const GenericToken endToken = {TOKEN_ERROR, 0, {}, {}, {}, {}, {}, {"Unexpected end of input", 0}};
     return endToken;
 }
 
-static const GenericToken& next() {
-    if (current < tokens->size()) return (*tokens)[current++];
-    static GenericToken endToken = {TOKEN_ERROR, 0, {}, {}, {}, {}, {}, {"Unexpected end of input", 0}};
+const GenericToken& Parser::next() {
+    if (current < tokens.size()) return tokens[current++];
+    static const GenericToken endToken = {TOKEN_ERROR, 0, {}, {}, {}, {}, {}, {"Unexpected end of input", 0}};
     return endToken;
 }
 
-static bool matchKeyword(GenericTokenType type) {
-    if (peek().type == type) { next(); return true; }
-    return false;
-}
-
-static bool matchSeparator(char symbol) {
+bool Parser::matchSeparator(char symbol) {
     if (peek().type == TOKEN_SEPARATOR && peek().separator.symbol == symbol) {
         next(); return true;
     }
     return false;
 }
 
-static bool matchIdentifier() {
+bool Parser::matchIdentifier() {
     if (peek().type == TOKEN_IDENTIFIER) { next(); return true; }
     return false;
 }
 
-static bool matchLiteral() {
-    if (peek().type == TOKEN_LITERAL) { next(); return true; }
-    return false;
-}
-
-static bool matchOperator(const std::string& symbol) {
+bool Parser::matchOperator(const std::string& symbol) {
     if (peek().type == TOKEN_OPERATOR && peek().op.symbol == symbol) {
         next(); return true;
     }
     return false;
 }
 
-// Parser forward declarations
-static bool parseProgram();
-static bool parseBlock();
-static bool parseStatementlist();
-static bool parseStatement();
-static bool parseAssignment();
-static bool parseInput();
-static bool parseOutput();
-static bool parseIf();
-static bool parseFor();
-static bool parseExpression();
-static bool parseTerm();
-static bool parseFactor();
-static bool parseReturn();
-
-static bool parseProgram() {
+bool Parser::parseProgram() {
     while (peek().type == TOKEN_KEYWORD && peek().keyword.type == KEYWORD_DEF) {
         next();
         if (!matchIdentifier()) {
@@ -125,7 +99,7 @@ static bool parseProgram() {
 }
 
 
-static bool parseBlock() {
+bool Parser::parseBlock() {
     if (!matchSeparator('{')) {
         printErrorWithContext("Expected '{'", peek().position);
         return false;
@@ -141,7 +115,7 @@ static bool parseBlock() {
     return true;
 }
 
-static bool parseStatementlist() {
+bool Parser::parseStatementlist() {
     while (peek().type != TOKEN_SEPARATOR || peek().separator.symbol != '}') {
         if (!parseStatement()) {
             printErrorWithContext("Failed to parse statement", peek().position);
@@ -151,7 +125,7 @@ static bool parseStatementlist() {
     return true;
 }
 
-static bool parseStatement() {
+bool Parser::parseStatement() {
     const GenericToken& token = peek();
     switch (token.type) {
         case TOKEN_KEYWORD:
@@ -160,6 +134,7 @@ static bool parseStatement() {
                 case KEYWORD_OUTPUT: return parseOutput();
                 case KEYWORD_IF: return parseIf();
                 case KEYWORD_FOR: return parseFor();
+                case KEYWORD_PARALLEL: return parseParallelFor();
                 case KEYWORD_RETURN: return parseReturn();
                 default:
                     printErrorWithContext("Unexpected keyword", token.position);
@@ -173,7 +148,7 @@ static bool parseStatement() {
     }
 }
 
-static bool parseAssignment() {
+bool Parser::parseAssignment() {
     if (!matchIdentifier()) {
         printErrorWithContext("Expected identifier", peek().position);
         return false;
@@ -193,7 +168,7 @@ static bool parseAssignment() {
     return true;
 }
 
-static bool parseInput() {
+bool Parser::parseInput() {
     next();
     if (!matchIdentifier()) {
         printErrorWithContext("Expected identifier after 'input'", peek().position);
@@ -206,7 +181,7 @@ static bool parseInput() {
     return true;
 }
 
-static bool parseOutput() {
+bool Parser::parseOutput() {
     next();
     if (!parseExpression()) {
         printErrorWithContext("Expected expression after 'output'", peek().position);
@@ -219,7 +194,7 @@ static bool parseOutput() {
     return true;
 }
 
-static bool parseReturn() {
+bool Parser::parseReturn() {
     next();
     if (matchSeparator(';')) return true;
     if (!parseExpression()) {
@@ -233,7 +208,7 @@ static bool parseReturn() {
     return true;
 }
 
-static bool parseIf() {
+bool Parser::parseIf() {
     next();
     if (!matchSeparator('(') || !parseExpression() || !matchSeparator(')')) {
         printErrorWithContext("Malformed 'if' condition", peek().position);
@@ -256,13 +231,13 @@ static bool parseIf() {
     }
     return true;
 }
-static bool parseSimpleAssignment() {
+bool Parser::parseSimpleAssignment() {
     if (!matchIdentifier()) return false;
     if (!matchOperator("=")) return false;
     if (!parseExpression()) return false;
     return true;
 }
-static bool parseFor() {
+bool Parser::parseFor() {
     next(); // consume 'for'
     if (!matchSeparator('(')) {
         printErrorWithContext("Expected '(' in 'for' loop", peek().position);
@@ -295,8 +270,16 @@ static bool parseFor() {
     return parseBlock();
 }
 
+bool Parser::parseParallelFor() {
+    next(); // consume 'parallel'
+    if (peek().type != TOKEN_KEYWORD || peek().keyword.type != KEYWORD_FOR) {
+        printErrorWithContext("Expected 'for' after 'parallel'", peek().position);
+        return false;
+    }
+    return parseFor();
+}
 
-static bool parseExpression() {
+bool Parser::parseExpression() {
     // Parse the left-hand side: a term
     if (!parseTerm()) {
         printErrorWithContext("Expected term in expression", peek().position);
@@ -338,7 +321,7 @@ static bool parseExpression() {
 }
 
 
-static bool parseTerm() {
+bool Parser::parseTerm() {
     if (!parseFactor()) return false;
     while (peek().type == TOKEN_OPERATOR && (peek().op.symbol == "*" || peek().op.symbol == "/" || peek().op.symbol == "%")) {
         next();
@@ -347,7 +330,7 @@ static bool parseTerm() {
     return true;
 }
 
-static bool parseFactor() {
+bool Parser::parseFactor() {
     const GenericToken& token = peek();
     if (token.type == TOKEN_LITERAL) {
         next();
@@ -390,6 +373,20 @@ static bool parseFactor() {
         next();
         return parseFactor();
     }
+    if (token.type == TOKEN_KEYWORD && token.keyword.type == KEYWORD_AWAIT) {
+        next();
+        return parseFactor();
+    }
+    if (token.type == TOKEN_KEYWORD && token.keyword.type == KEYWORD_SPAWN) {
+        next();
+        if (peek().type != TOKEN_IDENTIFIER || current + 1 >= tokens.size() ||
+            tokens[current + 1].type != TOKEN_SEPARATOR ||
+            tokens[current + 1].separator.symbol != '(') {
+            printErrorWithContext("Expected a function call after 'spawn'", peek().position);
+            return false;
+        }
+        return parseFactor();
+    }
     if (peek().type == TOKEN_SEPARATOR && peek().separator.symbol == '[') {
         next(); // consume '['
 
@@ -0,0 +1,91 @@
+#include "../include/partial_eval.h"
+#include "../include/memo.h"
+
+PartialEvaluator::PartialEvaluator(long stepBudget)
+    : interpreter(0), stepBudget(stepBudget), folded(0) {}
+
+int PartialEvaluator::run(const std::shared_ptr<ASTProgram>& program) {
+    pure = findPureFunctions(*program);
+    interpreter.load(program);
+    folded = 0;
+    for (auto& node : program->functions) {
+        if (auto func = std::dynamic_pointer_cast<ASTFunction>(node)) fold(func->body);
+    }
+    return folded;
+}
+
+// Expressions that do not depend on variables or calls
+bool PartialEvaluator::isConstant(const ASTNodePtr& node) const {
+    if (std::dynamic_pointer_cast<ASTLiteral>(node)) return true;
+    if (auto grouped = std::dynamic_pointer_cast<ASTGroupedExpression>(node)) {
+        return isConstant(grouped->expression);
+    }
+    if (auto unary = std::dynamic_pointer_cast<ASTUnaryExpression>(node)) {
+        return isConstant(unary->operand);
+    }
+    if (auto binary = std::dynamic_pointer_cast<ASTBinaryExpression>(node)) {
+        return isConstant(binary->left) && isConstant(binary->right);
+    }
+    if (auto arrayLit = std::dynamic_pointer_cast<ASTArrayLiteral>(node)) {
+        for (const auto& elem : arrayLit->elements) {
+            if (!isConstant(elem)) return false;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Folds the children first, so nested calls such as f(g(1)) collapse
+void PartialEvaluator::fold(ASTNodePtr& node) {
+    if (!node) return;
+
+    if (auto funcCall = std::dynamic_pointer_cast<ASTFunctionCall>(node)) {
+        for (auto& arg : funcCall->arguments) fold(arg);
+        auto callee = std::dynamic_pointer_cast<ASTIdentifier>(funcCall->callee);
+        // Built-ins win over user functions of the same name
+        if (!callee || Interpreter::isBuiltinFunction(callee->name) || !pure.count(callee->name)) return;
+        for (const auto& arg : funcCall->arguments) {
+            if (!isConstant(arg)) return;
+        }
+
+        RuntimeValue result;
+        if (!interpreter.evaluateConstant(node, stepBudget, result)) return;
+        switch (result.type) {
+            case RuntimeType::INTEGER: node = std::make_shared<ASTLiteral>(result.intValue); break;
+            case RuntimeType::FLOAT: node = std::make_shared<ASTLiteral>(result.floatValue); break;
+            case RuntimeType::BOOLEAN: node = std::make_shared<ASTLiteral>(result.boolValue); break;
+            case RuntimeType::STRING: node = std::make_shared<ASTLiteral>(*result.stringValue); break;
+            default: return;
+        }
+        folded++;
+    } else if (auto binary = std::dynamic_pointer_cast<ASTBinaryExpression>(node)) {
+        fold(binary->left);
+        fold(binary->right);
+    } else if (auto unary = std::dynamic_pointer_cast<ASTUnaryExpression>(node)) {
+        fold(unary->operand);
+    } else if (auto grouped = std::dynamic_pointer_cast<ASTGroupedExpression>(node)) {
+        fold(grouped->expression);
+    } else if (auto arrayLit = std::dynamic_pointer_cast<ASTArrayLiteral>(node)) {
+        for (auto& elem : arrayLit->elements) fold(elem);
+    } else if (auto arrayAccess = std::dynamic_pointer_cast<ASTArrayAccess>(node)) {
+        fold(arrayAccess->array);
+        fold(arrayAccess->index);
+    } else if (auto assignment = std::dynamic_pointer_cast<ASTAssignment>(node)) {
+        fold(assignment->expression);
+    } else if (auto output = std::dynamic_pointer_cast<ASTOutput>(node)) {
+        fold(output->expression);
+    } else if (auto returnStmt = std::dynamic_pointer_cast<ASTReturn>(node)) {
+        fold(returnStmt->expression);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(node)) {
+        fold(ifStmt->condition);
+        fold(ifStmt->thenBlock);
+        fold(ifStmt->elseBlock);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(node)) {
+        fold(forStmt->init);
+        fold(forStmt->condition);
+        fold(forStmt->increment);
+        fold(forStmt->body);
+    } else if (auto block = std::dynamic_pointer_cast<ASTBlock>(node)) {
+        for (auto& s : block->statements) fold(s);
+    }
+}
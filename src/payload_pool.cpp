@@ -0,0 +1,145 @@
+#include "../include/payload_pool.h"
+#include "../include/runtime.h"
+
+static thread_local PayloadPool* activePool = nullptr;
+static thread_local bool threadExiting = false;
+
+namespace {
+// The per-thread fallback pool. Payloads released while the thread is being
+// torn down go straight back to the allocator.
+struct DefaultPool {
+    PayloadPool pool;
+    ~DefaultPool() { threadExiting = true; }
+};
+}
+
+// Capacity limits of the size classes; anything larger is not cached
+static const size_t STRING_CLASS_LIMITS[] = {15, 64, 256, 1024};
+static const size_t ARRAY_CLASS_LIMITS[] = {4, 16, 64, 256};
+
+static size_t classFor(const size_t* limits, size_t count, size_t size) {
+    for (size_t i = 0; i < count; ++i) {
+        if (size <= limits[i]) return i;
+    }
+    return count;
+}
+
+PayloadPool::~PayloadPool() {
+    for (auto& list : freeStrings) {
+        for (StringPayload* str : list) delete str;
+        list.clear();
+    }
+    for (auto& list : freeArrays) {
+        for (ArrayPayload* array : list) delete array;
+        list.clear();
+    }
+}
+
+PayloadPool* PayloadPool::current() {
+    if (activePool) return activePool;
+    if (threadExiting) return nullptr;
+    static thread_local DefaultPool defaultPool;
+    return &defaultPool.pool;
+}
+
+StringPayload* PayloadPool::takeString(size_t length) {
+    size_t cls = classFor(STRING_CLASS_LIMITS, STRING_CLASSES, length);
+    if (cls == STRING_CLASSES || freeStrings[cls].empty()) return nullptr;
+    StringPayload* str = freeStrings[cls].back();
+    freeStrings[cls].pop_back();
+    return str;
+}
+
+void PayloadPool::giveString(StringPayload* str) {
+    size_t cls = classFor(STRING_CLASS_LIMITS, STRING_CLASSES, str->capacity());
+    if (cls == STRING_CLASSES || freeStrings[cls].size() >= MAX_CACHED_PER_CLASS) {
+        delete str;
+        return;
+    }
+    str->clear();
+    freeStrings[cls].push_back(str);
+}
+
+ArrayPayload* PayloadPool::takeArray(size_t length) {
+    size_t cls = classFor(ARRAY_CLASS_LIMITS, ARRAY_CLASSES, length);
+    if (cls == ARRAY_CLASSES || freeArrays[cls].empty()) return nullptr;
+    ArrayPayload* array = freeArrays[cls].back();
+    freeArrays[cls].pop_back();
+    return array;
+}
+
+void PayloadPool::giveArray(ArrayPayload* array) {
+    size_t cls = classFor(ARRAY_CLASS_LIMITS, ARRAY_CLASSES, array->capacity());
+    if (cls == ARRAY_CLASSES || freeArrays[cls].size() >= MAX_CACHED_PER_CLASS) {
+        delete array;
+        return;
+    }
+    array->clear();
+    freeArrays[cls].push_back(array);
+}
+
+StringPayload* PayloadPool::newString(const char* data, size_t length) {
+    PayloadPool* pool = current();
+    if (pool) {
+        if (StringPayload* str = pool->takeString(length)) {
+            str->assign(data, length);
+            return str;
+        }
+    }
+    StringPayload* str = new StringPayload();
+    str->assign(data, length);
+    return str;
+}
+
+void PayloadPool::release(StringPayload* str) {
+    if (str->refCount.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    str->refCount.store(1, std::memory_order_relaxed);
+    PayloadPool* pool = current();
+    if (pool) {
+        pool->giveString(str);
+    } else {
+        delete str;
+    }
+}
+
+ArrayPayload* PayloadPool::newArray(const std::vector<RuntimeValue>& elements) {
+    PayloadPool* pool = current();
+    if (pool) {
+        if (ArrayPayload* array = pool->takeArray(elements.size())) {
+            array->assign(elements.begin(), elements.end());
+            return array;
+        }
+    }
+    ArrayPayload* array = new ArrayPayload();
+    array->assign(elements.begin(), elements.end());
+    return array;
+}
+
+ArrayPayload* PayloadPool::newArray(std::vector<RuntimeValue>&& elements) {
+    PayloadPool* pool = current();
+    ArrayPayload* array = pool ? pool->takeArray(0) : nullptr;
+    if (!array) array = new ArrayPayload();
+    array->swap(elements);
+    return array;
+}
+
+void PayloadPool::release(ArrayPayload* array) {
+    if (array->refCount.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    array->refCount.store(1, std::memory_order_relaxed);
+    // Elements go first so their payloads are recycled too
+    array->clear();
+    PayloadPool* pool = current();
+    if (pool) {
+        pool->giveArray(array);
+    } else {
+        delete array;
+    }
+}
+
+PayloadPoolScope::PayloadPoolScope(PayloadPool& pool) : previous(activePool) {
+    activePool = &pool;
+}
+
+PayloadPoolScope::~PayloadPoolScope() {
+    activePool = previous;
+}
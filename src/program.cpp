@@ -0,0 +1,61 @@
+#include "../include/program.h"
+#include "../include/ast_generator.h"
+#include "../include/bounds_check.h"
+#include "../include/bytecode.h"
+#include "../include/cse.h"
+#include "../include/interpreter.h"
+#include "../include/parallel.h"
+#include "../include/parser.h"
+#include "../include/switch_table.h"
+#include "../include/tokenizer.h"
+#include "../include/vectorize.h"
+
+std::shared_ptr<const Program> Program::compile(const std::string& source, std::ostream& errors) {
+    std::vector<GenericToken> tokens = tokenizeSource(source, errors);
+    for (const auto& token : tokens) {
+        if (token.type == TOKEN_ERROR) {
+            errors << "Error at position " << token.error.position << ": " << token.error.message << "\n";
+        }
+    }
+    if (!Parser(tokens, source, errors).parse()) {
+        errors << "Parsing failed!\n";
+        return nullptr;
+    }
+    auto ast = ASTBuilder(tokens, errors).build();
+    if (!ast) {
+        errors << "AST generation failed!\n";
+        return nullptr;
+    }
+    eliminateCommonSubexpressions(*ast);
+    eliminateBoundsChecks(*ast);
+    vectorizeLoops(*ast);
+    buildSwitchTables(*ast);
+    bool ok = checkParallelLoops(*ast, errors);
+    ok = checkSpawns(*ast, errors) && ok;
+    if (!ok) return nullptr;
+
+    std::shared_ptr<Program> program(new Program());
+    program->compiled = std::make_shared<CompiledProgram>(compileProgram(*ast, true, true));
+    program->ast = std::move(ast);
+    return program;
+}
+
+bool Program::run(const std::string& input, std::ostream& output, std::ostream& errors, unsigned threads) const {
+    return ProgramContext(*this, threads).run(input, output, errors);
+}
+
+ProgramContext::ProgramContext(const Program& program, unsigned threads) : interpreter(new Interpreter()) {
+    interpreter->load(program.ast);
+    interpreter->setCompiled(program.compiled);
+    interpreter->setThreads(threads);
+}
+
+ProgramContext::~ProgramContext() = default;
+
+bool ProgramContext::run(const std::string& input, std::ostream& output, std::ostream& errors) {
+    interpreter->reset();
+    interpreter->setInput(input);
+    interpreter->setOutput(output);
+    interpreter->setErrors(errors);
+    return interpreter->runMain();
+}
@@ -1,11 +1,16 @@
 #include "../include/runtime.h"
+#include "../include/task.h"
+#include <climits>
 #include <sstream>
 
-// Copy constructor - handles deep copying of dynamic memory
+static thread_local std::ostream* activeErrors = nullptr;
+
+// Copy constructor - strings and arrays share the payload of other
 RuntimeValue::RuntimeValue(const RuntimeValue& other) : type(other.type) {
     switch (type) {
         case RuntimeType::STRING:
-            stringValue = new std::string(*other.stringValue);
+            stringValue = other.stringValue;
+            PayloadPool::retain(stringValue);
             break;
         case RuntimeType::INTEGER:
             intValue = other.intValue;
@@ -17,7 +22,16 @@ RuntimeValue::RuntimeValue(const RuntimeValue& other) : type(other.type) {
             boolValue = other.boolValue;
             break;
         case RuntimeType::ARRAY:
-            arrayValue = new std::vector<RuntimeValue>(*other.arrayValue);
+            arrayValue = other.arrayValue;
+            PayloadPool::retain(arrayValue);
+            break;
+        case RuntimeType::MAPPED_ARRAY:
+            mappedValue = other.mappedValue;
+            mappedValue->retain();
+            break;
+        case RuntimeType::TASK:
+            taskValue = other.taskValue;
+            taskValue->retain();
             break;
         case RuntimeType::UNDEFINED:
             break;
@@ -28,20 +42,24 @@ RuntimeValue::RuntimeValue(const RuntimeValue& other) : type(other.type) {
 RuntimeValue& RuntimeValue::operator=(const RuntimeValue& other) {
     if (this == &other) return *this;
     
-    // Clean up existing memory
-    if (type == RuntimeType::STRING && stringValue) {
-        delete stringValue;
-        stringValue = nullptr;
-    } else if (type == RuntimeType::ARRAY && arrayValue) {
-        delete arrayValue;
-        arrayValue = nullptr;
-    }
-    
-    // Copy new value
+    // Copy first: other may live inside the array being replaced
+    RuntimeValue copy(other);
+    return *this = std::move(copy);
+}
+
+RuntimeValue& RuntimeValue::operator=(RuntimeValue&& other) noexcept {
+    if (this == &other) return *this;
+    RuntimeValue old(std::move(*this));
+    takePayload(other);
+    return *this;
+}
+
+// Move the payload of other into this (which holds none) and leave other undefined
+void RuntimeValue::takePayload(RuntimeValue& other) noexcept {
     type = other.type;
     switch (type) {
         case RuntimeType::STRING:
-            stringValue = new std::string(*other.stringValue);
+            stringValue = other.stringValue;
             break;
         case RuntimeType::INTEGER:
             intValue = other.intValue;
@@ -53,20 +71,39 @@ RuntimeValue& RuntimeValue::operator=(const RuntimeValue& other) {
             boolValue = other.boolValue;
             break;
         case RuntimeType::ARRAY:
-            arrayValue = new std::vector<RuntimeValue>(*other.arrayValue);
+            arrayValue = other.arrayValue;
+            break;
+        case RuntimeType::MAPPED_ARRAY:
+            mappedValue = other.mappedValue;
+            break;
+        case RuntimeType::TASK:
+            taskValue = other.taskValue;
             break;
         case RuntimeType::UNDEFINED:
             break;
     }
-    return *this;
+    other.type = RuntimeType::UNDEFINED;
+}
+
+std::string& RuntimeValue::ownString() {
+    if (stringValue->refCount.load(std::memory_order_acquire) != 1) {
+        StringPayload* copy = PayloadPool::newString(stringValue->data(), stringValue->size());
+        PayloadPool::release(stringValue);
+        stringValue = copy;
+    }
+    return *stringValue;
 }
 
 // Destructor - clean up dynamic memory
 RuntimeValue::~RuntimeValue() {
     if (type == RuntimeType::STRING && stringValue) {
-        delete stringValue;
+        PayloadPool::release(stringValue);
     } else if (type == RuntimeType::ARRAY && arrayValue) {
-        delete arrayValue;
+        PayloadPool::release(arrayValue);
+    } else if (type == RuntimeType::MAPPED_ARRAY) {
+        mappedValue->release();
+    } else if (type == RuntimeType::TASK) {
+        taskValue->release();
     }
 }
 
@@ -90,6 +127,18 @@ std::string RuntimeValue::toString() const {
             result += "]";
             return result;
         }
+        case RuntimeType::MAPPED_ARRAY: {
+            std::string result = "[";
+            size_t count = mappedValue->size();
+            for (size_t i = 0; i < count; ++i) {
+                if (i > 0) result += ", ";
+                result += mappedValue->at(i).toString();
+            }
+            result += "]";
+            return result;
+        }
+        case RuntimeType::TASK:
+            return "task";
         case RuntimeType::UNDEFINED:
             return "undefined";
     }
@@ -128,21 +177,30 @@ RuntimeValue stringToNumber(const RuntimeValue& value) {
 
 // Convert any value to boolean
 RuntimeValue toBoolean(const RuntimeValue& value) {
+    return RuntimeValue(isTruthy(value));
+}
+
+// Truthiness without building a RuntimeValue
+bool isTruthy(const RuntimeValue& value) {
     switch (value.type) {
         case RuntimeType::BOOLEAN:
-            return value;
+            return value.boolValue;
         case RuntimeType::INTEGER:
-            return RuntimeValue(value.intValue != 0);
+            return value.intValue != 0;
         case RuntimeType::FLOAT:
-            return RuntimeValue(value.floatValue != 0.0);
+            return value.floatValue != 0.0;
         case RuntimeType::STRING:
-            return RuntimeValue(!value.stringValue->empty());
+            return !value.stringValue->empty();
         case RuntimeType::ARRAY:
-            return RuntimeValue(!value.arrayValue->empty());
+            return !value.arrayValue->empty();
+        case RuntimeType::MAPPED_ARRAY:
+            return value.mappedValue->size() != 0;
+        case RuntimeType::TASK:
+            return true;
         case RuntimeType::UNDEFINED:
-            return RuntimeValue(false);
+            return false;
     }
-    return RuntimeValue(false);
+    return false;
 }
 
 // Check if a value can be treated as a number
@@ -251,16 +309,31 @@ RuntimeValue performBinaryOperation(const RuntimeValue& left, const RuntimeValue
             return RuntimeValue(leftVal * rightVal);
         } else if (op == "/") {
             if (rightVal == 0) {
-                std::cerr << "Error: Division by zero!" << std::endl;
+                runtimeErrors() << "Error: Division by zero!" << std::endl;
                 return RuntimeValue(0.0);
             }
             return RuntimeValue(leftVal / rightVal);  // Division always returns float
         } else if (op == "%") {
             if (rightVal == 0) {
-                std::cerr << "Error: Modulo by zero!" << std::endl;
+                runtimeErrors() << "Error: Modulo by zero!" << std::endl;
+                return RuntimeValue(0);
+            }
+            // Both sides are truncated to ints first, which can make a
+            // divisor like 0.5 zero; out-of-range values and NaN saturate
+            // instead of being undefined
+            auto toInt = [](double value) {
+                if (!(value == value)) return 0;
+                if (value >= static_cast<double>(INT_MAX)) return INT_MAX;
+                if (value <= static_cast<double>(INT_MIN)) return INT_MIN;
+                return static_cast<int>(value);
+            };
+            int divisor = toInt(rightVal);
+            if (divisor == 0) {
+                runtimeErrors() << "Error: Modulo by zero!" << std::endl;
                 return RuntimeValue(0);
             }
-            return RuntimeValue(static_cast<int>(leftVal) % static_cast<int>(rightVal));
+            // x % -1 is 0; computing INT_MIN % -1 would trap
+            return RuntimeValue(divisor == -1 ? 0 : toInt(leftVal) % divisor);
         }
     }
     
@@ -286,17 +359,13 @@ RuntimeValue performBinaryOperation(const RuntimeValue& left, const RuntimeValue
     }
     
     if (op == "&&") {
-        RuntimeValue leftBool = toBoolean(left);
-        if (!leftBool.boolValue) return RuntimeValue(false);
-        return toBoolean(right);
+        return RuntimeValue(isTruthy(left) && isTruthy(right));
     }
     if (op == "||") {
-        RuntimeValue leftBool = toBoolean(left);
-        if (leftBool.boolValue) return RuntimeValue(true);
-        return toBoolean(right);
+        return RuntimeValue(isTruthy(left) || isTruthy(right));
     }
     
-    std::cerr << "Error: Unknown binary operation: " << op << std::endl;
+    runtimeErrors() << "Error: Unknown binary operation: " << op << std::endl;
     return RuntimeValue();
 }
 
@@ -310,10 +379,21 @@ RuntimeValue performUnaryOperation(const RuntimeValue& operand, const std::strin
     }
     
     if (op == "!") {
-        RuntimeValue boolVal = toBoolean(operand);
-        return RuntimeValue(!boolVal.boolValue);
+        return RuntimeValue(!isTruthy(operand));
     }
     
-    std::cerr << "Error: Unknown unary operation: " << op << std::endl;
+    runtimeErrors() << "Error: Unknown unary operation: " << op << std::endl;
     return RuntimeValue();
 }
+
+std::ostream& runtimeErrors() {
+    return activeErrors ? *activeErrors : std::cerr;
+}
+
+ErrorStreamScope::ErrorStreamScope(std::ostream& errors) : previous(activeErrors) {
+    activeErrors = &errors;
+}
+
+ErrorStreamScope::~ErrorStreamScope() {
+    activeErrors = previous;
+}
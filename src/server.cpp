@@ -0,0 +1,267 @@
+#include "../include/server.h"
+#include "../include/input_reader.h"
+#include "../include/thread_pool.h"
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// Requests larger than this are refused rather than buffered
+const uint32_t MAX_FRAME = 1u << 30;
+
+// A client that sends or takes nothing for this long loses its connection,
+// so that it cannot hold a worker forever
+const int IO_TIMEOUT_SECONDS = 30;
+
+bool readFull(int fd, char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = ::read(fd, data, length);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// MSG_NOSIGNAL: a client that went away must not take the server with it
+bool writeFull(int fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t n = ::send(fd, data, length, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data += n;
+        length -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool readFrame(int fd, std::string& frame) {
+    unsigned char header[4];
+    if (!readFull(fd, reinterpret_cast<char*>(header), 4)) return false;
+    uint32_t length = header[0] | header[1] << 8 | header[2] << 16 | static_cast<uint32_t>(header[3]) << 24;
+    if (length > MAX_FRAME) return false;
+    frame.resize(length);
+    return readFull(fd, &frame[0], length);
+}
+
+// kind is 0 for the frames of a request, which have none
+bool writeFrame(int fd, char kind, const std::string& frame) {
+    char header[5];
+    size_t start = kind ? 0 : 1;
+    uint32_t length = static_cast<uint32_t>(frame.size());
+    header[0] = kind;
+    for (int i = 0; i < 4; ++i) header[1 + i] = static_cast<char>(length >> (8 * i));
+    return writeFull(fd, header + start, 5 - start) && writeFull(fd, frame.data(), frame.size());
+}
+
+// Program output as 'o' frames, one per flush: the interpreter flushes
+// after every line
+class FrameOutput : public std::streambuf {
+private:
+    static constexpr size_t MAX_PENDING = 1 << 16;
+
+    int fd;
+    std::string pending;
+    bool broken = false;
+
+protected:
+    int overflow(int ch) override {
+        if (ch == traits_type::eof()) return traits_type::not_eof(ch);
+        pending += static_cast<char>(ch);
+        if (pending.size() >= MAX_PENDING) sync();
+        return ch;
+    }
+
+    std::streamsize xsputn(const char* data, std::streamsize count) override {
+        pending.append(data, static_cast<size_t>(count));
+        if (pending.size() >= MAX_PENDING) sync();
+        return count;
+    }
+
+    // Once the client is gone the rest of the output is dropped
+    int sync() override {
+        if (!pending.empty() && !broken) broken = !writeFrame(fd, 'o', pending);
+        pending.clear();
+        return 0;
+    }
+
+public:
+    explicit FrameOutput(int fd) : fd(fd) {}
+};
+
+void handleRequest(ProgramCache& cache, int fd) {
+    std::string kind, script, input;
+    if (!readFrame(fd, kind) || !readFrame(fd, script) || !readFrame(fd, input)) return;
+
+    std::ostringstream errors;
+    bool ok = kind == "source";
+    if (!ok) errors << "Error: unknown request kind '" << kind << "'\n";
+
+    int status = 1;
+    auto program = ok ? cache.get(script, errors) : nullptr;
+    if (program) {
+        FrameOutput frames(fd);
+        std::ostream output(&frames);
+        status = program->run(input, output, errors) ? 0 : 1;
+        output.flush();
+    }
+    if (!errors.str().empty() && !writeFrame(fd, 'e', errors.str())) return;
+    writeFrame(fd, 'x', std::to_string(status));
+}
+
+// Fills addr for path, false if it does not fit
+bool socketAddress(const std::string& path, sockaddr_un& addr) {
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "Error: socket path '" << path << "' is too long" << std::endl;
+        return false;
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+} // namespace
+
+uint64_t ProgramCache::hash(const std::string& source) {
+    uint64_t h = 14695981039346656037ull;
+    for (unsigned char ch : source) {
+        h ^= ch;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+std::shared_ptr<const Program> ProgramCache::get(const std::string& source, std::ostream& errors) {
+    uint64_t key = hash(source);
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        auto found = byHash.find(key);
+        if (found != byHash.end() && found->second->source == source) {
+            entries.splice(entries.begin(), entries, found->second);
+            return found->second->program;
+        }
+    }
+
+    // Compiled outside the lock, so that other requests keep running
+    auto program = Program::compile(source, errors);
+    if (!program) return nullptr;
+
+    std::lock_guard<std::mutex> guard(lock);
+    auto found = byHash.find(key);
+    if (found != byHash.end()) {
+        // Compiled meanwhile, or a different source with the same hash,
+        // which the newer one replaces
+        entries.erase(found->second);
+        byHash.erase(found);
+    }
+    entries.push_front({key, source, program});
+    byHash[key] = entries.begin();
+    if (entries.size() > capacity) {
+        byHash.erase(entries.back().hash);
+        entries.pop_back();
+    }
+    return program;
+}
+
+int serveRequests(const std::string& socketPath, unsigned workers, size_t cacheCapacity) {
+    sockaddr_un addr;
+    if (!socketAddress(socketPath, addr)) return 1;
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) {
+        std::cerr << "Error: cannot create a socket: " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+    // A socket file left behind by an earlier server, but nothing else
+    struct stat existing;
+    if (lstat(socketPath.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode)) {
+            std::cerr << "Error: " << socketPath << " exists and is not a socket" << std::endl;
+            close(listener);
+            return 1;
+        }
+        unlink(socketPath.c_str());
+    }
+    // Only the user running the server may connect
+    mode_t mask = umask(077);
+    bool bound = bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    umask(mask);
+    if (!bound || listen(listener, SOMAXCONN) < 0) {
+        std::cerr << "Error: cannot listen on " << socketPath << ": " << std::strerror(errno) << std::endl;
+        close(listener);
+        return 1;
+    }
+    std::cout << "Serving on " << socketPath << " with " << workers << " workers" << std::endl;
+
+    ProgramCache cache(cacheCapacity);
+    WorkStealingPool pool(workers);
+    unsigned next = 0;
+    while (true) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            std::cerr << "Error: accept failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        timeval timeout = {IO_TIMEOUT_SECONDS, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        pool.push(next++, [&cache, client](unsigned) {
+            handleRequest(cache, client);
+            close(client);
+        });
+    }
+    close(listener);
+    return 1;
+}
+
+int sendRequest(const std::string& socketPath, const std::string& scriptPath) {
+    std::ifstream in(scriptPath);
+    if (!in) {
+        std::cerr << "Failed to open file: " << scriptPath << std::endl;
+        return 1;
+    }
+    std::stringstream buffer;
+    buffer << in.rdbuf();
+    // A terminal would have the client wait for end of input
+    std::string input = isatty(0) ? "" : InputReader(0).readAll();
+
+    sockaddr_un addr;
+    if (!socketAddress(socketPath, addr)) return 1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        std::cerr << "Error: cannot connect to " << socketPath << ": " << std::strerror(errno) << std::endl;
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    if (!writeFrame(fd, 0, "source") || !writeFrame(fd, 0, buffer.str()) || !writeFrame(fd, 0, input)) {
+        std::cerr << "Error: cannot send the request to " << socketPath << std::endl;
+        close(fd);
+        return 1;
+    }
+
+    char kind;
+    std::string frame;
+    while (readFull(fd, &kind, 1) && readFrame(fd, frame)) {
+        if (kind == 'o') {
+            std::cout << frame << std::flush;
+        } else if (kind == 'e') {
+            std::cerr << frame;
+        } else if (kind == 'x') {
+            close(fd);
+            return std::atoi(frame.c_str());
+        }
+    }
+    close(fd);
+    std::cerr << "Error: the server closed the connection" << std::endl;
+    return 1;
+}
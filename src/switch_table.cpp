@@ -0,0 +1,169 @@
+#include "../include/switch_table.h"
+#include <algorithm>
+#include <climits>
+
+namespace {
+
+// The earlier of two arms, either of which may be -1
+int earliest(int a, int b) {
+    if (a < 0) return b;
+    if (b < 0) return a;
+    return std::min(a, b);
+}
+
+// The ASTIf that is all of an else block, or null
+std::shared_ptr<ASTIf> elseIf(const ASTNodePtr& elseBlock) {
+    if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(elseBlock)) return ifStmt;
+    auto block = std::dynamic_pointer_cast<ASTBlock>(elseBlock);
+    if (!block || block->statements.size() != 1) return nullptr;
+    return std::dynamic_pointer_cast<ASTIf>(block->statements[0]);
+}
+
+} // namespace
+
+int SwitchTable::intArm(int key) const {
+    if (!dense.empty()) {
+        long long offset = static_cast<long long>(key) - denseBase;
+        return offset >= 0 && offset < static_cast<long long>(dense.size()) ? dense[offset] : -1;
+    }
+    auto it = intArms.find(key);
+    return it != intArms.end() ? it->second : -1;
+}
+
+int SwitchTable::numericArm(double number) const {
+    if (intArms.empty() || !(number >= INT_MIN && number <= INT_MAX)) return -1;
+    int key = static_cast<int>(number);
+    return key == number ? intArm(key) : -1;
+}
+
+int SwitchTable::lookup(const RuntimeValue& value) const {
+    if (value.type == RuntimeType::INTEGER && stringNumbers.empty()) return intArm(value.intValue);
+    if (value.type == RuntimeType::STRING) {
+        auto text = stringArms.find(*value.stringValue);
+        int arm = text != stringArms.end() ? text->second : -1;
+        return intArms.empty() ? arm : earliest(arm, numericArm(getNumericValue(value)));
+    }
+    // -0.0 and 0.0 compare equal but need not hash alike
+    double number = getNumericValue(value) + 0.0;
+    int arm = numericArm(number);
+    auto numeric = stringNumbers.find(number);
+    return numeric != stringNumbers.end() ? earliest(arm, numeric->second) : arm;
+}
+
+bool SwitchTable::intCases(std::vector<std::pair<int, int>>& cases) const {
+    if (!stringNumbers.empty()) return false;
+    cases.assign(intArms.begin(), intArms.end());
+    std::sort(cases.begin(), cases.end());
+    return true;
+}
+
+void SwitchTable::index(const std::vector<std::pair<RuntimeValue, int>>& keys) {
+    // Later duplicates of a key can never be reached
+    int low = INT_MAX, high = INT_MIN;
+    for (const auto& [literal, arm] : keys) {
+        if (literal.type == RuntimeType::INTEGER) {
+            if (intArms.emplace(literal.intValue, arm).second) {
+                low = std::min(low, literal.intValue);
+                high = std::max(high, literal.intValue);
+            }
+        } else {
+            stringArms.emplace(*literal.stringValue, arm);
+            stringNumbers.emplace(getNumericValue(literal) + 0.0, arm);
+        }
+    }
+    size_t count = intArms.size();
+    if (count > 0 && static_cast<long long>(high) - low < static_cast<long long>(2 * count + 8)) {
+        denseBase = low;
+        dense.assign(static_cast<size_t>(high - low) + 1, -1);
+        for (const auto& [number, arm] : intArms) dense[number - low] = arm;
+    }
+}
+
+
+namespace {
+
+// Collects the chain starting at one if statement
+class SwitchBuilder {
+private:
+    std::shared_ptr<SwitchTable> table = std::make_shared<SwitchTable>();
+    std::vector<std::pair<RuntimeValue, int>> keys;
+
+    // The literal in x == literal or literal == x, for the chain's x
+    bool key(const ASTNodePtr& condition, RuntimeValue& value) {
+        auto compare = dynamic_cast<ASTBinaryExpression*>(unwrap(condition));
+        if (!compare || compare->op != "==") return false;
+        auto left = unwrap(compare->left);
+        auto right = unwrap(compare->right);
+        auto identifier = dynamic_cast<ASTIdentifier*>(left);
+        auto literal = dynamic_cast<ASTLiteral*>(right);
+        if (!identifier || !literal) {
+            identifier = dynamic_cast<ASTIdentifier*>(right);
+            literal = dynamic_cast<ASTLiteral*>(left);
+        }
+        if (!identifier || !literal) return false;
+        if (table->variable.empty()) table->variable = identifier->name;
+        if (identifier->name != table->variable) return false;
+
+        if (auto number = std::get_if<int>(&literal->value)) {
+            value = RuntimeValue(*number);
+        } else if (auto text = std::get_if<std::string>(&literal->value)) {
+            value = RuntimeValue(*text);
+        } else if (auto character = std::get_if<char>(&literal->value)) {
+            value = RuntimeValue(std::string(1, *character));
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+public:
+    std::shared_ptr<SwitchTable> build(const ASTIf& top) {
+        std::shared_ptr<ASTIf> link;
+        RuntimeValue value;
+        if (!key(top.condition, value)) return nullptr;
+        keys.push_back({value, 0});
+        table->arms.push_back(top.thenBlock);
+        table->otherwise = top.elseBlock;
+        while ((link = elseIf(table->otherwise)) && key(link->condition, value)) {
+            keys.push_back({value, static_cast<int>(table->arms.size())});
+            table->arms.push_back(link->thenBlock);
+            table->otherwise = link->elseBlock;
+        }
+        if (table->arms.size() < static_cast<size_t>(MIN_SWITCH_ARMS)) return nullptr;
+        table->index(keys);
+        return table;
+    }
+};
+
+
+int buildStatement(const ASTNodePtr& stmt) {
+    int built = 0;
+    if (auto block = std::dynamic_pointer_cast<ASTBlock>(stmt)) {
+        for (const auto& s : block->statements) built += buildStatement(s);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(stmt)) {
+        ifStmt->switchTable = SwitchBuilder().build(*ifStmt);
+        if (ifStmt->switchTable) {
+            built++;
+            for (const auto& arm : ifStmt->switchTable->arms) built += buildStatement(arm);
+            built += buildStatement(ifStmt->switchTable->otherwise);
+        } else {
+            built += buildStatement(ifStmt->thenBlock);
+            built += buildStatement(ifStmt->elseBlock);
+        }
+    } else if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(stmt)) {
+        built += buildStatement(forStmt->body);
+    }
+    return built;
+}
+
+} // namespace
+
+int buildSwitchTables(ASTProgram& program) {
+    int built = 0;
+    for (const auto& node : program.functions) {
+        if (auto func = std::dynamic_pointer_cast<ASTFunction>(node)) {
+            built += buildStatement(func->body);
+        }
+    }
+    return built;
+}
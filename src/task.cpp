@@ -0,0 +1,25 @@
+#include "../include/task.h"
+
+void SpawnedTask::release() {
+    if (refCount.fetch_sub(1, std::memory_order_acq_rel) == 1) delete this;
+}
+
+void SpawnedTask::finish(RuntimeValue value) {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        result = std::move(value);
+        done = true;
+    }
+    finished.notify_all();
+}
+
+bool SpawnedTask::isDone() const {
+    std::lock_guard<std::mutex> guard(lock);
+    return done;
+}
+
+RuntimeValue SpawnedTask::wait() {
+    std::unique_lock<std::mutex> guard(lock);
+    finished.wait(guard, [this] { return done; });
+    return result;
+}
@@ -0,0 +1,75 @@
+#include "../include/thread_pool.h"
+
+WorkStealingPool::WorkStealingPool(unsigned threads) {
+    if (threads == 0) threads = 1;
+    for (unsigned i = 0; i < threads; ++i) workers.push_back(std::make_unique<Worker>());
+    for (unsigned i = 0; i < threads; ++i) {
+        workers[i]->thread = std::thread([this, i] { work(i); });
+    }
+}
+
+// Finishes every queued task first
+WorkStealingPool::~WorkStealingPool() {
+    {
+        std::lock_guard<std::mutex> guard(idleLock);
+        stopping = true;
+    }
+    idle.notify_all();
+    for (auto& worker : workers) worker->thread.join();
+}
+
+unsigned WorkStealingPool::defaultThreads() {
+    unsigned threads = std::thread::hardware_concurrency();
+    return threads > 0 ? threads : 1;
+}
+
+void WorkStealingPool::push(unsigned worker, Task task) {
+    Worker& target = *workers[worker % workers.size()];
+    {
+        std::lock_guard<std::mutex> guard(target.lock);
+        target.tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> guard(idleLock);
+        queued++;
+    }
+    idle.notify_one();
+}
+
+// Own newest task, or else the oldest task of the next worker that has one
+bool WorkStealingPool::take(unsigned worker, Task& task) {
+    for (size_t offset = 0; offset < workers.size(); ++offset) {
+        Worker& victim = *workers[(worker + offset) % workers.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if (victim.tasks.empty()) continue;
+        if (offset == 0) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+        } else {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+        }
+        return true;
+    }
+    return false;
+}
+
+bool WorkStealingPool::runOne(unsigned worker) {
+    Task task;
+    if (!take(worker, task)) return false;
+    {
+        std::lock_guard<std::mutex> guard(idleLock);
+        queued--;
+    }
+    task(worker);
+    return true;
+}
+
+void WorkStealingPool::work(unsigned worker) {
+    while (true) {
+        if (runOne(worker)) continue;
+        std::unique_lock<std::mutex> lock(idleLock);
+        idle.wait(lock, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) return;
+    }
+}
@@ -15,6 +15,9 @@ TokenKeyword matchKeyword(const std::string& word, size_t position) {
     if (word == "else") return { KEYWORD_ELSE, word, position };
     if (word == "elif") return { KEYWORD_ELIF, word, position };
     if (word == "for") return { KEYWORD_FOR, word, position };
+    if (word == "parallel") return { KEYWORD_PARALLEL, word, position };
+    if (word == "spawn") return { KEYWORD_SPAWN, word, position };
+    if (word == "await") return { KEYWORD_AWAIT, word, position };
     if (word == "return") return { KEYWORD_RETURN, word, position };
     return { KEYWORD_UNKNOWN, word, position };
 }
@@ -106,7 +109,7 @@ void printTokenOperator(const TokenOperator* token) {
     std::cout << "TokenOperator: " << token->symbol << " at position " << token->position << "\n";
 }
 
-std::vector<GenericToken> tokenizeFile(FILE* file) {
+std::vector<GenericToken> tokenizeFile(FILE* file, std::ostream& errors) {
     std::vector<GenericToken> tokens;
     char ch;
     size_t index = 0;
@@ -144,7 +147,7 @@ std::vector<GenericToken> tokenizeFile(FILE* file) {
                     }
                 }
                 if (!closed) {
-                    std::cerr << "Error: Unclosed multi-line comment starting at position " << index << "\n";
+                    errors << "Error: Unclosed multi-line comment starting at position " << index << "\n";
                 }
                 continue;
             } else {
@@ -432,3 +435,15 @@ std::vector<GenericToken> tokenizeFile(FILE* file) {
     return tokens;
 }
 
+std::vector<GenericToken> tokenizeSource(const std::string& source, std::ostream& errors) {
+    // fmemopen refuses an empty buffer, which has no tokens anyway
+    if (source.empty()) return {};
+    FILE* file = fmemopen(const_cast<char*>(source.data()), source.size(), "r");
+    if (!file) {
+        errors << "Error: cannot read the source\n";
+        return {};
+    }
+    std::vector<GenericToken> tokens = tokenizeFile(file, errors);
+    fclose(file);
+    return tokens;
+}
@@ -0,0 +1,477 @@
+#include "../include/vectorize.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+
+// Iterations gathered and computed at a time
+constexpr int CHUNK = 256;
+
+#if defined(__GNUC__) || defined(__clang__)
+// Two doubles, one SSE2 or NEON register
+typedef double Lanes __attribute__((vector_size(2 * sizeof(double))));
+constexpr int LANE_COUNT = 2;
+#define VECTOR_LANES 1
+#else
+#define VECTOR_LANES 0
+#endif
+
+// out[j] = op(left[j], right[j]) for j < count, whole lanes at a time
+template <typename Op>
+void lanewise(const double* left, const double* right, double* out, int count, Op op) {
+    int j = 0;
+#if VECTOR_LANES
+    for (; j + LANE_COUNT <= count; j += LANE_COUNT) {
+        Lanes l, r;
+        std::memcpy(&l, left + j, sizeof(Lanes));
+        std::memcpy(&r, right + j, sizeof(Lanes));
+        Lanes result = op(l, r);
+        std::memcpy(out + j, &result, sizeof(Lanes));
+    }
+#endif
+    for (; j < count; ++j) out[j] = op(left[j], right[j]);
+}
+
+// Values of an int-typed node have to stay in int range to match the scalar
+// loop. Adding 0.0 turns -0.0 into the 0 an int would have been.
+bool intResults(double* values, int count) {
+    bool inRange = true;
+    for (int j = 0; j < count; ++j) {
+        values[j] += 0.0;
+        inRange &= values[j] >= INT_MIN && values[j] <= INT_MAX;
+    }
+    return inRange;
+}
+
+bool nonZero(const double* values, int count) {
+    bool all = true;
+    for (int j = 0; j < count; ++j) all &= values[j] != 0;
+    return all;
+}
+
+// The array a in len(a), or null
+const ASTIdentifier* lengthOf(const ASTNodePtr& node) {
+    auto call = dynamic_cast<ASTFunctionCall*>(unwrap(node));
+    if (!call || !isIdentifier(call->callee, "len") || call->arguments.size() != 1) return nullptr;
+    return dynamic_cast<ASTIdentifier*>(unwrap(call->arguments[0]));
+}
+
+} // namespace
+
+bool VectorKernel::run(const RuntimeValue* const* inputValues, RuntimeValue* outputValues) const {
+    const RuntimeValue* index = inputValues[0];
+    const RuntimeValue* bound = inputValues[1];
+    if (!index || !bound || index->type != RuntimeType::INTEGER || index->intValue < 0) return false;
+    long long start = index->intValue;
+    long long end;
+    if (boundIsLength) {
+        if (bound->type != RuntimeType::ARRAY) return false;
+        end = static_cast<long long>(bound->arrayValue->size());
+    } else {
+        if (bound->type != RuntimeType::INTEGER) return false;
+        end = bound->intValue;
+    }
+    // An empty loop is left to the scalar condition check
+    if (start >= end) return false;
+
+    // Int or float per node, from the inputs; arrays take the type of their
+    // first element and every later one has to match it
+    std::vector<char> isInt(nodes.size(), 0);
+    for (size_t k = 0; k < nodes.size(); ++k) {
+        const Node& node = nodes[k];
+        switch (node.kind) {
+            case NodeKind::ELEMENT: {
+                const RuntimeValue* array = inputValues[node.input];
+                if (!array || array->type != RuntimeType::ARRAY ||
+                    static_cast<long long>(array->arrayValue->size()) < end) {
+                    return false;
+                }
+                RuntimeType type = (*array->arrayValue)[start].type;
+                if (type != RuntimeType::INTEGER && type != RuntimeType::FLOAT) return false;
+                isInt[k] = type == RuntimeType::INTEGER;
+                break;
+            }
+            case NodeKind::INDEX:
+                isInt[k] = true;
+                break;
+            case NodeKind::CONSTANT:
+                isInt[k] = node.intConstant;
+                break;
+            case NodeKind::INVARIANT: {
+                const RuntimeValue* value = inputValues[node.input];
+                if (!value || !isPlainNumber(*value)) return false;
+                isInt[k] = value->type == RuntimeType::INTEGER;
+                break;
+            }
+            case NodeKind::NEGATE:
+                isInt[k] = isInt[node.left];
+                break;
+            case NodeKind::BINARY:
+                isInt[k] = node.op != BinaryOp::DIV && isInt[node.left] && isInt[node.right];
+                break;
+        }
+    }
+
+    std::vector<double> sums;
+    std::vector<char> intSums;
+    for (const Accumulator& accumulator : accumulators) {
+        const RuntimeValue* value = inputValues[accumulator.input];
+        if (!value || !isPlainNumber(*value)) return false;
+        bool intSum = value->type == RuntimeType::INTEGER;
+        for (const Term& term : accumulator.terms) intSum = intSum && isInt[term.node];
+        sums.push_back(plainNumber(*value));
+        intSums.push_back(intSum);
+    }
+
+    std::vector<double> buffers(nodes.size() * CHUNK);
+    auto buffer = [&](int k) { return buffers.data() + static_cast<size_t>(k) * CHUNK; };
+    for (size_t k = 0; k < nodes.size(); ++k) {
+        const Node& node = nodes[k];
+        if (node.kind == NodeKind::CONSTANT) {
+            std::fill(buffer(k), buffer(k) + CHUNK, node.constant);
+        } else if (node.kind == NodeKind::INVARIANT) {
+            std::fill(buffer(k), buffer(k) + CHUNK, plainNumber(*inputValues[node.input]));
+        }
+    }
+
+    int count = 0;
+    for (long long low = start; low < end; low += count) {
+        count = static_cast<int>(std::min<long long>(CHUNK, end - low));
+        for (size_t k = 0; k < nodes.size(); ++k) {
+            const Node& node = nodes[k];
+            double* values = buffer(static_cast<int>(k));
+            switch (node.kind) {
+                case NodeKind::ELEMENT: {
+                    const RuntimeValue* elements = inputValues[node.input]->arrayValue->data() + low;
+                    if (isInt[k]) {
+                        for (int j = 0; j < count; ++j) {
+                            if (elements[j].type != RuntimeType::INTEGER) return false;
+                            values[j] = elements[j].intValue;
+                        }
+                    } else {
+                        for (int j = 0; j < count; ++j) {
+                            if (elements[j].type != RuntimeType::FLOAT) return false;
+                            values[j] = elements[j].floatValue;
+                        }
+                    }
+                    continue;
+                }
+                case NodeKind::INDEX:
+                    for (int j = 0; j < count; ++j) values[j] = static_cast<double>(low + j);
+                    continue;
+                case NodeKind::CONSTANT:
+                case NodeKind::INVARIANT:
+                    continue;
+                case NodeKind::NEGATE:
+                    lanewise(buffer(node.left), buffer(node.left), values, count,
+                             [](auto l, auto) { return -l; });
+                    break;
+                case NodeKind::BINARY: {
+                    const double* left = buffer(node.left);
+                    const double* right = buffer(node.right);
+                    switch (node.op) {
+                        case BinaryOp::ADD:
+                            lanewise(left, right, values, count, [](auto l, auto r) { return l + r; });
+                            break;
+                        case BinaryOp::SUB:
+                            lanewise(left, right, values, count, [](auto l, auto r) { return l - r; });
+                            break;
+                        case BinaryOp::MUL:
+                            lanewise(left, right, values, count, [](auto l, auto r) { return l * r; });
+                            break;
+                        default:
+                            // The scalar loop reports division by zero
+                            if (!nonZero(right, count)) return false;
+                            lanewise(left, right, values, count, [](auto l, auto r) { return l / r; });
+                            break;
+                    }
+                    break;
+                }
+            }
+            if (isInt[k] && !intResults(values, count)) return false;
+        }
+
+        // Accumulators add up in loop order, so float sums round exactly as
+        // the scalar loop would
+        for (size_t a = 0; a < accumulators.size(); ++a) {
+            const std::vector<Term>& terms = accumulators[a].terms;
+            double sum = sums[a];
+            if (terms.size() == 1 && !intSums[a]) {
+                const double* values = buffer(terms[0].node);
+                if (terms[0].subtract) {
+                    for (int j = 0; j < count; ++j) sum -= values[j];
+                } else {
+                    for (int j = 0; j < count; ++j) sum += values[j];
+                }
+            } else {
+                bool inRange = true;
+                for (int j = 0; j < count; ++j) {
+                    for (const Term& term : terms) {
+                        double value = buffer(term.node)[j];
+                        sum = term.subtract ? sum - value : sum + value;
+                        inRange &= sum >= INT_MIN && sum <= INT_MAX;
+                    }
+                }
+                if (intSums[a] && !inRange) return false;
+            }
+            sums[a] = sum;
+        }
+    }
+
+    outputValues[0] = RuntimeValue(static_cast<int>(end));
+    size_t at = 1;
+    for (size_t a = 0; a < accumulators.size(); ++a, ++at) {
+        outputValues[at] = intSums[a] ? RuntimeValue(static_cast<int>(sums[a])) : RuntimeValue(sums[a]);
+    }
+    // Temporaries keep their value from the last iteration
+    for (int node : temporaries) {
+        double value = buffer(node)[count - 1];
+        outputValues[at++] = isInt[node] ? RuntimeValue(static_cast<int>(value)) : RuntimeValue(value);
+    }
+    return true;
+}
+
+bool VectorKernel::runOnSlots(RuntimeValue* locals, const std::vector<int>& inputSlots,
+                              const std::vector<int>& outputSlots) const {
+    std::vector<const RuntimeValue*> inputValues;
+    inputValues.reserve(inputSlots.size());
+    for (int slot : inputSlots) inputValues.push_back(locals + slot);
+    std::vector<RuntimeValue> outputValues(outputSlots.size());
+    if (!run(inputValues.data(), outputValues.data())) return false;
+    for (size_t i = 0; i < outputSlots.size(); ++i) {
+        locals[outputSlots[i]] = std::move(outputValues[i]);
+    }
+    return true;
+}
+
+// Builds the kernel of one loop, or gives up on it
+class LoopVectorizer {
+private:
+    const ASTFor& loop;
+    std::shared_ptr<VectorKernel> kernel;
+    std::string index;
+    std::vector<std::string> assigned;
+    std::unordered_map<std::string, int> inputIndex;
+    // Node already made for an array, invariant or temporary
+    std::unordered_map<std::string, int> elementNodes;
+    std::unordered_map<std::string, int> variableNodes;
+    int indexNode = -1;
+
+    using Node = VectorKernel::Node;
+    using NodeKind = VectorKernel::NodeKind;
+
+    bool isAssigned(const std::string& name) const {
+        return std::find(assigned.begin(), assigned.end(), name) != assigned.end();
+    }
+
+    int input(const std::string& name) {
+        auto it = inputIndex.find(name);
+        if (it != inputIndex.end()) return it->second;
+        int slot = static_cast<int>(kernel->inputs.size());
+        kernel->inputs.push_back(name);
+        inputIndex[name] = slot;
+        return slot;
+    }
+
+    int add(const Node& node) {
+        kernel->nodes.push_back(node);
+        return static_cast<int>(kernel->nodes.size()) - 1;
+    }
+
+    // Node computing expr each iteration, -1 when it is not element-wise
+    // arithmetic
+    int expression(const ASTNodePtr& expr) {
+        ASTNode* node = unwrap(expr);
+        if (auto literal = dynamic_cast<ASTLiteral*>(node)) {
+            Node constant{NodeKind::CONSTANT};
+            if (std::holds_alternative<int>(literal->value)) {
+                constant.constant = std::get<int>(literal->value);
+                constant.intConstant = true;
+            } else if (std::holds_alternative<double>(literal->value)) {
+                constant.constant = std::get<double>(literal->value);
+            } else {
+                return -1;
+            }
+            return add(constant);
+        }
+        if (auto identifier = dynamic_cast<ASTIdentifier*>(node)) {
+            if (identifier->name == index) {
+                if (indexNode < 0) indexNode = add(Node{NodeKind::INDEX});
+                return indexNode;
+            }
+            auto known = variableNodes.find(identifier->name);
+            if (known != variableNodes.end()) return known->second;
+            // Accumulators, and temporaries before their assignment, carry
+            // values between iterations
+            if (isAssigned(identifier->name)) return -1;
+            Node invariant{NodeKind::INVARIANT};
+            invariant.input = input(identifier->name);
+            return variableNodes[identifier->name] = add(invariant);
+        }
+        if (auto access = dynamic_cast<ASTArrayAccess*>(node)) {
+            auto array = dynamic_cast<ASTIdentifier*>(unwrap(access->array));
+            if (!array || array->name == index || isAssigned(array->name) ||
+                !isIdentifier(access->index, index)) {
+                return -1;
+            }
+            auto known = elementNodes.find(array->name);
+            if (known != elementNodes.end()) return known->second;
+            Node element{NodeKind::ELEMENT};
+            element.input = input(array->name);
+            return elementNodes[array->name] = add(element);
+        }
+        if (auto unary = dynamic_cast<ASTUnaryExpression*>(node)) {
+            if (unary->op != "-") return -1;
+            int operand = expression(unary->operand);
+            if (operand < 0) return -1;
+            Node negate{NodeKind::NEGATE};
+            negate.left = operand;
+            return add(negate);
+        }
+        if (auto binary = dynamic_cast<ASTBinaryExpression*>(node)) {
+            BinaryOp op = binaryOpFromSymbol(binary->op);
+            if (op != BinaryOp::ADD && op != BinaryOp::SUB && op != BinaryOp::MUL && op != BinaryOp::DIV) {
+                return -1;
+            }
+            int left = expression(binary->left);
+            int right = left < 0 ? -1 : expression(binary->right);
+            if (right < 0) return -1;
+            Node arithmetic{NodeKind::BINARY};
+            arithmetic.op = op;
+            arithmetic.left = left;
+            arithmetic.right = right;
+            return add(arithmetic);
+        }
+        return -1;
+    }
+
+public:
+    explicit LoopVectorizer(const ASTFor& loop) : loop(loop), kernel(std::make_shared<VectorKernel>()) {}
+
+    std::shared_ptr<VectorKernel> build() {
+        // i = ..., i = i + 1
+        auto init = std::dynamic_pointer_cast<ASTAssignment>(loop.init);
+        if (!init) return nullptr;
+        index = init->variable;
+        auto increment = std::dynamic_pointer_cast<ASTAssignment>(loop.increment);
+        if (!increment || increment->variable != index) return nullptr;
+        auto step = dynamic_cast<ASTBinaryExpression*>(unwrap(increment->expression));
+        auto one = step ? dynamic_cast<ASTLiteral*>(unwrap(step->right)) : nullptr;
+        if (!step || step->op != "+" || !isIdentifier(step->left, index) || !one ||
+            !std::holds_alternative<int>(one->value) || std::get<int>(one->value) != 1) {
+            return nullptr;
+        }
+
+        // i < len(a) or i < n
+        auto condition = dynamic_cast<ASTBinaryExpression*>(unwrap(loop.condition));
+        if (!condition || condition->op != "<" || !isIdentifier(condition->left, index)) return nullptr;
+        std::string bound;
+        if (const ASTIdentifier* array = lengthOf(condition->right)) {
+            bound = array->name;
+            kernel->boundIsLength = true;
+        } else if (auto variable = dynamic_cast<ASTIdentifier*>(unwrap(condition->right))) {
+            bound = variable->name;
+        } else {
+            return nullptr;
+        }
+        if (bound == index) return nullptr;
+
+        std::vector<ASTNodePtr> statements;
+        if (auto block = std::dynamic_pointer_cast<ASTBlock>(loop.body)) {
+            statements = block->statements;
+        } else if (loop.body) {
+            statements.push_back(loop.body);
+        }
+        if (statements.empty()) return nullptr;
+
+        // Everything assigned is assigned once, and never the index or bound
+        assigned = collectAssignedNames(loop.body);
+        for (size_t i = 0; i < assigned.size(); ++i) {
+            if (assigned[i] == index || assigned[i] == bound) return nullptr;
+            if (std::find(assigned.begin() + i + 1, assigned.end(), assigned[i]) != assigned.end()) return nullptr;
+        }
+
+        input(index);
+        input(bound);
+        std::vector<std::string> accumulatorNames;
+        std::vector<std::string> temporaryNames;
+        for (const auto& stmt : statements) {
+            auto assignment = std::dynamic_pointer_cast<ASTAssignment>(stmt);
+            if (!assignment) return nullptr;
+            const std::string& name = assignment->variable;
+
+            // s = s + e - f ..., evaluated left to right, or s = e + s
+            std::vector<std::pair<ASTNodePtr, bool>> terms;
+            ASTNode* spine = unwrap(assignment->expression);
+            while (auto binary = dynamic_cast<ASTBinaryExpression*>(spine)) {
+                if (binary->op != "+" && binary->op != "-") break;
+                terms.push_back({binary->right, binary->op == "-"});
+                spine = unwrap(binary->left);
+            }
+            auto start = dynamic_cast<ASTIdentifier*>(spine);
+            if (!start || start->name != name) {
+                terms.clear();
+                auto binary = dynamic_cast<ASTBinaryExpression*>(unwrap(assignment->expression));
+                if (binary && binary->op == "+" && isIdentifier(binary->right, name)) {
+                    terms.push_back({binary->left, false});
+                }
+            }
+            if (!terms.empty()) {
+                VectorKernel::Accumulator accumulator{input(name), {}};
+                for (auto term = terms.rbegin(); term != terms.rend(); ++term) {
+                    int node = expression(term->first);
+                    if (node < 0) return nullptr;
+                    accumulator.terms.push_back({node, term->second});
+                }
+                kernel->accumulators.push_back(std::move(accumulator));
+                accumulatorNames.push_back(name);
+                continue;
+            }
+
+            int node = expression(assignment->expression);
+            if (node < 0) return nullptr;
+            variableNodes[name] = node;
+            kernel->temporaries.push_back(node);
+            temporaryNames.push_back(name);
+        }
+
+        kernel->outputs.push_back(index);
+        kernel->outputs.insert(kernel->outputs.end(), accumulatorNames.begin(), accumulatorNames.end());
+        kernel->outputs.insert(kernel->outputs.end(), temporaryNames.begin(), temporaryNames.end());
+        return kernel;
+    }
+};
+
+namespace {
+
+int vectorizeStatement(const ASTNodePtr& stmt) {
+    int vectorized = 0;
+    if (auto block = std::dynamic_pointer_cast<ASTBlock>(stmt)) {
+        for (const auto& s : block->statements) vectorized += vectorizeStatement(s);
+    } else if (auto ifStmt = std::dynamic_pointer_cast<ASTIf>(stmt)) {
+        vectorized += vectorizeStatement(ifStmt->thenBlock);
+        vectorized += vectorizeStatement(ifStmt->elseBlock);
+    } else if (auto forStmt = std::dynamic_pointer_cast<ASTFor>(stmt)) {
+        forStmt->kernel = LoopVectorizer(*forStmt).build();
+        if (forStmt->kernel) {
+            vectorized++;
+        } else {
+            vectorized += vectorizeStatement(forStmt->body);
+        }
+    }
+    return vectorized;
+}
+
+} // namespace
+
+int vectorizeLoops(ASTProgram& program) {
+    int vectorized = 0;
+    for (const auto& node : program.functions) {
+        if (auto func = std::dynamic_pointer_cast<ASTFunction>(node)) {
+            vectorized += vectorizeStatement(func->body);
+        }
+    }
+    return vectorized;
+}
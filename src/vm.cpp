@@ -0,0 +1,712 @@
+#include "../include/vm.h"
+#include "../include/value_ops.h"
+#include <algorithm>
+
+static const std::string OP_SUB = "-";
+
+// Functions that keep failing their guards stay in the VM
+static const int MAX_DEOPTS = 64;
+
+// The arithmetic and comparison opcodes are laid out like BinaryOp
+static inline BinaryOp binaryOpOf(OpCode op) {
+    return static_cast<BinaryOp>(static_cast<int>(op) - static_cast<int>(OpCode::ADD));
+}
+
+VM::VM(const CompiledProgram& program, bool profiling, int jitThreshold, Interpreter* host)
+    : program(program), ownHost(host ? nullptr : new Interpreter()), host(host ? host : ownHost.get()),
+      threadedCode(program.functions.size()), maxDepth(DEFAULT_MAX_DEPTH), profiling(profiling),
+      native(program), tiers(program.functions.size()), jitThreshold(profiling ? 0 : jitThreshold),
+      specializeThreshold(DEFAULT_SPECIALIZE_THRESHOLD), loopExited(false) {
+    if (profiling) {
+        size_t count = static_cast<size_t>(OpCode::COUNT);
+        pairCounts.assign(count * count, 0);
+    }
+}
+
+void VM::execute() {
+    PayloadPoolScope poolScope(pool);
+
+    auto main = program.functionIndex.find("main");
+    if (main == program.functionIndex.end()) {
+        runtimeErrors() << "Error: No main function found!" << std::endl;
+        return;
+    }
+    std::cout << "=== Executing Program ===" << std::endl;
+    call(main->second, nullptr, 0);
+}
+
+RuntimeValue VM::call(int functionIndex, RuntimeValue* args, int argc) {
+    const CompiledFunction& function = program.functions[functionIndex];
+    if (argc != function.paramCount) {
+        runtimeErrors() << "Error: Function '" << function.name << "' expects " << function.paramCount
+                  << " arguments, got " << argc << std::endl;
+        return RuntimeValue();
+    }
+    if (jitThreshold > 0) {
+        RuntimeValue result;
+        if (callNative(functionIndex, args, argc, result)) return result;
+    }
+    return profiling ? run<true>(functionIndex, args, argc) : run<false>(functionIndex, args, argc);
+}
+
+void VM::enableMemoization(const std::unordered_set<std::string>& functions, size_t capacity) {
+    memoTables.clear();
+    memoTables.resize(program.functions.size());
+    for (const auto& name : functions) {
+        auto it = program.functionIndex.find(name);
+        if (it == program.functionIndex.end()) continue;
+        memoTables[it->second] = std::make_unique<MemoTable>(capacity);
+        // Native code would call it without consulting the table
+        native.exclude(it->second);
+    }
+}
+
+bool VM::runLoop(int functionIndex, std::vector<RuntimeValue>& locals, RuntimeValue& result) {
+    loopExited = false;
+    result = run<false>(functionIndex, locals.data(), static_cast<int>(locals.size()));
+    return loopExited;
+}
+
+// Runs the native version of the function, compiling it first once it is
+// hot. Returns false when the call has to be executed by the VM instead.
+bool VM::callNative(int functionIndex, RuntimeValue* args, int argc, RuntimeValue& result) {
+    bool integers = true;
+    for (int i = 0; i < argc; ++i) {
+        if (args[i].type != RuntimeType::INTEGER) integers = false;
+    }
+
+    CallTier& tier = tiers[functionIndex];
+    NativeFunction entry = native.entry(functionIndex);
+    if (!entry) {
+        // Native code is specialized for integer arguments, so only
+        // functions that have only been seen with those are compiled
+        if (!integers) tier.mixedTypes = true;
+        if (tier.mixedTypes || native.rejected(functionIndex) || ++tier.calls < jitThreshold) return false;
+        if (!native.compile(functionIndex)) return false;
+        entry = native.entry(functionIndex);
+    }
+    if (!integers || argc > NativeCode::MAX_PARAMS || tier.deopts >= MAX_DEOPTS) return false;
+
+    int64_t nativeArgs[NativeCode::MAX_PARAMS];
+    for (int i = 0; i < argc; ++i) {
+        nativeArgs[argc - 1 - i] = args[i].intValue;
+    }
+    NativeResult outcome = entry(nativeArgs, NativeCode::MAX_DEPTH);
+    if (outcome.deopt) {
+        // The function has no side effects, so the VM just runs it again
+        tier.deopts++;
+        return false;
+    }
+    result = RuntimeValue(outcome.value);
+    return true;
+}
+
+// Argument types packed into 3 bits each, 0 when there are too many
+static uint32_t typeSignature(const RuntimeValue* args, int argc) {
+    if (argc > 10) return 0;
+    uint32_t signature = 1;
+    for (int i = 0; i < argc; ++i) {
+        signature = signature << 3 | (static_cast<uint32_t>(args[i].type) + 1);
+    }
+    return signature;
+}
+
+// The copy of the function specialized for the types of args, null when the
+// generic code has to run. Signatures are counted until one gets hot.
+VM::Specialization* VM::specializationFor(int functionIndex, const RuntimeValue* args) {
+    const CompiledFunction& function = program.functions[functionIndex];
+    uint32_t signature = typeSignature(args, function.paramCount);
+    if (signature == 0) return nullptr;
+
+    CallTier& tier = tiers[functionIndex];
+    for (Specialization& variant : tier.specializations) {
+        if (variant.signature == signature) return variant.code.empty() ? nullptr : &variant;
+    }
+    if (tier.specializations.size() >= MAX_SPECIALIZATIONS) return nullptr;
+
+    auto seen = std::find_if(tier.signatures.begin(), tier.signatures.end(),
+                             [&](const std::pair<uint32_t, int>& entry) { return entry.first == signature; });
+    if (seen == tier.signatures.end()) {
+        // Functions called with ever new types are not worth tracking
+        if (tier.signatures.size() >= 4 * MAX_SPECIALIZATIONS) return nullptr;
+        tier.signatures.push_back({signature, 0});
+        seen = tier.signatures.end() - 1;
+    }
+    if (++seen->second < specializeThreshold) return nullptr;
+    tier.signatures.erase(seen);
+
+    std::vector<RuntimeType> types;
+    for (int i = 0; i < function.paramCount; ++i) {
+        types.push_back(args[i].type);
+    }
+    Specialization variant{signature, {}, {}};
+    if (!specializeFunction(program, function, types, variant.code)) variant.code.clear();
+    tier.specializations.push_back(std::move(variant));
+    Specialization& added = tier.specializations.back();
+    return added.code.empty() ? nullptr : &added;
+}
+
+#if VM_THREADED
+#define VM_CASE(name) L_##name:
+#define VM_DISPATCH()                                              \
+    do {                                                           \
+        if (Profile) {                                             \
+            if (previous != OpCode::COUNT) {                       \
+                pairCounts[static_cast<size_t>(previous) * opCount \
+                           + static_cast<size_t>(ip->op)]++;       \
+            }                                                      \
+            previous = ip->op;                                     \
+        }                                                          \
+        goto *ip->handler;                                         \
+    } while (0)
+#else
+#define VM_CASE(name) case OpCode::name:
+#define VM_DISPATCH() goto dispatch
+#endif
+
+#define VM_NEXT() do { ++ip; VM_DISPATCH(); } while (0)
+#define VM_JUMP(target) do { ip = code + (target); VM_DISPATCH(); } while (0)
+
+// Makes room for a frame of function at base and points locals/sp at it.
+// Values left above sp inside a frame are only released when the frame is
+// left, so that slots above the active frames are always undefined.
+inline void VM::enterFrame(int functionIndex, size_t base, RuntimeValue*& locals, RuntimeValue*& sp) {
+    const CompiledFunction& function = program.functions[functionIndex];
+    size_t needed = base + function.localCount + function.maxStack;
+    if (needed > stack.size()) {
+        stack.resize(std::max(needed, stack.size() * 2));
+    }
+    locals = stack.data() + base;
+    sp = locals + function.localCount;
+}
+
+// Releases everything a frame left in [from, to)
+static inline void clearSlots(RuntimeValue* from, RuntimeValue* to) {
+    for (RuntimeValue* slot = from; slot < to; ++slot) {
+        if (slot->type != RuntimeType::UNDEFINED) *slot = RuntimeValue();
+    }
+}
+
+// Calls between bytecode functions do not recurse in C++: frames live in
+// `frames` and their values in `stack`, so call depth is only bounded by
+// maxDepth. A TAILCALL reuses the caller's frame.
+template <bool Profile>
+RuntimeValue VM::run(int functionIndex, RuntimeValue* args, int argc) {
+    const size_t opCount = static_cast<size_t>(OpCode::COUNT);
+    (void)opCount;
+
+#if VM_THREADED
+    static const void* const handlers[] = {
+#define VM_LABEL(name) &&L_##name,
+        BYTECODE_OPCODES(VM_LABEL)
+#undef VM_LABEL
+    };
+#endif
+    // Code with handler addresses resolved, built on first use
+    auto resolve = [&](const std::vector<Instr>& source, std::vector<ThreadedInstr>& resolved) {
+        if (resolved.empty()) {
+            resolved.reserve(source.size());
+            for (const Instr& instr : source) {
+#if VM_THREADED
+                const void* handler = handlers[static_cast<size_t>(instr.op)];
+#else
+                const void* handler = nullptr;
+#endif
+                resolved.push_back({handler, instr.op, instr.a, instr.b});
+            }
+        }
+        return resolved.data();
+    };
+    // Code for a call of index whose arguments are already in place
+    auto codeFor = [&](int index, const RuntimeValue* callArgs) -> const ThreadedInstr* {
+        if (specializeThreshold > 0) {
+            if (Specialization* variant = specializationFor(index, callArgs)) {
+                return resolve(variant->code, variant->threaded);
+            }
+        }
+        return resolve(program.functions[index].code, threadedCode[index]);
+    };
+
+    // Frames of an outer run() (OSR entry while a call is active) stay below
+    size_t entryDepth = frames.size();
+    size_t entryBase = 0;
+    if (!frames.empty()) {
+        const CompiledFunction& outer = program.functions[frames.back().function];
+        entryBase = frames.back().base + outer.localCount + outer.maxStack;
+    }
+
+    RuntimeValue* locals;
+    RuntimeValue* sp;
+    enterFrame(functionIndex, entryBase, locals, sp);
+    for (int i = 0; i < argc; ++i) {
+        locals[i] = std::move(args[i]);
+    }
+    frames.push_back({functionIndex, entryBase, 0, 0});
+
+    const ThreadedInstr* code = codeFor(functionIndex, locals);
+    const ThreadedInstr* ip = code;
+    RuntimeValue returned;
+    OpCode previous = OpCode::COUNT;
+    (void)previous;
+
+#if VM_THREADED
+    VM_DISPATCH();
+#else
+dispatch:
+    if (Profile) {
+        if (previous != OpCode::COUNT) {
+            pairCounts[static_cast<size_t>(previous) * opCount + static_cast<size_t>(ip->op)]++;
+        }
+        previous = ip->op;
+    }
+    switch (ip->op) {
+#endif
+
+    VM_CASE(LOAD_CONST) {
+        *sp++ = program.constants[ip->a];
+        VM_NEXT();
+    }
+    VM_CASE(LOAD_LOCAL) {
+        *sp++ = locals[ip->a];
+        VM_NEXT();
+    }
+    VM_CASE(LOAD_LOCAL_CHECKED) {
+        if (locals[ip->a].type == RuntimeType::UNDEFINED) {
+            runtimeErrors() << "Error: Undefined variable '" << program.names[ip->b] << "'" << std::endl;
+        }
+        *sp++ = locals[ip->a];
+        VM_NEXT();
+    }
+    VM_CASE(LOAD_UNASSIGNED) {
+        runtimeErrors() << "Error: Undefined variable '" << program.names[ip->a] << "'" << std::endl;
+        *sp++ = RuntimeValue();
+        VM_NEXT();
+    }
+    VM_CASE(STORE_LOCAL) {
+        locals[ip->a] = std::move(*--sp);
+        VM_NEXT();
+    }
+    VM_CASE(POP) {
+        --sp;
+        VM_NEXT();
+    }
+
+    VM_CASE(ADD)
+    VM_CASE(SUB)
+    VM_CASE(MUL)
+    VM_CASE(DIV)
+    VM_CASE(MOD) {
+        applyArithmetic(binaryOpOf(ip->op), sp[-2], sp[-1]);
+        --sp;
+        VM_NEXT();
+    }
+
+    VM_CASE(EQ)
+    VM_CASE(NE)
+    VM_CASE(LT)
+    VM_CASE(LE)
+    VM_CASE(GT)
+    VM_CASE(GE) {
+        bool result = applyComparison(binaryOpOf(ip->op), sp[-2], sp[-1]);
+        setBoolean(sp[-2], result);
+        --sp;
+        VM_NEXT();
+    }
+
+    VM_CASE(NEG) {
+        RuntimeValue& operand = sp[-1];
+        if (operand.type == RuntimeType::INTEGER && operand.intValue != INT_MIN) {
+            operand.intValue = -operand.intValue;
+        } else {
+            operand = performUnaryOperation(operand, OP_SUB);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(NOT) {
+        setBoolean(sp[-1], !isTruthy(sp[-1]));
+        VM_NEXT();
+    }
+
+    VM_CASE(JUMP) {
+        VM_JUMP(ip->a);
+    }
+    VM_CASE(JUMP_IF_FALSE) {
+        --sp;
+        if (!isTruthy(*sp)) VM_JUMP(ip->a);
+        VM_NEXT();
+    }
+    VM_CASE(JUMP_IF_TRUE) {
+        --sp;
+        if (isTruthy(*sp)) VM_JUMP(ip->a);
+        VM_NEXT();
+    }
+
+    VM_CASE(CALL)
+    VM_CASE(TAILCALL) {
+        int callee = ip->a;
+        int count = ip->b;
+        RuntimeValue* callArgs = sp - count;
+        const CompiledFunction& target = program.functions[callee];
+        MemoTable* memo = memoTables.empty() ? nullptr : memoTables[callee].get();
+        if (memo && !MemoTable::memoizable(callArgs, count)) memo = nullptr;
+        // Memoized calls need a frame of their own to record the result
+        bool push = ip->op == OpCode::CALL || memo;
+        RuntimeValue result;
+        bool done = true;
+        if (count != target.paramCount) {
+            runtimeErrors() << "Error: Function '" << target.name << "' expects " << target.paramCount
+                      << " arguments, got " << count << std::endl;
+        } else if (memo && memo->lookup(callArgs, count, result)) {
+        } else if (jitThreshold > 0 && callNative(callee, callArgs, count, result)) {
+        } else if (push && frames.size() >= maxDepth) {
+            runtimeErrors() << "Error: Maximum call depth of " << maxDepth << " exceeded" << std::endl;
+        } else {
+            done = false;
+        }
+
+        if (done) {
+            clearSlots(callArgs, sp);
+            sp = callArgs;
+            if (ip->op == OpCode::TAILCALL) {
+                returned = std::move(result);
+                goto leaveFrame;
+            }
+            *sp++ = std::move(result);
+            VM_NEXT();
+        }
+
+        size_t base;
+        if (push) {
+            Frame& caller = frames.back();
+            caller.resume = ip + 1 - code;
+            caller.code = code;
+            caller.top = callArgs - stack.data();
+            caller.returnOnResume = ip->op == OpCode::TAILCALL;
+            base = caller.top;
+            Frame frame{callee, base, 0, 0};
+            if (memo) {
+                frame.memoFunction = callee;
+                frame.memoStart = memoArgs.size();
+                memoArgs.insert(memoArgs.end(), callArgs, callArgs + count);
+            }
+            frames.push_back(frame);
+        } else {
+            // Replace the current frame: arguments move down to its base
+            Frame& frame = frames.back();
+            base = frame.base;
+            const CompiledFunction& current = program.functions[frame.function];
+            for (int i = 0; i < count; ++i) {
+                locals[i] = std::move(callArgs[i]);
+            }
+            clearSlots(locals + count, locals + current.localCount + current.maxStack);
+            frame.function = callee;
+        }
+        enterFrame(callee, base, locals, sp);
+        // The caller may have left operands where the callee's locals go
+        clearSlots(locals + count, sp);
+        code = codeFor(callee, locals);
+        ip = code;
+        VM_DISPATCH();
+    }
+    VM_CASE(CALL_BUILTIN) {
+        // Own scope: computed goto would skip the argument vector's destructor
+        {
+            int count = ip->b;
+            sp -= count;
+            std::vector<RuntimeValue> callArgs(std::make_move_iterator(sp), std::make_move_iterator(sp + count));
+            const std::string& name = program.names[ip->a];
+            RuntimeValue result;
+            // A builtin can run tree-walker code that enters this VM again
+            // (spawn with one thread, a loop moving to OSR), which may grow
+            // the stack under this frame: come back to it by offset
+            size_t localsAt = static_cast<size_t>(locals - stack.data());
+            size_t spAt = static_cast<size_t>(sp - stack.data());
+            if (!host->handleBuiltinFunction(name, callArgs, result)) {
+                runtimeErrors() << "Error: Undefined function '" << name << "'" << std::endl;
+            }
+            locals = stack.data() + localsAt;
+            sp = stack.data() + spAt;
+            *sp++ = std::move(result);
+        }
+        VM_NEXT();
+    }
+
+    VM_CASE(MAKE_ARRAY) {
+        int count = ip->a;
+        sp -= count;
+        std::vector<RuntimeValue> elements(std::make_move_iterator(sp), std::make_move_iterator(sp + count));
+        *sp++ = RuntimeValue(std::move(elements));
+        VM_NEXT();
+    }
+    VM_CASE(INDEX) {
+        RuntimeValue element = indexValue(sp[-2], sp[-1]);
+        sp[-2] = std::move(element);
+        --sp;
+        VM_NEXT();
+    }
+    VM_CASE(INDEX_LOCAL_LOCAL_UNCHECKED) {
+        const RuntimeValue& array = locals[ip->a];
+        if (array.type == RuntimeType::ARRAY) {
+            *sp++ = (*array.arrayValue)[locals[ip->b].intValue];
+        } else {
+            *sp++ = indexValue(array, locals[ip->b]);
+        }
+        VM_NEXT();
+    }
+    VM_CASE(CONCAT_LOCAL) {
+        // Same rules as Interpreter::appendInPlace
+        int count = ip->b;
+        RuntimeValue* pieces = sp - count;
+        RuntimeValue& target = locals[ip->a];
+        int i = 0;
+        if (target.type == RuntimeType::STRING) {
+            while (i < count && pieces[i].type == RuntimeType::STRING) {
+                target.ownString().append(*pieces[i].stringValue);
+                i++;
+            }
+        }
+        for (; i < count; i++) {
+            applyArithmetic(BinaryOp::ADD, target, pieces[i]);
+        }
+        sp = pieces;
+        VM_NEXT();
+    }
+
+    VM_CASE(INPUT) {
+        locals[ip->a] = host->handleInput();
+        VM_NEXT();
+    }
+    VM_CASE(OUTPUT) {
+        host->handleOutput(*--sp);
+        VM_NEXT();
+    }
+    VM_CASE(REDUCE_TERM) {
+        host->logReductionTerm(program.reductionTerms[ip->a], std::move(*--sp));
+        VM_NEXT();
+    }
+    VM_CASE(RETURN) {
+        returned = std::move(*--sp);
+        goto leaveFrame;
+    }
+    VM_CASE(RETURN_UNDEFINED) {
+        returned = RuntimeValue();
+        goto leaveFrame;
+    }
+    VM_CASE(LOOP_EXIT) {
+        // Only ever the entry frame, see Interpreter::enterCompiledLoop
+        for (int i = 0; i < argc; ++i) {
+            args[i] = std::move(locals[i]);
+        }
+        loopExited = true;
+        returned = RuntimeValue();
+        goto leaveFrame;
+    }
+    VM_CASE(SWITCH_LOCAL) {
+        const JumpTable& jumpTable = program.functions[frames.back().function].jumpTables[ip->b];
+        VM_JUMP(jumpTable.targets[jumpTable.table->lookup(locals[ip->a]) + 1]);
+    }
+    VM_CASE(VECTOR_LOOP) {
+        const KernelCall& call = program.kernels[ip->b];
+        if (call.kernel->runOnSlots(locals, call.inputSlots, call.outputSlots)) VM_JUMP(ip->a);
+        VM_NEXT();
+    }
+
+    VM_CASE(ADD_LOCAL_CONST) {
+        const RuntimeValue& local = locals[ip->a];
+        const RuntimeValue& constant = program.constants[ip->b];
+        if (local.type == RuntimeType::INTEGER && constant.type == RuntimeType::INTEGER) {
+            long long result = static_cast<long long>(local.intValue) + constant.intValue;
+            if (fitsInt(result)) {
+                *sp++ = RuntimeValue(static_cast<int>(result));
+                VM_NEXT();
+            }
+        }
+        *sp = local;
+        applyArithmetic(BinaryOp::ADD, *sp, constant);
+        ++sp;
+        VM_NEXT();
+    }
+    VM_CASE(INDEX_LOCAL_LOCAL) {
+        *sp++ = indexValue(locals[ip->a], locals[ip->b]);
+        VM_NEXT();
+    }
+
+    VM_CASE(EQ_JUMP_IF_FALSE)
+    VM_CASE(NE_JUMP_IF_FALSE)
+    VM_CASE(LT_JUMP_IF_FALSE)
+    VM_CASE(LE_JUMP_IF_FALSE)
+    VM_CASE(GT_JUMP_IF_FALSE)
+    VM_CASE(GE_JUMP_IF_FALSE) {
+        static const BinaryOp compares[] = {BinaryOp::EQ, BinaryOp::NE, BinaryOp::LT,
+                                            BinaryOp::LE, BinaryOp::GT, BinaryOp::GE};
+        BinaryOp op = compares[static_cast<int>(ip->op) - static_cast<int>(OpCode::EQ_JUMP_IF_FALSE)];
+        bool result = applyComparison(op, sp[-2], sp[-1]);
+        sp -= 2;
+        if (!result) VM_JUMP(ip->a);
+        VM_NEXT();
+    }
+
+    // Typed variants: operand types are known, overflow and % by zero
+    // still take the generic path
+    VM_CASE(ADD_INT) {
+        long long result = static_cast<long long>(sp[-2].intValue) + sp[-1].intValue;
+        if (fitsInt(result)) {
+            sp[-2].intValue = static_cast<int>(result);
+        } else {
+            applyArithmetic(BinaryOp::ADD, sp[-2], sp[-1]);
+        }
+        --sp;
+        VM_NEXT();
+    }
+    VM_CASE(SUB_INT) {
+        long long result = static_cast<long long>(sp[-2].intValue) - sp[-1].intValue;
+        if (fitsInt(result)) {
+            sp[-2].intValue = static_cast<int>(result);
+        } else {
+            applyArithmetic(BinaryOp::SUB, sp[-2], sp[-1]);
+        }
+        --sp;
+        VM_NEXT();
+    }
+    VM_CASE(MUL_INT) {
+        long long result = static_cast<long long>(sp[-2].intValue) * sp[-1].intValue;
+        if (fitsInt(result)) {
+            sp[-2].intValue = static_cast<int>(result);
+        } else {
+            applyArithmetic(BinaryOp::MUL, sp[-2], sp[-1]);
+        }
+        --sp;
+        VM_NEXT();
+    }
+    VM_CASE(MOD_INT) {
+        int divisor = sp[-1].intValue;
+        if (divisor != 0) {
+            sp[-2].intValue = divisor == -1 ? 0 : sp[-2].intValue % divisor;
+        } else {
+            applyArithmetic(BinaryOp::MOD, sp[-2], sp[-1]);
+        }
+        --sp;
+        VM_NEXT();
+    }
+    VM_CASE(ADD_FLOAT) {
+        double result = plainNumber(sp[-2]) + plainNumber(sp[-1]);
+        sp[-2].type = RuntimeType::FLOAT;
+        sp[-2].floatValue = result;
+        --sp;
+        VM_NEXT();
+    }
+    VM_CASE(SUB_FLOAT) {
+        double result = plainNumber(sp[-2]) - plainNumber(sp[-1]);
+        sp[-2].type = RuntimeType::FLOAT;
+        sp[-2].floatValue = result;
+        --sp;
+        VM_NEXT();
+    }
+    VM_CASE(MUL_FLOAT) {
+        double result = plainNumber(sp[-2]) * plainNumber(sp[-1]);
+        sp[-2].type = RuntimeType::FLOAT;
+        sp[-2].floatValue = result;
+        --sp;
+        VM_NEXT();
+    }
+    VM_CASE(ADD_LOCAL_CONST_INT) {
+        const RuntimeValue& constant = program.constants[ip->b];
+        long long result = static_cast<long long>(locals[ip->a].intValue) + constant.intValue;
+        if (fitsInt(result)) {
+            *sp++ = RuntimeValue(static_cast<int>(result));
+            VM_NEXT();
+        }
+        *sp = locals[ip->a];
+        applyArithmetic(BinaryOp::ADD, *sp, constant);
+        ++sp;
+        VM_NEXT();
+    }
+    VM_CASE(EQ_INT_JUMP_IF_FALSE) {
+        sp -= 2;
+        if (!(sp[0].intValue == sp[1].intValue)) VM_JUMP(ip->a);
+        VM_NEXT();
+    }
+    VM_CASE(NE_INT_JUMP_IF_FALSE) {
+        sp -= 2;
+        if (!(sp[0].intValue != sp[1].intValue)) VM_JUMP(ip->a);
+        VM_NEXT();
+    }
+    VM_CASE(LT_INT_JUMP_IF_FALSE) {
+        sp -= 2;
+        if (!(sp[0].intValue < sp[1].intValue)) VM_JUMP(ip->a);
+        VM_NEXT();
+    }
+    VM_CASE(LE_INT_JUMP_IF_FALSE) {
+        sp -= 2;
+        if (!(sp[0].intValue <= sp[1].intValue)) VM_JUMP(ip->a);
+        VM_NEXT();
+    }
+    VM_CASE(GT_INT_JUMP_IF_FALSE) {
+        sp -= 2;
+        if (!(sp[0].intValue > sp[1].intValue)) VM_JUMP(ip->a);
+        VM_NEXT();
+    }
+    VM_CASE(GE_INT_JUMP_IF_FALSE) {
+        sp -= 2;
+        if (!(sp[0].intValue >= sp[1].intValue)) VM_JUMP(ip->a);
+        VM_NEXT();
+    }
+
+#if !VM_THREADED
+    default:
+        break;
+    }
+#endif
+
+    runtimeErrors() << "Error: Invalid bytecode" << std::endl;
+    returned = RuntimeValue();
+
+leaveFrame:
+    {
+        Frame frame = frames.back();
+        frames.pop_back();
+        const CompiledFunction& function = program.functions[frame.function];
+        clearSlots(locals, locals + function.localCount + function.maxStack);
+        if (frame.memoFunction >= 0) {
+            memoTables[frame.memoFunction]->store(memoArgs.data() + frame.memoStart,
+                                                  program.functions[frame.memoFunction].paramCount, returned);
+            memoArgs.resize(frame.memoStart);
+        }
+        if (frames.size() == entryDepth) {
+            return returned;
+        }
+        Frame& caller = frames.back();
+        if (caller.returnOnResume) {
+            // The call was a tail call made with a frame of its own
+            locals = stack.data() + caller.base;
+            goto leaveFrame;
+        }
+        code = caller.code;
+        ip = code + caller.resume;
+        locals = stack.data() + caller.base;
+        sp = stack.data() + caller.top;
+        *sp++ = std::move(returned);
+        VM_DISPATCH();
+    }
+}
+
+#undef VM_CASE
+#undef VM_DISPATCH
+#undef VM_NEXT
+#undef VM_JUMP
+
+void VM::printProfile(size_t limit) const {
+    size_t count = static_cast<size_t>(OpCode::COUNT);
+    std::vector<std::pair<uint64_t, size_t>> pairs;
+    for (size_t i = 0; i < pairCounts.size(); ++i) {
+        if (pairCounts[i] > 0) pairs.push_back({pairCounts[i], i});
+    }
+    std::sort(pairs.rbegin(), pairs.rend());
+    if (pairs.size() > limit) pairs.resize(limit);
+
+    std::cerr << "=== Opcode pair profile ===" << std::endl;
+    for (const auto& pair : pairs) {
+        std::cerr << "  " << opCodeName(static_cast<OpCode>(pair.second / count)) << " -> "
+                  << opCodeName(static_cast<OpCode>(pair.second % count)) << ": " << pair.first << std::endl;
+    }
+}
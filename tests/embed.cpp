@@ -0,0 +1,83 @@
+// Runs one compiled Program from several threads at once and a
+// ProgramContext several times over, through libpc as an embedder would.
+// Built and run by make check.
+#include "../include/program.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+const char* source = R"(
+def total(n) {
+    s = 0;
+    for (i = 0; i < n; i = i + 1) {
+        s = s + i % 7;
+    }
+    return s;
+}
+def main() {
+    input n;
+    output total(n);
+    if (n == 3) {
+        seen = 1;
+    }
+    output seen;
+}
+)";
+
+int failures = 0;
+
+void expect(bool ok, const std::string& what) {
+    if (!ok) {
+        std::cout << "FAILED tests/embed.cpp: " << what << std::endl;
+        failures++;
+    }
+}
+}
+
+int main() {
+    std::ostringstream compileErrors;
+    expect(!Program::compile("def main() { output 1 +; }", compileErrors), "a syntax error compiles");
+    expect(!compileErrors.str().empty(), "a syntax error is not reported");
+
+    auto program = Program::compile(source);
+    expect(program != nullptr, "the program does not compile");
+    if (!program) {
+        return 1;
+    }
+
+    // Each thread runs the loop long enough to move it to the VM, which the
+    // threads then share
+    std::vector<std::string> outputs(4);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < outputs.size(); t++) {
+        threads.emplace_back([&, t] {
+            std::ostringstream out, errors;
+            program->run(std::to_string(5000 + t) + "\n", out, errors);
+            outputs[t] = out.str() + errors.str();
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const char* totals[] = {"14995", "14997", "15000", "15004"};
+    for (size_t t = 0; t < outputs.size(); t++) {
+        expect(outputs[t] == std::string(totals[t]) + "\nundefined\nError: Undefined variable 'seen'\n",
+               "run " + std::to_string(t) + " printed " + outputs[t]);
+    }
+
+    // seen is assigned by the first run only and must not leak into the next
+    ProgramContext context(*program);
+    std::ostringstream first, second, errors;
+    context.run("3\n", first, errors);
+    context.run("4\n", second, errors);
+    expect(first.str() == "3\n1\n", "the first context run printed " + first.str());
+    expect(second.str() == "6\nundefined\n", "the second context run printed " + second.str());
+
+    if (failures == 0) {
+        std::cout << "ok     tests/embed.cpp" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
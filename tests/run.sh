@@ -0,0 +1,55 @@
+#!/bin/sh
+# Runs every tests/*.pc with the flags on its "// flags:" line, if any, and
+# compares what follows "=== Executing Program ===" (all of the output when
+# there is no such line, as with --batch and -jN) with tests/*.expected.
+# Standard input is tests/*.in if there is one. A "// image" line compiles
+# the script to a .pcb with those flags first and runs the .pcb instead,
+# and a "// serve" line starts a server with those flags and runs the
+# script through a.out --client; flags starting with -j go before the
+# script, as the -jN driver needs.
+cd "$(dirname "$0")/.." || exit 1
+failed=0
+for script in tests/*.pc; do
+    expected="${script%.pc}.expected"
+    input="${script%.pc}.in"
+    [ -f "$input" ] || input=/dev/null
+    flags=$(sed -n 's|^// flags: ||p' "$script")
+    if grep -q '^// image$' "$script"; then
+        image="build/$(basename "${script%.pc}").pcb"
+        ./build/a.out "$script" $flags --emit-pcb "$image" > /dev/null 2>&1
+        command="./build/a.out $image"
+    elif grep -q '^// serve$' "$script"; then
+        socket=build/test.sock
+        rm -f "$socket"
+        ./build/a.out --serve "$socket" $flags > /dev/null 2>&1 &
+        server=$!
+        tries=0
+        while [ ! -S "$socket" ] && [ $tries -lt 50 ]; do
+            sleep 0.1
+            tries=$((tries + 1))
+        done
+        command="./build/a.out --client $socket $script"
+    else
+        case "$flags" in
+            -j*) command="./build/a.out $flags $script" ;;
+            *) command="./build/a.out $script $flags" ;;
+        esac
+    fi
+    if $command < "$input" 2>&1 | awk '
+            started { print; next }
+            /=== Executing Program ===/ { started = 1; delete lines; count = 0; next }
+            { lines[++count] = $0 }
+            END { if (!started) for (i = 1; i <= count; i++) print lines[i] }' | cmp -s - "$expected"; then
+        echo "ok     $script"
+    else
+        echo "FAILED $script"
+        failed=1
+    fi
+    if [ -n "$server" ]; then
+        kill "$server"
+        wait "$server" 2> /dev/null
+        rm -f "$socket"
+        server=
+    fi
+done
+exit $failed